@@ -13,9 +13,13 @@ OBJS:=$(patsubst %.cc, $(BUILD)/%.o, $(SRC))
 TEST_SRC:=$(wildcard tests/*.cc)
 TEST_OBJS:=$(patsubst %.cc, $(BUILD)/%.o, $(TEST_SRC))
 TEST_EXE:=$(patsubst %.cc, $(BUILD)/%, $(TEST_SRC))
+BENCH_SRC:=$(wildcard bench/*.cc)
+BENCH_OBJS:=$(patsubst %.cc, $(BUILD)/%.o, $(BENCH_SRC))
+BENCH_EXE:=$(patsubst %.cc, $(BUILD)/%, $(BENCH_SRC))
 
 
 H:=$(wildcard src/*.h)
+TEST_H:=$(wildcard tests/*.h)
 $(info Sources: $(SRC))
 $(info Headers: $(H))
 $(info Objects: $(OBJS))
@@ -25,6 +29,7 @@ $(info Test Sources: $(TEST_SRC))
 $(info Test Objects: $(TEST_OBJS))
 $(info Test Exec: $(TEST_EXE))
 $(info Test Extra: $(TEST_EXTRA))
+$(info Bench Sources: $(BENCH_SRC))
 
 
 CXXFLAGS:=$(OPT) \
@@ -49,6 +54,7 @@ ifeq "$(ARCH)" "armhf"
 else ifeq "$(ARCH)" "x86_64"
 	CXX:=g++
 	LDFLAGS:= -L/usr/lib/x86_64-linux-gnu -ljansson -pthread -lrt
+	ZLIB?=1
 	AR:=ar
 	TESTER:=
 	STRIP:=strip
@@ -56,6 +62,18 @@ else ifeq "$(ARCH)" "x86_64"
 endif
 
 
+# gzip and zlib streams in compress.h need zlib, on by default for x86_64; the armhf
+# sysroot has no zlib, add zlib.h and libz there first: make ZLIB=1
+ifeq "$(ZLIB)" "1"
+	CXXFLAGS:=$(CXXFLAGS) -DCPPUTILS_HAVE_ZLIB
+	LDFLAGS:=$(LDFLAGS) -lz
+endif
+
+# zstd streams in compress.h need libzstd: make ZSTD=1
+ifeq "$(ZSTD)" "1"
+	CXXFLAGS:=$(CXXFLAGS) -DCPPUTILS_HAVE_ZSTD
+	LDFLAGS:=$(LDFLAGS) -lzstd
+endif
 
 $(info CXX $(CXX))
 $(info LDFLAGS $(LDFLAGS))
@@ -78,13 +96,20 @@ $(BUILD)/tests/% : $(BUILD)/tests/%.o
 	@$(TESTER) $@ || { echo Test $@ Failed!!! ; exit 1; }
 
 #mkdir -p $(@D)
-	
+
+$(BUILD)/bench/% : $(BUILD)/bench/%.o
+	echo "Processing " $< " into " $@
+	$(CXX) -fPIC -o $@ $< -L$(BUILD) -Wl,-Bstatic -lcpputils -Wl,-Bdynamic $(LDFLAGS)
+	@echo "Built: " $@
+
 
 $(BUILD)/tests/% : $(OBJ) 
 
 $(OBJS) : $(SRC) $(H) Makefile arch.mk
 
-$(TEST_OBJS) : $(TEST_SRC) $(SRC) $(H) Makefile arch.mk
+$(TEST_OBJS) : $(TEST_SRC) $(TEST_H) $(SRC) $(H) Makefile arch.mk
+
+$(BENCH_OBJS) : $(BENCH_SRC) $(SRC) $(H) Makefile arch.mk
 
 $(LIB_DYNAMIC): $(OBJS)
 	$(CXX) -shared -fPIC -o $@ -Wl,-soname,$(SONAME) $(OBJS) $(LDFLAGS)
@@ -101,7 +126,9 @@ endif
 
 $(TEST_EXE) : $(LIB_STATIC) $(LIB_DYNAMIC)
 
-all: $(LIB_STATIC) $(LIB_DYNAMIC) $(TEST_EXE) 
+$(BENCH_EXE) : $(LIB_STATIC) $(LIB_DYNAMIC)
+
+all: $(LIB_STATIC) $(LIB_DYNAMIC) $(TEST_EXE) $(BENCH_EXE)
 
 clean:
 	rm -rf $(BUILD)/*
@@ -0,0 +1,66 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <appendlog.h>
+#include <utils.h>
+
+// appends records from several threads with one fdatasync per record (the hand-rolled
+// way) and through AppendLog's group commits, then times reopening the log
+int main(int argc, char** argv) {
+	std::string dir=argc>1 ? argv[1] : "/tmp";
+	int threads=argc>2 ? atoi(argv[2]) : 8;
+	size_t recordBytes=argc>3 ? atoi(argv[3]) : 4096;
+	size_t total=argc>4 ? atoll(argv[4]) : 256<<20;
+	size_t perThread=total/recordBytes/threads;
+	std::string root=dir+"/cpputils_bench_appendlog_"+std::to_string(getpid());
+	std::string record(recordBytes, 'x');
+	std::cout<<"Threads: "<<threads<<", record: "<<recordBytes<<" bytes, total: "<<(perThread*threads*recordBytes>>20)<<" MB in "<<root<<std::endl;
+	utils::mkdir_p(root);
+
+	{
+		utils::FD fd(::open((root+"/plain.log").c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644));
+		std::mutex lock;
+		size_t n=std::max<size_t>(1, perThread/16);
+		auto start=utils::clock();
+		std::vector<std::thread> pool;
+		for (int t=0;t<threads;++t) pool.emplace_back([&]() {
+			for (size_t i=0;i<n;++i) {
+				std::lock_guard<std::mutex> g(lock);
+				if (::write(fd, record.data(), record.size())<0 || fdatasync(fd)) utils::errno_exception("write");
+			}
+		});
+		for (auto& t : pool) t.join();
+		double us=utils::microseconds(start);
+		std::cout<<"write+fdatasync per record: "<<n*threads*recordBytes/us<<" MB/s, "<<us/(n*threads)<<" us/record"<<std::endl;
+	}
+
+	utils::AppendLog::Options o;
+	o.directory=root+"/log";
+	{
+		utils::AppendLog log(o);
+		auto start=utils::clock();
+		std::vector<std::thread> pool;
+		for (int t=0;t<threads;++t) pool.emplace_back([&]() {
+			for (size_t i=0;i<perThread;++i) log.append(record);
+		});
+		for (auto& t : pool) t.join();
+		double us=utils::microseconds(start);
+		auto st=log.stats();
+		std::cout<<"AppendLog group commit: "<<st.bytes/us<<" MB/s, "<<us/st.records<<" us/record, "
+				<<st.records*1.0/st.syncs<<" records per fdatasync, "<<st.segments<<" segments"<<std::endl;
+	}
+	{
+		auto start=utils::clock();
+		utils::AppendLog log(o);
+		std::cout<<"reopen: "<<utils::microseconds(start)/1000.0<<" ms for "<<log.end()<<" records"<<std::endl;
+		start=utils::clock();
+		size_t bytes=0;
+		log.read(0, [&](const utils::AppendLog::Record& r) {bytes+=r.data.size();return true;});
+		std::cout<<"read back: "<<bytes/(double)utils::microseconds(start)<<" MB/s"<<std::endl;
+	}
+	std::string out, err;
+	utils::sh(("rm -rf "+root).c_str(), &out, &err);
+	return 0;
+}
@@ -0,0 +1,67 @@
+#include <iostream>
+#include <functional>
+#include <stdlib.h>
+#include <compress.h>
+#include <filecopy.h>
+#include <utils.h>
+
+// writes a gzip compressed NDJSON file, then reads it back the old way and streaming
+int main(int argc, char** argv) {
+	std::string dir=argc>1 ? argv[1] : "/tmp";
+	int records=argc>2 ? atoi(argv[2]) : 1000000;
+	std::string root=dir+"/cpputils_bench_compress_"+std::to_string(getpid());
+	utils::mkdir_p(root);
+	std::string text;
+	for (int i=0;i<records;++i) {
+		text+="{\"id\":"+std::to_string(i)+",\"user\":\"user"+std::to_string(i*7919ULL%100003)+"\",\"amount\":"+std::to_string(i%1000)+".25,\"tags\":[\"x\",\"y\"]}\n";
+	}
+	std::cout<<"Records: "<<records<<", "<<(text.size()>>20)<<" MB"<<std::endl;
+
+	auto report=[&](const std::string& name, const std::function<void()>& f) {
+		auto start=utils::clock();
+		try {
+			f();
+		} catch (const std::exception& e) {
+			std::cout<<name<<": "<<e.what()<<std::endl;
+			return;
+		}
+		auto us=std::max<uint64_t>(1, utils::microseconds(start));
+		std::cout<<name<<": "<<us/1000<<" ms, "<<text.size()/(double)us<<" MB/s"<<std::endl;
+	};
+	std::string file=root+"/data.ndjson.gz";
+	for (int level : {1, 6}) {
+		utils::CompressWriter::Options o;
+		o.level=level;
+		report("gzip write level "+std::to_string(level), [&]() {utils::dumpToCompressedFile(file, text, o);});
+	}
+	{
+		utils::CompressWriter::Options o;
+		o.compression=utils::Compression::ZSTD;
+		o.threads=2;
+		report("zstd write, 2 threads", [&]() {utils::dumpToCompressedFile(root+"/data.ndjson.zst", text, o);});
+	}
+
+	report("sh(zcat)+parse", [&]() {
+		std::string out, err;
+		utils::sh(("zcat "+file).c_str(), &out, &err);
+		size_t n=0;
+		for (size_t p=0;p<out.size();) {
+			size_t e=out.find('\n', p);
+			if (e==std::string::npos) e=out.size();
+			if (e>p) n+=json::parse(out.data()+p, e-p) ? 1 : 0;
+			p=e+1;
+		}
+		if (n!=(size_t)records) throw std::runtime_error("wrong count");
+	});
+	for (bool readAhead : {false, true}) {
+		report(readAhead ? "forEachLine, read ahead" : "forEachLine", [&]() {
+			utils::DecompressReader::Options o;
+			o.readAhead=readAhead;
+			utils::DecompressReader in(file, o);
+			if (json::forEachLine(in, [](const json::jsonptr&) {})!=(size_t)records) throw std::runtime_error("wrong count");
+		});
+	}
+	report("slurpCompressedFile", [&]() {utils::slurpCompressedFile(file);});
+	utils::removeTree(root);
+	return 0;
+}
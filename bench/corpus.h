@@ -0,0 +1,27 @@
+#ifndef BENCH_CORPUS_H_
+#define BENCH_CORPUS_H_
+
+#include <string>
+#include <jsonutils.h>
+
+// A synthetic document in the shape of our service payloads: an array of records mixing
+// short strings, integers, reals, booleans, nested objects and small arrays.
+inline json::jsonptr benchCorpus(size_t records) {
+	json_t* a=json_array();
+	for (size_t i=0;i<records;++i) {
+		std::string n=std::to_string(i);
+		json_array_append_new(a, json_pack("{s:I, s:s, s:s, s:f, s:b, s:{s:s, s:s, s:i}, s:[s,s,s], s:[f,f,f,f], s:n}",
+				"id", (json_int_t)(1000000+i*7),
+				"name", ("record number "+n).c_str(),
+				"email", ("user"+n+"@example.com").c_str(),
+				"score", i*0.37,
+				"active", (int)(i%3!=0),
+				"address", "city", "Springfield", "street", ("Main st. "+n).c_str(), "zip", (int)(10000+i%90000),
+				"tags", "alpha", "beta", i%2 ? "gamma" : "delta \"quoted\"",
+				"position", i*0.5, i*1.25, -0.001*i, 1e6+i,
+				"note"));
+	}
+	return json::own(a);
+}
+
+#endif /* BENCH_CORPUS_H_ */
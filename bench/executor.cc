@@ -0,0 +1,51 @@
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <executor.h>
+#include <utils.h>
+
+int main(int argc, char** argv) {
+	int rounds=argc>1 ? atoi(argv[1]) : 2000;
+	auto& ex=utils::Executor::shared();
+	unsigned threads=ex.size()+1;
+	std::vector<double> data(1<<16, 1.0);
+	std::cout<<"Workers: "<<ex.size()<<", rounds: "<<rounds<<", elements per round: "<<data.size()<<std::endl;
+
+	double sink=0;
+	auto start=utils::clock();
+	for (int r=0;r<rounds;++r) {
+		std::vector<double> partial(threads);
+		std::vector<std::thread> pool;
+		size_t chunk=data.size()/threads;
+		for (unsigned t=0;t<threads;++t) pool.emplace_back([&, t]() {
+			for (size_t i=t*chunk;i<(t+1==threads ? data.size() : (t+1)*chunk);++i) partial[t]+=data[i];
+		});
+		for (auto& t : pool) t.join();
+		for (auto p : partial) sink+=p;
+	}
+	auto spawnUs=utils::microseconds(start);
+	std::cout<<"std::thread per loop: "<<spawnUs*1.0/rounds<<" us/loop"<<std::endl;
+
+	start=utils::clock();
+	for (int r=0;r<rounds;++r) {
+		std::atomic<uint64_t> sum(0);
+		ex.parallel_for(0, data.size(), [&](size_t b, size_t e) {
+			double s=0;
+			for (size_t i=b;i<e;++i) s+=data[i];
+			sum+=(uint64_t)s;
+		});
+		sink+=sum;
+	}
+	auto poolUs=utils::microseconds(start);
+	std::cout<<"Executor::parallel_for: "<<poolUs*1.0/rounds<<" us/loop"<<std::endl;
+
+	start=utils::clock();
+	for (int r=0;r<rounds*10;++r) sink+=ex.submit([r]() {return r;}).get();
+	std::cout<<"submit+get round trip: "<<utils::microseconds(start)*1.0/(rounds*10)<<" us"<<std::endl;
+
+	auto st=ex.stats();
+	std::cout<<"submitted "<<st.submitted<<", executed "<<st.executed<<", stolen "<<st.stolen<<", parked "<<st.parked
+			<<" (checksum "<<sink<<")"<<std::endl;
+	return 0;
+}
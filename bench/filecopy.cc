@@ -0,0 +1,57 @@
+#include <iostream>
+#include <functional>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <filecopy.h>
+#include <utils.h>
+
+// copies one large file with every strategy, plus the two ways it was done before
+int main(int argc, char** argv) {
+	std::string dir=argc>1 ? argv[1] : "/tmp";
+	size_t size=argc>2 ? atoll(argv[2]) : 256<<20;
+	int rounds=argc>3 ? atoi(argv[3]) : 3;
+	std::string root=dir+"/cpputils_bench_filecopy_"+std::to_string(getpid());
+	utils::mkdir_p(root);
+	std::string src=root+"/src.bin", dst=root+"/dst.bin";
+	{
+		std::string block(1<<20, 0);
+		for (size_t i=0;i<block.size();++i) block[i]=(char)(i*2654435761u>>13);
+		utils::FD fd(::open(src.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+		for (size_t done=0;done<size;done+=block.size()) {
+			if (::write(fd, block.data(), std::min(block.size(), size-done))<0) utils::errno_exception("write");
+		}
+		fsync(fd);
+	}
+	std::cout<<"File: "<<(size>>20)<<" MB in "<<root<<", best of "<<rounds<<std::endl;
+
+	auto report=[&](const char* name, const std::function<void()>& f) {
+		double best=0;
+		for (int r=0;r<rounds;++r) {
+			unlink(dst.c_str());
+			auto start=utils::clock();
+			try {
+				f();
+			} catch (const std::exception& e) {
+				std::cout<<name<<": "<<e.what()<<std::endl;
+				return;
+			}
+			best=std::max(best, size/(double)std::max<uint64_t>(1, utils::microseconds(start)));
+		}
+		std::cout<<name<<": "<<best<<" MB/s"<<std::endl;
+	};
+	for (auto m : {utils::CopyMethod::AUTO, utils::CopyMethod::CLONE, utils::CopyMethod::COPY_FILE_RANGE, utils::CopyMethod::SENDFILE, utils::CopyMethod::READ_WRITE}) {
+		utils::CopyOptions o;
+		o.method=m;
+		report(utils::copyMethodName(m), [&]() {utils::copyFile(src, dst, o);});
+	}
+	report("slurpBinFile+dumpToFile", [&]() {
+		auto v=utils::slurpBinFile(src);
+		utils::dumpToFile(dst, v.data(), v.size());
+	});
+	report("sh(cp)", [&]() {
+		std::string out, err;
+		utils::sh(("cp "+src+" "+dst).c_str(), &out, &err);
+	});
+	utils::removeTree(root);
+	return 0;
+}
@@ -0,0 +1,75 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <filecopy.h>
+#include <hash.h>
+#include <utils.h>
+
+static volatile uint64_t sink;
+
+// the byte-at-a-time table CRC that hardware and slicing-by-8 replace
+static uint32_t crcBytewise(const uint8_t* p, size_t len) {
+	static uint32_t t[256];
+	if (!t[1]) {
+		for (uint32_t i=0;i<256;++i) {
+			uint32_t c=i;
+			for (int k=0;k<8;++k) c=(c>>1)^(0x82f63b78 & (0-(c & 1)));
+			t[i]=c;
+		}
+	}
+	uint32_t crc=~0u;
+	while (len--) crc=(crc>>8)^t[(crc^*p++) & 0xff];
+	return ~crc;
+}
+
+template<typename F> static void rate(const char* name, size_t bytes, int rounds, F f) {
+	auto start=utils::clock();
+	for (int i=0;i<rounds;++i) f();
+	std::cout<<name<<": "<<bytes*(double)rounds/utils::microseconds(start)<<" MB/s"<<std::endl;
+}
+
+int main() {
+	std::string data(64<<20, 0);
+	for (size_t i=0;i<data.size();++i) data[i]=(char)(i*2654435761ULL>>13);
+	const uint8_t* p=(const uint8_t*)data.data();
+	std::cout<<"crc32c in hardware: "<<utils::crc32cHardware()<<std::endl;
+	rate("crc32c bytewise", data.size(), 2, [&]() {sink=crcBytewise(p, data.size());});
+	rate("crc32c", data.size(), 10, [&]() {sink=utils::crc32c(data);});
+	rate("crc32c 4 KB pieces", data.size(), 10, [&]() {
+		for (size_t i=0;i<data.size();i+=4096) sink=utils::crc32c(p+i, 4096);
+	});
+	rate("hash64", data.size(), 10, [&]() {sink=utils::hash64(data);});
+	// in cache, where memory bandwidth does not hide the difference
+	rate("crc32c 256 KB in cache", 256<<10, 2000, [&]() {sink=utils::crc32c(p, 256<<10);});
+	rate("hash64 256 KB in cache", 256<<10, 2000, [&]() {sink=utils::hash64(p, 256<<10);});
+
+	char dir[]="/tmp/cpputils_bench_hash_XXXXXX";
+	if (!mkdtemp(dir)) return 1;
+	std::string d=dir;
+	utils::dumpToFile(d+"/big", data);
+	rate("hashFile", data.size(), 10, [&]() {sink=utils::hashFile(d+"/big");});
+	rate("crc32cFile", data.size(), 10, [&]() {sink=utils::crc32cFile(d+"/big");});
+
+	// a generator rewriting 500 files of 64 KB, none of them changed
+	const int FILES=500;
+	const size_t SIZE=64<<10;
+	std::vector<std::string> names;
+	for (int i=0;i<FILES;++i) names.push_back(d+"/gen"+std::to_string(i));
+	for (int i=0;i<FILES;++i) utils::dumpToFile(names[i], data.data()+i*SIZE, SIZE);
+	for (int round=0;round<2;++round) {
+		auto start=utils::clock();
+		for (int i=0;i<FILES;++i) utils::dumpToFile(names[i], data.data()+i*SIZE, SIZE);
+		uint64_t plain=utils::microseconds(start);
+		start=utils::clock();
+		size_t written=0;
+		for (int i=0;i<FILES;++i) written+=utils::dumpToFileIfChanged(names[i], data.data()+i*SIZE, SIZE);
+		uint64_t ifChanged=utils::microseconds(start);
+		start=utils::clock();
+		for (int i=0;i<FILES;++i) utils::dumpToFileAtomic(names[i], data.data()+i*SIZE, SIZE);
+		uint64_t atomic=utils::microseconds(start);
+		std::cout<<FILES<<" unchanged files: dumpToFile "<<plain<<" us, dumpToFileAtomic "<<atomic<<" us, dumpToFileIfChanged "<<ifChanged
+				<<" us, "<<written<<" written"<<std::endl;
+	}
+	utils::removeTree(d);
+	return 0;
+}
@@ -0,0 +1,34 @@
+#include <iostream>
+#include <jsonbinary.h>
+#include <utils.h>
+#include "corpus.h"
+
+template<typename E, typename D> static void run(const char* name, int iterations, const json::jsonptr& corpus, E encode, D decode) {
+	std::string buf;
+	size_t total=0;
+	auto start=utils::clock();
+	for (int i=0;i<iterations;++i) {
+		buf.clear();
+		encode(corpus, buf);
+	}
+	auto encUs=utils::microseconds(start);
+	start=utils::clock();
+	for (int i=0;i<iterations;++i) total+=json_array_size(decode(buf).get());
+	auto decUs=utils::microseconds(start);
+	double mb=buf.size()*(double)iterations;
+	std::cout<<name<<": "<<buf.size()<<" bytes, encode "<<mb/encUs<<" MB/s ("<<encUs/(double)iterations<<" us), decode "
+			<<mb/decUs<<" MB/s ("<<decUs/(double)iterations<<" us)"<<(total ? "" : " !")<<std::endl;
+}
+
+int main(int argc, char** argv) {
+	int iterations=argc>1 ? atoi(argv[1]) : 20;
+	auto corpus=benchCorpus(5000);
+	std::cout<<"Records: "<<json_array_size(corpus.get())<<", iterations: "<<iterations<<std::endl;
+	run("text   ", iterations, corpus, [](const json::jsonptr& j, std::string& out) {out=json::to_string(j);},
+			[](const std::string& s) {return json::parse(s);});
+	run("cbor   ", iterations, corpus, [](const json::jsonptr& j, std::string& out) {json::toCbor(j, out);},
+			[](const std::string& s) {return json::fromCbor(s);});
+	run("msgpack", iterations, corpus, [](const json::jsonptr& j, std::string& out) {json::toMsgPack(j, out);},
+			[](const std::string& s) {return json::fromMsgPack(s);});
+	return 0;
+}
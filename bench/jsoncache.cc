@@ -0,0 +1,38 @@
+#include <iostream>
+#include <hash.h>
+#include <jsoncache.h>
+#include <utils.h>
+#include "corpus.h"
+
+int main(int argc, char** argv) {
+	size_t distinct=argc>1 ? atoi(argv[1]) : 64;
+	size_t requests=20000;
+	std::vector<std::string> payloads;
+	for (size_t i=0;i<distinct;++i) {
+		auto records=benchCorpus(4);
+		json_object_set_new(json_array_get(records.get(), 0), "request", json_integer(i));
+		payloads.push_back(json::to_string(records));
+	}
+	std::string big=json::to_string(benchCorpus(20000));
+	auto start=utils::clock();
+	uint64_t h=0;
+	for (int i=0;i<20;++i) h^=utils::hash64(big, i);
+	std::cout<<"hash64: "<<big.size()*20/(double)utils::microseconds(start)<<" MB/s"<<std::endl;
+
+	long long total=0;
+	start=utils::clock();
+	for (size_t i=0;i<requests;++i) total+=json_array_size(json::parse(payloads[i%distinct]).get());
+	auto parseUs=utils::microseconds(start);
+
+	json::ParseCache cache(64<<20);
+	start=utils::clock();
+	for (size_t i=0;i<requests;++i) total+=json_array_size(cache.parse(payloads[i%distinct]).get());
+	auto cacheUs=utils::microseconds(start);
+
+	auto st=cache.stats();
+	std::cout<<"json::parse per request:      "<<parseUs/(double)requests<<" us"<<std::endl;
+	std::cout<<"ParseCache::parse per request: "<<cacheUs/(double)requests<<" us, hit rate "<<st.hitRate()
+			<<", "<<st.entries<<" entries, "<<st.bytes<<" bytes"<<std::endl;
+	std::cout<<"(checksum "<<total<<" "<<h<<")"<<std::endl;
+	return 0;
+}
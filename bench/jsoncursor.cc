@@ -0,0 +1,41 @@
+#include <iostream>
+#include <jsoncursor.h>
+#include <utils.h>
+
+int main(int argc, char** argv) {
+	int iterations=argc>1 ? atoi(argv[1]) : 200;
+	std::string text="{\"meta\" : {\"version\" : 3, \"owner\" : \"ops\"}, \"records\" : [";
+	for (int i=0;i<1000;++i) {
+		if (i) text+=",";
+		text+="{\"id\" : "+std::to_string(i)+", \"name\" : \"record number "+std::to_string(i)+"\", \"weight\" : "+std::to_string(i*0.25)+
+				", \"tags\" : [\"alpha\", \"beta\", \"gamma\"], \"enabled\" : true}";
+	}
+	text+="], \"footer\" : {\"count\" : 1000, \"checksum\" : \"abcdef\"}}";
+	std::cout<<"Document size: "<<text.size()<<" bytes, iterations: "<<iterations<<std::endl;
+
+	long long total=0;
+	auto start=utils::clock();
+	for (int i=0;i<iterations;++i) {
+		auto j=json::parse(text);
+		total+=json::getLong(j, "meta", "version")+json::getLong(j, "footer", "count")+strlen(json::getString(j, "footer", "checksum"));
+	}
+	auto parseUs=utils::microseconds(start);
+
+	start=utils::clock();
+	for (int i=0;i<iterations;++i) {
+		json::Document doc(text);
+		auto r=doc.root();
+		total+=json::getLong(r, "meta", "version")+json::getLong(r, "footer", "count")+json::getString(r, "footer", "checksum").size();
+	}
+	auto cursorUs=utils::microseconds(start);
+
+	start=utils::clock();
+	for (int i=0;i<iterations;++i) total+=json::structuralIndex(text.data(), text.size()).size();
+	auto indexUs=utils::microseconds(start);
+
+	std::cout<<"json::parse + 3 fields:    "<<parseUs/(double)iterations<<" us/op"<<std::endl;
+	std::cout<<"json::Document + 3 fields: "<<cursorUs/(double)iterations<<" us/op ("<<(double)parseUs/cursorUs<<"x)"<<std::endl;
+	std::cout<<"structural index only:     "<<text.size()*(double)iterations/indexUs<<" MB/s"<<std::endl;
+	std::cout<<"(checksum "<<total<<")"<<std::endl;
+	return 0;
+}
@@ -0,0 +1,41 @@
+#include <iostream>
+#include <cstring>
+#include <jsonindex.h>
+#include <utils.h>
+#include "corpus.h"
+
+int main(int argc, char** argv) {
+	size_t records=argc>1 ? atoi(argv[1]) : 200000;
+	size_t lookups=10000;
+	auto corpus=benchCorpus(records);
+	std::vector<std::string> emails;
+	for (size_t i=0;i<lookups;++i) emails.push_back("user"+std::to_string((i*7919)%records)+"@example.com");
+
+	size_t found=0;
+	auto start=utils::clock();
+	for (size_t i=0;i<lookups/100;++i) {
+		for (auto e : json::getJsonArrayElements(corpus)) {
+			const char* s=json::getString(e, "email");
+			if (s && emails[i]==s) {
+				++found;
+				break;
+			}
+		}
+	}
+	double scanUs=utils::microseconds(start)/(double)(lookups/100);
+
+	for (unsigned threads : {1u, 0u}) {
+		start=utils::clock();
+		json::ArrayIndex idx(corpus, {{"email"}, {"address", "zip"}}, true, threads);
+		auto buildUs=utils::microseconds(start);
+		std::cout<<"Build with "<<(threads ? "1 thread" : "all threads")<<": "<<buildUs/1000.0<<" ms"<<std::endl;
+		if (threads) continue;
+		start=utils::clock();
+		for (auto& e : emails) if (idx.find(0, e)) ++found;
+		double findUs=utils::microseconds(start)/(double)lookups;
+		std::cout<<"Linear scan per lookup: "<<scanUs<<" us"<<std::endl;
+		std::cout<<"ArrayIndex per lookup:  "<<findUs<<" us"<<std::endl;
+	}
+	std::cout<<"(found "<<found<<")"<<std::endl;
+	return 0;
+}
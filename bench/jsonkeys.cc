@@ -0,0 +1,70 @@
+#include <iostream>
+#include <malloc.h>
+#include <vector>
+#include <jsonkeys.h>
+#include <utils.h>
+
+namespace {
+
+size_t heapBytes=0;
+void* countingMalloc(size_t n) {
+	void* p=malloc(n);
+	heapBytes+=malloc_usable_size(p);
+	return p;
+}
+void countingFree(void* p) {
+	if (p) heapBytes-=malloc_usable_size(p);
+	free(p);
+}
+
+// parses n small event objects shaped by the given key names, returns the jansson heap they take
+size_t parseEvents(size_t n, const char* const keys[5], std::vector<json::jsonptr>& out) {
+	size_t start=heapBytes;
+	out.reserve(n);
+	for (size_t i=0;i<n;++i) {
+		std::string text=std::string("{\"")+keys[0]+"\" : "+std::to_string(1700000000000+i)+", \""+keys[1]+"\" : "+std::to_string(i%5000)+
+				", \""+keys[2]+"\" : \"ok\", \""+keys[3]+"\" : "+std::to_string(i%250)+", \""+keys[4]+"\" : true}";
+		out.push_back(json::parse(text));
+	}
+	return heapBytes-start;
+}
+
+}
+
+int main(int argc, char** argv) {
+	json_set_alloc_funcs(countingMalloc, countingFree);
+	size_t n=argc>1 ? atoll(argv[1]) : 1000000;
+	const char* const names[5]={"timestamp", "user_id", "status", "latency_ms", "cache_hit"};
+	const char* const tiny[5]={"a", "b", "c", "d", "e"};
+	const char* const verbose[5]={"event_timestamp_millis", "authenticated_user_id", "response_status_text", "upstream_latency_millis", "served_from_cache_flag"};
+
+	std::vector<json::jsonptr> events, other;
+	size_t tinyKeys=parseEvents(n, tiny, other);
+	other.clear();
+	size_t verboseKeys=parseEvents(n, verbose, other);
+	other.clear();
+	size_t realKeys=parseEvents(n, names, events);
+	std::cout<<"Objects: "<<n<<", 5 keys each; jansson heap per object:"<<std::endl;
+	std::cout<<"  one letter keys: "<<tinyKeys/n<<" bytes"<<std::endl;
+	std::cout<<"  6-10 letter keys: "<<realKeys/n<<" bytes, keys cost "<<(realKeys-tinyKeys)*100.0/realKeys<<"%"<<std::endl;
+	std::cout<<"  20-23 letter keys: "<<verboseKeys/n<<" bytes, keys cost "<<(verboseKeys-tinyKeys)*100.0/verboseKeys<<"%"<<std::endl;
+	std::cout<<"(the difference to one letter keys bounds what shared key storage could save)"<<std::endl;
+
+	json::Key latency=json::intern("latency_ms");
+	long long sum=0;
+	auto start=utils::clock();
+	for (auto& e : events) sum+=json::getLong(e, std::string("latency_ms").c_str());
+	auto stringUs=utils::microseconds(start);
+	start=utils::clock();
+	for (auto& e : events) sum+=json::getLong(e, "latency_ms");
+	auto literalUs=utils::microseconds(start);
+	start=utils::clock();
+	for (auto& e : events) sum+=json::getLong(e, latency);
+	auto keyUs=utils::microseconds(start);
+	start=utils::clock();
+	for (size_t i=0;i<n;++i) json::intern("latency_ms");
+	auto internUs=utils::microseconds(start);
+	std::cout<<"getLong by std::string: "<<stringUs<<" us, by literal: "<<literalUs<<" us, by Key: "<<keyUs<<" us (checksum "<<sum<<")"<<std::endl;
+	std::cout<<"intern of a known name: "<<internUs*1000.0/n<<" ns"<<std::endl;
+	return 0;
+}
@@ -0,0 +1,46 @@
+#include <iostream>
+#include <jsonmerge.h>
+#include <utils.h>
+#include "corpus.h"
+
+// the old way: deep copy the base, then overlay each layer recursively
+static void overlay(json_t* target, const json_t* layer) {
+	for (auto kv : json::JsonKeyValuePairs(layer)) {
+		json_t* t=json_object_get(target, kv.first);
+		if (json_is_null(kv.second)) json_object_del(target, kv.first);
+		else if (json_is_object(t) && json_is_object(kv.second)) overlay(t, kv.second);
+		else json_object_set_new(target, kv.first, json_deep_copy(kv.second));
+	}
+}
+
+int main(int argc, char** argv) {
+	size_t records=argc>1 ? atoi(argv[1]) : 50000;
+	auto corpus=benchCorpus(records);
+	auto base=json::own(json_object());
+	for (size_t i=0;i<records;++i) json_object_set(base.get(), ("service"+std::to_string(i)).c_str(), json_array_get(corpus.get(), i));
+	auto env=json::parse("{\"service7\" : {\"address\" : {\"city\" : \"Shelbyville\"}}, \"service9\" : null}");
+	auto host=json::parse("{\"service7\" : {\"active\" : false}, \"host\" : {\"name\" : \"h1\"}}");
+	int rounds=20;
+
+	auto start=utils::clock();
+	for (int i=0;i<rounds;++i) {
+		auto r=json::own(json_deep_copy(base.get()));
+		overlay(r.get(), env.get());
+		overlay(r.get(), host.get());
+	}
+	auto copyUs=utils::microseconds(start)/rounds;
+
+	start=utils::clock();
+	for (int i=0;i<rounds;++i) json::merge(base, env, host);
+	auto mergeUs=utils::microseconds(start)/rounds;
+
+	json::LayeredConfig cfg({base, env, host});
+	start=utils::clock();
+	for (int i=0;i<rounds*100;++i) cfg.setLayer(2, host);
+	auto layerUs=utils::microseconds(start)/(rounds*100.0);
+
+	std::cout<<"Deep copy + overlay:       "<<copyUs<<" us"<<std::endl;
+	std::cout<<"json::merge:               "<<mergeUs<<" us"<<std::endl;
+	std::cout<<"LayeredConfig::setLayer(2): "<<layerUs<<" us"<<std::endl;
+	return 0;
+}
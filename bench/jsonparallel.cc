@@ -0,0 +1,26 @@
+#include <iostream>
+#include <jsonparallel.h>
+#include <utils.h>
+
+int main(int argc, char** argv) {
+	size_t n=argc>1 ? atoll(argv[1]) : 2000000;
+	json_t* a=json_array();
+	for (size_t i=0;i<n;++i) json_array_append_new(a, i%16 ? json_integer(i) : json_real(i*0.5));
+	auto array=json::own(a);
+	auto number=[](json_t* e) {return json_is_integer(e) ? (double)json_integer_value(e) : json_real_value(e);};
+
+	auto start=utils::clock();
+	double serial=0;
+	for (auto e : json::getJsonArrayElements(array)) serial+=number(e);
+	auto serialUs=utils::microseconds(start);
+	std::cout<<"Range for, 1 thread: "<<serialUs<<" us"<<std::endl;
+
+	unsigned all=json::parallel::defaultThreads();
+	for (unsigned threads=1;threads<=all;threads*=2) {
+		start=utils::clock();
+		double sum=json::transform_reduce(json::getJsonArrayElements(array), 0.0, std::plus<double>(), number, threads);
+		auto us=utils::microseconds(start);
+		std::cout<<"transform_reduce, "<<threads<<" threads: "<<us<<" us, "<<(serialUs*1.0/us)<<"x"<<(sum==serial ? "" : " (sum differs by rounding)")<<std::endl;
+	}
+	return 0;
+}
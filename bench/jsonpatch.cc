@@ -0,0 +1,38 @@
+#include <iostream>
+#include <jsonpatch.h>
+#include <utils.h>
+#include "corpus.h"
+
+int main(int argc, char** argv) {
+	size_t records=argc>1 ? atoi(argv[1]) : 100000;
+	auto v1=benchCorpus(records);
+	// the next version shares every record but ten with the previous one
+	auto v2=json::own(json_copy(v1.get()));
+	for (size_t i=0;i<10;++i) {
+		size_t at=(i*records)/10;
+		json_t* e=json_deep_copy(json_array_get(v2.get(), at));
+		json_object_set_new(json_object_get(e, "address"), "zip", json_integer(-1));
+		json_array_set_new(v2.get(), at, e);
+	}
+	json_array_insert_new(v2.get(), records/2, json_pack("{s:i}", "id", -1));
+
+	auto start=utils::clock();
+	auto full=json::to_string(v2);
+	auto fullUs=utils::microseconds(start);
+
+	start=utils::clock();
+	auto patch=json::diff(v1, v2);
+	auto diffUs=utils::microseconds(start);
+	auto delta=json::to_string(patch);
+
+	auto replica=json::own(json_deep_copy(v1.get()));
+	start=utils::clock();
+	json::applyPatch(replica, patch);
+	auto applyUs=utils::microseconds(start);
+
+	std::cout<<"Full document: "<<full.size()<<" bytes, serialized in "<<fullUs<<" us"<<std::endl;
+	std::cout<<"Patch: "<<json_array_size(patch.get())<<" ops, "<<delta.size()<<" bytes, diff in "<<diffUs
+			<<" us, applied in "<<applyUs<<" us"<<std::endl;
+	std::cout<<"Replica matches: "<<json_equal(replica.get(), v2.get())<<std::endl;
+	return 0;
+}
@@ -0,0 +1,82 @@
+#include <iostream>
+#include <cstring>
+#include <jsonschema.h>
+#include <utils.h>
+#include "corpus.h"
+
+static const char* SCHEMA="{\"type\" : \"array\", \"items\" : {\"type\" : \"object\","
+		" \"required\" : [\"id\", \"name\", \"email\", \"score\", \"active\", \"address\", \"tags\", \"position\"],"
+		" \"properties\" : {"
+		"  \"id\" : {\"type\" : \"integer\", \"minimum\" : 0},"
+		"  \"name\" : {\"type\" : \"string\", \"minLength\" : 1, \"maxLength\" : 200},"
+		"  \"email\" : {\"type\" : \"string\", \"maxLength\" : 320},"
+		"  \"score\" : {\"type\" : \"number\", \"minimum\" : 0},"
+		"  \"active\" : {\"type\" : \"boolean\"},"
+		"  \"address\" : {\"type\" : \"object\", \"required\" : [\"city\", \"zip\"], \"properties\" : {"
+		"   \"city\" : {\"type\" : \"string\"}, \"street\" : {\"type\" : \"string\"},"
+		"   \"zip\" : {\"type\" : \"integer\", \"minimum\" : 10000, \"maximum\" : 99999}}},"
+		"  \"tags\" : {\"type\" : \"array\", \"maxItems\" : 8, \"items\" : {\"type\" : \"string\"}},"
+		"  \"position\" : {\"type\" : \"array\", \"minItems\" : 4, \"maxItems\" : 4, \"items\" : {\"type\" : \"number\"}},"
+		"  \"note\" : {\"type\" : \"null\"}}}}";
+
+// the hand-rolled equivalent of the schema above, as found around the code base
+static bool byHand(const json_t* corpus) {
+	try {
+		for (auto r : json::getJsonArrayElements(corpus)) {
+			if (json::getLongOrThrow("record", r, "id")<0) return false;
+			auto name=json::getStringOrThrow("record", r, "name");
+			if (!*name || strlen(name)>200) return false;
+			if (strlen(json::getStringOrThrow("record", r, "email"))>320) return false;
+			if (json::getNumberOrThrow("record", r, "score")<0) return false;
+			if (!json::hasBool(r, "active")) return false;
+			json::getStringOrThrow("record", r, "address", "city");
+			auto zip=json::getLongOrThrow("record", r, "address", "zip");
+			if (zip<10000 || zip>99999) return false;
+			auto tags=json::getChildOrThrow("record", r, "tags");
+			if (!json_is_array(tags) || json_array_size(tags)>8) return false;
+			for (auto t : json::getJsonArrayElements(tags)) if (!json_is_string(t)) return false;
+			auto pos=json::getChildOrThrow("record", r, "position");
+			if (!json_is_array(pos) || json_array_size(pos)!=4) return false;
+			for (auto p : json::getJsonArrayElements(pos)) if (!json_is_number(p)) return false;
+		}
+	} catch (const std::exception&) {
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv) {
+	size_t records=argc>1 ? atoi(argv[1]) : 100000;
+	auto corpus=benchCorpus(records);
+	json::Schema schema{std::string(SCHEMA)};
+	std::cout<<"Schema compiled to "<<schema.programSize()<<" instructions"<<std::endl;
+
+	bool handOk=true, schemaOk=true;
+	uint64_t handUs=UINT64_MAX, schemaUs=UINT64_MAX;
+	for (int round=0;round<3;++round) {
+		auto start=utils::clock();
+		handOk&=byHand(corpus.get());
+		handUs=std::min(handUs, utils::microseconds(start));
+		start=utils::clock();
+		schemaOk&=schema.validate(corpus);
+		schemaUs=std::min(schemaUs, utils::microseconds(start));
+	}
+	std::cout<<"Hand written checks: "<<handUs<<" us ("<<handOk<<")"<<std::endl;
+	std::cout<<"Schema::validate:    "<<schemaUs<<" us ("<<schemaOk<<")"<<std::endl;
+
+	// one bad record deep in a large document
+	json_object_set_new(json::getChild(json_array_get(corpus.get(), records-1), "address"), "zip", json_string("n/a"));
+	auto start=utils::clock();
+	try {
+		json::getLongOrThrow("record", json_array_get(corpus.get(), records-1), "address", "id");
+	} catch (const std::exception& e) {
+		std::cout<<"getLongOrThrow message: "<<strlen(e.what())<<" bytes in "<<utils::microseconds(start)<<" us"<<std::endl;
+	}
+	start=utils::clock();
+	try {
+		schema.check(corpus);
+	} catch (const std::exception& e) {
+		std::cout<<"Schema::check message: "<<strlen(e.what())<<" bytes in "<<utils::microseconds(start)<<" us: "<<e.what()<<std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,52 @@
+#include <iostream>
+#include <jsonsnapshot.h>
+#include <utils.h>
+#include "corpus.h"
+
+int main(int argc, char** argv) {
+	size_t records=argc>1 ? atoi(argv[1]) : 100000;
+	std::string dir="/tmp/cpputils_bench_snapshot."+std::to_string(getpid());
+	utils::mkdir_p(dir);
+	std::string text=dir+"/corpus.json", snap=dir+"/corpus.snap";
+	{
+		auto corpus=benchCorpus(records);
+		utils::dumpToFile(text, json::to_string(corpus));
+		auto start=utils::clock();
+		json::writeSnapshot(corpus, snap);
+		std::cout<<"Compiled "<<records<<" records in "<<utils::microseconds(start)/1000.0<<" ms"<<std::endl;
+	}
+	ssize_t textSize, snapSize;
+	utils::isRegularFile(text, &textSize);
+	utils::isRegularFile(snap, &snapSize);
+	std::cout<<"Text: "<<textSize<<" bytes, snapshot: "<<snapSize<<" bytes"<<std::endl;
+
+	long long total=0;
+	auto start=utils::clock();
+	{
+		auto j=json::parse(utils::slurpTextFile(text));
+		total+=json::getLong(json_array_get(j.get(), records/2), "id");
+	}
+	auto parseUs=utils::microseconds(start);
+
+	start=utils::clock();
+	{
+		json::Snapshot s(snap);
+		total+=json::getLong(s.root().at(records/2), "id");
+	}
+	auto mapUs=utils::microseconds(start);
+
+	json::Snapshot s(snap);
+	uint32_t idKey=s.keyId("id");
+	start=utils::clock();
+	for (auto e : s.root().elements()) total+=e.find(idKey).integer();
+	auto scanUs=utils::microseconds(start);
+
+	std::cout<<"slurpTextFile + parse + lookup: "<<parseUs<<" us"<<std::endl;
+	std::cout<<"Snapshot open + lookup:         "<<mapUs<<" us"<<std::endl;
+	std::cout<<"Snapshot scan of all ids:       "<<scanUs<<" us"<<std::endl;
+	std::cout<<"(checksum "<<total<<")"<<std::endl;
+	unlink(text.c_str());
+	unlink(snap.c_str());
+	rmdir(dir.c_str());
+	return 0;
+}
@@ -0,0 +1,41 @@
+#include <iostream>
+#include <atomic>
+#include <jsonparallel.h>
+#include <jsoncursor.h>
+#include <utils.h>
+#include "corpus.h"
+
+int main(int argc, char** argv) {
+	size_t records=argc>1 ? atoll(argv[1]) : 200000;
+	std::string text=json::to_string(benchCorpus(records));
+	std::cout<<"Document size: "<<text.size()<<" bytes, records: "<<records<<std::endl;
+
+	auto start=utils::clock();
+	auto serial=json::parse(text);
+	auto parseUs=utils::microseconds(start);
+	std::cout<<"json::parse: "<<parseUs<<" us"<<std::endl;
+
+	start=utils::clock();
+	auto seps=json::topLevelSeparators(text.data(), text.size());
+	auto scanUs=utils::microseconds(start);
+	std::cout<<"Boundary scan: "<<scanUs<<" us ("<<(text.size()/(scanUs+1))<<" MB/s)"<<std::endl;
+
+	unsigned all=json::parallel::defaultThreads();
+	for (unsigned threads=1;threads<=all;threads*=2) {
+		start=utils::clock();
+		auto parsed=json::parseArrayParallel(text, threads);
+		auto us=utils::microseconds(start);
+		std::cout<<"parseArrayParallel, "<<threads<<" threads: "<<us<<" us, "<<(parseUs*1.0/us)<<"x"
+				<<(json_equal(parsed.get(), serial.get()) ? "" : " MISMATCH")<<std::endl;
+	}
+
+	start=utils::clock();
+	json::parse(text);
+	std::cout<<"json::parse again: "<<utils::microseconds(start)<<" us"<<std::endl;
+
+	std::atomic<size_t> count(0);
+	start=utils::clock();
+	json::parseArrayParallel(text, [&](size_t, json::jsonptr r) {count+=json_object_size(r.get());}, all);
+	std::cout<<"parseArrayParallel to a callback, "<<all<<" threads: "<<utils::microseconds(start)<<" us"<<std::endl;
+	return 0;
+}
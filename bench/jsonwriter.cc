@@ -0,0 +1,97 @@
+#include <iostream>
+#include <jsonwriter.h>
+#include <utils.h>
+
+struct Line {
+	std::string sku;
+	std::string title;
+	long long quantity;
+	double price;
+	std::optional<std::string> coupon;
+};
+JSON_BINDING(Line, JSON_FIELD(Line, sku), JSON_FIELD(Line, title), JSON_FIELD(Line, quantity), JSON_FIELD(Line, price), JSON_FIELD(Line, coupon))
+
+struct Order {
+	long long id;
+	std::string customer;
+	std::string status;
+	bool paid;
+	std::vector<std::string> tags;
+	std::vector<Line> lines;
+	std::map<std::string, long long> counters;
+};
+JSON_BINDING(Order, JSON_FIELD(Order, id), JSON_FIELD(Order, customer), JSON_FIELD(Order, status), JSON_FIELD(Order, paid),
+		JSON_FIELD(Order, tags), JSON_FIELD(Order, lines), JSON_FIELD(Order, counters))
+
+static Order makeOrder() {
+	Order o{123456789, "Jane \"JD\" Doe", "shipped", true, {}, {}, {}};
+	for (int i=0;i<8;++i) o.tags.push_back("tag-"+std::to_string(i));
+	for (int i=0;i<16;++i) {
+		Line l{"SKU-"+std::to_string(100000+i), "Some product title number "+std::to_string(i), i+1, 9.99*(i+1), std::nullopt};
+		if (i%3==0) l.coupon="SAVE10";
+		o.lines.push_back(l);
+	}
+	for (int i=0;i<8;++i) o.counters["counter_"+std::to_string(i)]=i*1000;
+	return o;
+}
+
+static json::jsonptr toTree(const Order& o) {
+	auto j=json::own(json_object());
+	json_object_set_new(j.get(), "id", json_integer(o.id));
+	json_object_set_new(j.get(), "customer", json_string(o.customer.c_str()));
+	json_object_set_new(j.get(), "status", json_string(o.status.c_str()));
+	json_object_set_new(j.get(), "paid", json_boolean(o.paid));
+	json_t* tags=json_array();
+	for (auto& t : o.tags) json_array_append_new(tags, json_string(t.c_str()));
+	json_object_set_new(j.get(), "tags", tags);
+	json_t* lines=json_array();
+	for (auto& l : o.lines) {
+		json_t* lj=json_object();
+		json_object_set_new(lj, "sku", json_string(l.sku.c_str()));
+		json_object_set_new(lj, "title", json_string(l.title.c_str()));
+		json_object_set_new(lj, "quantity", json_integer(l.quantity));
+		json_object_set_new(lj, "price", json_real(l.price));
+		if (l.coupon) json_object_set_new(lj, "coupon", json_string(l.coupon->c_str()));
+		json_array_append_new(lines, lj);
+	}
+	json_object_set_new(j.get(), "lines", lines);
+	json_t* counters=json_object();
+	for (auto& c : o.counters) json_object_set_new(counters, c.first.c_str(), json_integer(c.second));
+	json_object_set_new(j.get(), "counters", counters);
+	return j;
+}
+
+int main(int argc, char** argv) {
+	int iterations=argc>1 ? atoi(argv[1]) : 20000;
+	Order o=makeOrder();
+	std::string buf;
+	json::write(o, buf);
+	std::cout<<"Object size: "<<buf.size()<<" bytes, iterations: "<<iterations<<std::endl;
+
+	size_t total=0;
+	auto start=utils::clock();
+	for (int i=0;i<iterations;++i) total+=json::to_string(toTree(o)).size();
+	auto treeUs=utils::microseconds(start);
+
+	start=utils::clock();
+	for (int i=0;i<iterations;++i) {
+		buf.clear();
+		json::write(o, buf);
+		total+=buf.size();
+	}
+	auto writeUs=utils::microseconds(start);
+
+	start=utils::clock();
+	for (int i=0;i<iterations;++i) {
+		buf.clear();
+		json::write(o, buf, true);
+		total+=buf.size();
+	}
+	auto prettyUs=utils::microseconds(start);
+
+	std::cout<<"tree + to_string: "<<treeUs*1000.0/iterations<<" ns/op"<<std::endl;
+	std::cout<<"json::write:      "<<writeUs*1000.0/iterations<<" ns/op ("<<(double)treeUs/writeUs<<"x)"<<std::endl;
+	std::cout<<"json::write pretty: "<<prettyUs*1000.0/iterations<<" ns/op"<<std::endl;
+	std::cout<<"(checksum "<<total<<")"<<std::endl;
+	return 0;
+}
@@ -0,0 +1,61 @@
+#include <iostream>
+#include <fstream>
+#include <functional>
+#include <stdlib.h>
+#include <linereader.h>
+#include <utils.h>
+
+// counts the lines and tab separated fields of one large file in every way there is
+int main(int argc, char** argv) {
+	std::string dir=argc>1 ? argv[1] : "/tmp";
+	size_t size=argc>2 ? atoll(argv[2]) : 512<<20;
+	std::string file=dir+"/cpputils_bench_lines_"+std::to_string(getpid())+".tsv";
+	{
+		std::string text;
+		uint64_t x=1;
+		while (text.size()<size) {
+			x=x*6364136223846793005ULL+1442695040888963407ULL;
+			text+=std::to_string(x>>40)+"\tkey"+std::to_string(x%1000)+"\t"+std::string(x%60, 'v')+"\n";
+		}
+		utils::dumpToFile(file, text);
+	}
+	std::cout<<"File: "<<(size>>20)<<" MB"<<std::endl;
+
+	auto report=[&](const char* name, const std::function<size_t()>& f) {
+		auto start=utils::clock();
+		size_t n=f();
+		auto us=std::max<uint64_t>(1, utils::microseconds(start));
+		std::cout<<name<<": "<<n<<" in "<<us/1000<<" ms, "<<size/(double)us<<" MB/s"<<std::endl;
+	};
+	report("slurpTextFile+char loop", [&]() {
+		std::string s=utils::slurpTextFile(file);
+		size_t n=0;
+		for (char c : s) if (c=='\n') ++n;
+		return n;
+	});
+	report("ifstream getline", [&]() {
+		std::ifstream in(file);
+		size_t n=0;
+		for (std::string l;std::getline(in, l);) ++n;
+		return n;
+	});
+	for (bool map : {false, true}) {
+		report(map ? "LineReader map" : "LineReader read", [&]() {
+			utils::LineReader::Options o;
+			o.map=map;
+			utils::LineReader r(file, o);
+			size_t n=0;
+			for (std::string_view l;r.next(l);) ++n;
+			return n;
+		});
+	}
+	report("LineReader+splitFields", [&]() {
+		utils::LineReader r(file);
+		std::vector<std::string_view> fields;
+		size_t n=0;
+		for (std::string_view l;r.next(l);) n+=utils::splitFields(l, '\t', fields);
+		return n;
+	});
+	unlink(file.c_str());
+	return 0;
+}
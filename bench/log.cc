@@ -0,0 +1,56 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <vector>
+#include <log.h>
+#include <utils.h>
+
+int main(int argc, char** argv) {
+	size_t n=argc>1 ? atoll(argv[1]) : 200000;
+	std::string file=argc>2 ? argv[2] : "/tmp/cpputils_bench.log";
+	static const utils::LogFormat served("served {path} to {user} in {us} us, status {status}");
+	const std::string user="ann";
+
+	{
+		utils::Log::Options o;
+		o.fileName=file;
+		o.ringBytes=64<<20;
+		utils::Log log(o);
+		log.info(served, "/warmup", user, 0, 200);
+		log.flush();
+		std::vector<uint32_t> samples, clockOnly;
+		for (int i=0;i<10000;++i) {
+			auto s=utils::clock();
+			clockOnly.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(utils::clock()-s).count());
+		}
+		std::sort(clockOnly.begin(), clockOnly.end());
+		samples.reserve(n/64+1);
+		auto start=utils::clock();
+		for (size_t i=0;i<n;++i) {
+			if (i%64) {
+				log.info(served, "/index.html", user, i, 200);
+				continue;
+			}
+			auto s=utils::clock();
+			log.info(served, "/index.html", user, i, 200);
+			samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(utils::clock()-s).count());
+		}
+		auto callerUs=utils::microseconds(start);
+		log.flush();
+		auto totalUs=utils::microseconds(start);
+		std::sort(samples.begin(), samples.end());
+		auto s=log.stats();
+		std::cout<<"utils::Log, "<<n<<" records: caller "<<callerUs*1000.0/n<<" ns/record (p50 "<<samples[samples.size()/2]
+				<<" ns, p99 "<<samples[samples.size()*99/100]<<" ns, minus "<<clockOnly[clockOnly.size()/2]<<" ns of clock reads), until written "
+				<<totalUs<<" us, dropped "<<s.dropped<<std::endl;
+	}
+	unlink(file.c_str());
+	{
+		std::ofstream out(file);
+		auto start=utils::clock();
+		for (size_t i=0;i<n;++i) out<<"served /index.html to "<<user<<" in "<<i<<" us, status "<<200<<std::endl;
+		std::cout<<"std::ofstream with endl: "<<utils::microseconds(start)*1000.0/n<<" ns/record"<<std::endl;
+	}
+	unlink(file.c_str());
+	return 0;
+}
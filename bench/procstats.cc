@@ -0,0 +1,31 @@
+#include <iostream>
+#include <dirent.h>
+#include <stdlib.h>
+#include <procstats.h>
+#include <utils.h>
+
+// one sample the kept-descriptor way, against reopening every file and lsof
+int main(int argc, char** argv) {
+	int rounds=argc>1 ? atoi(argv[1]) : 20000;
+	utils::ProcStats stats;
+	utils::ProcSample s;
+	auto start=utils::clock();
+	for (int i=0;i<rounds;++i) stats.sample(s);
+	std::cout<<"ProcStats::sample: "<<utils::microseconds(start)*1000.0/rounds<<" ns"<<std::endl;
+
+	start=utils::clock();
+	size_t total=0;
+	for (int i=0;i<rounds;++i) {
+		for (const char* f : {"/proc/self/stat", "/proc/self/statm", "/proc/self/status", "/proc/self/io"}) total+=utils::slurpTextFile(f).size();
+		DIR* d=opendir("/proc/self/fd");
+		while (readdir(d)) ++total;
+		closedir(d);
+	}
+	std::cout<<"slurpTextFile+opendir: "<<utils::microseconds(start)*1000.0/rounds<<" ns"<<std::endl;
+
+	start=utils::clock();
+	std::string out, err;
+	utils::sh("lsof -b -n -P -p $PPID", &out, &err);
+	std::cout<<"sh(lsof): "<<utils::microseconds(start)<<" us"<<(out.empty() ? " (no lsof)" : "")<<std::endl;
+	return total==0;
+}
@@ -0,0 +1,55 @@
+#include <algorithm>
+#include <iostream>
+#include <profiler.h>
+#include <utils.h>
+
+static volatile uint64_t sink;
+
+static __attribute__((noinline)) uint64_t work(uint64_t n) {
+	uint64_t x=1;
+	for (uint64_t i=0;i<n;++i) x=x*6364136223846793005ULL+(i>>3);
+	return x;
+}
+
+static __attribute__((noinline)) uint64_t deep(int depth, uint64_t n) {
+	if (!depth) return work(n);
+	uint64_t r=deep(depth-1, n);
+	sink=sink+r;
+	return r;
+}
+
+// CPU time of a fixed amount of work, best of a few rounds
+static uint64_t measure(uint64_t n, uint64_t& total) {
+	uint64_t best=UINT64_MAX;
+	total=0;
+	for (int round=0;round<5;++round) {
+		timespec a, b;
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &a);
+		sink=deep(30, n);
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &b);
+		uint64_t us=(b.tv_sec-a.tv_sec)*1000000+(b.tv_nsec-a.tv_nsec)/1000;
+		best=std::min(best, us);
+		total+=us;
+	}
+	return best;
+}
+
+int main() {
+	const uint64_t N=400000000;
+	uint64_t total;
+	uint64_t base=measure(N, total);
+	std::cout<<"no profiler: "<<base<<" us"<<std::endl;
+	for (unsigned hz : {100u, 1000u, 10000u}) {
+		utils::Profiler::start(hz);
+		uint64_t us=measure(N, total);
+		utils::Profiler::stop();
+		auto s=utils::Profiler::stats();
+		auto start=utils::clock();
+		std::string folded=utils::Profiler::folded();
+		uint64_t dump=utils::microseconds(start);
+		std::cout<<hz<<" Hz: "<<us<<" us, overhead "<<(double)((int64_t)us-(int64_t)base)*100/base<<"%, "
+				<<s.samples<<" samples of "<<s.dropped+s.samples<<", "<<(s.samples ? (double)total/s.samples : 0)<<" CPU us between samples, folded in "<<dump<<" us, "
+				<<std::count(folded.begin(), folded.end(), '\n')<<" stacks"<<std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,139 @@
+#include <iostream>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <queue.h>
+#include <utils.h>
+
+// the usual bounded queue: a deque behind one mutex and two condition variables
+class MutexQueue {
+	std::mutex lock;
+	std::condition_variable notEmpty, notFull;
+	std::deque<uint64_t> items;
+	size_t limit;
+	bool closed=false;
+public:
+	explicit MutexQueue(size_t capacity) : limit(capacity) {}
+	bool push(uint64_t&& v) {
+		std::unique_lock<std::mutex> g(lock);
+		notFull.wait(g, [&]() {return items.size()<limit || closed;});
+		if (closed) return false;
+		items.push_back(v);
+		g.unlock();
+		notEmpty.notify_one();
+		return true;
+	}
+	bool pop(uint64_t& v) {
+		std::unique_lock<std::mutex> g(lock);
+		notEmpty.wait(g, [&]() {return !items.empty() || closed;});
+		if (items.empty()) return false;
+		v=items.front();
+		items.pop_front();
+		g.unlock();
+		notFull.notify_one();
+		return true;
+	}
+	template<typename IT> size_t push_batch(IT first, size_t n) {
+		for (size_t i=0;i<n;++i, ++first) if (!push(std::move(*first))) return i;
+		return n;
+	}
+	template<typename OUT> size_t pop_batch(OUT out, size_t max) {
+		uint64_t v;
+		if (!max || !pop(v)) return 0;
+		*out=v;
+		return 1;
+	}
+	void close() {
+		std::lock_guard<std::mutex> g(lock);
+		closed=true;
+		notEmpty.notify_all();
+		notFull.notify_all();
+	}
+};
+
+// moves items through q with the given number of producer and consumer threads; returns Mitems/s
+template<typename Q> double run(Q& q, unsigned producers, unsigned consumers, uint64_t items, size_t batch, uint64_t& sink) {
+	std::vector<std::thread> threads;
+	std::atomic<uint64_t> sum(0);
+	auto start=utils::clock();
+	for (unsigned c=0;c<consumers;++c) threads.emplace_back([&]() {
+		uint64_t local=0, buf[64];
+		for (;;) {
+			size_t n;
+			if (batch>1) {
+				n=q.pop_batch(buf, batch);
+			} else {
+				n=q.pop(buf[0]);
+			}
+			if (!n) break;
+			for (size_t i=0;i<n;++i) local+=buf[i];
+		}
+		sum+=local;
+	});
+	std::vector<std::thread> pushers;
+	for (unsigned p=0;p<producers;++p) pushers.emplace_back([&, p]() {
+		uint64_t buf[64];
+		for (uint64_t i=p;i<items;) {
+			size_t n=0;
+			for (;n<batch && i<items;++n, i+=producers) buf[n]=i;
+			if (batch>1) {
+				q.push_batch(buf, n);
+			} else {
+				q.push(std::move(buf[0]));
+			}
+		}
+	});
+	for (auto& t : pushers) t.join();
+	q.close();
+	for (auto& t : threads) t.join();
+	auto us=utils::microseconds(start);
+	sink+=sum;
+	if (sum!=items*(items-1)/2) std::cout<<"lost items: sum "<<sum<<std::endl;
+	return items*1.0/std::max<uint64_t>(us, 1);
+}
+
+int main(int argc, char** argv) {
+	uint64_t items=argc>1 ? atoll(argv[1]) : 1<<18;
+	unsigned maxThreads=argc>2 ? atoi(argv[2]) : 64;
+	size_t capacity=1024;
+	std::cout<<"Items: "<<items<<", capacity: "<<capacity<<", cores: "<<std::thread::hardware_concurrency()<<std::endl;
+	uint64_t sink=0;
+
+	{
+		utils::SpscQueue<uint64_t> q(capacity);
+		auto start=utils::clock();
+		std::thread consumer([&]() {
+			uint64_t v, got=0;
+			while (got<items) {
+				if (q.try_pop(v)) {
+					sink+=v;
+					++got;
+				} else {
+					std::this_thread::yield();
+				}
+			}
+		});
+		for (uint64_t i=0;i<items;++i) {
+			uint64_t v=i;
+			while (!q.try_push(std::move(v))) std::this_thread::yield();
+		}
+		consumer.join();
+		std::cout<<"SpscQueue try_push/try_pop 1:1: "<<items*1.0/std::max<uint64_t>(utils::microseconds(start), 1)<<" Mitems/s"<<std::endl;
+	}
+
+	std::cout<<"threads\tmutex\tmpmc\tmpmc batch 16\tMitems/s"<<std::endl;
+	for (unsigned t=1;t<=maxThreads;t*=2) {
+		unsigned producers=std::max(1u, t/2), consumers=std::max(1u, t-t/2);
+		MutexQueue m(capacity);
+		double mutexRate=run(m, producers, consumers, items, 1, sink);
+		utils::BlockingQueue<utils::MpmcQueue<uint64_t>> q(capacity);
+		double mpmcRate=run(q, producers, consumers, items, 1, sink);
+		utils::BlockingQueue<utils::MpmcQueue<uint64_t>> qb(capacity);
+		double batchRate=run(qb, producers, consumers, items, 16, sink);
+		std::cout<<t<<"\t"<<mutexRate<<"\t"<<mpmcRate<<"\t"<<batchRate<<std::endl;
+	}
+	std::cout<<"(checksum "<<sink<<")"<<std::endl;
+	return 0;
+}
@@ -0,0 +1,89 @@
+#include <iostream>
+#include <map>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <reactor.h>
+#include <utils.h>
+
+// many idle pipes with a few ready at a time: epoll reactor against a poll() loop
+// rebuilding its set every round, the way sh() used select; then timer churn
+int main(int argc, char** argv) {
+	int n=argc>1 ? atoi(argv[1]) : 8000;
+	int rounds=argc>2 ? atoi(argv[2]) : 2000;
+	const int READY=16;
+	std::vector<utils::FD> readers(n), writers(n);
+	for (int i=0;i<n;++i) {
+		int p[2];
+		if (pipe2(p, O_NONBLOCK | O_CLOEXEC)) utils::errno_exception("pipe2");
+		readers[i]=p[0];
+		writers[i]=p[1];
+	}
+	std::cout<<"Pipes: "<<n<<", "<<READY<<" ready per round, "<<rounds<<" rounds"<<std::endl;
+	auto kick=[&](int round) {
+		for (int k=0;k<READY;++k) {
+			if (::write(writers[(round*7919+k*104729)%n], "x", 1)<0) utils::errno_exception("write");
+		}
+	};
+	char b[64];
+	{
+		utils::Reactor r;
+		size_t events=0;
+		for (int i=0;i<n;++i) {
+			r.add(readers[i], utils::Reactor::READ, [&, i](uint32_t) {
+				while (::read(readers[i], b, sizeof(b))>0);
+				++events;
+			});
+		}
+		auto start=utils::clock();
+		for (int round=0;round<rounds;++round) {
+			kick(round);
+			r.runOnce(0);
+		}
+		auto us=utils::microseconds(start);
+		std::cout<<"Reactor: "<<events<<" events, "<<us*1000.0/rounds<<" ns per round"<<std::endl;
+		for (int i=0;i<n;++i) r.remove(readers[i]);
+	}
+	{
+		size_t events=0;
+		std::vector<pollfd> fds(n);
+		auto start=utils::clock();
+		for (int round=0;round<rounds;++round) {
+			kick(round);
+			for (int i=0;i<n;++i) fds[i]=pollfd{readers[i].fd, POLLIN, 0};
+			int k=::poll(fds.data(), n, 0);
+			for (int i=0;i<n && k>0;++i) {
+				if (!fds[i].revents) continue;
+				--k;
+				while (::read(fds[i].fd, b, sizeof(b))>0);
+				++events;
+			}
+		}
+		auto us=utils::microseconds(start);
+		std::cout<<"poll: "<<events<<" events, "<<us*1000.0/rounds<<" ns per round"<<std::endl;
+	}
+
+	const int TIMERS=1000000;
+	{
+		utils::TimerWheel w;
+		std::vector<utils::TimerWheel::Id> ids(TIMERS);
+		auto start=utils::clock();
+		for (int i=0;i<TIMERS;++i) ids[i]=w.add(1+(i*2654435761u)%600000, []() {});
+		for (int i=0;i<TIMERS;i+=2) w.cancel(ids[i]);
+		w.advance(600001);
+		std::cout<<"TimerWheel: "<<TIMERS<<" added, half cancelled, rest fired in "<<utils::microseconds(start)/1000<<" ms"<<std::endl;
+	}
+	{
+		std::multimap<uint64_t, std::function<void()>> m;
+		std::vector<std::multimap<uint64_t, std::function<void()>>::iterator> its(TIMERS);
+		auto start=utils::clock();
+		for (int i=0;i<TIMERS;++i) its[i]=m.emplace(1+(i*2654435761u)%600000, []() {});
+		for (int i=0;i<TIMERS;i+=2) m.erase(its[i]);
+		while (!m.empty()) {
+			m.begin()->second();
+			m.erase(m.begin());
+		}
+		std::cout<<"multimap: same in "<<utils::microseconds(start)/1000<<" ms"<<std::endl;
+	}
+	return 0;
+}
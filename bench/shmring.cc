@@ -0,0 +1,185 @@
+#include <iostream>
+#include <string>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <jsonutils.h>
+#include <shmring.h>
+#include <utils.h>
+
+static const char* MESSAGE="{\"id\": 0, \"type\": \"update\", \"user\": \"someone@example.com\", \"tags\": [\"a\", \"b\", \"c\"],"
+		" \"score\": 0.75, \"payload\": {\"x\": 1, \"y\": 2, \"text\": \"the quick brown fox jumps over the lazy dog\"}}";
+
+static void writeAll(int fd, const char* p, size_t n) {
+	while (n) {
+		ssize_t w=::write(fd, p, n);
+		if (w<0) {
+			if (errno==EINTR) continue;
+			utils::errno_exception("write");
+		}
+		p+=w;
+		n-=w;
+	}
+}
+
+// length-prefixed JSON text, read in large chunks and parsed out of the buffer
+class PipeReader {
+	int fd;
+	std::string buffer;
+	size_t at=0;
+public:
+	explicit PipeReader(int f) : fd(f) {}
+	json::jsonptr next() {
+		for (;;) {
+			if (buffer.size()-at>=4) {
+				uint32_t len;
+				memcpy(&len, buffer.data()+at, 4);
+				if (buffer.size()-at>=4+len) {
+					auto j=json::parse(buffer.data()+at+4, len);
+					at+=4+len;
+					return j;
+				}
+			}
+			buffer.erase(0, at);
+			at=0;
+			size_t old=buffer.size();
+			buffer.resize(old+(1<<16));
+			ssize_t n=::read(fd, &buffer[old], 1<<16);
+			buffer.resize(old+(n>0 ? n : 0));
+			if (n<=0) return json::jsonptr();
+		}
+	}
+};
+
+static void sendPipe(int fd, const json::jsonptr& j) {
+	std::string s=json::to_string(j);
+	uint32_t len=s.size();
+	s.insert(0, (const char*)&len, 4);
+	writeAll(fd, s.data(), s.size());
+}
+
+int main() {
+	const int N=200000, ROUNDS=20000;
+	auto message=json::parse(MESSAGE);
+	std::cout<<"message: "<<json::to_string(message).size()<<" bytes of JSON text"<<std::endl;
+	{
+		int p[2];
+		if (pipe(p)) return 1;
+		auto start=utils::clock();
+		pid_t pid=fork();
+		if (!pid) {
+			::close(p[0]);
+			for (int i=0;i<N;++i) {
+				json_object_set_new(message.get(), "id", json_integer(i));
+				sendPipe(p[1], message);
+			}
+			_exit(0);
+		}
+		::close(p[1]);
+		PipeReader r(p[0]);
+		int got=0;
+		while (auto j=r.next()) got+=json::getLong(j.get(), "id")==got;
+		::waitpid(pid, nullptr, 0);
+		::close(p[0]);
+		uint64_t us=utils::microseconds(start);
+		std::cout<<"pipe: "<<got<<" messages in "<<us<<" us, "<<N*1e6/us<<" msg/s"<<std::endl;
+	}
+	for (bool cbor : {false, true}) {
+		utils::ShmRing ring(1<<20);
+		auto start=utils::clock();
+		pid_t pid=fork();
+		if (!pid) {
+			for (int i=0;i<N;++i) {
+				json_object_set_new(message.get(), "id", json_integer(i));
+				ring.pushJson(message.get(), cbor);
+			}
+			ring.close();
+			_exit(0);
+		}
+		int got=0;
+		while (auto j=ring.popJson()) got+=json::getLong(j.get(), "id")==got;
+		::waitpid(pid, nullptr, 0);
+		uint64_t us=utils::microseconds(start);
+		std::cout<<"ring"<<(cbor ? " cbor" : "")<<": "<<got<<" messages in "<<us<<" us, "<<N*1e6/us<<" msg/s"<<std::endl;
+	}
+	{
+		// the raw transport without JSON: 200 byte messages
+		std::string payload(200, 'x');
+		utils::ShmRing ring(1<<20);
+		int p[2];
+		if (pipe(p)) return 1;
+		auto start=utils::clock();
+		pid_t pid=fork();
+		if (!pid) {
+			for (int i=0;i<N;++i) ring.push(payload);
+			ring.close();
+			_exit(0);
+		}
+		utils::ShmRing::Message m;
+		size_t bytes=0;
+		while (ring.pop(m)) bytes+=m.size();
+		::waitpid(pid, nullptr, 0);
+		uint64_t us=utils::microseconds(start);
+		std::cout<<"ring bytes only: "<<N*1e6/us<<" msg/s, "<<bytes/(double)us<<" MB/s"<<std::endl;
+		start=utils::clock();
+		pid=fork();
+		if (!pid) {
+			::close(p[0]);
+			for (int i=0;i<N;++i) writeAll(p[1], payload.data(), payload.size());
+			_exit(0);
+		}
+		::close(p[1]);
+		char b[1<<16];
+		bytes=0;
+		for (ssize_t n;(n=::read(p[0], b, sizeof(b)))>0;) bytes+=n;
+		::waitpid(pid, nullptr, 0);
+		::close(p[0]);
+		us=utils::microseconds(start);
+		std::cout<<"pipe bytes only: "<<N*1e6/us<<" msg/s, "<<bytes/(double)us<<" MB/s"<<std::endl;
+	}
+	{
+		// round trips: a request and its reply
+		int a[2], b[2];
+		if (pipe(a) || pipe(b)) return 1;
+		pid_t pid=fork();
+		if (!pid) {
+			::close(a[1]);
+			::close(b[0]);
+			PipeReader r(a[0]);
+			while (auto j=r.next()) sendPipe(b[1], j);
+			_exit(0);
+		}
+		::close(a[0]);
+		::close(b[1]);
+		PipeReader r(b[0]);
+		auto start=utils::clock();
+		for (int i=0;i<ROUNDS;++i) {
+			sendPipe(a[1], message);
+			r.next();
+		}
+		uint64_t us=utils::microseconds(start);
+		::close(a[1]);
+		::waitpid(pid, nullptr, 0);
+		::close(b[0]);
+		std::cout<<"pipe round trip: "<<us*1000/ROUNDS<<" ns"<<std::endl;
+	}
+	{
+		utils::ShmRing requests(1<<16), replies(1<<16);
+		pid_t pid=fork();
+		if (!pid) {
+			while (auto j=requests.popJson()) replies.pushJson(j.get());
+			_exit(0);
+		}
+		auto start=utils::clock();
+		for (int i=0;i<ROUNDS;++i) {
+			requests.pushJson(message.get());
+			replies.popJson();
+		}
+		uint64_t us=utils::microseconds(start);
+		requests.close();
+		::waitpid(pid, nullptr, 0);
+		std::cout<<"ring round trip: "<<us*1000/ROUNDS<<" ns"<<std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,333 @@
+#include <appendlog.h>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <hash.h>
+#include <jsonbinary.h>
+
+namespace utils {
+
+namespace {
+
+const size_t READ_BYTES=1<<20;
+
+std::string segmentName(uint64_t first) {
+	char name[32];
+	snprintf(name, sizeof(name), "%020llu.log", (unsigned long long)first);
+	return name;
+}
+
+bool parseSegmentName(const char* name, uint64_t& first) {
+	if (strlen(name)!=24 || strcmp(name+20, ".log")) return false;
+	first=0;
+	for (int i=0;i<20;++i) {
+		if (name[i]<'0' || name[i]>'9') return false;
+		first=first*10+(name[i]-'0');
+	}
+	return true;
+}
+
+void fillHeader(char* h, const void* data, uint32_t len, AppendLog::Format format) {
+	memcpy(h+4, &len, 4);
+	h[8]=format;
+	uint32_t crc=crc32c(data, len, crc32c(h+4, 5));
+	memcpy(h, &crc, 4);
+}
+
+// reads the records of one segment in order, up to the end of the file or the first damaged one
+class Scanner {
+	int fd;
+	size_t size;
+	size_t pos=0;
+	std::string buf;
+	size_t bufStart=0, bufLen=0;
+
+	bool load(size_t off, size_t n) {
+		if (off+n>size) return false;
+		if (off>=bufStart && off+n<=bufStart+bufLen) return true;
+		size_t want=std::min(std::max(n, READ_BYTES), size-off);
+		if (buf.size()<want) buf.resize(want);
+		size_t got=0;
+		while (got<want) {
+			ssize_t r=::pread(fd, &buf[got], want-got, off+got);
+			if (r<0) {
+				if (errno==EINTR) continue;
+				errno_exception("Failed to read log segment");
+			}
+			if (!r) break;
+			got+=r;
+		}
+		bufStart=off;
+		bufLen=got;
+		return got>=n;
+	}
+public:
+	Scanner(int fd, size_t size) : fd(fd), size(size) {}
+	inline size_t position() const {return pos;}
+	bool next(AppendLog::Format& format, std::string_view& data) {
+		if (!load(pos, AppendLog::HEADER)) return false;
+		const char* h=buf.data()+(pos-bufStart);
+		uint32_t crc, len;
+		memcpy(&crc, h, 4);
+		memcpy(&len, h+4, 4);
+		if (len>AppendLog::MAX_RECORD || (uint8_t)h[8]>AppendLog::CBOR) return false;
+		if (!load(pos, AppendLog::HEADER+len)) return false;
+		h=buf.data()+(pos-bufStart);
+		if (crc32c(h+AppendLog::HEADER, len, crc32c(h+4, 5))!=crc) return false;
+		format=(AppendLog::Format)h[8];
+		data=std::string_view(h+AppendLog::HEADER, len);
+		pos+=AppendLog::HEADER+len;
+		return true;
+	}
+};
+
+size_t fileSize(int fd) {
+	struct stat st;
+	if (fstat(fd, &st)) errno_exception("Failed to stat log segment");
+	return st.st_size;
+}
+
+}
+
+json::jsonptr AppendLog::Record::json() const {
+	if (format==JSON) return json::parse(data.data(), data.size());
+	if (format==CBOR) return json::fromCbor(data.data(), data.size());
+	throw std::runtime_error("AppendLog record "+std::to_string(sequence)+" is binary, not json");
+}
+
+AppendLog::AppendLog(const Options& o) : options(o) {
+	if (options.directory.empty()) throw std::runtime_error("AppendLog needs a directory");
+	mkdir_p(options.directory);
+	dirFd=::open(options.directory.c_str(), O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+	if (!dirFd) errno_exception("Failed to open "+options.directory);
+	if (flock(dirFd, LOCK_EX | LOCK_NB)) errno_exception("AppendLog "+options.directory+" is in use");
+	recover();
+}
+
+AppendLog::~AppendLog() {
+	std::unique_lock<std::mutex> g(lock);
+	committed.wait(g, [&]() {return !writing;});
+	if (fd && failure.empty()) {
+		// give back the preallocated tail; the next open preallocates again
+		if (!ftruncate(fd, offset) && options.sync) fsync(fd);
+	}
+}
+
+void AppendLog::recover() {
+	DIR* d=::fdopendir(::dup(dirFd));
+	if (!d) errno_exception("Failed to list "+options.directory);
+	while (dirent* e=::readdir(d)) {
+		uint64_t first;
+		if (parseSegmentName(e->d_name, first)) segments[first]=e->d_name;
+	}
+	::closedir(d);
+	if (segments.empty()) {
+		openSegment(0);
+		return;
+	}
+	auto last=segments.rbegin();
+	std::string name=options.directory+"/"+last->second;
+	fd=::openat(dirFd, last->second.c_str(), O_RDWR | O_CLOEXEC);
+	if (!fd) errno_exception("Failed to open "+name);
+	size_t size=fileSize(fd);
+	Scanner scan(fd, size);
+	Format format;
+	std::string_view data;
+	uint64_t count=0;
+	while (scan.next(format, data)) ++count;
+	offset=scan.position();
+	segmentFirst=last->first;
+	nextSequence=writtenSequence=syncedSequence=segmentFirst+count;
+	if (offset<size) {
+		// drop whatever follows the last good record, so a later crash cannot bring back
+		// records that were never acknowledged
+		if (ftruncate(fd, offset)) errno_exception("Failed to truncate "+name);
+	}
+	if (options.preallocate && offset<options.segmentBytes && fallocate(fd, 0, 0, options.segmentBytes) && errno!=EOPNOTSUPP)
+		errno_exception("Failed to preallocate "+name);
+	if (options.sync && fsync(fd)) errno_exception("Failed to sync "+name);
+}
+
+void AppendLog::openSegment(uint64_t first) {
+	std::string base=segmentName(first);
+	std::string name=options.directory+"/"+base;
+	fd=::openat(dirFd, base.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (!fd) errno_exception("Failed to create "+name);
+	if (options.preallocate && fallocate(fd, 0, 0, options.segmentBytes) && errno!=EOPNOTSUPP)
+		errno_exception("Failed to preallocate "+name);
+	if (options.sync && (fsync(fd) || fsync(dirFd))) errno_exception("Failed to sync "+name);
+	offset=0;
+	segmentFirst=first;
+	std::lock_guard<std::mutex> g(lock);
+	segments[first]=base;
+}
+
+void AppendLog::roll(uint64_t first) {
+	if (ftruncate(fd, offset)) errno_exception("Failed to trim log segment "+segmentName(segmentFirst));
+	if (options.sync && fsync(fd)) errno_exception("Failed to sync log segment "+segmentName(segmentFirst));
+	openSegment(first);
+}
+
+void AppendLog::flush() {
+	size_t i=0;
+	while (i<iov.size()) {
+		ssize_t w=::pwritev(fd, &iov[i], std::min<size_t>(iov.size()-i, IOV_MAX), offset);
+		if (w<0) {
+			if (errno==EINTR) continue;
+			errno_exception("Failed to write log segment "+segmentName(segmentFirst));
+		}
+		offset+=w;
+		while (i<iov.size() && (size_t)w>=iov[i].iov_len) w-=iov[i++].iov_len;
+		if (w) {
+			iov[i].iov_base=(char*)iov[i].iov_base+w;
+			iov[i].iov_len-=w;
+		}
+	}
+	iov.clear();
+}
+
+void AppendLog::writeBatch(uint64_t first) {
+	size_t pending=0;
+	for (size_t i=0;i<batch.size();++i) {
+		Pending& p=batch[i];
+		size_t size=HEADER+p.length;
+		if (offset+pending>0 && offset+pending+size>options.segmentBytes) {
+			flush();
+			pending=0;
+			roll(first+i);
+		}
+		iov.push_back({p.header, HEADER});
+		if (p.length) iov.push_back({(void*)p.data, p.length});
+		pending+=size;
+	}
+	flush();
+	if (options.sync && fdatasync(fd)) errno_exception("Failed to sync log segment "+segmentName(segmentFirst));
+}
+
+void AppendLog::lead(std::unique_lock<std::mutex>& g) {
+	writing=true;
+	batch.swap(queue);
+	uint64_t first=writtenSequence;
+	g.unlock();
+	std::string error;
+	try {
+		writeBatch(first);
+	} catch (const std::exception& e) {
+		error=e.what();
+		iov.clear();
+	}
+	g.lock();
+	if (error.empty()) {
+		writtenSequence=first+batch.size();
+		if (options.sync) syncedSequence=writtenSequence;
+		records+=batch.size();
+		for (auto& p : batch) bytes+=HEADER+p.length;
+		++commits;
+		if (options.sync) ++syncs;
+	} else {
+		// what reached the disk is unknown, so the log takes no more records
+		failure=error;
+	}
+	batch.clear();
+	writing=false;
+	committed.notify_all();
+}
+
+uint64_t AppendLog::append(const void* data, size_t len, Format format) {
+	if (len>MAX_RECORD) throw std::runtime_error("AppendLog record of "+std::to_string(len)+" bytes is too large");
+	Pending p;
+	p.data=data;
+	p.length=len;
+	fillHeader(p.header, data, len, format);
+	std::unique_lock<std::mutex> g(lock);
+	if (!failure.empty()) throw std::runtime_error("AppendLog failed: "+failure);
+	uint64_t sequence=nextSequence++;
+	queue.push_back(p);
+	while (writtenSequence<=sequence) {
+		if (!failure.empty()) throw std::runtime_error("AppendLog failed: "+failure);
+		if (writing) committed.wait(g);
+		else lead(g);
+	}
+	return sequence;
+}
+
+uint64_t AppendLog::append(const json_t* j, Format format) {
+	std::string s;
+	if (format==JSON) s=json::to_string(j);
+	else if (format==CBOR) json::toCbor(j, s);
+	else throw std::runtime_error("AppendLog stores json as JSON or CBOR");
+	return append(s.data(), s.size(), format);
+}
+
+void AppendLog::sync() {
+	std::unique_lock<std::mutex> g(lock);
+	committed.wait(g, [&]() {return !writing;});
+	if (!failure.empty()) throw std::runtime_error("AppendLog failed: "+failure);
+	if (syncedSequence==writtenSequence) return;
+	uint64_t upTo=writtenSequence;
+	writing=true;
+	g.unlock();
+	int r=fdatasync(fd);
+	int err=errno;
+	g.lock();
+	writing=false;
+	if (!r) {
+		syncedSequence=upTo;
+		++syncs;
+	}
+	committed.notify_all();
+	if (r) {
+		errno=err;
+		errno_exception("Failed to sync log segment "+segmentName(segmentFirst));
+	}
+}
+
+void AppendLog::read(uint64_t sequence, const std::function<bool(const Record&)>& f) const {
+	std::map<uint64_t, std::string> files;
+	uint64_t limit;
+	{
+		std::lock_guard<std::mutex> g(lock);
+		files=segments;
+		limit=writtenSequence;
+	}
+	auto it=files.upper_bound(sequence);
+	if (it!=files.begin()) --it;
+	for (;it!=files.end();++it) {
+		if (it->first>=limit) break;
+		FD file(::openat(dirFd.fd, it->second.c_str(), O_RDONLY | O_CLOEXEC));
+		if (!file) errno_exception("Failed to open "+options.directory+"/"+it->second);
+		Scanner scan(file, fileSize(file));
+		Record r;
+		r.sequence=it->first;
+		while (r.sequence<limit && scan.next(r.format, r.data)) {
+			if (r.sequence>=sequence && !f(r)) return;
+			++r.sequence;
+		}
+	}
+}
+
+void AppendLog::dropBefore(uint64_t sequence) {
+	std::lock_guard<std::mutex> g(lock);
+	for (auto it=segments.begin();it!=segments.end();) {
+		auto next=std::next(it);
+		if (next==segments.end() || next->first>sequence) break;
+		if (unlinkat(dirFd, it->second.c_str(), 0)) errno_exception("Failed to delete "+options.directory+"/"+it->second);
+		it=segments.erase(it);
+	}
+}
+
+uint64_t AppendLog::end() const {
+	std::lock_guard<std::mutex> g(lock);
+	return nextSequence;
+}
+
+AppendLog::Stats AppendLog::stats() const {
+	std::lock_guard<std::mutex> g(lock);
+	return Stats{records, bytes, commits, syncs, segments.size()};
+}
+
+}
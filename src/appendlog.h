@@ -0,0 +1,122 @@
+#ifndef SRC_APPENDLOG_H_
+#define SRC_APPENDLOG_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/uio.h>
+#include <jsonutils.h>
+#include <utils.h>
+
+/*
+ * Durable append-only record log.
+ *
+ *   utils::AppendLog events({"/var/lib/app/events"});
+ *   uint64_t seq=events.append(j);					// compact json, durable on return
+ *   events.append(j, utils::AppendLog::CBOR);
+ *   events.read(0, [](const utils::AppendLog::Record& r) {use(r.json()); return true;});
+ *
+ * Records go to segment files in one directory, named after the sequence number of their
+ * first record (00000000000000000000.log, ...). Each record is a 9 byte header (crc32c of
+ * what follows, length, format) and its payload. append() blocks until its record is on
+ * disk: the first of the concurrent callers becomes the leader and writes everything
+ * queued meanwhile with writev and a single fdatasync, then wakes the others, so under
+ * load one disk flush covers many records. With sync=false records are written but not
+ * flushed; sync() flushes them.
+ *
+ * Segments are preallocated with fallocate, so appending does not grow the file, and are
+ * trimmed to their data when the log moves on to the next one at segmentBytes. Opening
+ * scans only the last segment: the log ends at the first record whose checksum does not
+ * match (a torn write), and everything after it is discarded. The directory is locked
+ * with flock, so one process at a time owns a log.
+ */
+
+namespace utils {
+
+class AppendLog {
+public:
+	enum Format : uint8_t {BINARY, JSON, CBOR};
+	struct Options {
+		std::string directory;
+		size_t segmentBytes=64<<20;
+		bool preallocate=true;
+		bool sync=true;					// fdatasync every group commit
+	};
+	struct Record {
+		uint64_t sequence;
+		Format format;
+		std::string_view data;
+		// decodes JSON and CBOR records
+		json::jsonptr json() const;
+	};
+	struct Stats {
+		uint64_t records;
+		uint64_t bytes;
+		uint64_t commits;				// group writes
+		uint64_t syncs;
+		size_t segments;
+	};
+	static const size_t HEADER=9;
+	static const uint32_t MAX_RECORD=0x7fffffff;
+private:
+	struct Pending {
+		char header[HEADER];
+		const void* data;
+		uint32_t length;
+	};
+
+	Options options;
+	FD dirFd;
+	mutable std::mutex lock;
+	std::condition_variable committed;
+	// first sequence number -> file name
+	std::map<uint64_t, std::string> segments;
+	std::vector<Pending> queue;
+	bool writing=false;
+	std::string failure;
+	uint64_t nextSequence=0, writtenSequence=0, syncedSequence=0;
+	uint64_t records=0, bytes=0, commits=0, syncs=0;
+	// the leader's, touched only by the thread holding the lead
+	FD fd;
+	size_t offset=0;
+	uint64_t segmentFirst=0;
+	std::vector<Pending> batch;
+	std::vector<iovec> iov;
+
+	void recover();
+	void openSegment(uint64_t first);
+	void roll(uint64_t first);
+	void lead(std::unique_lock<std::mutex>& g);
+	void writeBatch(uint64_t first);
+	void flush();
+public:
+	explicit AppendLog(const Options& options);
+	AppendLog(const AppendLog&) = delete;
+	AppendLog& operator=(const AppendLog&) = delete;
+	~AppendLog();
+
+	// returns the record's sequence number once it is written (and flushed if options.sync)
+	uint64_t append(const void* data, size_t len, Format format=BINARY);
+	inline uint64_t append(std::string_view data, Format format=BINARY) {return append(data.data(), data.size(), format);}
+	uint64_t append(const json_t* j, Format format=JSON);
+	inline uint64_t append(const json::jsonptr& j, Format format=JSON) {return append(j.get(), format);}
+	// flushes everything appended so far
+	void sync();
+
+	// calls f for the written records from sequence on, in order, until it returns false
+	void read(uint64_t sequence, const std::function<bool(const Record&)>& f) const;
+	// deletes the segments holding only records before sequence
+	void dropBefore(uint64_t sequence);
+	// sequence number the next record will get
+	uint64_t end() const;
+	Stats stats() const;
+};
+
+}
+
+#endif /* SRC_APPENDLOG_H_ */
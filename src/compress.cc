@@ -0,0 +1,532 @@
+#include <compress.h>
+#include <linereader.h>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#ifdef CPPUTILS_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CPPUTILS_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace utils {
+
+const char* compressionName(Compression c) {
+	switch (c) {
+		case Compression::NONE: return "none";
+		case Compression::GZIP: return "gzip";
+		case Compression::ZLIB: return "zlib";
+		case Compression::ZSTD: return "zstd";
+	}
+	return "?";
+}
+
+bool compressionSupported(Compression c) {
+#ifndef CPPUTILS_HAVE_ZLIB
+	if (c==Compression::GZIP || c==Compression::ZLIB) return false;
+#endif
+#ifndef CPPUTILS_HAVE_ZSTD
+	if (c==Compression::ZSTD) return false;
+#endif
+	return true;
+}
+
+Compression detectCompression(const void* data, size_t size) {
+	auto p=(const unsigned char*)data;
+	if (size>=2 && p[0]==0x1f && p[1]==0x8b) return Compression::GZIP;
+	if (size>=4 && p[0]==0x28 && p[1]==0xb5 && p[2]==0x2f && p[3]==0xfd) return Compression::ZSTD;
+	// deflate with a 32K window and no preset dictionary: 78 01, 78 5e, 78 9c or 78 da
+	if (size>=2 && p[0]==0x78 && !(p[1] & 0x20) && (p[0]*256+p[1])%31==0) return Compression::ZLIB;
+	return Compression::NONE;
+}
+
+struct DecompressReader::Decoder {
+	virtual ~Decoder() {}
+	// decodes from in into out, counting what was used of each; true when a stream ended
+	virtual bool decode(const char* in, size_t inLen, size_t& inUsed, char* out, size_t outLen, size_t& outUsed)=0;
+};
+
+struct CompressWriter::Encoder {
+	virtual ~Encoder() {}
+	// true once finish has written everything
+	virtual bool encode(const char* in, size_t inLen, size_t& inUsed, char* out, size_t outLen, size_t& outUsed, bool finish)=0;
+};
+
+namespace {
+
+#ifdef CPPUTILS_HAVE_ZLIB
+struct ZlibDecoder : DecompressReader::Decoder {
+	z_stream z;
+	const std::string& name;
+	ZlibDecoder(const std::string& n) : name(n) {
+		memset(&z, 0, sizeof(z));
+		// 32 lets zlib take either a gzip or a zlib header
+		if (inflateInit2(&z, 15+32)!=Z_OK) throw std::runtime_error("Failed to initialize inflate for "+name);
+	}
+	~ZlibDecoder() {inflateEnd(&z);}
+	bool decode(const char* in, size_t inLen, size_t& inUsed, char* out, size_t outLen, size_t& outUsed) override {
+		z.next_in=(Bytef*)in;
+		z.avail_in=(uInt)std::min<size_t>(inLen, UINT_MAX);
+		z.next_out=(Bytef*)out;
+		z.avail_out=(uInt)std::min<size_t>(outLen, UINT_MAX);
+		int r=inflate(&z, Z_NO_FLUSH);
+		inUsed=(const char*)z.next_in-in;
+		outUsed=(char*)z.next_out-out;
+		if (r==Z_STREAM_END) {
+			// another member may follow
+			inflateReset(&z);
+			return true;
+		}
+		if (r!=Z_OK && r!=Z_BUF_ERROR) throw std::runtime_error("Corrupt compressed data in "+name+": "+(z.msg ? z.msg : std::to_string(r)));
+		return false;
+	}
+};
+
+// a zlib header is two bytes that text can start with ("x^"), so it only counts if what
+// has been read inflates without an error, and ends the stream when it is all there is
+bool inflates(const char* p, size_t n, bool whole, const std::string& name) {
+	z_stream z;
+	memset(&z, 0, sizeof(z));
+	if (inflateInit(&z)!=Z_OK) throw std::runtime_error("Failed to initialize inflate for "+name);
+	char out[16384];
+	z.next_in=(Bytef*)p;
+	z.avail_in=n;
+	int r=Z_OK;
+	size_t produced=0;
+	// a bounded trial; a long enough run of valid output is as good as the end
+	while (r==Z_OK && z.avail_in && produced<(1<<16)) {
+		z.next_out=(Bytef*)out;
+		z.avail_out=sizeof(out);
+		r=inflate(&z, Z_NO_FLUSH);
+		produced+=sizeof(out)-z.avail_out;
+	}
+	inflateEnd(&z);
+	if (r==Z_STREAM_END) return true;
+	return (r==Z_OK || r==Z_BUF_ERROR) && (!whole || produced>=(1<<16));
+}
+
+struct ZlibEncoder : CompressWriter::Encoder {
+	z_stream z;
+	ZlibEncoder(bool gzip, int level, const std::string& name) {
+		memset(&z, 0, sizeof(z));
+		if (deflateInit2(&z, level<0 ? Z_DEFAULT_COMPRESSION : level, Z_DEFLATED, gzip ? 15+16 : 15, 8, Z_DEFAULT_STRATEGY)!=Z_OK) {
+			throw std::runtime_error("Failed to initialize deflate at level "+std::to_string(level)+" for "+name);
+		}
+	}
+	~ZlibEncoder() {deflateEnd(&z);}
+	bool encode(const char* in, size_t inLen, size_t& inUsed, char* out, size_t outLen, size_t& outUsed, bool finish) override {
+		z.next_in=(Bytef*)in;
+		z.avail_in=(uInt)std::min<size_t>(inLen, UINT_MAX);
+		z.next_out=(Bytef*)out;
+		z.avail_out=(uInt)std::min<size_t>(outLen, UINT_MAX);
+		bool all=z.avail_in==inLen;
+		int r=deflate(&z, finish && all ? Z_FINISH : Z_NO_FLUSH);
+		inUsed=(const char*)z.next_in-in;
+		outUsed=(char*)z.next_out-out;
+		if (r==Z_STREAM_ERROR) throw std::runtime_error("deflate failed");
+		return r==Z_STREAM_END;
+	}
+};
+#endif
+
+#ifdef CPPUTILS_HAVE_ZSTD
+struct ZstdDecoder : DecompressReader::Decoder {
+	ZSTD_DStream* d;
+	const std::string& name;
+	ZstdDecoder(const std::string& n) : d(ZSTD_createDStream()), name(n) {
+		if (!d) throw std::runtime_error("Failed to initialize zstd for "+name);
+	}
+	~ZstdDecoder() {ZSTD_freeDStream(d);}
+	bool decode(const char* in, size_t inLen, size_t& inUsed, char* out, size_t outLen, size_t& outUsed) override {
+		ZSTD_inBuffer i{in, inLen, 0};
+		ZSTD_outBuffer o{out, outLen, 0};
+		size_t r=ZSTD_decompressStream(d, &o, &i);
+		if (ZSTD_isError(r)) throw std::runtime_error("Corrupt compressed data in "+name+": "+ZSTD_getErrorName(r));
+		inUsed=i.pos;
+		outUsed=o.pos;
+		return r==0;
+	}
+};
+
+struct ZstdEncoder : CompressWriter::Encoder {
+	ZSTD_CCtx* c;
+	ZstdEncoder(int level, int threads, const std::string& name) : c(ZSTD_createCCtx()) {
+		if (!c) throw std::runtime_error("Failed to initialize zstd for "+name);
+		size_t r=ZSTD_CCtx_setParameter(c, ZSTD_c_compressionLevel, level<0 ? ZSTD_CLEVEL_DEFAULT : level);
+		// a libzstd built without threads refuses workers; compress on this thread then
+		if (!ZSTD_isError(r) && threads>0) ZSTD_CCtx_setParameter(c, ZSTD_c_nbWorkers, threads);
+		if (ZSTD_isError(r)) {
+			ZSTD_freeCCtx(c);
+			throw std::runtime_error("Invalid zstd level "+std::to_string(level)+" for "+name);
+		}
+	}
+	~ZstdEncoder() {ZSTD_freeCCtx(c);}
+	bool encode(const char* in, size_t inLen, size_t& inUsed, char* out, size_t outLen, size_t& outUsed, bool finish) override {
+		ZSTD_inBuffer i{in, inLen, 0};
+		ZSTD_outBuffer o{out, outLen, 0};
+		size_t r=ZSTD_compressStream2(c, &o, &i, finish ? ZSTD_e_end : ZSTD_e_continue);
+		if (ZSTD_isError(r)) throw std::runtime_error(std::string("zstd compression failed: ")+ZSTD_getErrorName(r));
+		inUsed=i.pos;
+		outUsed=o.pos;
+		return finish && r==0;
+	}
+};
+#endif
+
+}
+
+DecompressReader::DecompressReader(const std::string& fileName) : DecompressReader(fileName, Options()) {}
+
+DecompressReader::DecompressReader(FD&& f) : DecompressReader(std::move(f), Options()) {}
+
+DecompressReader::DecompressReader(const std::string& fileName, const Options& o) : name(fileName) {
+	fd=::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+	if (!fd) errno_exception("Failed to open "+fileName);
+	open(o);
+}
+
+DecompressReader::DecompressReader(FD&& f, const Options& o) : name("fd "+std::to_string(f.fd)), fd(std::move(f)) {
+	open(o);
+}
+
+DecompressReader::~DecompressReader() {
+	if (reader.joinable()) {
+		// a push blocked on the full queue fails, a wait for input returns, and the thread stops
+		chunks.close();
+		uint64_t one=1;
+		::write(stop, &one, sizeof(one));
+		reader.join();
+	}
+}
+
+void DecompressReader::open(const Options& o) {
+	options=o;
+	if (options.chunkBytes<4096) options.chunkBytes=4096;
+	in.reset(new char[options.chunkBytes]);
+	::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	// enough for the longest magic, short of the end of the input
+	while (inLen<4 && !inEof) fillInput();
+	type=detectCompression(in.get(), inLen);
+	switch (type) {
+		case Compression::NONE:
+			break;
+		case Compression::GZIP:
+		case Compression::ZLIB:
+#ifdef CPPUTILS_HAVE_ZLIB
+			if (type==Compression::ZLIB && !inflates(in.get(), inLen, inEof, name)) {
+				type=Compression::NONE;
+				break;
+			}
+			decoder.reset(new ZlibDecoder(name));
+			break;
+#else
+			throw std::runtime_error(name+" is "+compressionName(type)+" compressed, which this build does not support");
+#endif
+		case Compression::ZSTD:
+#ifdef CPPUTILS_HAVE_ZSTD
+			decoder.reset(new ZstdDecoder(name));
+			break;
+#else
+			throw std::runtime_error(name+" is zstd compressed, which this build does not support");
+#endif
+	}
+	if (options.readAhead) {
+		stop=::eventfd(0, EFD_CLOEXEC);
+		if (!stop) errno_exception("eventfd failed");
+		reader=std::thread([this]() {readAhead();});
+	}
+}
+
+void DecompressReader::fillInput() {
+	if (inPos==inLen) inPos=inLen=0;
+	for (;;) {
+		if (stop) {
+			pollfd p[2]={{fd, POLLIN, 0}, {stop, POLLIN, 0}};
+			if (::poll(p, 2, -1)<0) {
+				if (errno==EINTR) continue;
+				errno_exception("Failed to wait for "+name);
+			}
+			if (p[1].revents) throw std::runtime_error("Reading "+name+" was stopped");
+		}
+		ssize_t r=::read(fd, in.get()+inLen, options.chunkBytes-inLen);
+		if (r<0) {
+			if (errno==EINTR) continue;
+			errno_exception("Failed to read "+name);
+		}
+		if (!r) inEof=true;
+		inLen+=r;
+		return;
+	}
+}
+
+size_t DecompressReader::produce(char* out, size_t n) {
+	if (!n) return 0;
+	if (!decoder) {
+		if (inPos==inLen) {
+			if (inEof) return 0;
+			fillInput();
+		}
+		size_t k=std::min(n, inLen-inPos);
+		memcpy(out, in.get()+inPos, k);
+		inPos+=k;
+		return k;
+	}
+	for (;;) {
+		if (inPos==inLen && !inEof) fillInput();
+		if (inPos==inLen) {
+			if (inFrame) throw std::runtime_error("Truncated compressed data in "+name);
+			return 0;
+		}
+		size_t used=0, k=0;
+		inFrame=true;
+		if (decoder->decode(in.get()+inPos, inLen-inPos, used, out, n, k)) inFrame=false;
+		inPos+=used;
+		if (k) return k;
+		if (!used && inPos<inLen) {
+			// the decoder wants more than what is left in the buffer
+			if (inEof || inPos==0) throw std::runtime_error("Truncated compressed data in "+name);
+			memmove(in.get(), in.get()+inPos, inLen-inPos);
+			inLen-=inPos;
+			inPos=0;
+			fillInput();
+		}
+	}
+}
+
+void DecompressReader::readAhead() {
+	try {
+		for (;;) {
+			std::string s(options.chunkBytes, 0);
+			size_t k=0;
+			while (k<s.size()) {
+				size_t r=produce(&s[k], s.size()-k);
+				if (!r) break;
+				k+=r;
+			}
+			if (!k) break;
+			s.resize(k);
+			if (!chunks.push(std::move(s))) return;
+		}
+	} catch (...) {
+		error=std::current_exception();
+	}
+	chunks.close();
+}
+
+size_t DecompressReader::read(void* buffer, size_t size) {
+	if (!reader.joinable()) return produce((char*)buffer, size);
+	if (done || !size) return 0;
+	if (chunkPos==chunk.size()) {
+		chunk.clear();
+		if (!chunks.pop(chunk)) {
+			done=true;
+			if (error) std::rethrow_exception(error);
+			return 0;
+		}
+		chunkPos=0;
+	}
+	size_t k=std::min(size, chunk.size()-chunkPos);
+	memcpy(buffer, chunk.data()+chunkPos, k);
+	chunkPos+=k;
+	return k;
+}
+
+CompressWriter::CompressWriter(const std::string& fileName, const Options& o) : name(fileName) {
+	fd=::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (!fd) errno_exception("Failed to create "+fileName);
+	open(o);
+}
+
+CompressWriter::CompressWriter(FD&& f, const Options& o) : name("fd "+std::to_string(f.fd)), fd(std::move(f)) {
+	open(o);
+}
+
+CompressWriter::~CompressWriter() {
+	if (!closed) {
+		try {
+			close();
+		} catch (...) {
+		}
+	}
+}
+
+static const size_t OUT_BYTES=1<<20;
+
+void CompressWriter::open(const Options& o) {
+	options=o;
+	switch (options.compression) {
+		case Compression::NONE:
+			break;
+		case Compression::GZIP:
+		case Compression::ZLIB:
+#ifdef CPPUTILS_HAVE_ZLIB
+			encoder.reset(new ZlibEncoder(options.compression==Compression::GZIP, options.level, name));
+			break;
+#else
+			throw std::runtime_error("Cannot write "+name+": "+compressionName(options.compression)+" is not supported by this build");
+#endif
+		case Compression::ZSTD:
+#ifdef CPPUTILS_HAVE_ZSTD
+			encoder.reset(new ZstdEncoder(options.level, options.threads, name));
+			break;
+#else
+			throw std::runtime_error("Cannot write "+name+": zstd is not supported by this build");
+#endif
+	}
+	out.reset(new char[OUT_BYTES]);
+}
+
+void CompressWriter::writeOut(const char* p, size_t n) {
+	for (size_t done=0;done<n;) {
+		ssize_t r=::write(fd, p+done, n-done);
+		if (r<0) {
+			if (errno==EINTR) continue;
+			errno_exception("Failed to write "+name);
+		}
+		done+=r;
+	}
+	bytesOut+=n;
+}
+
+void CompressWriter::flush() {
+	writeOut(out.get(), outLen);
+	outLen=0;
+}
+
+void CompressWriter::encode(const char* p, size_t n, bool finish) {
+	for (;;) {
+		if (outLen==OUT_BYTES) flush();
+		size_t used=0, k=0;
+		bool end=encoder->encode(p, n, used, out.get()+outLen, OUT_BYTES-outLen, k, finish);
+		p+=used;
+		n-=used;
+		outLen+=k;
+		if (finish ? end : !n) return;
+	}
+}
+
+void CompressWriter::write(const void* data, size_t size) {
+	if (closed) throw std::runtime_error("Write to closed "+name);
+	bytesIn+=size;
+	if (encoder) {
+		encode((const char*)data, size, false);
+		return;
+	}
+	if (outLen+size>OUT_BYTES) flush();
+	if (size>=OUT_BYTES) {
+		// large writes skip the buffer
+		writeOut((const char*)data, size);
+		return;
+	}
+	memcpy(out.get()+outLen, data, size);
+	outLen+=size;
+}
+
+void CompressWriter::close() {
+	if (closed) return;
+	closed=true;
+	if (encoder) encode(nullptr, 0, true);
+	flush();
+	if (::close(fd.fd)) {
+		fd.fd=-1;
+		errno_exception("Failed to close "+name);
+	}
+	fd.fd=-1;
+}
+
+std::string slurpCompressedFile(const std::string& fileName) {
+	DecompressReader in(fileName);
+	std::string s;
+	size_t len=0;
+	for (;;) {
+		if (s.size()-len<(1<<16)) s.resize(std::max<size_t>(s.size()*2, 1<<20));
+		size_t k=in.read(&s[len], s.size()-len);
+		if (!k) break;
+		len+=k;
+	}
+	s.resize(len);
+	return s;
+}
+
+void dumpToCompressedFile(const std::string& fileName, const void* buffer, size_t len, const CompressWriter::Options& options) {
+	CompressWriter out(fileName, options);
+	out.write(buffer, len);
+	out.close();
+}
+
+}
+
+namespace json {
+
+namespace {
+
+struct Feed {
+	utils::DecompressReader& in;
+	std::exception_ptr error;
+};
+
+size_t feed(void* buffer, size_t size, void* data) {
+	Feed* f=(Feed*)data;
+	try {
+		return f->in.read(buffer, size);
+	} catch (...) {
+		f->error=std::current_exception();
+		return (size_t)-1;
+	}
+}
+
+}
+
+jsonptr parse(utils::DecompressReader& in) {
+	Feed f{in, nullptr};
+	json_error_t e;
+	json_t* j=json_load_callback(feed, &f, JSON_DECODE_ANY, &e);
+	if (f.error) {
+		if (j) json_decref(j);
+		std::rethrow_exception(f.error);
+	}
+	if (!j) {
+		throw std::runtime_error("Invalid json in "+in.getName()+"; Error: "+e.text+
+				": line : "+std::to_string(e.line)+
+				", column: "+std::to_string(e.column)+
+				", position: "+std::to_string(e.position));
+	}
+	return own(j);
+}
+
+jsonptr parseFile(const std::string& fileName) {
+	utils::DecompressReader::Options o;
+	o.readAhead=true;
+	utils::DecompressReader in(fileName, o);
+	return parse(in);
+}
+
+size_t forEachLine(utils::DecompressReader& in, const std::function<void(const jsonptr&)>& f) {
+	utils::LineReader lines([&](char* p, size_t n) {return in.read(p, n);});
+	size_t count=0;
+	for (std::string_view l;lines.next(l);) {
+		if (l.find_first_not_of(" \t") == std::string_view::npos) continue;
+		json_error_t e;
+		json_t* j=json_loadb(l.data(), l.size(), JSON_DECODE_ANY, &e);
+		if (!j) {
+			throw std::runtime_error("Invalid json in "+in.getName()+" at line "+std::to_string(lines.lineNumber())+"; Error: "+e.text+
+					", column: "+std::to_string(e.column));
+		}
+		f(own(j));
+		++count;
+	}
+	return count;
+}
+
+size_t forEachLine(const std::string& fileName, const std::function<void(const jsonptr&)>& f) {
+	utils::DecompressReader::Options o;
+	o.readAhead=true;
+	utils::DecompressReader in(fileName, o);
+	return forEachLine(in, f);
+}
+
+}
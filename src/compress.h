@@ -0,0 +1,164 @@
+#ifndef SRC_COMPRESS_H_
+#define SRC_COMPRESS_H_
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <jsonutils.h>
+#include <queue.h>
+#include <utils.h>
+
+/*
+ * Streaming gzip/zlib/zstd decompression and compression.
+ *
+ *   utils::DecompressReader in("export.json.gz");
+ *   auto root=json::parse(in);
+ *
+ *   json::forEachLine("events.ndjson.zst", [](const json::jsonptr& e) {...});
+ *
+ *   utils::CompressWriter::Options o;
+ *   o.compression=utils::Compression::ZSTD;
+ *   o.threads=4;
+ *   utils::CompressWriter out("events.ndjson.zst", o);
+ *   out.write(line);
+ *   out.close();
+ *
+ * The reader looks at the first bytes of its input and decodes gzip (also several
+ * concatenated members, as pigz writes), zlib or zstd; anything else is passed through,
+ * so plain files read the same way. With readAhead a background thread decodes chunks
+ * of chunkBytes a few steps ahead of the caller, so decompression overlaps with parsing.
+ * Corrupt or truncated input throws.
+ *
+ * gzip and zlib need zlib and CPPUTILS_HAVE_ZLIB (ZLIB=1 in arch.mk, the default for
+ * x86_64), zstd needs libzstd and CPPUTILS_HAVE_ZSTD (ZSTD=1); a format that is not built
+ * in throws on input and is refused for output. On the write side level is
+ * the codec's own scale (-1 for its default) and threads makes zstd compress on that
+ * many threads of its own; gzip and zlib always compress on the calling thread.
+ */
+
+namespace utils {
+
+enum class Compression {NONE, GZIP, ZLIB, ZSTD};
+
+const char* compressionName(Compression c);
+bool compressionSupported(Compression c);
+// from the first bytes of a stream; NONE if they match no known format. zlib's two byte
+// header is a weak signal, which DecompressReader confirms by inflating the first input
+Compression detectCompression(const void* data, size_t size);
+
+class DecompressReader {
+public:
+	struct Options {
+		size_t chunkBytes=1<<20;
+		bool readAhead=false;
+	};
+	struct Decoder;
+private:
+	Options options;
+	std::string name;
+	FD fd;
+	Compression type=Compression::NONE;
+	std::unique_ptr<Decoder> decoder;
+	std::unique_ptr<char[]> in;
+	size_t inPos=0;
+	size_t inLen=0;
+	bool inEof=false;
+	// a frame or member was started and has not ended yet
+	bool inFrame=false;
+
+	std::thread reader;
+	// an eventfd the destructor signals, so a read-ahead blocked on a pipe returns
+	FD stop;
+	BlockingQueue<SpscQueue<std::string>> chunks{4};
+	std::string chunk;
+	size_t chunkPos=0;
+	bool done=false;
+	std::exception_ptr error;
+
+	void open(const Options& o);
+	void fillInput();
+	size_t produce(char* out, size_t n);
+	void readAhead();
+public:
+	explicit DecompressReader(const std::string& fileName);
+	DecompressReader(const std::string& fileName, const Options& options);
+	// reads from fd, which the reader then owns
+	explicit DecompressReader(FD&& fd);
+	DecompressReader(FD&& fd, const Options& options);
+	DecompressReader(const DecompressReader&) = delete;
+	DecompressReader& operator=(const DecompressReader&) = delete;
+	~DecompressReader();
+
+	inline Compression compression() const {return type;}
+	inline const std::string& getName() const {return name;}
+	// up to size decoded bytes, 0 at the end of the input
+	size_t read(void* buffer, size_t size);
+};
+
+class CompressWriter {
+public:
+	struct Options {
+		Compression compression=Compression::GZIP;
+		int level=-1;
+		int threads=0;
+	};
+	struct Encoder;
+private:
+	Options options;
+	std::string name;
+	FD fd;
+	std::unique_ptr<Encoder> encoder;
+	std::unique_ptr<char[]> out;
+	size_t outLen=0;
+	uint64_t bytesIn=0;
+	uint64_t bytesOut=0;
+	bool closed=false;
+
+	void open(const Options& o);
+	void writeOut(const char* p, size_t n);
+	void flush();
+	void encode(const char* p, size_t n, bool finish);
+public:
+	// creates or truncates fileName
+	CompressWriter(const std::string& fileName, const Options& options);
+	// writes to fd, which the writer then owns
+	CompressWriter(FD&& fd, const Options& options);
+	CompressWriter(const CompressWriter&) = delete;
+	CompressWriter& operator=(const CompressWriter&) = delete;
+	// closes if close() was not called, ignoring errors
+	~CompressWriter();
+
+	void write(const void* data, size_t size);
+	inline void write(std::string_view s) {write(s.data(), s.size());}
+	// ends the stream and closes the file
+	void close();
+
+	inline uint64_t uncompressedBytes() const {return bytesIn;}
+	inline uint64_t compressedBytes() const {return bytesOut;}
+};
+
+// the decoded content of a file, compressed or not
+std::string slurpCompressedFile(const std::string& fileName);
+void dumpToCompressedFile(const std::string& fileName, const void* buffer, size_t len, const CompressWriter::Options& options);
+inline void dumpToCompressedFile(const std::string& fileName, const std::string& s, const CompressWriter::Options& options) {
+	dumpToCompressedFile(fileName, s.data(), s.length(), options);
+}
+
+}
+
+namespace json {
+
+// parses the whole stream chunk by chunk, without holding its text
+jsonptr parse(utils::DecompressReader& in);
+jsonptr parseFile(const std::string& fileName);
+
+// calls f with every non-blank line parsed, returns how many; errors name the line
+size_t forEachLine(utils::DecompressReader& in, const std::function<void(const jsonptr&)>& f);
+size_t forEachLine(const std::string& fileName, const std::function<void(const jsonptr&)>& f);
+
+}
+
+#endif /* SRC_COMPRESS_H_ */
@@ -0,0 +1,342 @@
+#include <executor.h>
+#include <deque>
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
+#include <utils.h>
+
+namespace utils {
+
+namespace detail {
+
+void FutureStateBase::complete() {
+	std::vector<std::function<void()>> run;
+	{
+		std::lock_guard<std::mutex> g(lock);
+		ready.store(1, std::memory_order_release);
+		run.swap(continuations);
+	}
+	futexWake(ready, INT_MAX);
+	for (auto& f : run) executor->post(std::move(f));
+}
+
+void FutureStateBase::onComplete(std::function<void()> f) {
+	{
+		std::lock_guard<std::mutex> g(lock);
+		if (!ready.load(std::memory_order_relaxed)) {
+			continuations.push_back(std::move(f));
+			return;
+		}
+	}
+	executor->post(std::move(f));
+}
+
+void FutureStateBase::wait() {
+	executor->helpUntilSet(ready);
+}
+
+}
+
+namespace {
+
+typedef Executor::Task Task;
+
+// Chase-Lev work-stealing deque (the C11 formulation of Le, Pop, Cohen, Zappa Nardelli)
+class Deque {
+	struct Array {
+		size_t mask;
+		std::unique_ptr<std::atomic<Task*>[]> slots;
+		explicit Array(size_t capacity) : mask(capacity-1), slots(new std::atomic<Task*>[capacity]) {}
+		inline Task* get(int64_t i) const {return slots[i & mask].load(std::memory_order_relaxed);}
+		inline void put(int64_t i, Task* t) {slots[i & mask].store(t, std::memory_order_relaxed);}
+	};
+	alignas(64) std::atomic<int64_t> top{0};
+	alignas(64) std::atomic<int64_t> bottom{0};
+	std::atomic<Array*> array;
+	// thieves may still read a replaced array, so they are kept until the deque goes
+	std::vector<std::unique_ptr<Array>> arrays;
+public:
+	Deque() {
+		arrays.emplace_back(new Array(256));
+		array.store(arrays.back().get(), std::memory_order_relaxed);
+	}
+	void push(Task* t) {
+		int64_t b=bottom.load(std::memory_order_relaxed);
+		int64_t tp=top.load(std::memory_order_acquire);
+		Array* a=array.load(std::memory_order_relaxed);
+		if (b-tp>(int64_t)a->mask) {
+			Array* bigger=new Array((a->mask+1)*2);
+			for (int64_t i=tp;i<b;++i) bigger->put(i, a->get(i));
+			arrays.emplace_back(bigger);
+			array.store(bigger, std::memory_order_release);
+			a=bigger;
+		}
+		a->put(b, t);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b+1, std::memory_order_relaxed);
+	}
+	Task* pop() {
+		int64_t b=bottom.load(std::memory_order_relaxed)-1;
+		Array* a=array.load(std::memory_order_relaxed);
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t=top.load(std::memory_order_relaxed);
+		if (t>b) {
+			bottom.store(b+1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		Task* x=a->get(b);
+		if (t==b) {
+			if (!top.compare_exchange_strong(t, t+1, std::memory_order_seq_cst, std::memory_order_relaxed)) x=nullptr;
+			bottom.store(b+1, std::memory_order_relaxed);
+		}
+		return x;
+	}
+	Task* steal() {
+		int64_t t=top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b=bottom.load(std::memory_order_acquire);
+		if (t>=b) return nullptr;
+		Array* a=array.load(std::memory_order_acquire);
+		Task* x=a->get(t);
+		if (!top.compare_exchange_strong(t, t+1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+		return x;
+	}
+	inline size_t size() const {
+		int64_t n=bottom.load(std::memory_order_relaxed)-top.load(std::memory_order_relaxed);
+		return n>0 ? n : 0;
+	}
+};
+
+struct Current {
+	const Executor* owner;
+	int index;
+};
+thread_local Current current{nullptr, -1};
+
+}
+
+struct Executor::Worker {
+	Deque deque;
+	std::thread thread;
+	uint64_t seed;
+	alignas(64) std::atomic<uint64_t> executed{0};
+	std::atomic<uint64_t> stolen{0};
+	std::atomic<uint64_t> parked{0};
+};
+
+struct Executor::Shared {
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::mutex injectLock;
+	std::deque<Task*> inject;
+	std::atomic<size_t> injected{0};
+	std::atomic<uint32_t> wakeups{0};
+	std::atomic<int> sleepers{0};
+	std::atomic<bool> stopping{false};
+	std::atomic<uint64_t> submitted{0};
+	std::atomic<uint64_t> executedOutside{0};
+	std::atomic<uint64_t> stolenOutside{0};
+
+	Task* popInjected() {
+		if (!injected.load(std::memory_order_acquire)) return nullptr;
+		std::lock_guard<std::mutex> g(injectLock);
+		if (inject.empty()) return nullptr;
+		Task* t=inject.front();
+		inject.pop_front();
+		injected.store(inject.size(), std::memory_order_release);
+		return t;
+	}
+	Task* find(int self, uint64_t& seed, bool& stole) {
+		stole=false;
+		if (self>=0) {
+			if (Task* t=workers[self]->deque.pop()) return t;
+		}
+		if (Task* t=popInjected()) return t;
+		size_t n=workers.size();
+		seed^=seed<<13;
+		seed^=seed>>7;
+		seed^=seed<<17;
+		// a steal can lose a race while the deque is not empty, so look around twice
+		for (int round=0;round<2;++round) {
+			for (size_t k=0, start=seed%n;k<n;++k) {
+				size_t v=(start+k)%n;
+				if ((int)v==self) continue;
+				if (Task* t=workers[v]->deque.steal()) {
+					stole=true;
+					return t;
+				}
+			}
+		}
+		return nullptr;
+	}
+	bool hasWork() const {
+		if (injected.load(std::memory_order_acquire)) return true;
+		for (auto& w : workers) if (w->deque.size()) return true;
+		return false;
+	}
+	void notify() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleepers.load(std::memory_order_relaxed)>0) {
+			wakeups.fetch_add(1, std::memory_order_seq_cst);
+			futexWake(wakeups, 1);
+		}
+	}
+};
+
+namespace {
+
+void run(Task* t) noexcept {
+	t->run();
+	delete t;
+}
+
+}
+
+Executor::Executor(unsigned threads, bool pinThreads) : s(new Shared()) {
+	if (!threads) threads=std::max(1u, std::thread::hardware_concurrency());
+	std::vector<int> cpus;
+	if (pinThreads) {
+		cpu_set_t set;
+		if (!sched_getaffinity(0, sizeof(set), &set)) {
+			for (int c=0;c<CPU_SETSIZE;++c) if (CPU_ISSET(c, &set)) cpus.push_back(c);
+		}
+	}
+	for (unsigned i=0;i<threads;++i) {
+		s->workers.emplace_back(new Worker());
+		s->workers.back()->seed=0x9e3779b97f4a7c15ULL*(i+1);
+	}
+	for (unsigned i=0;i<threads;++i) {
+		Worker& w=*s->workers[i];
+		w.thread=std::thread([this, i]() {
+			current={this, (int)i};
+			Worker& me=*s->workers[i];
+			for (;;) {
+				bool stole;
+				if (Task* t=s->find(i, me.seed, stole)) {
+					if (stole) me.stolen.fetch_add(1, std::memory_order_relaxed);
+					run(t);
+					me.executed.fetch_add(1, std::memory_order_relaxed);
+					continue;
+				}
+				uint32_t seen=s->wakeups.load(std::memory_order_seq_cst);
+				s->sleepers.fetch_add(1, std::memory_order_seq_cst);
+				bool stop=s->stopping.load(std::memory_order_seq_cst);
+				if (!stop && !s->hasWork()) {
+					me.parked.fetch_add(1, std::memory_order_relaxed);
+					futexWait(s->wakeups, seen, -1);
+				}
+				s->sleepers.fetch_sub(1, std::memory_order_seq_cst);
+				if (stop && !s->hasWork()) return;
+			}
+		});
+		if (!cpus.empty()) {
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(cpus[i%cpus.size()], &set);
+			pthread_setaffinity_np(w.thread.native_handle(), sizeof(set), &set);
+		}
+	}
+}
+
+Executor::~Executor() {
+	s->stopping.store(true, std::memory_order_seq_cst);
+	s->wakeups.fetch_add(1, std::memory_order_seq_cst);
+	futexWake(s->wakeups, INT_MAX);
+	for (auto& w : s->workers) w->thread.join();
+}
+
+Executor& Executor::shared() {
+	// never destroyed: library code may still use it from static destructors
+	static Executor* e=new Executor();
+	return *e;
+}
+
+unsigned Executor::size() const {
+	return s->workers.size();
+}
+
+int Executor::currentWorker() const {
+	return current.owner==this ? current.index : -1;
+}
+
+void Executor::push(Task* t) {
+	s->submitted.fetch_add(1, std::memory_order_relaxed);
+	int self=currentWorker();
+	if (self>=0) {
+		s->workers[self]->deque.push(t);
+	} else {
+		std::lock_guard<std::mutex> g(s->injectLock);
+		s->inject.push_back(t);
+		s->injected.store(s->inject.size(), std::memory_order_release);
+	}
+	s->notify();
+}
+
+bool Executor::emptyHere() const {
+	int self=currentWorker();
+	return self>=0 ? s->workers[self]->deque.size()==0 : s->injected.load(std::memory_order_relaxed)==0;
+}
+
+bool Executor::runOne() {
+	int self=currentWorker();
+	thread_local uint64_t seed=0x2545f4914f6cdd1dULL^(uintptr_t)&seed;
+	bool stole;
+	Task* t=s->find(self, self>=0 ? s->workers[self]->seed : seed, stole);
+	if (!t) return false;
+	run(t);
+	if (self>=0) {
+		if (stole) s->workers[self]->stolen.fetch_add(1, std::memory_order_relaxed);
+		s->workers[self]->executed.fetch_add(1, std::memory_order_relaxed);
+	} else {
+		if (stole) s->stolenOutside.fetch_add(1, std::memory_order_relaxed);
+		s->executedOutside.fetch_add(1, std::memory_order_relaxed);
+	}
+	return true;
+}
+
+void Executor::helpUntilSet(const std::atomic<uint32_t>& word) {
+	auto& w=const_cast<std::atomic<uint32_t>&>(word);
+	while (!w.load(std::memory_order_acquire)) {
+		if (runOne()) continue;
+		// woken when the word is set; the timeout picks up tasks queued meanwhile
+		futexWait(w, 0, 200);
+	}
+}
+
+void Executor::runRange(const std::shared_ptr<detail::ForState>& st, size_t b, size_t e) {
+	while (b<e) {
+		if (st->failed.load(std::memory_order_relaxed)) return;
+		if (e-b>=2*st->grain && emptyHere()) {
+			size_t mid=b+(e-b)/2;
+			st->pending.fetch_add(1, std::memory_order_relaxed);
+			post([this, st, mid, e]() {
+				runRange(st, mid, e);
+				st->finish();
+			});
+			e=mid;
+			continue;
+		}
+		size_t step=std::min(e, b+st->grain);
+		try {
+			st->body(b, step);
+		} catch (...) {
+			std::lock_guard<std::mutex> g(st->lock);
+			if (!st->error) st->error=std::current_exception();
+			st->failed.store(true, std::memory_order_relaxed);
+		}
+		b=step;
+	}
+}
+
+Executor::Stats Executor::stats() const {
+	Stats r{s->submitted.load(), s->executedOutside.load(), s->stolenOutside.load(), 0, s->injected.load()};
+	for (auto& w : s->workers) {
+		r.executed+=w->executed.load();
+		r.stolen+=w->stolen.load();
+		r.parked+=w->parked.load();
+		r.queued+=w->deque.size();
+	}
+	return r;
+}
+
+}
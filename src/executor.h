@@ -0,0 +1,216 @@
+#ifndef SRC_EXECUTOR_H_
+#define SRC_EXECUTOR_H_
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <vector>
+#include <utils.h>
+
+/*
+ * Work-stealing thread pool.
+ *
+ *   auto f=utils::Executor::shared().submit([&]() {return utils::slurpTextFile(name);});
+ *   auto parsed=f.then([](std::string text) {return json::parse(text);});
+ *   utils::Executor::shared().parallel_for(0, files.size(), [&](size_t b, size_t e) {...});
+ *   json::jsonptr j=parsed.get();
+ *
+ * Every worker owns a Chase-Lev deque: it pushes and pops its own tasks at the bottom
+ * without locking, and idle workers steal from the top of others'. Tasks submitted from
+ * outside the pool go through a shared injection queue. Workers with nothing to run or
+ * steal park on a futex and are woken by new work.
+ *
+ * parallel_for splits lazily: the running thread halves its remaining range and offers
+ * the upper half for stealing only while its own deque is empty, so a range is cut
+ * finely when workers are idle and hardly at all when they are busy. The calling thread
+ * takes part, and a thread waiting on a Future or a parallel_for runs queued tasks
+ * meanwhile, so nested parallelism does not starve the pool. Exceptions thrown by tasks
+ * surface from Future::get() and from parallel_for (the first one).
+ *
+ * shared() is the process-wide pool used by the library's parallel paths.
+ */
+
+namespace utils {
+
+class Executor;
+
+namespace detail {
+
+struct FutureStateBase {
+	std::atomic<uint32_t> ready{0};
+	std::exception_ptr error;
+	Executor* executor;
+	std::mutex lock;
+	std::vector<std::function<void()>> continuations;
+	explicit FutureStateBase(Executor* e) : executor(e) {}
+	void complete();
+	void onComplete(std::function<void()> f);
+	void wait();
+};
+template<typename T> struct FutureState : FutureStateBase {
+	std::optional<T> value;
+	using FutureStateBase::FutureStateBase;
+};
+template<> struct FutureState<void> : FutureStateBase {
+	using FutureStateBase::FutureStateBase;
+};
+
+template<typename F, typename T> struct ThenResult {typedef decltype(std::declval<F>()(std::declval<T>())) type;};
+template<typename F> struct ThenResult<F, void> {typedef decltype(std::declval<F>()()) type;};
+
+struct ForState {
+	std::atomic<uint32_t> pending{1};
+	std::atomic<uint32_t> done{0};
+	std::atomic<bool> failed{false};
+	std::exception_ptr error;
+	std::mutex lock;
+	size_t grain;
+	std::function<void(size_t, size_t)> body;
+	void finish() {
+		if (pending.fetch_sub(1, std::memory_order_acq_rel)==1) {
+			done.store(1, std::memory_order_release);
+			futexWake(done, INT_MAX);
+		}
+	}
+};
+
+}
+
+template<typename T> class Future {
+	std::shared_ptr<detail::FutureState<T>> state;
+	friend class Executor;
+	template<typename U> friend class Future;
+	explicit Future(std::shared_ptr<detail::FutureState<T>> s) : state(std::move(s)) {}
+public:
+	Future() {}
+	inline bool valid() const {return state!=nullptr;}
+	inline bool ready() const {return state && state->ready.load(std::memory_order_acquire);}
+	// runs other tasks of the executor while waiting
+	inline void wait() const {state->wait();}
+	// waits, then returns the result or rethrows the task's exception; call once
+	T get() {
+		wait();
+		if (state->error) std::rethrow_exception(state->error);
+		if constexpr (!std::is_void<T>::value) return std::move(*state->value);
+	}
+	// f(result) runs on the executor once this completes; if this failed, f is skipped and
+	// the returned future carries the same exception
+	template<typename F> auto then(F f) -> Future<typename detail::ThenResult<F, T>::type>;
+};
+
+class Executor {
+public:
+	struct Stats {
+		uint64_t submitted;
+		uint64_t executed;
+		uint64_t stolen;
+		uint64_t parked;
+		size_t queued;
+	};
+	class Task {
+	public:
+		virtual ~Task() {}
+		virtual void run()=0;
+	};
+private:
+	template<typename F> class FunctionTask : public Task {
+		F f;
+	public:
+		explicit FunctionTask(F&& fn) : f(std::move(fn)) {}
+		void run() override {f();}
+	};
+	struct Worker;
+	struct Shared;
+	std::unique_ptr<Shared> s;
+
+	void push(Task* t);
+	bool emptyHere() const;
+	void runRange(const std::shared_ptr<detail::ForState>& st, size_t b, size_t e);
+public:
+	explicit Executor(unsigned threads=0, bool pinThreads=false);
+	Executor(const Executor&) = delete;
+	Executor& operator=(const Executor&) = delete;
+	// runs the tasks still queued, then stops the workers
+	~Executor();
+
+	static Executor& shared();
+	unsigned size() const;
+	// index of the calling worker thread of this executor, -1 for any other thread
+	int currentWorker() const;
+
+	template<typename F> void post(F f) {
+		push(new FunctionTask<F>(std::move(f)));
+	}
+	template<typename F> auto submit(F f) -> Future<decltype(f())> {
+		typedef decltype(f()) R;
+		auto st=std::make_shared<detail::FutureState<R>>(this);
+		post([st, f=std::move(f)]() mutable {
+			try {
+				if constexpr (std::is_void<R>::value) f();
+				else st->value.emplace(f());
+			} catch (...) {
+				st->error=std::current_exception();
+			}
+			st->complete();
+		});
+		return Future<R>(st);
+	}
+
+	// calls body(b, e) over subranges of [begin, end) no shorter than grain (0 picks one
+	// from the range and pool size) and returns when all are done
+	template<typename F> void parallel_for(size_t begin, size_t end, F body, size_t grain=0);
+
+	// runs one queued task, if any; true if it did
+	bool runOne();
+	// runs queued tasks until word is nonzero, parking briefly when there are none
+	void helpUntilSet(const std::atomic<uint32_t>& word);
+	Stats stats() const;
+};
+
+template<typename F> void Executor::parallel_for(size_t begin, size_t end, F body, size_t grain) {
+	if (begin>=end) return;
+	size_t n=end-begin;
+	if (!grain) grain=std::max<size_t>(1, n/((size()+1)*64));
+	if (n<=grain || !size()) {
+		body(begin, end);
+		return;
+	}
+	auto st=std::make_shared<detail::ForState>();
+	st->grain=grain;
+	st->body=std::ref(body);
+	runRange(st, begin, end);
+	st->finish();
+	helpUntilSet(st->done);
+	if (st->error) std::rethrow_exception(st->error);
+}
+
+template<typename T> template<typename F>
+auto Future<T>::then(F f) -> Future<typename detail::ThenResult<F, T>::type> {
+	typedef typename detail::ThenResult<F, T>::type R;
+	auto prev=state;
+	auto next=std::make_shared<detail::FutureState<R>>(prev->executor);
+	prev->onComplete([prev, next, f=std::move(f)]() mutable {
+		try {
+			if (prev->error) std::rethrow_exception(prev->error);
+			if constexpr (std::is_void<T>::value && std::is_void<R>::value) f();
+			else if constexpr (std::is_void<T>::value) next->value.emplace(f());
+			else if constexpr (std::is_void<R>::value) f(std::move(*prev->value));
+			else next->value.emplace(f(std::move(*prev->value)));
+		} catch (...) {
+			next->error=std::current_exception();
+		}
+		next->complete();
+	});
+	return Future<R>(next);
+}
+
+}
+
+#endif /* SRC_EXECUTOR_H_ */
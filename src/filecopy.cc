@@ -0,0 +1,280 @@
+#include <filecopy.h>
+#include <cerrno>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <utils.h>
+
+namespace utils {
+
+namespace {
+
+const size_t BUFFER=1<<20;
+// the most copy_file_range and sendfile move in one call
+const size_t CHUNK=1<<30;
+
+bool unsupported(int e) {
+	return e==ENOSYS || e==EXDEV || e==EINVAL || e==EOPNOTSUPP || e==ENOTTY;
+}
+
+ssize_t copyRange(int in, off_t inOffset, int out, off_t outOffset, size_t len) {
+#ifdef SYS_copy_file_range
+	loff_t i=inOffset, o=outOffset;
+	return syscall(SYS_copy_file_range, in, &i, out, &o, len, 0);
+#else
+	errno=ENOSYS;
+	return -1;
+#endif
+}
+
+class Copier {
+	int in, out;
+	const std::string& from;
+	const std::string& to;
+	bool forced;
+	std::unique_ptr<char[]> buf;
+
+	void writeAll(const char* p, size_t n, off_t off) {
+		while (n) {
+			ssize_t w=::pwrite(out, p, n, off);
+			if (w<0) {
+				if (errno==EINTR) continue;
+				errno_exception("Failed to write "+to);
+			}
+			p+=w;
+			n-=w;
+			off+=w;
+		}
+	}
+	bool fallBack() {
+		if (forced || method==CopyMethod::READ_WRITE) return false;
+		method=method==CopyMethod::COPY_FILE_RANGE ? CopyMethod::SENDFILE : CopyMethod::READ_WRITE;
+		return true;
+	}
+public:
+	CopyMethod method;
+	Copier(int in, int out, const std::string& from, const std::string& to, CopyMethod m)
+		: in(in), out(out), from(from), to(to), forced(m!=CopyMethod::AUTO), method(forced ? m : CopyMethod::COPY_FILE_RANGE) {}
+
+	// copies [off, end) to the same offsets; returns where the source ended
+	off_t range(off_t off, off_t end) {
+		while (off<end) {
+			size_t want=std::min<uint64_t>(end-off, CHUNK);
+			ssize_t n;
+			if (method==CopyMethod::COPY_FILE_RANGE) {
+				n=copyRange(in, off, out, off, want);
+			} else if (method==CopyMethod::SENDFILE) {
+				if (::lseek(out, off, SEEK_SET)<0) errno_exception("Failed to seek in "+to);
+				off_t i=off;
+				n=::sendfile(out, in, &i, want);
+			} else {
+				if (!buf) buf.reset(new char[BUFFER]);
+				n=::pread(in, buf.get(), std::min(want, BUFFER), off);
+				if (n>0) writeAll(buf.get(), n, off);
+			}
+			if (n<0) {
+				if (errno==EINTR) continue;
+				int e=errno;
+				if (unsupported(e) && fallBack()) continue;
+				if (unsupported(e) && forced) throw std::runtime_error(std::string(copyMethodName(method))+" is not supported for "+from+" -> "+to);
+				errno=e;
+				errno_exception("Failed to copy "+from+" to "+to);
+			}
+			if (!n) {
+				// some file systems report nothing copied instead of failing
+				if (method!=CopyMethod::READ_WRITE && fallBack()) continue;
+				char probe;
+				// the real end of the file is fine, data the forced method could not move is not
+				if (forced && method!=CopyMethod::READ_WRITE && ::pread(in, &probe, 1, off)>0)
+					throw std::runtime_error(std::string(copyMethodName(method))+" copied nothing for "+from+" -> "+to);
+				break;
+			}
+			off+=n;
+		}
+		return off;
+	}
+};
+
+void preserve(int fd, const std::string& name, const struct stat& st, const CopyOptions& o) {
+	if (o.preserveMode && ::fchmod(fd, st.st_mode & 07777)) errno_exception("Failed to set the mode of "+name);
+	if (o.preserveTimes) {
+		timespec times[2]={st.st_atim, st.st_mtim};
+		if (::futimens(fd, times)) errno_exception("Failed to set the times of "+name);
+	}
+}
+
+void copyLink(const std::string& from, const std::string& to, const struct stat& st, const CopyOptions& o) {
+	std::string target(st.st_size ? st.st_size : 4096, 0);
+	ssize_t n=::readlink(from.c_str(), &target[0], target.size());
+	if (n<0) errno_exception("Failed to read link "+from);
+	target.resize(n);
+	if (::unlink(to.c_str()) && errno!=ENOENT) errno_exception("Failed to replace "+to);
+	if (::symlink(target.c_str(), to.c_str())) errno_exception("Failed to create link "+to);
+	if (o.preserveTimes) {
+		timespec times[2]={st.st_atim, st.st_mtim};
+		::utimensat(AT_FDCWD, to.c_str(), times, AT_SYMLINK_NOFOLLOW);
+	}
+}
+
+struct DirCloser {
+	void operator()(DIR* d) const {::closedir(d);}
+};
+
+size_t copyDir(const std::string& from, const std::string& to, const struct stat& st, const struct stat& root, const CopyOptions& o) {
+	std::unique_ptr<DIR, DirCloser> d(::opendir(from.c_str()));
+	if (!d) errno_exception("Failed to open directory "+from);
+	size_t copied=0;
+	while (dirent* e=::readdir(d.get())) {
+		std::string name=e->d_name;
+		if (name=="." || name=="..") continue;
+		std::string src=from+"/"+name, dst=to+"/"+name;
+		struct stat s;
+		if (::lstat(src.c_str(), &s)) errno_exception("Failed to stat "+src);
+		if (S_ISDIR(s.st_mode)) {
+			// copying a tree into itself must not descend into the copy
+			if (s.st_dev==root.st_dev && s.st_ino==root.st_ino) continue;
+			if (::mkdir(dst.c_str(), 0700) && errno!=EEXIST) errno_exception("Failed to create directory "+dst);
+			copied+=copyDir(src, dst, s, root, o);
+		} else if (S_ISREG(s.st_mode)) {
+			copyFile(src, dst, o);
+			++copied;
+		} else if (S_ISLNK(s.st_mode)) {
+			copyLink(src, dst, s, o);
+			++copied;
+		}
+	}
+	FD fd(::open(to.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+	if (!fd) errno_exception("Failed to open directory "+to);
+	preserve(fd, to, st, o);
+	// the names of what was copied into it
+	if (o.sync && ::fsync(fd)) errno_exception("Failed to sync "+to);
+	return copied;
+}
+
+void syncParent(const std::string& name) {
+	std::string dir, base;
+	splitDirBasename(name, dir, base);
+	FD fd(::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+	if (!fd || ::fsync(fd)) errno_exception("Failed to sync directory of "+name);
+}
+
+}
+
+const char* copyMethodName(CopyMethod m) {
+	switch (m) {
+	case CopyMethod::AUTO: return "auto";
+	case CopyMethod::CLONE: return "clone";
+	case CopyMethod::COPY_FILE_RANGE: return "copy_file_range";
+	case CopyMethod::SENDFILE: return "sendfile";
+	case CopyMethod::READ_WRITE: return "read/write";
+	}
+	return "?";
+}
+
+CopyMethod copyFile(const std::string& from, const std::string& to, const CopyOptions& o) {
+	FD in(::open(from.c_str(), O_RDONLY | O_CLOEXEC));
+	if (!in) errno_exception("Failed to open "+from);
+	struct stat st, dst;
+	if (::fstat(in, &st)) errno_exception("Failed to stat "+from);
+	if (!S_ISREG(st.st_mode)) throw std::runtime_error(from+" is not a regular file");
+	if (!::stat(to.c_str(), &dst) && dst.st_dev==st.st_dev && dst.st_ino==st.st_ino)
+		throw std::runtime_error("Can't copy "+from+" onto itself");
+	FD out(::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 0777));
+	if (!out) errno_exception("Failed to create "+to);
+
+	CopyMethod used=CopyMethod::CLONE;
+	bool cloned=false;
+	if (o.method==CopyMethod::AUTO || o.method==CopyMethod::CLONE) {
+#ifdef FICLONE
+		cloned=!::ioctl(out, FICLONE, (int)in);
+		if (!cloned && !unsupported(errno) && errno!=EPERM) errno_exception("Failed to clone "+from+" to "+to);
+#else
+		errno=ENOTTY;
+#endif
+		if (!cloned && o.method==CopyMethod::CLONE) throw std::runtime_error("clone is not supported for "+from+" -> "+to);
+	}
+	if (!cloned) {
+		Copier c(in, out, from, to, o.method);
+		if (!st.st_size) {
+			// files under /proc and the like say 0 and still have content; a forced method is
+			// kept and throws if it can't read them
+			if (o.method==CopyMethod::AUTO) c.method=CopyMethod::READ_WRITE;
+			c.range(0, std::numeric_limits<off_t>::max());
+		} else if (o.sparse && (off_t)st.st_blocks*512<st.st_size) {
+			for (off_t pos=0;pos<st.st_size;) {
+				off_t data=::lseek(in, pos, SEEK_DATA);
+				if (data<0) {
+					if (errno==ENXIO) break;
+					if (errno!=EINVAL) errno_exception("Failed to find data in "+from);
+					// no hole support: the rest is data
+					data=pos;
+				}
+				off_t hole=::lseek(in, data, SEEK_HOLE);
+				if (hole<0) hole=st.st_size;
+				c.range(data, std::min(hole, st.st_size));
+				pos=hole;
+			}
+			if (::ftruncate(out, st.st_size)) errno_exception("Failed to size "+to);
+		} else {
+			c.range(0, st.st_size);
+		}
+		used=c.method;
+	}
+	preserve(out, to, st, o);
+	if (o.sync && ::fsync(out)) errno_exception("Failed to sync "+to);
+	return used;
+}
+
+void moveFile(const std::string& from, const std::string& to, const CopyOptions& o) {
+	if (!::rename(from.c_str(), to.c_str())) return;
+	if (errno!=EXDEV) errno_exception("Failed to move "+from+" to "+to);
+	struct stat st;
+	if (::lstat(from.c_str(), &st)) errno_exception("Failed to stat "+from);
+	// the copy must be on disk before the original goes
+	CopyOptions synced=o;
+	synced.sync=true;
+	if (S_ISDIR(st.st_mode)) copyTree(from, to, synced);
+	else if (S_ISLNK(st.st_mode)) copyLink(from, to, st, synced);
+	else copyFile(from, to, synced);
+	syncParent(to);
+	removeTree(from);
+}
+
+size_t copyTree(const std::string& from, const std::string& to, const CopyOptions& o) {
+	struct stat st, root;
+	if (::stat(from.c_str(), &st)) errno_exception("Failed to stat "+from);
+	if (!S_ISDIR(st.st_mode)) throw std::runtime_error(from+" is not a directory");
+	if (::mkdir(to.c_str(), 0700) && errno!=EEXIST) errno_exception("Failed to create directory "+to);
+	if (::stat(to.c_str(), &root)) errno_exception("Failed to stat "+to);
+	if (!S_ISDIR(root.st_mode)) throw std::runtime_error(to+" is not a directory");
+	return copyDir(from, to, st, root, o);
+}
+
+void removeTree(const std::string& name) {
+	struct stat st;
+	if (::lstat(name.c_str(), &st)) {
+		if (errno==ENOENT) return;
+		errno_exception("Failed to stat "+name);
+	}
+	if (S_ISDIR(st.st_mode)) {
+		std::unique_ptr<DIR, DirCloser> d(::opendir(name.c_str()));
+		if (!d) errno_exception("Failed to open directory "+name);
+		while (dirent* e=::readdir(d.get())) {
+			std::string entry=e->d_name;
+			if (entry!="." && entry!="..") removeTree(name+"/"+entry);
+		}
+		if (::rmdir(name.c_str())) errno_exception("Failed to delete "+name);
+	} else if (::unlink(name.c_str()) && errno!=ENOENT) {
+		errno_exception("Failed to delete "+name);
+	}
+}
+
+}
@@ -0,0 +1,49 @@
+#ifndef SRC_FILECOPY_H_
+#define SRC_FILECOPY_H_
+
+#include <cstddef>
+#include <string>
+
+/*
+ * Copying and moving files inside the kernel.
+ *
+ *   utils::copyFile("build/app.tar", "/srv/releases/app.tar");
+ *   utils::moveFile("/srv/staging/app", "/srv/releases/app");		// rename, or copy+delete across filesystems
+ *   utils::copyTree("conf", "/etc/app");
+ *
+ * copyFile tries, in order: a FICLONE reflink (btrfs, xfs: no data is copied at all),
+ * copy_file_range (server-side copies on NFS/CIFS, block copies elsewhere), sendfile and
+ * finally a read/write loop with a 1 MB buffer, each time falling back when the previous
+ * one is not supported for the pair of files. Holes in sparse sources are found with
+ * SEEK_DATA/SEEK_HOLE and left as holes. The copy gets the source's permission bits and
+ * access/modification times; ownership is left alone. Errors throw std::runtime_error.
+ */
+
+namespace utils {
+
+enum class CopyMethod {AUTO, CLONE, COPY_FILE_RANGE, SENDFILE, READ_WRITE};
+const char* copyMethodName(CopyMethod m);
+
+struct CopyOptions {
+	// AUTO falls back through the list; any other method is used alone and throws if unsupported
+	CopyMethod method=CopyMethod::AUTO;
+	bool preserveMode=true;
+	bool preserveTimes=true;
+	bool sparse=true;
+	// fsync the copy, and the directories copyTree fills, before returning
+	bool sync=false;
+};
+
+// copies a regular file, replacing to; returns the method that copied the data
+CopyMethod copyFile(const std::string& from, const std::string& to, const CopyOptions& options=CopyOptions());
+// renames from to to, copying and deleting when they are on different filesystems
+void moveFile(const std::string& from, const std::string& to, const CopyOptions& options=CopyOptions());
+// copies a directory recursively into to (created if missing): directories, regular files and
+// symbolic links, skipping other file types; returns the number of files copied
+size_t copyTree(const std::string& from, const std::string& to, const CopyOptions& options=CopyOptions());
+// deletes a file, a symbolic link or a directory with everything in it
+void removeTree(const std::string& name);
+
+}
+
+#endif /* SRC_FILECOPY_H_ */
@@ -0,0 +1,409 @@
+#include <hash.h>
+#include <utils.h>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#elif defined(__arm__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+namespace utils {
+
+namespace {
+
+const uint64_t S0=0xa0761d6478bd642fULL, S1=0xe7037ed1a0b428dbULL, S2=0x8ebc6af09c88c6e3ULL, S3=0x589965cc75374cc3ULL;
+
+inline void mum(uint64_t* a, uint64_t* b) {
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 r=(unsigned __int128)*a * *b;
+	*a=(uint64_t)r;
+	*b=(uint64_t)(r>>64);
+#else
+	uint64_t ha=*a>>32, hb=*b>>32, la=(uint32_t)*a, lb=(uint32_t)*b;
+	uint64_t rh=ha*hb, rm0=ha*lb, rm1=hb*la, rl=la*lb, t=rl+(rm0<<32), c=t<rl;
+	uint64_t lo=t+(rm1<<32);
+	c+=lo<t;
+	*a=lo;
+	*b=rh+(rm0>>32)+(rm1>>32)+c;
+#endif
+}
+
+inline uint64_t mix(uint64_t a, uint64_t b) {
+	mum(&a, &b);
+	return a^b;
+}
+
+inline uint64_t r8(const uint8_t* p) {
+	uint64_t v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+inline uint64_t r4(const uint8_t* p) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+inline uint64_t r3(const uint8_t* p, size_t len) {
+	return (uint64_t(p[0])<<16) | (uint64_t(p[len>>1])<<8) | p[len-1];
+}
+
+}
+
+uint64_t hash64(const void* key, size_t len, uint64_t seed) {
+	const uint8_t* p=(const uint8_t*)key;
+	seed^=mix(seed^S0, S1);
+	uint64_t a, b;
+	if (len<=16) {
+		if (len>=4) {
+			a=(r4(p)<<32) | r4(p+((len>>3)<<2));
+			b=(r4(p+len-4)<<32) | r4(p+len-4-((len>>3)<<2));
+		} else if (len>0) {
+			a=r3(p, len);
+			b=0;
+		} else {
+			a=b=0;
+		}
+	} else {
+		size_t i=len;
+		if (i>48) {
+			uint64_t see1=seed, see2=seed;
+			do {
+				seed=mix(r8(p)^S1, r8(p+8)^seed);
+				see1=mix(r8(p+16)^S2, r8(p+24)^see1);
+				see2=mix(r8(p+32)^S3, r8(p+40)^see2);
+				p+=48;
+				i-=48;
+			} while (i>48);
+			seed^=see1^see2;
+		}
+		while (i>16) {
+			seed=mix(r8(p)^S1, r8(p+8)^seed);
+			i-=16;
+			p+=16;
+		}
+		a=r8(p+i-16);
+		b=r8(p+i-8);
+	}
+	a^=S1;
+	b^=seed;
+	mum(&a, &b);
+	return mix(a^S0^len, b^S1);
+}
+
+namespace {
+
+// hash64 over input that arrives in pieces, with the same result as over all of it at
+// once: a stripe is taken only once more input follows it, as hash64 does, and the last
+// 16 bytes taken stay at hand for the final read, which may reach back into them
+class Hash64Stream {
+	uint64_t seed, initial, see1, see2;
+	uint64_t total=0;
+	bool striped=false;
+	// the 16 bytes before pending, then pending
+	uint8_t buf[16+48];
+	size_t pending=0;
+
+	inline void stripe(const uint8_t* p) {
+		seed=mix(r8(p)^S1, r8(p+8)^seed);
+		see1=mix(r8(p+16)^S2, r8(p+24)^see1);
+		see2=mix(r8(p+32)^S3, r8(p+40)^see2);
+	}
+public:
+	explicit Hash64Stream(uint64_t s) : initial(s) {
+		seed=s^mix(s^S0, S1);
+		see1=see2=seed;
+	}
+	void update(const uint8_t* p, size_t len) {
+		if (!len) return;
+		total+=len;
+		if (pending && pending+len>48) {
+			size_t k=48-pending;
+			memcpy(buf+16+pending, p, k);
+			stripe(buf+16);
+			memcpy(buf, buf+16+32, 16);
+			striped=true;
+			p+=k;
+			len-=k;
+			pending=0;
+		}
+		if (!pending && len>48) {
+			do {
+				stripe(p);
+				p+=48;
+				len-=48;
+			} while (len>48);
+			memcpy(buf, p-16, 16);
+			striped=true;
+		}
+		memcpy(buf+16+pending, p, len);
+		pending+=len;
+	}
+	uint64_t finish() {
+		if (!striped) return hash64(buf+16, pending, initial);
+		seed^=see1^see2;
+		const uint8_t* p=buf+16;
+		size_t i=pending;
+		while (i>16) {
+			seed=mix(r8(p)^S1, r8(p+8)^seed);
+			i-=16;
+			p+=16;
+		}
+		uint64_t a=r8(p+i-16)^S1, b=r8(p+i-8)^seed;
+		mum(&a, &b);
+		return mix(a^S0^total, b^S1);
+	}
+};
+
+}
+
+Hash128 hash128(const void* p, size_t len, uint64_t seed) {
+	return Hash128{hash64(p, len, seed), hash64(p, len, seed^0x9e3779b97f4a7c15ULL)};
+}
+
+namespace {
+
+const uint32_t POLY=0x82f63b78;
+
+// slicing-by-8 tables for the reflected polynomial 0x82f63b78
+struct Crc32cTables {
+	uint32_t t[8][256];
+	Crc32cTables() {
+		for (uint32_t i=0;i<256;++i) {
+			uint32_t c=i;
+			for (int k=0;k<8;++k) c=(c>>1)^(POLY & (0-(c & 1)));
+			t[0][i]=c;
+		}
+		for (uint32_t i=0;i<256;++i) {
+			for (int k=1;k<8;++k) t[k][i]=(t[k-1][i]>>8)^t[0][t[k-1][i] & 0xff];
+		}
+	}
+};
+
+const Crc32cTables& crcTables() {
+	static const Crc32cTables tables;
+	return tables;
+}
+
+uint32_t crc32cTables(uint32_t crc, const uint8_t* p, size_t len) {
+	const auto& t=crcTables().t;
+#if __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+	while (len && ((uintptr_t)p & 7)) {
+		crc=(crc>>8)^t[0][(crc^*p++) & 0xff];
+		--len;
+	}
+	for (;len>=8;len-=8, p+=8) {
+		uint64_t w;
+		memcpy(&w, p, 8);
+		w^=crc;
+		crc=t[7][w & 0xff]^t[6][(w>>8) & 0xff]^t[5][(w>>16) & 0xff]^t[4][(w>>24) & 0xff]
+				^t[3][(w>>32) & 0xff]^t[2][(w>>40) & 0xff]^t[1][(w>>48) & 0xff]^t[0][w>>56];
+	}
+#endif
+	while (len--) crc=(crc>>8)^t[0][(crc^*p++) & 0xff];
+	return crc;
+}
+
+#if defined(__x86_64__)
+
+// the crc32 instruction takes 3 cycles but a new one can start every cycle: three
+// streams over consecutive blocks, joined by shifting the earlier ones over the later
+const size_t BLOCK=1024;
+
+// a*b modulo the polynomial, both reflected
+uint32_t multiplyModP(uint32_t a, uint32_t b) {
+	uint32_t p=0;
+	for (uint32_t m=1u<<31;m;m>>=1) {
+		if (a & m) p^=b;
+		b=(b>>1)^(POLY & (0-(b & 1)));
+	}
+	return p;
+}
+
+// the register after BLOCK more zero bytes, linear in the register so one table per byte
+struct Crc32cShift {
+	uint32_t t[4][256];
+	Crc32cShift() {
+		// x^(8*BLOCK) by squaring x, BLOCK being a power of 2
+		uint32_t x=1u<<30;
+		for (size_t bits=1;bits<BLOCK*8;bits<<=1) x=multiplyModP(x, x);
+		for (uint32_t i=0;i<256;++i) {
+			for (int k=0;k<4;++k) t[k][i]=multiplyModP(x, i<<(8*k));
+		}
+	}
+	inline uint32_t operator()(uint32_t crc) const {
+		return t[0][crc & 0xff]^t[1][(crc>>8) & 0xff]^t[2][(crc>>16) & 0xff]^t[3][crc>>24];
+	}
+};
+
+const Crc32cShift& crcShift() {
+	static const Crc32cShift shift;
+	return shift;
+}
+
+__attribute__((target("sse4.2"))) uint32_t crc32cSse42(uint32_t crc, const uint8_t* p, size_t len) {
+	while (len && ((uintptr_t)p & 7)) {
+		crc=__builtin_ia32_crc32qi(crc, *p++);
+		--len;
+	}
+	if (len>=3*BLOCK) {
+		const Crc32cShift& shift=crcShift();
+		do {
+			uint64_t a=crc, b=0, c=0;
+			for (size_t i=0;i<BLOCK;i+=8) {
+				uint64_t x, y, z;
+				memcpy(&x, p+i, 8);
+				memcpy(&y, p+BLOCK+i, 8);
+				memcpy(&z, p+2*BLOCK+i, 8);
+				a=__builtin_ia32_crc32di(a, x);
+				b=__builtin_ia32_crc32di(b, y);
+				c=__builtin_ia32_crc32di(c, z);
+			}
+			crc=shift(shift((uint32_t)a)^(uint32_t)b)^(uint32_t)c;
+			p+=3*BLOCK;
+			len-=3*BLOCK;
+		} while (len>=3*BLOCK);
+	}
+	uint64_t c=crc;
+	for (;len>=8;len-=8, p+=8) {
+		uint64_t w;
+		memcpy(&w, p, 8);
+		c=__builtin_ia32_crc32di(c, w);
+	}
+	crc=c;
+	while (len--) crc=__builtin_ia32_crc32qi(crc, *p++);
+	return crc;
+}
+
+#elif defined(__aarch64__)
+
+__attribute__((target("+crc"))) uint32_t crc32cArm(uint32_t crc, const uint8_t* p, size_t len) {
+	while (len && ((uintptr_t)p & 7)) {
+		crc=__builtin_aarch64_crc32cb(crc, *p++);
+		--len;
+	}
+	for (;len>=8;len-=8, p+=8) {
+		uint64_t w;
+		memcpy(&w, p, 8);
+		crc=__builtin_aarch64_crc32cx(crc, w);
+	}
+	while (len--) crc=__builtin_aarch64_crc32cb(crc, *p++);
+	return crc;
+}
+
+#elif defined(__arm__) && defined(__ARM_FEATURE_CRC32)
+
+uint32_t crc32cArm(uint32_t crc, const uint8_t* p, size_t len) {
+	while (len && ((uintptr_t)p & 3)) {
+		crc=__crc32cb(crc, *p++);
+		--len;
+	}
+	for (;len>=4;len-=4, p+=4) {
+		uint32_t w;
+		memcpy(&w, p, 4);
+		crc=__crc32cw(crc, w);
+	}
+	while (len--) crc=__crc32cb(crc, *p++);
+	return crc;
+}
+
+#endif
+
+typedef uint32_t (*Crc32cUpdate)(uint32_t, const uint8_t*, size_t);
+
+Crc32cUpdate crc32cPick() {
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2")) return &crc32cSse42;
+#elif defined(__aarch64__)
+	if (getauxval(AT_HWCAP) & HWCAP_CRC32) return &crc32cArm;
+#elif defined(__arm__) && defined(__ARM_FEATURE_CRC32)
+	return &crc32cArm;
+#endif
+	return &crc32cTables;
+}
+
+// chosen on first use, static initializers elsewhere may already need it
+Crc32cUpdate crc32cUpdate() {
+	static const Crc32cUpdate f=crc32cPick();
+	return f;
+}
+
+}
+
+uint32_t crc32c(const void* data, size_t len, uint32_t crc) {
+	return ~crc32cUpdate()(~crc, (const uint8_t*)data, len);
+}
+
+bool crc32cHardware() {
+	return crc32cUpdate()!=&crc32cTables;
+}
+
+namespace {
+
+// calls f on the file's bytes: mapped when it is a regular file that fits the address
+// space, otherwise read in chunks to its end
+template<typename F> void forEachChunk(int fd, const std::string& name, F f) {
+	struct stat st;
+	if (::fstat(fd, &st)) errno_exception("Failed to stat "+name);
+	if (S_ISREG(st.st_mode) && (uint64_t)st.st_size<=SIZE_MAX/2) {
+		if (!st.st_size) {
+			f(nullptr, 0, true);
+			return;
+		}
+		void* m=::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (m!=MAP_FAILED) {
+			::madvise(m, st.st_size, MADV_SEQUENTIAL);
+			f((const char*)m, (size_t)st.st_size, true);
+			::munmap(m, st.st_size);
+			return;
+		}
+	}
+	std::string buffer(1<<20, 0);
+	for (;;) {
+		ssize_t n=::read(fd, &buffer[0], buffer.size());
+		if (n<0) {
+			if (errno==EINTR) continue;
+			errno_exception("Failed to read "+name);
+		}
+		f(buffer.data(), (size_t)n, n==0);
+		if (!n) return;
+	}
+}
+
+FD openForHashing(const std::string& fileName) {
+	FD fd(::open(fileName.c_str(), O_RDONLY | O_CLOEXEC));
+	if (!fd) errno_exception("Failed to open "+fileName);
+	return fd;
+}
+
+}
+
+uint64_t hashFile(int fd, uint64_t seed) {
+	Hash64Stream h(seed);
+	forEachChunk(fd, "fd "+std::to_string(fd), [&](const char* p, size_t len, bool) {
+		h.update((const uint8_t*)p, len);
+	});
+	return h.finish();
+}
+
+uint64_t hashFile(const std::string& fileName, uint64_t seed) {
+	return hashFile(openForHashing(fileName), seed);
+}
+
+uint32_t crc32cFile(int fd, uint32_t crc) {
+	forEachChunk(fd, "fd "+std::to_string(fd), [&](const char* p, size_t len, bool) {
+		crc=crc32c(p, len, crc);
+	});
+	return crc;
+}
+
+uint32_t crc32cFile(const std::string& fileName, uint32_t crc) {
+	return crc32cFile(openForHashing(fileName), crc);
+}
+
+}
@@ -0,0 +1,52 @@
+#ifndef SRC_HASH_H_
+#define SRC_HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Fast non-cryptographic hashing of byte ranges, in the wyhash family: 64x64->128 bit
+ * multiply-and-fold over 48 byte stripes, several GB/s per core. Results depend on the
+ * native byte order, so they are fine for in-memory tables but should not be persisted
+ * or compared across machines. Not suitable where an attacker chooses the input and
+ * collisions matter; use a keyed cryptographic hash there.
+ *
+ * crc32c is the Castagnoli CRC (iSCSI, ext4, RFC 3720), byte order independent and meant
+ * for checksums that are stored; pass the previous result as crc to continue a running one.
+ * It runs on the CRC instructions of SSE4.2 or ARMv8 when the CPU has them, chosen at the
+ * first call, and on slicing-by-8 tables otherwise.
+ *
+ *   uint64_t h=utils::hashFile("out/model.bin");
+ *   uint32_t c=utils::crc32cFile(fd);
+ *
+ * The file variants map regular files and hash them from the start without copying;
+ * anything else (pipes, sockets) is read to its end in 1 MB pieces, hashed as they come.
+ */
+
+namespace utils {
+
+struct Hash128 {
+	uint64_t lo, hi;
+	inline bool operator==(const Hash128& o) const {return lo==o.lo && hi==o.hi;}
+	inline bool operator!=(const Hash128& o) const {return !(*this==o);}
+};
+
+uint64_t hash64(const void* p, size_t len, uint64_t seed=0);
+inline uint64_t hash64(const std::string& s, uint64_t seed=0) {return hash64(s.data(), s.size(), seed);}
+// two independently seeded 64 bit lanes
+Hash128 hash128(const void* p, size_t len, uint64_t seed=0);
+inline Hash128 hash128(const std::string& s, uint64_t seed=0) {return hash128(s.data(), s.size(), seed);}
+
+uint32_t crc32c(const void* p, size_t len, uint32_t crc=0);
+inline uint32_t crc32c(const std::string& s, uint32_t crc=0) {return crc32c(s.data(), s.size(), crc);}
+bool crc32cHardware();
+
+uint64_t hashFile(const std::string& fileName, uint64_t seed=0);
+uint64_t hashFile(int fd, uint64_t seed=0);
+uint32_t crc32cFile(const std::string& fileName, uint32_t crc=0);
+uint32_t crc32cFile(int fd, uint32_t crc=0);
+
+}
+
+#endif /* SRC_HASH_H_ */
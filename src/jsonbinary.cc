@@ -0,0 +1,507 @@
+#include <jsonbinary.h>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace json {
+
+namespace {
+
+inline void put8(std::string& out, uint8_t v) {out+=(char)v;}
+inline void put16(std::string& out, uint16_t v) {
+	char b[2]={(char)(v>>8), (char)v};
+	out.append(b, 2);
+}
+inline void put32(std::string& out, uint32_t v) {
+	char b[4]={(char)(v>>24), (char)(v>>16), (char)(v>>8), (char)v};
+	out.append(b, 4);
+}
+inline void put64(std::string& out, uint64_t v) {
+	put32(out, (uint32_t)(v>>32));
+	put32(out, (uint32_t)v);
+}
+
+inline bool exactFloat(double v, float& f) {
+	if (!(fabs(v)<=FLT_MAX)) return false;
+	f=(float)v;
+	return (double)f==v;
+}
+inline uint32_t floatBits(float f) {
+	uint32_t b;
+	memcpy(&b, &f, 4);
+	return b;
+}
+inline uint64_t doubleBits(double d) {
+	uint64_t b;
+	memcpy(&b, &d, 8);
+	return b;
+}
+
+class Reader {
+	const uint8_t* p;
+	const uint8_t* end;
+	const uint8_t* begin;
+	int depth;
+public:
+	const char* format;
+	Reader(const char* fmt, const char* b, size_t len) : p((const uint8_t*)b), end((const uint8_t*)b+len), begin((const uint8_t*)b), depth(0), format(fmt) {}
+
+	[[noreturn]] void fail(const std::string& what) const {
+		throw std::runtime_error(std::string("Invalid ")+format+": "+what+", position: "+std::to_string(p-begin));
+	}
+	inline void need(size_t n) const {
+		if ((size_t)(end-p)<n) fail("unexpected end of input");
+	}
+	inline bool atEnd() const {return p==end;}
+	inline uint8_t u8() {
+		need(1);
+		return *p++;
+	}
+	inline uint8_t peek() {
+		need(1);
+		return *p;
+	}
+	inline uint16_t u16() {
+		need(2);
+		uint16_t v=(uint16_t(p[0])<<8) | p[1];
+		p+=2;
+		return v;
+	}
+	inline uint32_t u32() {
+		need(4);
+		uint32_t v=(uint32_t(p[0])<<24) | (uint32_t(p[1])<<16) | (uint32_t(p[2])<<8) | p[3];
+		p+=4;
+		return v;
+	}
+	inline uint64_t u64() {
+		uint64_t hi=u32();
+		return (hi<<32) | u32();
+	}
+	inline float f32() {
+		uint32_t b=u32();
+		float f;
+		memcpy(&f, &b, 4);
+		return f;
+	}
+	inline double f64() {
+		uint64_t b=u64();
+		double d;
+		memcpy(&d, &b, 8);
+		return d;
+	}
+	inline const char* bytes(uint64_t n) {
+		need(n);
+		const char* s=(const char*)p;
+		p+=n;
+		return s;
+	}
+	inline void enter() {
+		if (++depth>JSON_PARSER_MAX_DEPTH) fail("maximum nesting depth exceeded");
+	}
+	inline void leave() {--depth;}
+
+	json_t* string(const char* s, size_t n) {
+		json_t* j=json_stringn(s, n);
+		if (!j) fail("string is not valid UTF-8");
+		return j;
+	}
+	json_t* real(double v) {
+		if (v!=v || v-v!=0) fail("non finite real");
+		return json_real(v);
+	}
+	json_t* integer(uint64_t v, bool negative) {
+		if (v>(uint64_t)INT64_MAX) fail("integer out of range");
+		return json_integer(negative ? -(json_int_t)v-1 : (json_int_t)v);
+	}
+	void set(json_t* obj, const std::string& k, json_t* v) {
+		if (memchr(k.data(), 0, k.size())) {
+			json_decref(v);
+			fail("object key contains NUL");
+		}
+		if (json_object_set_new(obj, k.c_str(), v)) fail("object key is not valid UTF-8");
+	}
+};
+
+struct Holder {
+	json_t* j;
+	explicit Holder(json_t* v) : j(v) {}
+	~Holder() {if (j) json_decref(j);}
+	json_t* release() {
+		json_t* r=j;
+		j=nullptr;
+		return r;
+	}
+};
+
+/* CBOR */
+
+inline void cborHead(std::string& out, uint8_t major, uint64_t v) {
+	major<<=5;
+	if (v<24) {
+		put8(out, major | (uint8_t)v);
+	} else if (v<=0xff) {
+		put8(out, major | 24);
+		put8(out, (uint8_t)v);
+	} else if (v<=0xffff) {
+		put8(out, major | 25);
+		put16(out, (uint16_t)v);
+	} else if (v<=0xffffffffULL) {
+		put8(out, major | 26);
+		put32(out, (uint32_t)v);
+	} else {
+		put8(out, major | 27);
+		put64(out, v);
+	}
+}
+
+void cborEncode(const json_t* j, std::string& out) {
+	if (!j) {
+		put8(out, 0xf6);
+		return;
+	}
+	switch (json_typeof(j)) {
+		case JSON_OBJECT:
+			cborHead(out, 5, json_object_size(j));
+			for (auto p : getJsonKeyValuePairs(j)) {
+				size_t n=strlen(p.first);
+				cborHead(out, 3, n);
+				out.append(p.first, n);
+				cborEncode(p.second, out);
+			}
+			break;
+		case JSON_ARRAY:
+			cborHead(out, 4, json_array_size(j));
+			for (auto e : getJsonArrayElements(j)) cborEncode(e, out);
+			break;
+		case JSON_STRING: {
+			size_t n=json_string_length(j);
+			cborHead(out, 3, n);
+			out.append(json_string_value(j), n);
+			break;
+		}
+		case JSON_INTEGER: {
+			json_int_t v=json_integer_value(j);
+			if (v>=0) cborHead(out, 0, (uint64_t)v);
+			else cborHead(out, 1, (uint64_t)(-(v+1)));
+			break;
+		}
+		case JSON_REAL: {
+			double v=json_real_value(j);
+			float f;
+			if (exactFloat(v, f)) {
+				put8(out, 0xfa);
+				put32(out, floatBits(f));
+			} else {
+				put8(out, 0xfb);
+				put64(out, doubleBits(v));
+			}
+			break;
+		}
+		case JSON_TRUE: put8(out, 0xf5); break;
+		case JSON_FALSE: put8(out, 0xf4); break;
+		case JSON_NULL: put8(out, 0xf6); break;
+		default:
+			throw std::runtime_error("Unknown json element type: "+std::to_string(j->type));
+	}
+}
+
+double halfToDouble(uint16_t h) {
+	int e=(h>>10) & 0x1f;
+	int m=h & 0x3ff;
+	double v;
+	if (e==0) v=ldexp(m, -24);
+	else if (e!=31) v=ldexp(m+1024, e-25);
+	else v= m==0 ? HUGE_VAL : NAN;
+	return (h & 0x8000) ? -v : v;
+}
+
+const uint64_t INDEFINITE=UINT64_MAX;
+
+uint64_t cborArgument(Reader& r, uint8_t info) {
+	if (info<24) return info;
+	switch (info) {
+		case 24: return r.u8();
+		case 25: return r.u16();
+		case 26: return r.u32();
+		case 27: return r.u64();
+		case 31: return INDEFINITE;
+	}
+	r.fail("invalid additional information "+std::to_string(info));
+}
+
+inline bool cborBreak(Reader& r) {
+	if (r.peek()==0xff) {
+		r.u8();
+		return true;
+	}
+	return false;
+}
+
+void cborText(Reader& r, uint64_t n, std::string& out) {
+	out.clear();
+	if (n!=INDEFINITE) {
+		out.append(r.bytes(n), n);
+		return;
+	}
+	while (!cborBreak(r)) {
+		uint8_t b=r.u8();
+		if ((b>>5)!=3) r.fail("indefinite text string chunk is not a text string");
+		uint64_t len=cborArgument(r, b & 0x1f);
+		if (len==INDEFINITE) r.fail("nested indefinite text string");
+		out.append(r.bytes(len), len);
+	}
+}
+
+json_t* cborDecode(Reader& r) {
+	uint8_t b=r.u8();
+	uint8_t major=b>>5;
+	uint8_t info=b & 0x1f;
+	switch (major) {
+		case 0: return r.integer(cborArgument(r, info), false);
+		case 1: return r.integer(cborArgument(r, info), true);
+		case 2: r.fail("byte strings are not supported");
+		case 3: {
+			uint64_t n=cborArgument(r, info);
+			if (n!=INDEFINITE) return r.string(r.bytes(n), n);
+			std::string s;
+			cborText(r, n, s);
+			return r.string(s.data(), s.size());
+		}
+		case 4: {
+			uint64_t n=cborArgument(r, info);
+			Holder a(json_array());
+			r.enter();
+			for (uint64_t k=0;n==INDEFINITE ? !cborBreak(r) : k<n;++k) {
+				if (json_array_append_new(a.j, cborDecode(r))) r.fail("failed to append to array");
+			}
+			r.leave();
+			return a.release();
+		}
+		case 5: {
+			uint64_t n=cborArgument(r, info);
+			Holder o(json_object());
+			r.enter();
+			std::string key;
+			for (uint64_t k=0;n==INDEFINITE ? !cborBreak(r) : k<n;++k) {
+				uint8_t kb=r.u8();
+				if ((kb>>5)!=3) r.fail("object key is not a text string");
+				cborText(r, cborArgument(r, kb & 0x1f), key);
+				r.set(o.j, key, cborDecode(r));
+			}
+			r.leave();
+			return o.release();
+		}
+		case 6: {
+			cborArgument(r, info);
+			r.enter();
+			json_t* v=cborDecode(r);
+			r.leave();
+			return v;
+		}
+		default:
+			switch (info) {
+				case 20: return json_false();
+				case 21: return json_true();
+				case 22: return json_null();
+				case 25: return r.real(halfToDouble(r.u16()));
+				case 26: return r.real(r.f32());
+				case 27: return r.real(r.f64());
+			}
+			r.fail("unsupported simple value "+std::to_string(info));
+	}
+}
+
+/* MessagePack */
+
+inline void packUnsigned(std::string& out, uint64_t v) {
+	if (v<0x80) {
+		put8(out, (uint8_t)v);
+	} else if (v<=0xff) {
+		put8(out, 0xcc);
+		put8(out, (uint8_t)v);
+	} else if (v<=0xffff) {
+		put8(out, 0xcd);
+		put16(out, (uint16_t)v);
+	} else if (v<=0xffffffffULL) {
+		put8(out, 0xce);
+		put32(out, (uint32_t)v);
+	} else {
+		put8(out, 0xcf);
+		put64(out, v);
+	}
+}
+inline void packSigned(std::string& out, int64_t v) {
+	if (v>=-32) {
+		put8(out, (uint8_t)v);
+	} else if (v>=INT8_MIN) {
+		put8(out, 0xd0);
+		put8(out, (uint8_t)v);
+	} else if (v>=INT16_MIN) {
+		put8(out, 0xd1);
+		put16(out, (uint16_t)v);
+	} else if (v>=INT32_MIN) {
+		put8(out, 0xd2);
+		put32(out, (uint32_t)v);
+	} else {
+		put8(out, 0xd3);
+		put64(out, (uint64_t)v);
+	}
+}
+inline void packHead(std::string& out, size_t n, uint8_t fix, size_t fixMax, uint8_t c8, uint8_t c16, uint8_t c32) {
+	if (n<=fixMax) {
+		put8(out, fix | (uint8_t)n);
+	} else if (c8 && n<=0xff) {
+		put8(out, c8);
+		put8(out, (uint8_t)n);
+	} else if (n<=0xffff) {
+		put8(out, c16);
+		put16(out, (uint16_t)n);
+	} else if (n<=0xffffffffULL) {
+		put8(out, c32);
+		put32(out, (uint32_t)n);
+	} else {
+		throw std::runtime_error("Json value is too large for MessagePack: "+std::to_string(n));
+	}
+}
+inline void packString(std::string& out, const char* s, size_t n) {
+	packHead(out, n, 0xa0, 31, 0xd9, 0xda, 0xdb);
+	out.append(s, n);
+}
+
+void packEncode(const json_t* j, std::string& out) {
+	if (!j) {
+		put8(out, 0xc0);
+		return;
+	}
+	switch (json_typeof(j)) {
+		case JSON_OBJECT:
+			packHead(out, json_object_size(j), 0x80, 15, 0, 0xde, 0xdf);
+			for (auto p : getJsonKeyValuePairs(j)) {
+				packString(out, p.first, strlen(p.first));
+				packEncode(p.second, out);
+			}
+			break;
+		case JSON_ARRAY:
+			packHead(out, json_array_size(j), 0x90, 15, 0, 0xdc, 0xdd);
+			for (auto e : getJsonArrayElements(j)) packEncode(e, out);
+			break;
+		case JSON_STRING:
+			packString(out, json_string_value(j), json_string_length(j));
+			break;
+		case JSON_INTEGER: {
+			json_int_t v=json_integer_value(j);
+			if (v>=0) packUnsigned(out, (uint64_t)v);
+			else packSigned(out, v);
+			break;
+		}
+		case JSON_REAL: {
+			double v=json_real_value(j);
+			float f;
+			if (exactFloat(v, f)) {
+				put8(out, 0xca);
+				put32(out, floatBits(f));
+			} else {
+				put8(out, 0xcb);
+				put64(out, doubleBits(v));
+			}
+			break;
+		}
+		case JSON_TRUE: put8(out, 0xc3); break;
+		case JSON_FALSE: put8(out, 0xc2); break;
+		case JSON_NULL: put8(out, 0xc0); break;
+		default:
+			throw std::runtime_error("Unknown json element type: "+std::to_string(j->type));
+	}
+}
+
+bool packStringLength(Reader& r, uint8_t b, uint64_t& n) {
+	if ((b & 0xe0)==0xa0) n=b & 0x1f;
+	else if (b==0xd9) n=r.u8();
+	else if (b==0xda) n=r.u16();
+	else if (b==0xdb) n=r.u32();
+	else return false;
+	return true;
+}
+
+json_t* packDecode(Reader& r);
+
+json_t* packArray(Reader& r, uint64_t n) {
+	Holder a(json_array());
+	r.enter();
+	for (uint64_t k=0;k<n;++k) {
+		if (json_array_append_new(a.j, packDecode(r))) r.fail("failed to append to array");
+	}
+	r.leave();
+	return a.release();
+}
+
+json_t* packMap(Reader& r, uint64_t n) {
+	Holder o(json_object());
+	r.enter();
+	std::string key;
+	for (uint64_t k=0;k<n;++k) {
+		uint64_t len;
+		if (!packStringLength(r, r.u8(), len)) r.fail("object key is not a string");
+		key.assign(r.bytes(len), len);
+		r.set(o.j, key, packDecode(r));
+	}
+	r.leave();
+	return o.release();
+}
+
+json_t* packDecode(Reader& r) {
+	uint8_t b=r.u8();
+	if (b<0x80) return json_integer(b);
+	if (b>=0xe0) return json_integer((int8_t)b);
+	if ((b & 0xf0)==0x80) return packMap(r, b & 0x0f);
+	if ((b & 0xf0)==0x90) return packArray(r, b & 0x0f);
+	uint64_t n;
+	if (packStringLength(r, b, n)) return r.string(r.bytes(n), n);
+	switch (b) {
+		case 0xc0: return json_null();
+		case 0xc2: return json_false();
+		case 0xc3: return json_true();
+		case 0xca: return r.real(r.f32());
+		case 0xcb: return r.real(r.f64());
+		case 0xcc: return json_integer(r.u8());
+		case 0xcd: return json_integer(r.u16());
+		case 0xce: return json_integer(r.u32());
+		case 0xcf: return r.integer(r.u64(), false);
+		case 0xd0: return json_integer((int8_t)r.u8());
+		case 0xd1: return json_integer((int16_t)r.u16());
+		case 0xd2: return json_integer((int32_t)r.u32());
+		case 0xd3: return json_integer((int64_t)r.u64());
+		case 0xdc: return packArray(r, r.u16());
+		case 0xdd: return packArray(r, r.u32());
+		case 0xde: return packMap(r, r.u16());
+		case 0xdf: return packMap(r, r.u32());
+	}
+	r.fail("unsupported type byte "+std::to_string(b));
+}
+
+}
+
+void toCbor(const json_t* j, std::string& out) {
+	cborEncode(j, out);
+}
+
+jsonptr fromCbor(const char* p, size_t len) {
+	Reader r("cbor", p, len);
+	auto j=own(cborDecode(r));
+	if (!r.atEnd()) r.fail("trailing data");
+	return j;
+}
+
+void toMsgPack(const json_t* j, std::string& out) {
+	packEncode(j, out);
+}
+
+jsonptr fromMsgPack(const char* p, size_t len) {
+	Reader r("msgpack", p, len);
+	auto j=own(packDecode(r));
+	if (!r.atEnd()) r.fail("trailing data");
+	return j;
+}
+
+}
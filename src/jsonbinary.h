@@ -0,0 +1,46 @@
+#ifndef SRC_JSONBINARY_H_
+#define SRC_JSONBINARY_H_
+
+#include <string>
+#include <jsonutils.h>
+
+/*
+ * Binary encodings of json trees: CBOR (RFC 8949) and MessagePack.
+ *
+ * Encoders append to a caller-owned buffer, so one std::string can be reused across messages.
+ * Decoders accept exactly one encoded value and throw std::runtime_error on malformed,
+ * truncated or trailing input. Round trips are lossless: integers stay integers, reals keep
+ * every bit (they are shrunk to single precision only when that is exact), strings may hold
+ * NUL bytes. Byte strings, extension types and non-string map keys have no json equivalent
+ * and are rejected.
+ */
+
+namespace json {
+
+void toCbor(const json_t* j, std::string& out);
+inline void toCbor(const jsonptr& j, std::string& out) {toCbor(j.get(), out);}
+inline std::string toCbor(const json_t* j) {
+	std::string out;
+	toCbor(j, out);
+	return out;
+}
+inline std::string toCbor(const jsonptr& j) {return toCbor(j.get());}
+
+jsonptr fromCbor(const char* p, size_t len);
+inline jsonptr fromCbor(const std::string& s) {return fromCbor(s.data(), s.size());}
+
+void toMsgPack(const json_t* j, std::string& out);
+inline void toMsgPack(const jsonptr& j, std::string& out) {toMsgPack(j.get(), out);}
+inline std::string toMsgPack(const json_t* j) {
+	std::string out;
+	toMsgPack(j, out);
+	return out;
+}
+inline std::string toMsgPack(const jsonptr& j) {return toMsgPack(j.get());}
+
+jsonptr fromMsgPack(const char* p, size_t len);
+inline jsonptr fromMsgPack(const std::string& s) {return fromMsgPack(s.data(), s.size());}
+
+}
+
+#endif /* SRC_JSONBINARY_H_ */
@@ -0,0 +1,92 @@
+#include <jsoncache.h>
+#include <stdexcept>
+
+namespace json {
+
+// sizes of the jansson 2.x node structs plus ~16 bytes of malloc overhead per block
+size_t footprint(const json_t* j) {
+	if (!j) return 0;
+	switch (json_typeof(j)) {
+		case JSON_OBJECT: {
+			size_t n=json_object_size(j), total=80+16*n;
+			const char* k;
+			json_t* v;
+			json_object_foreach((json_t*)j, k, v) total+=72+strlen(k)+footprint(v);
+			return total;
+		}
+		case JSON_ARRAY: {
+			size_t total=56+8*json_array_size(j);
+			for (size_t i=0;i<json_array_size(j);++i) total+=footprint(json_array_get(j, i));
+			return total;
+		}
+		case JSON_STRING: return 64+json_string_length(j);
+		case JSON_INTEGER:
+		case JSON_REAL: return 40;
+		default: return 0;
+	}
+}
+
+ParseCache::ParseCache(size_t budgetBytes, unsigned shardCount) {
+	if (shardCount==0) throw std::runtime_error("ParseCache needs at least one shard");
+	shardBudget=budgetBytes/shardCount;
+	for (unsigned i=0;i<shardCount;++i) shards.emplace_back(new Shard);
+}
+
+jsonptr ParseCache::parse(const char* p, size_t len) {
+	// nothing to cache; json::parse returns an empty pointer for these
+	if (!p || len==0) return jsonptr();
+	Key key{utils::hash128(p, len), len};
+	Shard& s=*shards[key.hash.hi%shards.size()];
+	{
+		std::lock_guard<std::mutex> g(s.lock);
+		auto it=s.map.find(key);
+		if (it!=s.map.end()) {
+			++s.hits;
+			s.lru.splice(s.lru.begin(), s.lru, it->second);
+			return it->second->j;
+		}
+		++s.misses;
+	}
+	// parse outside the lock; a concurrent miss on the same input may parse it twice
+	auto j=json::parse(p, len);
+	size_t bytes=footprint(j.get())+sizeof(Entry)+64;
+	if (bytes>shardBudget) return j;
+	std::lock_guard<std::mutex> g(s.lock);
+	auto it=s.map.find(key);
+	if (it!=s.map.end()) return it->second->j;
+	while (s.bytes+bytes>shardBudget) {
+		auto& victim=s.lru.back();
+		s.bytes-=victim.bytes;
+		s.map.erase(victim.key);
+		s.lru.pop_back();
+		++s.evictions;
+	}
+	s.lru.push_front(Entry{key, j, bytes});
+	s.map.emplace(key, s.lru.begin());
+	s.bytes+=bytes;
+	return j;
+}
+
+ParseCache::Stats ParseCache::stats() const {
+	Stats r{0, 0, 0, 0, 0};
+	for (auto& s : shards) {
+		std::lock_guard<std::mutex> g(s->lock);
+		r.hits+=s->hits;
+		r.misses+=s->misses;
+		r.evictions+=s->evictions;
+		r.entries+=s->map.size();
+		r.bytes+=s->bytes;
+	}
+	return r;
+}
+
+void ParseCache::clear() {
+	for (auto& s : shards) {
+		std::lock_guard<std::mutex> g(s->lock);
+		s->map.clear();
+		s->lru.clear();
+		s->bytes=0;
+	}
+}
+
+}
@@ -0,0 +1,85 @@
+#ifndef SRC_JSONCACHE_H_
+#define SRC_JSONCACHE_H_
+
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <hash.h>
+#include <jsonutils.h>
+
+/*
+ * Bounded cache in front of json::parse for inputs that repeat byte for byte.
+ *
+ *   static json::ParseCache cache(64<<20);
+ *   auto j=cache.parse(body);          // same tree as json::parse(body)
+ *
+ * Inputs are keyed by their 128 bit utils::hash128 and length; the text itself is not
+ * kept. Each of the shards is an LRU list under its own mutex, charged with an estimate
+ * of the tree's heap footprint against budget/shards bytes. Trees larger than a shard's
+ * budget are parsed but not cached.
+ *
+ * A hit hands out the very same tree to every caller, on any thread. jansson reference
+ * counts are atomic, so sharing is safe as long as nobody modifies the tree: treat the
+ * result as read-only and json_deep_copy() it when a mutable copy is needed.
+ */
+
+namespace json {
+
+class ParseCache {
+public:
+	struct Stats {
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t evictions;
+		uint64_t entries;
+		uint64_t bytes;
+		inline double hitRate() const {return hits+misses ? (double)hits/(hits+misses) : 0;}
+	};
+private:
+	struct Key {
+		utils::Hash128 hash;
+		size_t length;
+		inline bool operator==(const Key& o) const {return hash==o.hash && length==o.length;}
+	};
+	struct KeyHash {
+		inline size_t operator()(const Key& k) const {return k.hash.lo;}
+	};
+	struct Entry {
+		Key key;
+		jsonptr j;
+		size_t bytes;
+	};
+	struct Shard {
+		std::mutex lock;
+		std::list<Entry> lru;
+		std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> map;
+		size_t bytes=0;
+		uint64_t hits=0, misses=0, evictions=0;
+	};
+	size_t shardBudget;
+	std::vector<std::unique_ptr<Shard>> shards;
+public:
+	explicit ParseCache(size_t budgetBytes, unsigned shardCount=16);
+	ParseCache(const ParseCache&) = delete;
+	ParseCache& operator=(const ParseCache&) = delete;
+
+	jsonptr parse(const char* p, size_t len);
+	// null and empty strings go straight to json::parse, which handles them differently
+	inline jsonptr parse(const char* p) {return p && *p ? parse(p, strlen(p)) : json::parse(p);}
+	inline jsonptr parse(const std::string& str) {return parse(str.data(), str.size());}
+
+	Stats stats() const;
+	void clear();
+};
+
+// rough heap footprint of a jansson tree
+size_t footprint(const json_t* j);
+
+}
+
+#endif /* SRC_JSONCACHE_H_ */
@@ -0,0 +1,594 @@
+#include <jsoncursor.h>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace json {
+
+namespace {
+
+struct Masks {
+	uint64_t backslash;
+	uint64_t quote;
+	uint64_t whitespace;
+	uint64_t op;
+};
+
+#ifdef __SSE2__
+inline uint64_t eq(__m128i v, char c) {
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+}
+inline void classify(const char* p, Masks& m) {
+	m={0,0,0,0};
+	for (int k=0;k<4;++k) {
+		__m128i v=_mm_loadu_si128((const __m128i*)(p+16*k));
+		int shift=16*k;
+		m.backslash|=eq(v,'\\')<<shift;
+		m.quote|=eq(v,'"')<<shift;
+		m.whitespace|=(eq(v,' ') | eq(v,'\t') | eq(v,'\n') | eq(v,'\r'))<<shift;
+		m.op|=(eq(v,'{') | eq(v,'}') | eq(v,'[') | eq(v,']') | eq(v,':') | eq(v,','))<<shift;
+	}
+}
+#else
+enum {C_BACKSLASH=1, C_QUOTE=2, C_WS=4, C_OP=8};
+struct ClassTable {
+	uint8_t cls[256];
+	ClassTable() {
+		memset(cls, 0, sizeof(cls));
+		cls[(unsigned char)'\\']=C_BACKSLASH;
+		cls[(unsigned char)'"']=C_QUOTE;
+		for (char c : {' ','\t','\n','\r'}) cls[(unsigned char)c]=C_WS;
+		for (char c : {'{','}','[',']',':',','}) cls[(unsigned char)c]=C_OP;
+	}
+};
+const ClassTable classTable;
+inline void classify(const char* p, Masks& m) {
+	m={0,0,0,0};
+	for (int k=0;k<64;++k) {
+		uint8_t c=classTable.cls[(unsigned char)p[k]];
+		if (!c) continue;
+		uint64_t bit=uint64_t(1)<<k;
+		if (c & C_BACKSLASH) m.backslash|=bit;
+		else if (c & C_QUOTE) m.quote|=bit;
+		else if (c & C_WS) m.whitespace|=bit;
+		else m.op|=bit;
+	}
+}
+#endif
+
+// characters preceded by an odd number of backslashes, carrying runs across blocks
+inline uint64_t escapedChars(uint64_t bs, uint64_t& prevOdd) {
+	const uint64_t even=0x5555555555555555ULL;
+	const uint64_t odd=~even;
+	uint64_t startEdges=bs & ~(bs<<1);
+	uint64_t evenStartMask=even ^ prevOdd;
+	uint64_t evenStarts=startEdges & evenStartMask;
+	uint64_t oddStarts=startEdges & ~evenStartMask;
+	uint64_t evenCarries=bs+evenStarts;
+	uint64_t oddCarries;
+	bool overflow=__builtin_add_overflow(bs, oddStarts, &oddCarries);
+	oddCarries|=prevOdd;
+	prevOdd=overflow ? 1 : 0;
+	uint64_t evenCarryEnds=evenCarries & ~bs;
+	uint64_t oddCarryEnds=oddCarries & ~bs;
+	return (evenCarryEnds & odd) | (oddCarryEnds & even);
+}
+
+inline uint64_t prefixXor(uint64_t x) {
+	x^=x<<1;
+	x^=x<<2;
+	x^=x<<4;
+	x^=x<<8;
+	x^=x<<16;
+	x^=x<<32;
+	return x;
+}
+
+inline bool isAtomEnd(char c) {
+	switch (c) {
+		case ' ': case '\t': case '\n': case '\r':
+		case '{': case '}': case '[': case ']': case ':': case ',': case '"':
+			return true;
+	}
+	return false;
+}
+
+[[noreturn]] void invalid(const char* what, size_t pos) {
+	throw std::runtime_error(std::string("Invalid json: ")+what+", position: "+std::to_string(pos));
+}
+
+void appendUtf8(std::string& out, uint32_t cp) {
+	if (cp<0x80) {
+		out+=(char)cp;
+	} else if (cp<0x800) {
+		out+=(char)(0xc0 | (cp>>6));
+		out+=(char)(0x80 | (cp & 0x3f));
+	} else if (cp<0x10000) {
+		out+=(char)(0xe0 | (cp>>12));
+		out+=(char)(0x80 | ((cp>>6) & 0x3f));
+		out+=(char)(0x80 | (cp & 0x3f));
+	} else {
+		out+=(char)(0xf0 | (cp>>18));
+		out+=(char)(0x80 | ((cp>>12) & 0x3f));
+		out+=(char)(0x80 | ((cp>>6) & 0x3f));
+		out+=(char)(0x80 | (cp & 0x3f));
+	}
+}
+
+bool hex4(const char* p, uint32_t& v) {
+	v=0;
+	for (int k=0;k<4;++k) {
+		char c=p[k];
+		v<<=4;
+		if (c>='0' && c<='9') v|=c-'0';
+		else if (c>='a' && c<='f') v|=c-'a'+10;
+		else if (c>='A' && c<='F') v|=c-'A'+10;
+		else return false;
+	}
+	return true;
+}
+
+// decodes the string body [p,end) into out, returns the offset of a bad escape or -1
+ssize_t unescape(const char* p, const char* end, std::string& out) {
+	const char* begin=p;
+	out.clear();
+	out.reserve(end-p);
+	while (p<end) {
+		const char* bs=(const char*)memchr(p, '\\', end-p);
+		const char* stop=bs ? bs : end;
+		for (const char* q=p;q<stop;++q) if ((unsigned char)*q<0x20) return q-begin;
+		out.append(p, stop);
+		if (!bs) break;
+		p=bs+1;
+		if (p>=end) return bs-begin;
+		switch (*p) {
+			case '"': out+='"'; break;
+			case '\\': out+='\\'; break;
+			case '/': out+='/'; break;
+			case 'b': out+='\b'; break;
+			case 'f': out+='\f'; break;
+			case 'n': out+='\n'; break;
+			case 'r': out+='\r'; break;
+			case 't': out+='\t'; break;
+			case 'u': {
+				uint32_t cp;
+				if (end-p<5 || !hex4(p+1, cp)) return bs-begin;
+				p+=4;
+				if (cp>=0xd800 && cp<=0xdbff) {
+					uint32_t lo;
+					if (end-p<7 || p[1]!='\\' || p[2]!='u' || !hex4(p+3, lo) || lo<0xdc00 || lo>0xdfff) return bs-begin;
+					cp=0x10000+((cp-0xd800)<<10)+(lo-0xdc00);
+					p+=6;
+				} else if (cp>=0xdc00 && cp<=0xdfff) {
+					return bs-begin;
+				} else if (cp==0) {
+					return bs-begin;
+				}
+				appendUtf8(out, cp);
+				break;
+			}
+			default:
+				return bs-begin;
+		}
+		++p;
+	}
+	return -1;
+}
+
+bool validNumber(const char* p, const char* end, bool& real) {
+	real=false;
+	if (p<end && *p=='-') ++p;
+	if (p>=end) return false;
+	if (*p=='0') ++p;
+	else if (*p>='1' && *p<='9') while (p<end && *p>='0' && *p<='9') ++p;
+	else return false;
+	if (p<end && *p=='.') {
+		real=true;
+		++p;
+		const char* d=p;
+		while (p<end && *p>='0' && *p<='9') ++p;
+		if (p==d) return false;
+	}
+	if (p<end && (*p=='e' || *p=='E')) {
+		real=true;
+		++p;
+		if (p<end && (*p=='+' || *p=='-')) ++p;
+		const char* d=p;
+		while (p<end && *p>='0' && *p<='9') ++p;
+		if (p==d) return false;
+	}
+	return p==end;
+}
+
+}
+
+std::vector<uint32_t> structuralIndex(const char* buf, size_t len) {
+	if (len>=UINT32_MAX) throw std::runtime_error("Json document is too large for the structural index: "+std::to_string(len));
+	std::vector<uint32_t> index;
+	index.reserve(len/8+16);
+	uint64_t prevOdd=0;
+	uint64_t prevInString=0;
+	uint64_t prevAtom=0;
+	char tail[64];
+	for (size_t off=0;off<len;off+=64) {
+		const char* p=buf+off;
+		if (len-off<64) {
+			memset(tail, ' ', sizeof(tail));
+			memcpy(tail, p, len-off);
+			p=tail;
+		}
+		Masks m;
+		classify(p, m);
+		uint64_t quotes=m.quote & ~escapedChars(m.backslash, prevOdd);
+		uint64_t inString=prefixXor(quotes) ^ prevInString;
+		prevInString=(uint64_t)((int64_t)inString>>63);
+		uint64_t atom=~(m.whitespace | m.op | quotes | inString);
+		uint64_t atomStart=atom & ~((atom<<1) | prevAtom);
+		prevAtom=atom>>63;
+		uint64_t bits=(m.op & ~inString) | (quotes & inString) | atomStart;
+		while (bits) {
+			index.push_back((uint32_t)(off+__builtin_ctzll(bits)));
+			bits&=bits-1;
+		}
+	}
+	if (prevInString) invalid("unterminated string", len);
+	return index;
+}
+
+std::vector<size_t> topLevelSeparators(const char* buf, size_t len) {
+	std::vector<size_t> seps;
+	uint64_t prevOdd=0;
+	uint64_t prevInString=0;
+	int depth=0;
+	bool started=false;
+	bool closed=false;
+	char tail[64];
+	for (size_t off=0;off<len;off+=64) {
+		const char* p=buf+off;
+		if (len-off<64) {
+			memset(tail, ' ', sizeof(tail));
+			memcpy(tail, p, len-off);
+			p=tail;
+		}
+		Masks m;
+		classify(p, m);
+		uint64_t quotes=m.quote & ~escapedChars(m.backslash, prevOdd);
+		uint64_t inString=prefixXor(quotes) ^ prevInString;
+		prevInString=(uint64_t)((int64_t)inString>>63);
+		uint64_t outside=~(inString | quotes);
+		if (closed) {
+			uint64_t rest=~m.whitespace;
+			if (rest) invalid("unexpected data after the top level array", off+__builtin_ctzll(rest));
+			continue;
+		}
+		if (!started) {
+			uint64_t first=~m.whitespace;
+			if (!first) continue;
+			if (p[__builtin_ctzll(first)]!='[') invalid("top level value is not an array", off+__builtin_ctzll(first));
+			started=true;
+		}
+		for (uint64_t bits=m.op & outside;bits;bits&=bits-1) {
+			int k=__builtin_ctzll(bits);
+			switch (p[k]) {
+				case '[': case '{':
+					if (depth++==0) seps.push_back(off+k);
+					break;
+				case ']': case '}':
+					if (--depth==0) {
+						if (p[k]!=']') invalid("unbalanced bracket", off+k);
+						seps.push_back(off+k);
+						closed=true;
+						uint64_t rest=~m.whitespace & ~((uint64_t(2)<<k)-1);
+						if (rest) invalid("unexpected data after the top level array", off+__builtin_ctzll(rest));
+						bits=1;
+					} else if (depth<0) {
+						invalid("unbalanced bracket", off+k);
+					}
+					break;
+				case ',':
+					if (depth==1) seps.push_back(off+k);
+					break;
+			}
+		}
+	}
+	if (prevInString) invalid("unterminated string", len);
+	if (!started) invalid("empty document", len);
+	if (!closed) invalid("unterminated array", len);
+	return seps;
+}
+
+Document::Document(const char* p, size_t l) : buf(p), len(l) {
+	build();
+}
+Document::Document(std::string&& s) : owned(std::move(s)), buf(owned.data()), len(owned.size()) {
+	build();
+}
+
+void Document::build() {
+	index=structuralIndex(buf, len);
+	if (index.empty()) invalid("empty document", len);
+	match.assign(index.size(), 0);
+	std::vector<uint32_t> stack;
+	for (uint32_t k=0;k<index.size();++k) {
+		char c=buf[index[k]];
+		if (c=='{' || c=='[') {
+			stack.push_back(k);
+		} else if (c=='}' || c==']') {
+			if (stack.empty()) invalid("unbalanced bracket", index[k]);
+			uint32_t open=stack.back();
+			stack.pop_back();
+			if ((buf[index[open]]=='{') != (c=='}')) invalid("mismatched bracket", index[k]);
+			match[open]=k;
+		}
+	}
+	if (!stack.empty()) invalid("unclosed bracket", index[stack.back()]);
+	root().checkValue();
+	if (root().next()!=index.size()) invalid("garbage after the root value", index[root().next()]);
+}
+
+Cursor Document::root() const {
+	return Cursor(this, 0);
+}
+
+void Cursor::fail(const char* what, uint32_t at) const {
+	invalid(what, at<doc->index.size() ? doc->index[at] : doc->len);
+}
+
+void Cursor::checkValue() const {
+	switch (lead()) {
+		case ',': case ':': case '}': case ']':
+			fail("value expected", i);
+	}
+}
+
+uint32_t Cursor::next() const {
+	char c=lead();
+	if (c=='{' || c=='[') return doc->match[i]+1;
+	return i+1;
+}
+
+json_type Cursor::type() const {
+	switch (lead()) {
+		case '{': return JSON_OBJECT;
+		case '[': return JSON_ARRAY;
+		case '"': return JSON_STRING;
+		case 't':
+		case 'f': return boolean() ? JSON_TRUE : JSON_FALSE;
+		case 'n':
+			if (raw()!="null") fail("invalid literal", i);
+			return JSON_NULL;
+		default:
+			if (!isNumber()) fail("invalid literal", i);
+			return isReal() ? JSON_REAL : JSON_INTEGER;
+	}
+}
+
+size_t Cursor::stringEnd(bool& escaped) const {
+	const char* b=doc->buf;
+	size_t p=doc->index[i]+1;
+	escaped=false;
+	for (;;) {
+		const char* q=(const char*)memchr(b+p, '"', doc->len-p);
+		if (!q) fail("unterminated string", i);
+		size_t qp=q-b;
+		size_t n=0;
+		while (qp-n>p && b[qp-n-1]=='\\') ++n;
+		if (n>0) escaped=true;
+		if ((n&1)==0) {
+			if (!escaped && memchr(b+p, '\\', qp-p)) escaped=true;
+			return qp;
+		}
+		p=qp+1;
+	}
+}
+
+uint32_t Cursor::valueEnd() const {
+	char c=lead();
+	if (c=='{' || c=='[') return doc->index[doc->match[i]]+1;
+	if (c=='"') {
+		bool escaped;
+		return stringEnd(escaped)+1;
+	}
+	size_t p=doc->index[i];
+	while (p<doc->len && !isAtomEnd(doc->buf[p])) ++p;
+	return p;
+}
+
+std::string_view Cursor::raw() const {
+	if (!*this) return std::string_view();
+	size_t start=doc->index[i];
+	return std::string_view(doc->buf+start, valueEnd()-start);
+}
+
+bool Cursor::isInteger() const {
+	if (!isNumber()) return false;
+	auto r=raw();
+	bool real;
+	if (!validNumber(r.data(), r.data()+r.size(), real)) fail("invalid number", i);
+	return !real;
+}
+bool Cursor::isReal() const {
+	if (!isNumber()) return false;
+	auto r=raw();
+	bool real;
+	if (!validNumber(r.data(), r.data()+r.size(), real)) fail("invalid number", i);
+	return real;
+}
+
+Cursor Cursor::find(const char* key, size_t keyLen) const {
+	if (!isObject()) return Cursor();
+	const auto& index=doc->index;
+	const char* b=doc->buf;
+	uint32_t k=i+1;
+	if (b[index[k]]=='}') return Cursor();
+	std::string scratch;
+	for (;;) {
+		if (b[index[k]]!='"') fail("object key expected", k);
+		if (b[index[k+1]]!=':') fail("':' expected", k+1);
+		Cursor keyCursor(doc, k);
+		bool escaped;
+		size_t end=keyCursor.stringEnd(escaped);
+		size_t start=index[k]+1;
+		bool same;
+		if (!escaped) {
+			same= end-start==keyLen && memcmp(b+start, key, keyLen)==0;
+		} else {
+			if (unescape(b+start, b+end, scratch)>=0) fail("invalid string escape", k);
+			same= scratch.size()==keyLen && memcmp(scratch.data(), key, keyLen)==0;
+		}
+		Cursor value(doc, k+2);
+		value.checkValue();
+		if (same) return value;
+		k=value.next();
+		char c=b[index[k]];
+		if (c=='}') return Cursor();
+		if (c!=',') fail("',' or '}' expected", k);
+		++k;
+	}
+}
+
+Cursor Cursor::at(size_t n) const {
+	if (!isArray()) return Cursor();
+	for (auto e : elements()) {
+		if (n==0) return e;
+		--n;
+	}
+	return Cursor();
+}
+
+size_t Cursor::size() const {
+	size_t n=0;
+	if (isArray()) {
+		for (auto e : elements()) {
+			(void)e;
+			++n;
+		}
+	} else if (isObject()) {
+		auto p=pairs();
+		for (auto it=p.begin(), end=p.end();it!=end;++it) ++n;
+	}
+	return n;
+}
+
+bool Cursor::string(std::string& out) const {
+	if (!isString()) return false;
+	bool escaped;
+	size_t end=stringEnd(escaped);
+	size_t start=doc->index[i]+1;
+	ssize_t bad=unescape(doc->buf+start, doc->buf+end, out);
+	if (bad>=0) invalid("invalid string", start+bad);
+	return true;
+}
+std::string Cursor::string() const {
+	std::string s;
+	if (!string(s)) throw std::runtime_error("Json value at position "+std::to_string(*this ? doc->index[i] : 0)+" is not a string");
+	return s;
+}
+
+long long Cursor::integer() const {
+	if (!isInteger()) throw std::runtime_error("Json value at position "+std::to_string(*this ? doc->index[i] : 0)+" is not an integer");
+	auto r=raw();
+	long long v=0;
+	auto res=std::from_chars(r.data(), r.data()+r.size(), v);
+	if (res.ec!=std::errc()) fail("too big integer", i);
+	return v;
+}
+
+double Cursor::number() const {
+	if (!isNumber()) throw std::runtime_error("Json value at position "+std::to_string(*this ? doc->index[i] : 0)+" is not a number");
+	auto r=raw();
+	bool real;
+	if (!validNumber(r.data(), r.data()+r.size(), real)) fail("invalid number", i);
+	double v=0;
+	if (!real) {
+		long long l=0;
+		auto res=std::from_chars(r.data(), r.data()+r.size(), l);
+		if (res.ec!=std::errc()) fail("too big integer", i);
+		return (double)l;
+	}
+	auto res=std::from_chars(r.data(), r.data()+r.size(), v);
+	if (res.ec!=std::errc()) fail("real number overflow", i);
+	return v;
+}
+
+bool Cursor::boolean() const {
+	auto r=raw();
+	if (r=="true") return true;
+	if (r=="false") return false;
+	if (!isBool()) throw std::runtime_error("Json value at position "+std::to_string(*this ? doc->index[i] : 0)+" is not a boolean");
+	fail("invalid literal", i);
+}
+
+jsonptr Cursor::materialize() const {
+	if (!*this) return jsonptr();
+	auto r=raw();
+	return parse(r.data(), r.size());
+}
+
+void CursorArrayIterator::operator++() {
+	uint32_t k=Cursor(doc, i).next();
+	char c=doc->buf[doc->index[k]];
+	if (c==']') {
+		i=Cursor::npos;
+	} else if (c==',') {
+		i=k+1;
+		Cursor(doc, i).checkValue();
+	} else {
+		Cursor(doc, k).fail("',' or ']' expected", k);
+	}
+}
+
+CursorArrayIterator CursorArrayElements::begin() const {
+	if (!c.isArray()) return end();
+	uint32_t k=c.i+1;
+	if (c.doc->buf[c.doc->index[k]]==']') return end();
+	Cursor(c.doc, k).checkValue();
+	return CursorArrayIterator(c.doc, k);
+}
+
+std::pair<std::string_view, Cursor> CursorKeyValueIterator::operator *() {
+	Cursor keyCursor(doc, i);
+	bool escaped;
+	size_t end=keyCursor.stringEnd(escaped);
+	size_t start=doc->index[i]+1;
+	std::string_view key(doc->buf+start, end-start);
+	if (escaped) {
+		if (unescape(doc->buf+start, doc->buf+end, scratch)>=0) keyCursor.fail("invalid string escape", i);
+		key=scratch;
+	}
+	return std::make_pair(key, Cursor(doc, i+2));
+}
+
+void CursorKeyValueIterator::check() const {
+	Cursor keyCursor(doc, i);
+	if (doc->buf[doc->index[i]]!='"') keyCursor.fail("object key expected", i);
+	if (doc->buf[doc->index[i+1]]!=':') keyCursor.fail("':' expected", i+1);
+	Cursor(doc, i+2).checkValue();
+}
+
+void CursorKeyValueIterator::operator++() {
+	uint32_t k=Cursor(doc, i+2).next();
+	char c=doc->buf[doc->index[k]];
+	if (c=='}') {
+		i=Cursor::npos;
+	} else if (c==',') {
+		i=k+1;
+		check();
+	} else {
+		Cursor(doc, k).fail("',' or '}' expected", k);
+	}
+}
+
+CursorKeyValueIterator CursorKeyValuePairs::begin() const {
+	if (!c.isObject()) return end();
+	uint32_t k=c.i+1;
+	if (c.doc->buf[c.doc->index[k]]=='}') return end();
+	CursorKeyValueIterator it(c.doc, k);
+	it.check();
+	return it;
+}
+
+}
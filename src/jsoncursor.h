@@ -0,0 +1,226 @@
+#ifndef SRC_JSONCURSOR_H_
+#define SRC_JSONCURSOR_H_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <jsonutils.h>
+
+/*
+ * Lazy, on-demand access to a JSON text.
+ *
+ * Document runs a single vectorized pass over the input that records the positions of
+ * structural characters, string starts and scalar starts, and pairs up brackets. A Cursor
+ * is a position in that index: navigating skips whole containers in O(1) and a value is
+ * only decoded (or checked) when it is actually read.
+ *
+ *   json::Document doc(text);
+ *   long long id=json::getLong(doc.root(), "user", "id");
+ *   json::jsonptr tags=json::getChildPtr(doc.root(), "user", "tags");  // materialized with jansson
+ *
+ * The document references the input buffer, which must outlive it (unless constructed from
+ * an rvalue string). Only bracket structure is validated up front, everything else is
+ * validated when visited; invalid input reached through a cursor throws std::runtime_error.
+ */
+
+namespace json {
+
+class Cursor;
+class CursorArrayElements;
+class CursorKeyValuePairs;
+
+std::vector<uint32_t> structuralIndex(const char* p, size_t len);
+// positions of the opening '[' of a top level array, of its own commas and of its closing ']'
+std::vector<size_t> topLevelSeparators(const char* p, size_t len);
+
+class Document {
+	std::string owned;
+	const char* buf;
+	size_t len;
+	std::vector<uint32_t> index;
+	std::vector<uint32_t> match;
+	void build();
+	friend class Cursor;
+	friend class CursorArrayIterator;
+	friend class CursorArrayElements;
+	friend class CursorKeyValueIterator;
+	friend class CursorKeyValuePairs;
+public:
+	Document(const char* p, size_t len);
+	explicit Document(const std::string& s) : Document(s.data(), s.size()) {}
+	explicit Document(std::string&& s);
+	Document(const Document&) = delete;
+	Document(Document&&) = delete;
+	Document& operator=(const Document&) = delete;
+	Document& operator=(Document&&) = delete;
+
+	Cursor root() const;
+	inline const char* data() const {return buf;}
+	inline size_t length() const {return len;}
+	inline size_t structurals() const {return index.size();}
+};
+
+class Cursor {
+	const Document* doc;
+	uint32_t i;
+	friend class Document;
+	friend class CursorArrayIterator;
+	friend class CursorArrayElements;
+	friend class CursorKeyValueIterator;
+	friend class CursorKeyValuePairs;
+	inline char lead() const {return doc->buf[doc->index[i]];}
+	uint32_t next() const;
+	uint32_t valueEnd() const;
+	size_t stringEnd(bool& escaped) const;
+	void checkValue() const;
+	[[noreturn]] void fail(const char* what, uint32_t at) const;
+public:
+	static const uint32_t npos=UINT32_MAX;
+	inline Cursor() : doc(nullptr), i(npos) {}
+	inline Cursor(const Document* d, uint32_t idx) : doc(d), i(idx) {}
+	inline explicit operator bool() const {return doc && i!=npos;}
+
+	json_type type() const;
+	inline bool isObject() const {return *this && lead()=='{';}
+	inline bool isArray() const {return *this && lead()=='[';}
+	inline bool isString() const {return *this && lead()=='"';}
+	inline bool isBool() const {return *this && (lead()=='t' || lead()=='f');}
+	inline bool isNull() const {return *this && lead()=='n';}
+	inline bool isNumber() const {return *this && (lead()=='-' || (lead()>='0' && lead()<='9'));}
+	bool isInteger() const;
+	bool isReal() const;
+
+	Cursor find(const char* key, size_t keyLen) const;
+	inline Cursor find(const char* key) const {return find(key, strlen(key));}
+	inline Cursor find(const std::string& key) const {return find(key.data(), key.size());}
+	Cursor at(size_t n) const;
+	size_t size() const;
+
+	bool string(std::string& out) const;
+	std::string string() const;
+	long long integer() const;
+	double number() const;
+	bool boolean() const;
+	std::string_view raw() const;
+	jsonptr materialize() const;
+
+	CursorArrayElements elements() const;
+	CursorKeyValuePairs pairs() const;
+};
+
+class CursorArrayIterator {
+	const Document* doc;
+	uint32_t i;
+public:
+	explicit CursorArrayIterator(const Document* d, uint32_t idx) : doc(d), i(idx) {}
+	inline bool operator ==(CursorArrayIterator rhs) const {return i==rhs.i;}
+	inline bool operator !=(CursorArrayIterator rhs) const {return i!=rhs.i;}
+	inline Cursor operator *() const {return Cursor(doc, i);}
+	void operator++();
+};
+class CursorArrayElements {
+	Cursor c;
+public:
+	explicit CursorArrayElements(const Cursor& p) : c(p) {}
+	CursorArrayIterator begin() const;
+	CursorArrayIterator end() const {return CursorArrayIterator(nullptr, Cursor::npos);}
+};
+
+class CursorKeyValueIterator {
+	const Document* doc;
+	uint32_t i;
+	std::string scratch;
+	void check() const;
+	friend class CursorKeyValuePairs;
+public:
+	explicit CursorKeyValueIterator(const Document* d, uint32_t idx) : doc(d), i(idx) {}
+	inline bool operator !=(const CursorKeyValueIterator& rhs) const {return i!=rhs.i;}
+	// the key view stays valid until the iterator is advanced
+	std::pair<std::string_view, Cursor> operator *();
+	void operator++();
+};
+class CursorKeyValuePairs {
+	Cursor c;
+public:
+	explicit CursorKeyValuePairs(const Cursor& p) : c(p) {}
+	CursorKeyValueIterator begin() const;
+	CursorKeyValueIterator end() const {return CursorKeyValueIterator(nullptr, Cursor::npos);}
+};
+
+inline CursorArrayElements Cursor::elements() const {return CursorArrayElements(*this);}
+inline CursorKeyValuePairs Cursor::pairs() const {return CursorKeyValuePairs(*this);}
+
+inline Cursor getChild(const Cursor& c) {return c;}
+template<typename...REST> Cursor getChild(const Cursor& c, const char* first, REST... rest) {
+	if (!c.isObject()) return Cursor();
+	return getChild(c.find(first), rest...);
+}
+template<typename...REST> bool hasChild(const Cursor& c, REST... rest) {
+	return (bool)getChild(c, rest...);
+}
+template<typename...REST> jsonptr getChildPtr(const Cursor& c, REST... rest) {
+	auto v=getChild(c, rest...);
+	return v ? v.materialize() : jsonptr();
+}
+
+template<typename...REST> bool hasString(const Cursor& c, REST... rest) {
+	return getChild(c, rest...).isString();
+}
+template<typename...REST> std::string getString(const Cursor& c, REST... rest) {
+	auto v=getChild(c, rest...);
+	return v.isString() ? v.string() : std::string();
+}
+template<typename...REST> std::string getString(const char* fallback, const Cursor& c, REST... rest) {
+	auto v=getChild(c, rest...);
+	return v.isString() ? v.string() : std::string(fallback ? fallback : "");
+}
+
+template<typename...REST> bool hasLong(const Cursor& c, REST... rest) {
+	return getChild(c, rest...).isInteger();
+}
+template<typename...REST> long long getLong(const Cursor& c, REST... rest) {
+	auto v=getChild(c, rest...);
+	return v.isInteger() ? v.integer() : 0;
+}
+template<typename...REST> long long getLong(long long fallback, const Cursor& c, REST... rest) {
+	auto v=getChild(c, rest...);
+	return v.isInteger() ? v.integer() : fallback;
+}
+
+template<typename...REST> bool hasBool(const Cursor& c, REST... rest) {
+	return getChild(c, rest...).isBool();
+}
+template<typename...REST> bool getBool(const Cursor& c, REST... rest) {
+	auto v=getChild(c, rest...);
+	return v.isBool() ? v.boolean() : false;
+}
+template<typename...REST> bool getBool(bool fallback, const Cursor& c, REST... rest) {
+	auto v=getChild(c, rest...);
+	return v.isBool() ? v.boolean() : fallback;
+}
+
+template<typename...REST> bool hasNumber(const Cursor& c, REST... rest) {
+	return getChild(c, rest...).isNumber();
+}
+template<typename...REST> double getNumber(const Cursor& c, REST... rest) {
+	auto v=getChild(c, rest...);
+	return v.isNumber() ? v.number() : 0;
+}
+template<typename...REST> double getNumber(double fallback, const Cursor& c, REST... rest) {
+	auto v=getChild(c, rest...);
+	return v.isNumber() ? v.number() : fallback;
+}
+
+template<typename...REST> CursorArrayElements getJsonArrayElements(const Cursor& c, REST... rest) {
+	return getChild(c, rest...).elements();
+}
+template<typename...REST> CursorKeyValuePairs getJsonKeyValuePairs(const Cursor& c, REST... rest) {
+	return getChild(c, rest...).pairs();
+}
+
+}
+
+#endif /* SRC_JSONCURSOR_H_ */
@@ -0,0 +1,320 @@
+#include <jsonindex.h>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string_view>
+#include <executor.h>
+
+namespace json {
+
+namespace {
+
+const uint8_t ABSENT=0xff;
+
+inline uint64_t mix(uint64_t x) {
+	x^=x>>30;
+	x*=0xbf58476d1ce4e5b9ULL;
+	x^=x>>27;
+	x*=0x94d049bb133111ebULL;
+	x^=x>>31;
+	return x;
+}
+
+ArrayIndex::Key keyOf(const json_t* v) {
+	ArrayIndex::Key k;
+	k.type=ABSENT;
+	k.length=0;
+	k.integer=0;
+	if (!v) return k;
+	switch (json_typeof(v)) {
+		case JSON_STRING:
+			k.string=json_string_value(v);
+			k.length=json_string_length(v);
+			break;
+		case JSON_INTEGER:
+			k.integer=json_integer_value(v);
+			break;
+		case JSON_REAL:
+			k.real=json_real_value(v);
+			if (k.real==0) k.real=0;
+			break;
+		case JSON_TRUE:
+		case JSON_FALSE:
+		case JSON_NULL:
+			break;
+		default:
+			return k;
+	}
+	k.type=json_typeof(v);
+	return k;
+}
+
+uint64_t hashOf(const ArrayIndex::Key& k) {
+	switch (k.type) {
+		case JSON_STRING: return mix(std::hash<std::string_view>()(std::string_view(k.string, k.length)) ^ 0x5f3759df);
+		case JSON_INTEGER: return mix((uint64_t)k.integer);
+		case JSON_REAL: {
+			uint64_t b;
+			memcpy(&b, &k.real, sizeof(b));
+			return mix(b ^ 0x9e3779b97f4a7c15ULL);
+		}
+		default: return mix(k.type+0x100);
+	}
+}
+
+bool equal(const ArrayIndex::Key& a, const ArrayIndex::Key& b) {
+	if (a.type!=b.type) return false;
+	switch (a.type) {
+		case JSON_STRING: return a.length==b.length && memcmp(a.string, b.string, a.length)==0;
+		case JSON_INTEGER: return a.integer==b.integer;
+		case JSON_REAL: return a.real==b.real;
+		default: return true;
+	}
+}
+
+int rank(uint8_t type) {
+	switch (type) {
+		case JSON_NULL: return 0;
+		case JSON_FALSE: return 1;
+		case JSON_TRUE: return 2;
+		case JSON_INTEGER:
+		case JSON_REAL: return 3;
+		default: return 4;
+	}
+}
+
+int compare(const ArrayIndex::Key& a, const ArrayIndex::Key& b) {
+	int ra=rank(a.type), rb=rank(b.type);
+	if (ra!=rb) return ra<rb ? -1 : 1;
+	if (ra==3) {
+		if (a.type==JSON_INTEGER && b.type==JSON_INTEGER) return a.integer<b.integer ? -1 : (a.integer>b.integer ? 1 : 0);
+		double x=a.type==JSON_INTEGER ? (double)a.integer : a.real;
+		double y=b.type==JSON_INTEGER ? (double)b.integer : b.real;
+		return x<y ? -1 : (x>y ? 1 : 0);
+	}
+	if (ra==4) {
+		int c=memcmp(a.string, b.string, std::min(a.length, b.length));
+		if (c) return c<0 ? -1 : 1;
+		return a.length<b.length ? -1 : (a.length>b.length ? 1 : 0);
+	}
+	return 0;
+}
+
+const json_t* resolve(const json_t* e, const ArrayIndex::Path& path) {
+	for (auto& segment : path) {
+		if (!e) return nullptr;
+		e=json_object_get(e, segment.c_str());
+	}
+	return e;
+}
+
+template<typename F> void parallel(unsigned workers, F f) {
+	if (workers<2) {
+		f(0u);
+		return;
+	}
+	utils::Executor::shared().parallel_for(0, workers, [&](size_t b, size_t e) {
+		for (size_t w=b;w<e;++w) f((unsigned)w);
+	}, 1);
+}
+
+}
+
+ArrayIndex::ArrayIndex(const jsonptr& a, std::vector<Path> p, bool sorted, unsigned t)
+		: array(a), paths(std::move(p)), withSorted(sorted), threads(t), built(false), shardBits(0) {
+	if (!json_is_array(array.get())) throw std::runtime_error("ArrayIndex requires a json array");
+	if (paths.empty()) throw std::runtime_error("ArrayIndex requires at least one key path");
+	if (threads==0) threads=utils::Executor::shared().size()+1;
+	rebuild();
+}
+
+void ArrayIndex::invalidate() {
+	built=false;
+	tables.clear();
+}
+
+void ArrayIndex::rebuild() {
+	invalidate();
+	const json_t* a=array.get();
+	size_t n=json_array_size(a);
+	if (n>=UINT32_MAX) throw std::runtime_error("ArrayIndex supports up to 2^32-1 elements, got "+std::to_string(n));
+	unsigned workers=n>=parallelThreshold ? std::min<size_t>(threads, n/1024) : 1;
+	if (workers<1) workers=1;
+	shardBits=0;
+	while ((1u<<shardBits)<workers*4 && workers>1) ++shardBits;
+	size_t shards=size_t(1)<<shardBits;
+
+	tables.resize(paths.size());
+	for (auto& t : tables) {
+		t.keys.resize(n);
+		t.hashes.resize(n);
+		t.shards.resize(shards);
+	}
+
+	// extract keys and hashes, bucketing element numbers by shard for every worker
+	std::vector<std::vector<std::vector<uint32_t>>> lists(workers, std::vector<std::vector<uint32_t>>(paths.size()*shards));
+	size_t chunk=(n+workers-1)/workers;
+	parallel(workers, [&](unsigned w) {
+		size_t lo=std::min(n, w*chunk), hi=std::min(n, lo+chunk);
+		auto& mine=lists[w];
+		for (size_t i=lo;i<hi;++i) {
+			const json_t* e=json_array_get(a, i);
+			for (size_t p=0;p<paths.size();++p) {
+				Table& t=tables[p];
+				Key k=keyOf(resolve(e, paths[p]));
+				t.keys[i]=k;
+				if (k.type==ABSENT) continue;
+				uint64_t h=hashOf(k);
+				t.hashes[i]=h;
+				mine[p*shards+(shardBits ? h>>(64-shardBits) : 0)].push_back((uint32_t)i);
+			}
+		}
+	});
+
+	// fill the open addressing shards; workers own disjoint shards
+	parallel(workers, [&](unsigned w) {
+		for (size_t s=w;s<shards;s+=workers) {
+			for (size_t p=0;p<paths.size();++p) {
+				Table& t=tables[p];
+				size_t count=0;
+				for (auto& l : lists) count+=l[p*shards+s].size();
+				size_t capacity=8;
+				while (capacity<count*2) capacity<<=1;
+				auto& buckets=t.shards[s];
+				buckets.assign(capacity, Bucket{0, 0});
+				size_t mask=capacity-1;
+				for (auto& l : lists) {
+					for (uint32_t i : l[p*shards+s]) {
+						uint64_t h=t.hashes[i];
+						size_t pos=h & mask;
+						while (buckets[pos].element) pos=(pos+1) & mask;
+						buckets[pos]=Bucket{h, i+1};
+					}
+				}
+			}
+		}
+	});
+
+	if (withSorted) {
+		for (auto& t : tables) {
+			for (auto& l : lists) {
+				for (size_t s=0;s<shards;++s) {
+					size_t p=&t-&tables[0];
+					t.sorted.insert(t.sorted.end(), l[p*shards+s].begin(), l[p*shards+s].end());
+				}
+			}
+			auto less=[&t](uint32_t x, uint32_t y) {
+				int c=compare(t.keys[x], t.keys[y]);
+				return c ? c<0 : x<y;
+			};
+			// sort chunks in parallel, then merge them pairwise
+			size_t m=t.sorted.size();
+			unsigned parts=m>=parallelThreshold ? workers : 1;
+			size_t part=(m+parts-1)/parts;
+			parallel(parts, [&](unsigned w) {
+				size_t lo=std::min(m, w*part), hi=std::min(m, lo+part);
+				std::sort(t.sorted.begin()+lo, t.sorted.begin()+hi, less);
+			});
+			for (size_t width=part;width<m;width*=2) {
+				for (size_t lo=0;lo+width<m;lo+=2*width) {
+					std::inplace_merge(t.sorted.begin()+lo, t.sorted.begin()+lo+width, t.sorted.begin()+std::min(m, lo+2*width), less);
+				}
+			}
+		}
+	}
+	built=true;
+}
+
+const ArrayIndex::Table& ArrayIndex::table(size_t path) const {
+	if (!built) throw std::runtime_error("ArrayIndex is invalidated, rebuild it first");
+	if (path>=tables.size()) throw std::runtime_error("ArrayIndex has no key path "+std::to_string(path));
+	return tables[path];
+}
+
+void ArrayIndex::lookup(size_t path, const Key& k, std::vector<json_t*>* all, json_t** first) const {
+	const Table& t=table(path);
+	if (k.type==ABSENT) return;
+	uint64_t h=hashOf(k);
+	auto& buckets=t.shards[shardBits ? h>>(64-shardBits) : 0];
+	size_t mask=buckets.size()-1;
+	for (size_t pos=h & mask;buckets[pos].element;pos=(pos+1) & mask) {
+		const Bucket& b=buckets[pos];
+		if (b.hash!=h || !equal(t.keys[b.element-1], k)) continue;
+		json_t* e=json_array_get(array.get(), b.element-1);
+		if (first) {
+			*first=e;
+			return;
+		}
+		all->push_back(e);
+	}
+}
+
+json_t* ArrayIndex::find(size_t path, const json_t* v) const {
+	json_t* e=nullptr;
+	lookup(path, keyOf(v), nullptr, &e);
+	return e;
+}
+
+json_t* ArrayIndex::find(size_t path, const char* v) const {
+	Key k=keyOf(nullptr);
+	if (v) {
+		k.type=JSON_STRING;
+		k.string=v;
+		k.length=strlen(v);
+	}
+	json_t* e=nullptr;
+	lookup(path, k, nullptr, &e);
+	return e;
+}
+
+json_t* ArrayIndex::find(size_t path, long long v) const {
+	Key k=keyOf(nullptr);
+	k.type=JSON_INTEGER;
+	k.integer=v;
+	json_t* e=nullptr;
+	lookup(path, k, nullptr, &e);
+	return e;
+}
+
+std::vector<json_t*> ArrayIndex::findAll(size_t path, const json_t* v) const {
+	std::vector<json_t*> r;
+	lookup(path, keyOf(v), &r, nullptr);
+	return r;
+}
+
+std::vector<json_t*> ArrayIndex::findAll(size_t path, const char* v) const {
+	std::vector<json_t*> r;
+	if (!v) return r;
+	Key k=keyOf(nullptr);
+	k.type=JSON_STRING;
+	k.string=v;
+	k.length=strlen(v);
+	lookup(path, k, &r, nullptr);
+	return r;
+}
+
+std::vector<json_t*> ArrayIndex::findAll(size_t path, long long v) const {
+	std::vector<json_t*> r;
+	Key k=keyOf(nullptr);
+	k.type=JSON_INTEGER;
+	k.integer=v;
+	lookup(path, k, &r, nullptr);
+	return r;
+}
+
+std::vector<json_t*> ArrayIndex::range(size_t path, const json_t* lo, const json_t* hi) const {
+	const Table& t=table(path);
+	if (!withSorted) throw std::runtime_error("ArrayIndex was built without the sorted index");
+	Key klo=keyOf(lo), khi=keyOf(hi);
+	if ((lo && klo.type==ABSENT) || (hi && khi.type==ABSENT)) throw std::runtime_error("ArrayIndex range bounds must be scalars");
+	auto begin=t.sorted.begin(), end=t.sorted.end();
+	if (lo) begin=std::lower_bound(begin, end, klo, [&t](uint32_t e, const Key& k) {return compare(t.keys[e], k)<0;});
+	if (hi) end=std::upper_bound(begin, end, khi, [&t](const Key& k, uint32_t e) {return compare(k, t.keys[e])<0;});
+	std::vector<json_t*> r;
+	r.reserve(end-begin);
+	for (auto it=begin;it!=end;++it) r.push_back(json_array_get(array.get(), *it));
+	return r;
+}
+
+}
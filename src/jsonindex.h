@@ -0,0 +1,96 @@
+#ifndef SRC_JSONINDEX_H_
+#define SRC_JSONINDEX_H_
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <vector>
+#include <jsonutils.h>
+
+/*
+ * Hash index over the elements of a large json array, keyed by the scalar found at one or
+ * more key paths inside each element.
+ *
+ *   json::ArrayIndex idx(users, {{"id"}, {"address", "zip"}}, true);
+ *   json_t* u=idx.find(0, "u-1234");                   // element whose "id" is "u-1234"
+ *   auto near=idx.range(1, json::own(json_integer(10000)), json::own(json_integer(10099)));
+ *
+ * Equality lookups go through an open addressing table per path; with sorted=true a
+ * secondary sorted index answers inclusive range queries. Values compare the way
+ * json_equal does (an integer never equals a real) and ranges order null < false < true
+ * < numbers < strings. Returned elements are borrowed from the indexed array, which the
+ * index keeps alive.
+ *
+ * The index does not track changes to the array: after mutating it call rebuild(), or
+ * invalidate() to make further lookups throw. Large arrays are indexed in parallel.
+ */
+
+namespace json {
+
+class ArrayIndex {
+public:
+	typedef std::vector<std::string> Path;
+	struct Key {
+		uint8_t type;
+		uint32_t length;
+		union {
+			long long integer;
+			double real;
+			const char* string;
+		};
+	};
+private:
+	struct Bucket {
+		uint64_t hash;
+		uint32_t element;
+	};
+	struct Table {
+		std::vector<Key> keys;
+		std::vector<uint64_t> hashes;
+		std::vector<std::vector<Bucket>> shards;
+		std::vector<uint32_t> sorted;
+	};
+	jsonptr array;
+	std::vector<Path> paths;
+	bool withSorted;
+	unsigned threads;
+	bool built;
+	std::vector<Table> tables;
+	int shardBits;
+
+	const Table& table(size_t path) const;
+	void lookup(size_t path, const Key& k, std::vector<json_t*>* all, json_t** first) const;
+public:
+	static const size_t parallelThreshold=1<<16;
+
+	ArrayIndex(const jsonptr& array, std::vector<Path> paths, bool sorted=false, unsigned threads=0);
+	ArrayIndex(const jsonptr& array, std::initializer_list<Path> paths, bool sorted=false, unsigned threads=0)
+		: ArrayIndex(array, std::vector<Path>(paths), sorted, threads) {}
+	ArrayIndex(const ArrayIndex&) = delete;
+	ArrayIndex& operator=(const ArrayIndex&) = delete;
+
+	void rebuild();
+	void invalidate();
+	inline bool valid() const {return built;}
+	inline size_t size() const {return json_array_size(array.get());}
+
+	// first element whose value at paths[path] equals v, nullptr if none
+	json_t* find(size_t path, const json_t* v) const;
+	json_t* find(size_t path, const char* v) const;
+	inline json_t* find(size_t path, const std::string& v) const {return find(path, v.c_str());}
+	json_t* find(size_t path, long long v) const;
+	inline json_t* find(size_t path, int v) const {return find(path, (long long)v);}
+	std::vector<json_t*> findAll(size_t path, const json_t* v) const;
+	std::vector<json_t*> findAll(size_t path, const char* v) const;
+	std::vector<json_t*> findAll(size_t path, long long v) const;
+
+	// elements with lo <= value <= hi in the sorted index; a null bound is open
+	std::vector<json_t*> range(size_t path, const json_t* lo, const json_t* hi) const;
+	inline std::vector<json_t*> range(size_t path, const jsonptr& lo, const jsonptr& hi) const {
+		return range(path, lo.get(), hi.get());
+	}
+};
+
+}
+
+#endif /* SRC_JSONINDEX_H_ */
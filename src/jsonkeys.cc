@@ -0,0 +1,138 @@
+#include <jsonkeys.h>
+#include <hash.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace json {
+
+namespace {
+
+struct Entry {
+	Key key;
+	uint64_t hash;
+};
+
+// open addressing over ids+1, 0 is empty; replaced, never modified, when it fills up
+struct Table {
+	size_t mask;
+	std::unique_ptr<std::atomic<uint32_t>[]> slots;
+	explicit Table(size_t capacity) : mask(capacity-1), slots(new std::atomic<uint32_t>[capacity]) {
+		for (size_t i=0;i<capacity;++i) slots[i].store(0, std::memory_order_relaxed);
+	}
+};
+
+class Dictionary {
+	static const size_t segmentBits=10;
+	static const size_t maxSegments=4096;
+	std::atomic<Entry*> segments[maxSegments];
+	std::atomic<uint32_t> count;
+	std::atomic<Table*> table;
+	// every table ever published, a reader may still be probing an old one
+	std::vector<std::unique_ptr<Table>> tables;
+	std::vector<std::unique_ptr<char[]>> blocks;
+	char* free;
+	size_t left;
+	std::mutex lock;
+
+	inline const Entry& entry(uint32_t id) const {
+		return segments[id>>segmentBits].load(std::memory_order_acquire)[id & ((1u<<segmentBits)-1)];
+	}
+	void place(Table* t, uint32_t id, uint64_t h) {
+		for (size_t i=h & t->mask;;i=(i+1) & t->mask) {
+			if (!t->slots[i].load(std::memory_order_relaxed)) {
+				t->slots[i].store(id+1, std::memory_order_release);
+				return;
+			}
+		}
+	}
+	const char* store(const char* s, size_t len) {
+		if (len+1>left) {
+			size_t size=std::max<size_t>(len+1, 64<<10);
+			blocks.emplace_back(new char[size]);
+			free=blocks.back().get();
+			left=size;
+		}
+		char* r=free;
+		memcpy(r, s, len);
+		r[len]=0;
+		free+=len+1;
+		left-=len+1;
+		return r;
+	}
+public:
+	Dictionary() : count(0), free(nullptr), left(0) {
+		for (auto& s : segments) s.store(nullptr, std::memory_order_relaxed);
+		tables.emplace_back(new Table(1024));
+		table.store(tables.back().get(), std::memory_order_release);
+	}
+	Key find(const char* s, size_t len, uint64_t h) const {
+		const Table* t=table.load(std::memory_order_acquire);
+		for (size_t i=h & t->mask;;i=(i+1) & t->mask) {
+			uint32_t id=t->slots[i].load(std::memory_order_acquire);
+			if (!id) return Key();
+			const Entry& e=entry(id-1);
+			if (e.hash==h && e.key.size()==len && !memcmp(e.key.c_str(), s, len)) return e.key;
+		}
+	}
+	Key add(const char* s, size_t len, uint64_t h) {
+		std::lock_guard<std::mutex> g(lock);
+		Key k=find(s, len, h);
+		if (k.valid()) return k;
+		uint32_t id=count.load(std::memory_order_relaxed);
+		if ((id>>segmentBits)>=maxSegments) throw std::runtime_error("Too many interned json keys");
+		if (len>=UINT32_MAX) throw std::runtime_error("Json key is too long to intern: "+std::to_string(len));
+		auto& segment=segments[id>>segmentBits];
+		if (!segment.load(std::memory_order_relaxed)) segment.store(new Entry[size_t(1)<<segmentBits], std::memory_order_release);
+		Entry& e=segment.load(std::memory_order_relaxed)[id & ((1u<<segmentBits)-1)];
+		e.key=Key(store(s, len), (uint32_t)len, id);
+		e.hash=h;
+		count.store(id+1, std::memory_order_release);
+		Table* t=table.load(std::memory_order_relaxed);
+		if ((id+1)*2>t->mask+1) {
+			tables.emplace_back(new Table((t->mask+1)*2));
+			t=tables.back().get();
+			for (uint32_t i=0;i<=id;++i) place(t, i, entry(i).hash);
+			table.store(t, std::memory_order_release);
+		} else {
+			place(t, id, h);
+		}
+		return e.key;
+	}
+	Key byId(uint32_t id) const {
+		if (id>=count.load(std::memory_order_acquire)) throw std::runtime_error("No interned json key with id "+std::to_string(id));
+		return entry(id).key;
+	}
+	inline size_t size() const {return count.load(std::memory_order_acquire);}
+};
+
+// never destroyed, so keys stay valid in static destructors
+Dictionary& dictionary() {
+	static Dictionary* d=new Dictionary();
+	return *d;
+}
+
+}
+
+Key intern(const char* name, size_t len) {
+	uint64_t h=utils::hash64(name, len);
+	auto& d=dictionary();
+	Key k=d.find(name, len, h);
+	return k.valid() ? k : d.add(name, len, h);
+}
+
+Key findKey(const char* name, size_t len) {
+	return dictionary().find(name, len, utils::hash64(name, len));
+}
+
+Key keyById(uint32_t id) {
+	return dictionary().byId(id);
+}
+
+size_t internedKeys() {
+	return dictionary().size();
+}
+
+}
@@ -0,0 +1,58 @@
+#ifndef SRC_JSONKEYS_H_
+#define SRC_JSONKEYS_H_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <jsonutils.h>
+
+/*
+ * Process-wide dictionary of interned object keys.
+ *
+ *   static const json::Key latency=json::intern("latency_ms");
+ *   long long ms=json::getLong(event, latency);       // a Key is accepted wherever a key is
+ *   uint32_t id=latency.id();                          // small, dense, stable for the process
+ *   json::Key same=json::keyById(id);
+ *
+ * The dictionary only grows: interned names are never freed or moved, so a Key (or the
+ * const char* it converts to) stays valid until the process exits, including in static
+ * destructors. Lookups are lock-free and may run concurrently with interning, which takes
+ * a mutex only when a name is new.
+ *
+ * jansson copies every key inline into its own hash table entry, so interning does not
+ * change what a parsed json_t costs, and a lookup in a json_t still hashes the name. What
+ * a Key adds is identity: interned names compare by pointer, ids index plain arrays, and
+ * accessor paths built from Keys need no std::string or strlen on the caller's side.
+ */
+
+namespace json {
+
+class Key {
+	const char* name;
+	uint32_t length;
+	uint32_t ident;
+public:
+	Key() : name(nullptr), length(0), ident(UINT32_MAX) {}
+	Key(const char* n, uint32_t l, uint32_t i) : name(n), length(l), ident(i) {}
+	inline bool valid() const {return name!=nullptr;}
+	inline uint32_t id() const {return ident;}
+	inline const char* c_str() const {return name;}
+	inline size_t size() const {return length;}
+	inline operator const char*() const {return name;}
+	inline bool operator==(const Key& o) const {return name==o.name;}
+	inline bool operator!=(const Key& o) const {return name!=o.name;}
+};
+
+Key intern(const char* name, size_t len);
+inline Key intern(const char* name) {return intern(name, strlen(name));}
+inline Key intern(const std::string& name) {return intern(name.data(), name.size());}
+// does not intern, returns an invalid Key if name was never interned
+Key findKey(const char* name, size_t len);
+inline Key findKey(const char* name) {return findKey(name, strlen(name));}
+inline Key findKey(const std::string& name) {return findKey(name.data(), name.size());}
+Key keyById(uint32_t id);
+size_t internedKeys();
+
+}
+
+#endif /* SRC_JSONKEYS_H_ */
@@ -0,0 +1,68 @@
+#include <jsonmerge.h>
+#include <stdexcept>
+
+namespace json {
+
+namespace {
+
+// a patch object can be used as a value as is unless a null member somewhere asks for a delete
+bool hasNullMember(const json_t* patch) {
+	for (auto kv : JsonKeyValuePairs(patch)) {
+		if (json_is_null(kv.second)) return true;
+		if (json_is_object(kv.second) && hasNullMember(kv.second)) return true;
+	}
+	return false;
+}
+
+// returns a new reference
+json_t* mergeInto(const json_t* target, const json_t* patch) {
+	if (!json_is_object(patch)) return json_incref((json_t*)patch);
+	if (!json_is_object(target)) {
+		if (!hasNullMember(patch)) return json_incref((json_t*)patch);
+		target=nullptr;
+	}
+	json_t* result=target ? json_copy((json_t*)target) : json_object();
+	for (auto kv : JsonKeyValuePairs(patch)) {
+		if (json_is_null(kv.second)) {
+			json_object_del(result, kv.first);
+			continue;
+		}
+		json_t* old=json_object_get(result, kv.first);
+		// the same subtree is a no-op only when it holds no deletes to apply to itself
+		if (old==kv.second && !(json_is_object(old) && hasNullMember(old))) continue;
+		json_object_set_new_nocheck(result, kv.first, mergeInto(old, kv.second));
+	}
+	return result;
+}
+
+}
+
+jsonptr merge(const json_t* target, const json_t* patch) {
+	if (!patch) return target ? attach((json_t*)target) : jsonptr();
+	return own(mergeInto(target, patch));
+}
+
+jsonptr merge(const std::vector<jsonptr>& layers) {
+	if (layers.empty()) return jsonptr();
+	// the base is a document, not a patch: its nulls stay
+	jsonptr r=layers[0];
+	for (size_t i=1;i<layers.size();++i) r=merge(r.get(), layers[i].get());
+	return r;
+}
+
+LayeredConfig::LayeredConfig(std::vector<jsonptr> l) : layers(std::move(l)), merged(layers.size()) {
+	if (layers.empty()) throw std::runtime_error("LayeredConfig needs at least one layer");
+	recompute(0);
+}
+
+void LayeredConfig::recompute(size_t from) {
+	for (size_t i=from;i<layers.size();++i) merged[i]=i ? merge(merged[i-1].get(), layers[i].get()) : layers[0];
+}
+
+void LayeredConfig::setLayer(size_t i, const jsonptr& layer) {
+	if (i>=layers.size()) throw std::runtime_error("LayeredConfig has no layer "+std::to_string(i));
+	layers[i]=layer;
+	recompute(i);
+}
+
+}
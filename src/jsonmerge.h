@@ -0,0 +1,51 @@
+#ifndef SRC_JSONMERGE_H_
+#define SRC_JSONMERGE_H_
+
+#include <vector>
+#include <jsonutils.h>
+
+/*
+ * JSON Merge Patch (RFC 7386) with structural sharing.
+ *
+ *   auto effective=json::merge(base, environment, host);
+ *
+ * The base is taken as is, nulls included, and each layer is applied on top of the previous
+ * result: objects merge key by key, a null member deletes the key, anything else replaces. Only objects on the paths a layer
+ * touches are copied (shallowly); every other subtree of the result is the very json_t
+ * of the base or of a layer, shared through its refcount. Merging therefore costs time
+ * and memory proportional to the layers, not to the base document, but the result and
+ * the inputs must be treated as immutable from then on.
+ *
+ * LayeredConfig keeps the intermediate results, so replacing one layer only re-applies
+ * the layers from that one up.
+ */
+
+namespace json {
+
+jsonptr merge(const json_t* target, const json_t* patch);
+inline jsonptr merge(const jsonptr& target, const jsonptr& patch) {return merge(target.get(), patch.get());}
+template<typename...REST> jsonptr merge(const jsonptr& target, const jsonptr& patch, const jsonptr& next, REST... rest) {
+	return merge(merge(target, patch), next, rest...);
+}
+jsonptr merge(const std::vector<jsonptr>& layers);
+
+class LayeredConfig {
+	std::vector<jsonptr> layers;
+	// merged[i] is the merge of layers[0..i]
+	std::vector<jsonptr> merged;
+	void recompute(size_t from);
+public:
+	explicit LayeredConfig(std::vector<jsonptr> layers);
+	LayeredConfig(const LayeredConfig&) = delete;
+	LayeredConfig& operator=(const LayeredConfig&) = delete;
+
+	// replaces one layer and re-applies it and the ones above it
+	void setLayer(size_t i, const jsonptr& layer);
+	inline const jsonptr& layer(size_t i) const {return layers.at(i);}
+	inline size_t size() const {return layers.size();}
+	inline const jsonptr& result() const {return merged.back();}
+};
+
+}
+
+#endif /* SRC_JSONMERGE_H_ */
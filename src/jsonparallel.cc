@@ -0,0 +1,80 @@
+#include <jsonparallel.h>
+#include <jsoncursor.h>
+#include <algorithm>
+
+namespace json {
+
+namespace {
+
+// below this, starting threads costs about as much as the parse they would share
+const size_t parallelBytes=1<<20;
+
+bool blank(const char* p, const char* e) {
+	for (;p<e;++p) if (*p!=' ' && *p!='\t' && *p!='\n' && *p!='\r') return false;
+	return true;
+}
+
+[[noreturn]] void elementError(std::string_view text, size_t start, size_t end, size_t n, const json_error_t& e) {
+	size_t line=std::count(text.begin(), text.begin()+start, '\n')+std::max(e.line, 1);
+	size_t column=e.column;
+	if (e.line<=1) {
+		size_t nl=text.rfind('\n', start-1);
+		column+=start-(nl==std::string_view::npos ? 0 : nl+1);
+	}
+	std::string_view element=text.substr(start, end-start);
+	while (!element.empty() && blank(element.data(), element.data()+1)) element.remove_prefix(1);
+	throw std::runtime_error("Invalid json: element "+std::to_string(n)+": "+
+			std::string(element.substr(0, 64))+(element.size()>64 ? "..." : "")+
+			"; Error: "+e.text+
+			": line : "+std::to_string(line)+
+			", column: "+std::to_string(column)+
+			", position: "+std::to_string(start+e.position));
+}
+
+// element i lies between seps[i] and seps[i+1]
+size_t elementCount(std::string_view text, const std::vector<size_t>& seps) {
+	if (seps.size()==2 && blank(text.data()+seps[0]+1, text.data()+seps[1])) return 0;
+	return seps.size()-1;
+}
+
+template<typename F> void parseElements(std::string_view text, const std::vector<size_t>& seps, size_t n, unsigned threads, F onElement) {
+	if (!n) return;
+	// aim for chunks of about 64KB of text, so that a few large records still spread out
+	size_t grain=std::clamp<size_t>((size_t(64)<<10)/(text.size()/n+1), 1, 64);
+	auto split=parallel::split(n, threads, grain, text.size()<parallelBytes ? SIZE_MAX : 2);
+	parallel::chunks(n, split, [&](size_t b, size_t e, size_t) {
+		json_error_t err;
+		for (size_t i=b;i<e;++i) {
+			size_t start=seps[i]+1;
+			size_t end=seps[i+1];
+			json_t* v=json_loadb(text.data()+start, end-start, JSON_DECODE_ANY, &err);
+			if (!v) elementError(text, start, end, i, err);
+			onElement(i, v);
+		}
+	});
+}
+
+}
+
+jsonptr parseArrayParallel(std::string_view text, unsigned threads) {
+	auto seps=topLevelSeparators(text.data(), text.size());
+	std::vector<json_t*> elements(elementCount(text, seps), nullptr);
+	try {
+		parseElements(text, seps, elements.size(), threads, [&](size_t i, json_t* v) {elements[i]=v;});
+	} catch (...) {
+		for (auto v : elements) if (v) json_decref(v);
+		throw;
+	}
+	json_t* a=json_array();
+	for (auto v : elements) json_array_append_new(a, v);
+	return own(a);
+}
+
+size_t parseArrayParallel(std::string_view text, const std::function<void(size_t, jsonptr)>& f, unsigned threads) {
+	auto seps=topLevelSeparators(text.data(), text.size());
+	size_t n=elementCount(text, seps);
+	parseElements(text, seps, n, threads, [&](size_t i, json_t* v) {f(i, own(v));});
+	return n;
+}
+
+}
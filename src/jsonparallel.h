@@ -0,0 +1,109 @@
+#ifndef SRC_JSONPARALLEL_H_
+#define SRC_JSONPARALLEL_H_
+
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <string_view>
+#include <vector>
+#include <executor.h>
+#include <jsonutils.h>
+
+/*
+ * Parallel loops over json arrays and objects.
+ *
+ *   json::parallel_for_each(json::getJsonArrayElements(users), [](json_t* u) {...});
+ *   double total=json::transform_reduce(json::getJsonArrayElements(orders), 0.0,
+ *           std::plus<double>(), [](json_t* o) {return json::getNumber(o, "amount");});
+ *
+ * The range is cut into chunks of a multiple of 8 elements (a cache line of json_t*)
+ * and about 8 chunks per thread, which run on utils::Executor::shared() together with
+ * the calling thread; idle workers steal chunks, so one that lands on heavy elements
+ * simply takes fewer. threads only bounds how finely the range is cut. Ranges below
+ * parallelThreshold elements run on the calling thread. The first exception thrown by f
+ * is rethrown once all chunks have stopped.
+ *
+ * Elements are only read concurrently: f must not modify the container, and jansson
+ * values shared between elements must not be modified either. reduce must be associative;
+ * each chunk is reduced on its own and the partials are combined in order.
+ *
+ * parseArrayParallel parses a text whose top level value is an array, typically a large
+ * file of records. A single scan finds the array's own commas, skipping strings and
+ * nested containers, and the elements are then parsed concurrently with jansson. Errors
+ * carry line, column and position within the whole text, like parse().
+ */
+
+namespace json {
+
+namespace parallel {
+
+const size_t parallelThreshold=4096;
+
+// the pool's workers and the calling thread
+inline unsigned defaultThreads() {
+	return utils::Executor::shared().size()+1;
+}
+
+struct Split {
+	size_t chunk;
+	size_t count;
+};
+// cuts [0, n) into chunks at least grain long, a single one below threshold or threads<2
+inline Split split(size_t n, unsigned threads, size_t grain=64, size_t threshold=parallelThreshold) {
+	if (!threads) threads=defaultThreads();
+	if (n<threshold || threads<2) return Split{n, n ? size_t(1) : 0};
+	threads=std::min<size_t>(threads, n/grain ? n/grain : 1);
+	size_t chunk=std::max<size_t>(grain, (n/(threads*8)+7) & ~size_t(7));
+	return Split{chunk, (n+chunk-1)/chunk};
+}
+
+// calls body(begin, end, k) for each chunk k of [0, n)
+template<typename F> void chunks(size_t n, const Split& split, F body) {
+	if (split.count<=1) {
+		if (n) body(size_t(0), n, size_t(0));
+		return;
+	}
+	utils::Executor::shared().parallel_for(0, split.count, [&](size_t b, size_t e) {
+		for (size_t k=b;k<e;++k) body(k*split.chunk, std::min(n, (k+1)*split.chunk), k);
+	}, 1);
+}
+
+template<typename T> struct alignas(64) Partial {
+	std::optional<T> value;
+};
+
+}
+
+template<typename RANGE, typename F> void parallel_for_each(const RANGE& range, F f, unsigned threads=0) {
+	auto first=range.begin();
+	parallel::chunks(range.size(), parallel::split(range.size(), threads), [&](size_t b, size_t e, size_t) {
+		auto it=first+b;
+		for (size_t i=b;i<e;++i, ++it) f(*it);
+	});
+}
+
+template<typename RANGE, typename T, typename REDUCE, typename TRANSFORM>
+T transform_reduce(const RANGE& range, T init, REDUCE reduce, TRANSFORM transform, unsigned threads=0) {
+	auto first=range.begin();
+	auto split=parallel::split(range.size(), threads);
+	std::vector<parallel::Partial<T>> partial(split.count);
+	parallel::chunks(range.size(), split, [&](size_t b, size_t e, size_t k) {
+		auto it=first+b;
+		auto& p=partial[k].value;
+		for (size_t i=b;i<e;++i, ++it) {
+			if (p) p=reduce(std::move(*p), transform(*it));
+			else p=transform(*it);
+		}
+	});
+	for (auto& p : partial) if (p.value) init=reduce(std::move(init), std::move(*p.value));
+	return init;
+}
+
+jsonptr parseArrayParallel(std::string_view text, unsigned threads=0);
+// calls f(index, element) from the worker thread that parsed the element, in no particular
+// order, so the whole array never has to be held in memory; returns the number of elements
+size_t parseArrayParallel(std::string_view text, const std::function<void(size_t, jsonptr)>& f, unsigned threads=0);
+
+}
+
+#endif /* SRC_JSONPARALLEL_H_ */
@@ -0,0 +1,418 @@
+#include <jsonpatch.h>
+#include <hash.h>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace json {
+
+namespace {
+
+inline uint64_t combine(uint64_t h, uint64_t v) {
+	h^=v+0x9e3779b97f4a7c15ULL+(h<<6)+(h>>2);
+	return h;
+}
+
+std::vector<std::string> splitPointer(const std::string& p) {
+	std::vector<std::string> tokens;
+	if (p.empty()) return tokens;
+	if (p[0]!='/') throw std::runtime_error("Invalid json pointer: "+p);
+	std::string cur;
+	for (size_t i=1;i<=p.size();++i) {
+		if (i==p.size() || p[i]=='/') {
+			tokens.emplace_back(std::move(cur));
+			cur.clear();
+		} else if (p[i]=='~') {
+			if (i+1<p.size() && p[i+1]=='0') cur+='~';
+			else if (i+1<p.size() && p[i+1]=='1') cur+='/';
+			else throw std::runtime_error("Invalid json pointer: "+p);
+			++i;
+		} else {
+			cur+=p[i];
+		}
+	}
+	return tokens;
+}
+
+// array index token: digits without a leading zero, or "-" for one past the end
+bool arrayIndex(const std::string& t, size_t size, bool allowEnd, size_t& index) {
+	if (allowEnd && t=="-") {
+		index=size;
+		return true;
+	}
+	if (t.empty() || t.size()>18 || (t.size()>1 && t[0]=='0')) return false;
+	index=0;
+	for (char c : t) {
+		if (c<'0' || c>'9') return false;
+		index=index*10+(c-'0');
+	}
+	return allowEnd ? index<=size : index<size;
+}
+
+json_t* child(json_t* j, const std::string& t) {
+	if (json_is_object(j)) return json_object_get(j, t.c_str());
+	size_t i;
+	if (json_is_array(j) && arrayIndex(t, json_array_size(j), false, i)) return json_array_get(j, i);
+	return nullptr;
+}
+
+json_t* resolve(json_t* j, const std::vector<std::string>& tokens, size_t count) {
+	for (size_t i=0;i<count && j;++i) j=child(j, tokens[i]);
+	return j;
+}
+
+std::string parentOf(const std::string& p) {
+	return p.substr(0, p.rfind('/'));
+}
+
+struct Undo {
+	enum Kind {ADD, REMOVE, REPLACE} kind;
+	std::string path;
+	jsonptr value;
+};
+
+class Patcher {
+	jsonptr& doc;
+	std::vector<Undo>* undo;
+	json_t* parent(const std::string& path, const std::vector<std::string>& tokens) {
+		json_t* p=resolve(doc.get(), tokens, tokens.size()-1);
+		if (!json_is_object(p) && !json_is_array(p)) throw std::runtime_error("json patch path has no container: "+path);
+		return p;
+	}
+public:
+	Patcher(jsonptr& d, std::vector<Undo>* u) : doc(d), undo(u) {}
+
+	// takes ownership of v
+	void add(const std::string& path, json_t* v) {
+		jsonptr value=own(v);
+		auto tokens=splitPointer(path);
+		if (tokens.empty()) {
+			if (undo) undo->push_back(Undo{Undo::REPLACE, path, doc});
+			doc=value;
+			return;
+		}
+		json_t* p=parent(path, tokens);
+		const std::string& t=tokens.back();
+		if (json_is_object(p)) {
+			json_t* old=json_object_get(p, t.c_str());
+			if (undo) {
+				if (old) undo->push_back(Undo{Undo::REPLACE, path, attach(old)});
+				else undo->push_back(Undo{Undo::REMOVE, path, jsonptr()});
+			}
+			if (json_object_set(p, t.c_str(), value.get())) throw std::runtime_error("json patch can't set "+path);
+			return;
+		}
+		size_t i;
+		if (!arrayIndex(t, json_array_size(p), true, i)) throw std::runtime_error("json patch index out of range: "+path);
+		if (json_array_insert(p, i, value.get())) throw std::runtime_error("json patch can't insert "+path);
+		if (undo) undo->push_back(Undo{Undo::REMOVE, parentOf(path)+"/"+std::to_string(i), jsonptr()});
+	}
+
+	jsonptr remove(const std::string& path) {
+		auto tokens=splitPointer(path);
+		if (tokens.empty()) throw std::runtime_error("json patch can't remove the root");
+		json_t* p=parent(path, tokens);
+		const std::string& t=tokens.back();
+		json_t* v=child(p, t);
+		if (!v) throw std::runtime_error("json patch path does not exist: "+path);
+		jsonptr removed=attach(v);
+		if (json_is_object(p)) {
+			json_object_del(p, t.c_str());
+			if (undo) undo->push_back(Undo{Undo::ADD, path, removed});
+		} else {
+			size_t i;
+			arrayIndex(t, json_array_size(p), false, i);
+			json_array_remove(p, i);
+			if (undo) undo->push_back(Undo{Undo::ADD, parentOf(path)+"/"+std::to_string(i), removed});
+		}
+		return removed;
+	}
+
+	void replace(const std::string& path, json_t* v) {
+		jsonptr value=own(v);
+		if (!getPointer(doc.get(), path)) throw std::runtime_error("json patch path does not exist: "+path);
+		if (!path.empty()) remove(path);
+		add(path, json_incref(value.get()));
+	}
+
+	void apply(const json_t* op, size_t n) {
+		const char* name=getString(op, "op");
+		const char* path=getString(op, "path");
+		if (!name || !path) throw std::runtime_error("Invalid json patch: operation "+std::to_string(n)+" needs \"op\" and \"path\"");
+		json_t* value=json_object_get(op, "value");
+		const char* from=getString(op, "from");
+		if (!strcmp(name, "add") || !strcmp(name, "replace") || !strcmp(name, "test")) {
+			if (!value) throw std::runtime_error("Invalid json patch: operation "+std::to_string(n)+" needs a \"value\"");
+			if (name[0]=='a') add(path, json_deep_copy(value));
+			else if (name[0]=='r') replace(path, json_deep_copy(value));
+			else if (!json_equal(getPointer(doc.get(), path), value)) throw std::runtime_error("json patch test failed at "+std::string(path));
+		} else if (!strcmp(name, "remove")) {
+			remove(path);
+		} else if (!strcmp(name, "move") || !strcmp(name, "copy")) {
+			if (!from) throw std::runtime_error("Invalid json patch: operation "+std::to_string(n)+" needs \"from\"");
+			json_t* src=getPointer(doc.get(), from);
+			if (!src) throw std::runtime_error("json patch path does not exist: "+std::string(from));
+			if (name[0]=='c') {
+				add(path, json_deep_copy(src));
+				return;
+			}
+			size_t fl=strlen(from);
+			if (!strncmp(path, from, fl) && path[fl]=='/') throw std::runtime_error("json patch can't move "+std::string(from)+" into itself");
+			if (!strcmp(path, from)) return;
+			auto v=remove(from);
+			add(path, json_incref(v.get()));
+		} else {
+			throw std::runtime_error("Invalid json patch: unknown op "+std::string(name)+", operation "+std::to_string(n));
+		}
+	}
+};
+
+class Differ {
+	json_t* patch;
+	void op(const char* name, const std::string& path, const json_t* value) {
+		json_t* o=json_object();
+		json_object_set_new_nocheck(o, "op", json_string_nocheck(name));
+		json_object_set_new_nocheck(o, "path", json_stringn_nocheck(path.data(), path.size()));
+		if (value) json_object_set_nocheck(o, "value", (json_t*)value);
+		json_array_append_new(patch, o);
+	}
+
+	// aligns a[i0,i1) with b[j0,j1) on a longest common subsequence when the table is small,
+	// otherwise on anchors unique to both sides (shared nodes first, then subtree hashes)
+	// with the gaps between them aligned recursively; unaligned runs are paired by position
+	struct Aligner {
+		const json_t* a;
+		const json_t* b;
+		std::vector<uint64_t> ha, hb;
+		std::vector<std::pair<size_t, size_t>> matches;
+		Aligner(const json_t* x, const json_t* y) : a(x), b(y), ha(json_array_size(x), 0), hb(json_array_size(y), 0) {}
+
+		uint64_t hashA(size_t i) {
+			if (!ha[i]) ha[i]=treeHash(json_array_get(a, i)) | 1;
+			return ha[i];
+		}
+		uint64_t hashB(size_t j) {
+			if (!hb[j]) hb[j]=treeHash(json_array_get(b, j)) | 1;
+			return hb[j];
+		}
+		bool same(size_t i, size_t j) {
+			json_t* x=json_array_get(a, i);
+			json_t* y=json_array_get(b, j);
+			return x==y || (hashA(i)==hashB(j) && json_equal(x, y));
+		}
+
+		void lcs(size_t i0, size_t i1, size_t j0, size_t j1) {
+			size_t na=i1-i0, nb=j1-j0;
+			std::vector<uint32_t> t((na+1)*(nb+1), 0);
+			auto at=[&](size_t i, size_t j) -> uint32_t& {return t[(i-i0)*(nb+1)+(j-j0)];};
+			for (size_t i=i1;i-->i0;) {
+				for (size_t j=j1;j-->j0;) {
+					if (same(i, j)) at(i, j)=at(i+1, j+1)+1;
+					else at(i, j)=std::max(at(i+1, j), at(i, j+1));
+				}
+			}
+			for (size_t i=i0, j=j0;i<i1 && j<j1;) {
+				if (same(i, j)) matches.emplace_back(i++, j++);
+				else if (at(i+1, j)>=at(i, j+1)) ++i;
+				else ++j;
+			}
+		}
+
+		template<typename KA, typename KB> std::vector<std::pair<size_t, size_t>> anchors(size_t i0, size_t i1, size_t j0, size_t j1, KA keyA, KB keyB) {
+			std::unordered_map<uint64_t, std::pair<size_t, size_t>> seen;
+			for (size_t i=i0;i<i1;++i) {
+				auto& s=seen.emplace(keyA(i), std::make_pair(size_t(0), i)).first->second;
+				++s.first;
+			}
+			std::unordered_map<uint64_t, std::pair<size_t, size_t>> other;
+			for (size_t j=j0;j<j1;++j) {
+				auto it=seen.find(keyB(j));
+				if (it==seen.end() || it->second.first!=1) continue;
+				auto& s=other.emplace(it->first, std::make_pair(size_t(0), j)).first->second;
+				++s.first;
+			}
+			std::vector<std::pair<size_t, size_t>> pairs;
+			for (auto& o : other) {
+				size_t i=seen[o.first].second, j=o.second.second;
+				if (o.second.first==1 && same(i, j)) pairs.emplace_back(i, j);
+			}
+			std::sort(pairs.begin(), pairs.end());
+			// longest run of pairs increasing in both coordinates
+			std::vector<size_t> tails, prev(pairs.size());
+			for (size_t k=0;k<pairs.size();++k) {
+				auto pos=std::lower_bound(tails.begin(), tails.end(), pairs[k].second, [&](size_t t, size_t j) {return pairs[t].second<j;});
+				prev[k]=pos==tails.begin() ? SIZE_MAX : *(pos-1);
+				if (pos==tails.end()) tails.push_back(k);
+				else *pos=k;
+			}
+			std::vector<std::pair<size_t, size_t>> r(tails.size());
+			for (size_t k=tails.empty() ? SIZE_MAX : tails.back(), n=r.size();k!=SIZE_MAX;k=prev[k]) r[--n]=pairs[k];
+			return r;
+		}
+
+		void align(size_t i0, size_t i1, size_t j0, size_t j1) {
+			if (i0==i1 || j0==j1) return;
+			if ((i1-i0)*(j1-j0)<=(1u<<20)) {
+				lcs(i0, i1, j0, j1);
+				return;
+			}
+			auto r=anchors(i0, i1, j0, j1, [&](size_t i) {return (uint64_t)(uintptr_t)json_array_get(a, i);},
+					[&](size_t j) {return (uint64_t)(uintptr_t)json_array_get(b, j);});
+			if (r.empty()) r=anchors(i0, i1, j0, j1, [&](size_t i) {return hashA(i);}, [&](size_t j) {return hashB(j);});
+			for (auto& p : r) {
+				align(i0, p.first, j0, p.second);
+				matches.push_back(p);
+				i0=p.first+1;
+				j0=p.second+1;
+			}
+			if (!r.empty()) align(i0, i1, j0, j1);
+		}
+	};
+
+	// how many top level members two values share, to decide which elements to diff
+	static size_t similarity(const json_t* x, const json_t* y) {
+		if (json_typeof(x)!=json_typeof(y)) return 0;
+		size_t r=0;
+		if (json_is_object(x)) {
+			for (auto kv : JsonKeyValuePairs(x)) r+=json_equal(kv.second, json_object_get(y, kv.first));
+		} else if (json_is_array(x)) {
+			for (size_t k=0;k<json_array_size(x) && k<json_array_size(y);++k) r+=json_equal(json_array_get(x, k), json_array_get(y, k));
+		} else {
+			r=json_equal((json_t*)x, (json_t*)y);
+		}
+		return r;
+	}
+
+	void arrays(const json_t* a, const json_t* b, const std::string& path) {
+		size_t n=json_array_size(a), m=json_array_size(b), pre=0, suf=0;
+		while (pre<n && pre<m && json_equal(json_array_get(a, pre), json_array_get(b, pre))) ++pre;
+		while (suf<n-pre && suf<m-pre && json_equal(json_array_get(a, n-1-suf), json_array_get(b, m-1-suf))) ++suf;
+		Aligner al(a, b);
+		al.align(pre, n-suf, pre, m-suf);
+		al.matches.emplace_back(n-suf, m-suf);
+
+		size_t pos=pre, i=pre, j=pre;
+		for (auto& mt : al.matches) {
+			size_t ga=mt.first-i, gb=mt.second-j, paired=std::min(ga, gb);
+			// pair the shorter run with the head or the tail of the longer one, whichever is closer
+			size_t skip=ga>gb ? ga-gb : gb-ga, sa=0, sb=0;
+			if (skip && paired) {
+				size_t head=0, tail=0;
+				for (size_t k=0;k<paired;++k) {
+					head+=similarity(json_array_get(a, i+k), json_array_get(b, j+k));
+					tail+=similarity(json_array_get(a, i+k+(ga>gb ? skip : 0)), json_array_get(b, j+k+(gb>ga ? skip : 0)));
+				}
+				if (tail>head) (ga>gb ? sa : sb)=skip;
+			}
+			for (size_t k=0;k<sa;++k) op("remove", path+"/"+std::to_string(pos), nullptr);
+			for (size_t k=0;k<sb;++k, ++pos) op("add", path+"/"+std::to_string(pos), json_array_get(b, j+k));
+			for (size_t k=0;k<paired;++k, ++pos) {
+				diff(json_array_get(a, i+sa+k), json_array_get(b, j+sb+k), path+"/"+std::to_string(pos));
+			}
+			for (size_t k=sa+paired;k<ga;++k) op("remove", path+"/"+std::to_string(pos), nullptr);
+			for (size_t k=sb+paired;k<gb;++k, ++pos) op("add", path+"/"+std::to_string(pos), json_array_get(b, j+k));
+			i=mt.first+1;
+			j=mt.second+1;
+			++pos;
+		}
+	}
+public:
+	explicit Differ(json_t* p) : patch(p) {}
+
+	void diff(const json_t* a, const json_t* b, const std::string& path) {
+		if (a==b) return;
+		if (json_typeof(a)!=json_typeof(b) || (!json_is_object(a) && !json_is_array(a))) {
+			if (!json_equal((json_t*)a, (json_t*)b)) op("replace", path, b);
+			return;
+		}
+		if (json_is_array(a)) {
+			arrays(a, b, path);
+			return;
+		}
+		for (auto kv : JsonKeyValuePairs(a)) {
+			json_t* other=json_object_get(b, kv.first);
+			if (!other) op("remove", path+"/"+escapePointer(kv.first), nullptr);
+			else diff(kv.second, other, path+"/"+escapePointer(kv.first));
+		}
+		for (auto kv : JsonKeyValuePairs(b)) {
+			if (!json_object_get(a, kv.first)) op("add", path+"/"+escapePointer(kv.first), kv.second);
+		}
+	}
+};
+
+}
+
+std::string escapePointer(const char* key) {
+	std::string r;
+	for (;*key;++key) {
+		if (*key=='~') r+="~0";
+		else if (*key=='/') r+="~1";
+		else r+=*key;
+	}
+	return r;
+}
+
+json_t* getPointer(const json_t* doc, const std::string& pointer) {
+	auto tokens=splitPointer(pointer);
+	return resolve((json_t*)doc, tokens, tokens.size());
+}
+
+uint64_t treeHash(const json_t* j) {
+	if (!j) return 0;
+	switch (json_typeof(j)) {
+		case JSON_OBJECT: {
+			// summed so that key order does not matter
+			uint64_t h=0;
+			for (auto kv : JsonKeyValuePairs(j)) h+=combine(utils::hash64(kv.first, strlen(kv.first)), treeHash(kv.second));
+			return combine(h, JSON_OBJECT);
+		}
+		case JSON_ARRAY: {
+			uint64_t h=JSON_ARRAY;
+			for (auto e : JsonArrayElements(j)) h=combine(h, treeHash(e));
+			return h;
+		}
+		case JSON_STRING: return combine(utils::hash64(json_string_value(j), json_string_length(j)), JSON_STRING);
+		case JSON_INTEGER: {
+			long long v=json_integer_value(j);
+			return combine(utils::hash64(&v, sizeof(v)), JSON_INTEGER);
+		}
+		case JSON_REAL: {
+			double d=json_real_value(j);
+			if (d==0) d=0;
+			return combine(utils::hash64(&d, sizeof(d)), JSON_REAL);
+		}
+		default: return combine(0, json_typeof(j));
+	}
+}
+
+jsonptr diff(const json_t* a, const json_t* b) {
+	if (!a || !b) throw std::runtime_error("json::diff of a null tree");
+	auto patch=own(json_array());
+	Differ(patch.get()).diff(a, b, "");
+	return patch;
+}
+
+void applyPatch(jsonptr& doc, const json_t* patch) {
+	if (!json_is_array(patch)) throw std::runtime_error("Invalid json patch: not an array");
+	std::vector<Undo> undo;
+	Patcher p(doc, &undo);
+	size_t n=0;
+	try {
+		for (auto op : JsonArrayElements(patch)) {
+			if (!json_is_object(op)) throw std::runtime_error("Invalid json patch: operation "+std::to_string(n)+" is not an object");
+			p.apply(op, n++);
+		}
+	} catch (...) {
+		Patcher rollback(doc, nullptr);
+		for (auto it=undo.rbegin();it!=undo.rend();++it) {
+			if (it->kind==Undo::ADD) rollback.add(it->path, json_incref(it->value.get()));
+			else if (it->kind==Undo::REMOVE) rollback.remove(it->path);
+			else rollback.replace(it->path, json_incref(it->value.get()));
+		}
+		throw;
+	}
+}
+
+}
@@ -0,0 +1,41 @@
+#ifndef SRC_JSONPATCH_H_
+#define SRC_JSONPATCH_H_
+
+#include <string>
+#include <jsonutils.h>
+
+/*
+ * JSON Patch (RFC 6902) generation and application, with JSON Pointers (RFC 6901) as paths.
+ *
+ *   auto patch=json::diff(previous, current);     // [{"op" : "replace", "path" : "/db/port", "value" : 5433}]
+ *   json::applyPatch(replica, patch);             // replica now equals current
+ *
+ * diff() walks both trees together and skips subtrees that are the same json_t, so two
+ * versions sharing most of their nodes diff in time proportional to what changed. Arrays
+ * are trimmed of their common prefix and suffix and the rest is aligned on subtree hashes,
+ * so an insertion in the middle becomes one "add" rather than a cascade of "replace"s.
+ * Patch values reference subtrees of b rather than copies.
+ *
+ * applyPatch() mutates doc in place (the root itself may be replaced) and is atomic: if an
+ * operation fails, the ones already applied are rolled back and std::runtime_error is
+ * thrown. Values taken from the patch are deep copied into doc.
+ */
+
+namespace json {
+
+jsonptr diff(const json_t* a, const json_t* b);
+inline jsonptr diff(const jsonptr& a, const jsonptr& b) {return diff(a.get(), b.get());}
+
+void applyPatch(jsonptr& doc, const json_t* patch);
+inline void applyPatch(jsonptr& doc, const jsonptr& patch) {applyPatch(doc, patch.get());}
+
+// the value at a JSON Pointer, nullptr if there is none
+json_t* getPointer(const json_t* doc, const std::string& pointer);
+std::string escapePointer(const char* key);
+
+// order independent structural hash: equal trees in the json_equal sense hash equal
+uint64_t treeHash(const json_t* j);
+
+}
+
+#endif /* SRC_JSONPATCH_H_ */
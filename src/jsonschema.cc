@@ -0,0 +1,519 @@
+#include <jsonschema.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace json {
+
+namespace {
+
+enum Op : uint8_t {
+	END, FAIL, TYPE, MINIMUM, MAXIMUM, MULTIPLE_OF, MIN_LENGTH, MAX_LENGTH, PATTERN,
+	MIN_ITEMS, MAX_ITEMS, UNIQUE_ITEMS, ITEMS, MIN_PROPERTIES, MAX_PROPERTIES,
+	OBJECT, ENUM, CONST, ALL_OF, ANY_OF, ONE_OF, BRANCH, NOT
+};
+
+enum TypeBit : uint32_t {
+	T_NULL=1, T_BOOLEAN=2, T_OBJECT=4, T_ARRAY=8, T_NUMBER=16, T_STRING=32, T_INTEGER=64
+};
+
+const char* TYPE_NAMES[]={"null", "boolean", "object", "array", "number", "string", "integer"};
+
+const uint32_t MAX_PATH=64;
+const uint32_t NONE=UINT32_MAX;
+
+bool byName(const Schema::Member& m, const char* name) {
+	return strcmp(m.name, name)<0;
+}
+
+uint32_t typeBit(const char* name, const std::string& where) {
+	for (uint32_t i=0;i<7;++i) if (!strcmp(name, TYPE_NAMES[i])) return 1u<<i;
+	throw std::runtime_error("Invalid schema at "+where+": unknown type "+name);
+}
+
+bool isIntegral(const json_t* v) {
+	if (json_is_integer(v)) return true;
+	if (!json_is_real(v)) return false;
+	double d=json_real_value(v);
+	return std::isfinite(d) && d==std::floor(d);
+}
+
+uint32_t typeMask(const json_t* v) {
+	switch (json_typeof(v)) {
+		case JSON_NULL: return T_NULL;
+		case JSON_TRUE:
+		case JSON_FALSE: return T_BOOLEAN;
+		case JSON_OBJECT: return T_OBJECT;
+		case JSON_ARRAY: return T_ARRAY;
+		case JSON_STRING: return T_STRING;
+		case JSON_INTEGER: return T_NUMBER | T_INTEGER;
+		default: return isIntegral(v) ? T_NUMBER | T_INTEGER : T_NUMBER;
+	}
+}
+
+const char* typeName(const json_t* v) {
+	switch (json_typeof(v)) {
+		case JSON_NULL: return "null";
+		case JSON_TRUE:
+		case JSON_FALSE: return "boolean";
+		case JSON_OBJECT: return "object";
+		case JSON_ARRAY: return "array";
+		case JSON_STRING: return "string";
+		case JSON_INTEGER: return "integer";
+		default: return "number";
+	}
+}
+
+// a short rendering of a value for messages, never the whole document
+std::string brief(const json_t* v) {
+	if (json_is_object(v)) return "an object";
+	if (json_is_array(v)) return "an array";
+	char* s=json_dumps(v, JSON_ENCODE_ANY);
+	std::string r=s ? s : "?";
+	free(s);
+	if (r.size()>40) r=r.substr(0, 37)+"...";
+	return r;
+}
+
+size_t utf8Length(const char* s, size_t bytes) {
+	size_t n=0;
+	for (size_t i=0;i<bytes;++i) n+=((unsigned char)s[i] & 0xc0)!=0x80;
+	return n;
+}
+
+double number(const json_t* v) {
+	return json_is_integer(v) ? (double)json_integer_value(v) : json_real_value(v);
+}
+
+std::string format(double d) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%.17g", d);
+	return buf;
+}
+
+uint32_t count(const json_t* v, const char* keyword, const std::string& where) {
+	if (!isIntegral(v) || number(v)<0 || number(v)>UINT32_MAX) throw std::runtime_error("Invalid schema at "+where+": "+keyword+" must be a non-negative integer");
+	return (uint32_t)number(v);
+}
+
+bool annotation(const char* k) {
+	static const char* ignored[]={"$schema", "$id", "$comment", "$anchor", "title", "description", "default",
+			"examples", "deprecated", "readOnly", "writeOnly", "format", "contentMediaType", "contentEncoding"};
+	for (auto i : ignored) if (!strcmp(k, i)) return true;
+	return false;
+}
+
+}
+
+struct Schema::Context {
+	std::vector<Error>* errors;
+	size_t maxErrors;
+	uint32_t depth;
+	struct {
+		const char* key;
+		size_t index;
+	} path[MAX_PATH];
+
+	inline void push(const char* key, size_t index) {
+		if (depth<MAX_PATH) {
+			path[depth].key=key;
+			path[depth].index=index;
+		}
+		++depth;
+	}
+	inline void pop() {--depth;}
+
+	std::string pointer() const {
+		std::string r;
+		for (uint32_t i=0;i<depth && i<MAX_PATH;++i) {
+			r+='/';
+			if (!path[i].key) {
+				r+=std::to_string(path[i].index);
+				continue;
+			}
+			for (const char* k=path[i].key;*k;++k) {
+				if (*k=='~') r+="~0";
+				else if (*k=='/') r+="~1";
+				else r+=*k;
+			}
+		}
+		if (depth>MAX_PATH) r+="/...";
+		return r;
+	}
+
+	// records an error; false once no more are wanted
+	template<typename F> bool fail(F message) {
+		if (!errors) return false;
+		errors->push_back(Error{pointer(), message()});
+		return errors->size()<maxErrors;
+	}
+};
+
+Schema::Schema(const jsonptr& schema) : source(schema) {
+	if (!schema) throw std::runtime_error("Invalid schema: null");
+	root=compile(source.get(), "#");
+}
+
+uint32_t Schema::compile(const json_t* s, const std::string& where) {
+	std::vector<Insn> code;
+	if (json_is_false(s)) code.push_back(Insn{FAIL, 0, 0, 0, 0});
+	else if (!json_is_true(s) && !json_is_object(s)) throw std::runtime_error("Invalid schema at "+where+": a schema is an object or a boolean");
+	const json_t* additional=nullptr;
+	const json_t* required=nullptr;
+	std::vector<Member> declared;
+	auto schemaList=[&](const char* k, const json_t* v) {
+		if (!json_is_array(v) || !json_array_size(v)) throw std::runtime_error("Invalid schema at "+where+": "+k+" must be a non-empty array");
+		std::vector<uint32_t> blocks;
+		for (size_t i=0;i<json_array_size(v);++i) blocks.push_back(compile(json_array_get(v, i), where+"/"+k+"/"+std::to_string(i)));
+		return blocks;
+	};
+	if (json_is_object(s)) for (auto kv : JsonKeyValuePairs(s)) {
+		const char* k=kv.first;
+		const json_t* v=kv.second;
+		std::string at=where+"/"+k;
+		if (!strcmp(k, "type")) {
+			uint32_t mask=0;
+			if (json_is_string(v)) mask=typeBit(json_string_value(v), at);
+			else if (json_is_array(v)) {
+				for (auto t : JsonArrayElements(v)) {
+					if (!json_is_string(t)) throw std::runtime_error("Invalid schema at "+at+": type names must be strings");
+					mask|=typeBit(json_string_value(t), at);
+				}
+			} else throw std::runtime_error("Invalid schema at "+at+": type must be a string or an array");
+			if (mask & T_NUMBER) mask|=T_INTEGER;
+			code.push_back(Insn{TYPE, mask, 0, 0, 0});
+		} else if (!strcmp(k, "enum")) {
+			if (!json_is_array(v)) throw std::runtime_error("Invalid schema at "+at+": enum must be an array");
+			code.push_back(Insn{ENUM, (uint32_t)values.size(), (uint32_t)json_array_size(v), 0, 0});
+			for (auto e : JsonArrayElements(v)) values.push_back(e);
+		} else if (!strcmp(k, "const")) {
+			code.push_back(Insn{CONST, (uint32_t)values.size(), 0, 0, 0});
+			values.push_back(v);
+		} else if (!strcmp(k, "minimum") || !strcmp(k, "maximum") || !strcmp(k, "exclusiveMinimum") || !strcmp(k, "exclusiveMaximum")) {
+			if (!json_is_number(v)) throw std::runtime_error("Invalid schema at "+at+": "+k+" must be a number");
+			bool exclusive=k[0]=='e';
+			bool min=strstr(k, "inimum")!=nullptr;
+			code.push_back(Insn{min ? MINIMUM : MAXIMUM, exclusive, 0, 0, number(v)});
+		} else if (!strcmp(k, "multipleOf")) {
+			if (!json_is_number(v) || number(v)<=0) throw std::runtime_error("Invalid schema at "+at+": multipleOf must be a positive number");
+			code.push_back(Insn{MULTIPLE_OF, 0, 0, 0, number(v)});
+		} else if (!strcmp(k, "minLength")) {
+			code.push_back(Insn{MIN_LENGTH, count(v, k, at), 0, 0, 0});
+		} else if (!strcmp(k, "maxLength")) {
+			code.push_back(Insn{MAX_LENGTH, count(v, k, at), 0, 0, 0});
+		} else if (!strcmp(k, "minItems")) {
+			code.push_back(Insn{MIN_ITEMS, count(v, k, at), 0, 0, 0});
+		} else if (!strcmp(k, "maxItems")) {
+			code.push_back(Insn{MAX_ITEMS, count(v, k, at), 0, 0, 0});
+		} else if (!strcmp(k, "minProperties")) {
+			code.push_back(Insn{MIN_PROPERTIES, count(v, k, at), 0, 0, 0});
+		} else if (!strcmp(k, "maxProperties")) {
+			code.push_back(Insn{MAX_PROPERTIES, count(v, k, at), 0, 0, 0});
+		} else if (!strcmp(k, "uniqueItems")) {
+			if (!json_is_boolean(v)) throw std::runtime_error("Invalid schema at "+at+": uniqueItems must be a boolean");
+			if (json_is_true(v)) code.push_back(Insn{UNIQUE_ITEMS, 0, 0, 0, 0});
+		} else if (!strcmp(k, "pattern")) {
+			if (!json_is_string(v)) throw std::runtime_error("Invalid schema at "+at+": pattern must be a string");
+			try {
+				patterns.emplace_back(new std::regex(json_string_value(v), std::regex::ECMAScript | std::regex::optimize));
+			} catch (const std::regex_error& e) {
+				throw std::runtime_error("Invalid schema at "+at+": bad pattern: "+e.what());
+			}
+			code.push_back(Insn{PATTERN, (uint32_t)patterns.size()-1, 0, 0, 0});
+		} else if (!strcmp(k, "items")) {
+			code.push_back(Insn{ITEMS, compile(v, at), 0, 0, 0});
+		} else if (!strcmp(k, "required")) {
+			if (!json_is_array(v)) throw std::runtime_error("Invalid schema at "+at+": required must be an array");
+			for (auto r : JsonArrayElements(v)) {
+				if (!json_is_string(r)) throw std::runtime_error("Invalid schema at "+at+": required names must be strings");
+			}
+			required=v;
+		} else if (!strcmp(k, "properties")) {
+			if (!json_is_object(v)) throw std::runtime_error("Invalid schema at "+at+": properties must be an object");
+			for (auto p : JsonKeyValuePairs(v)) declared.push_back(Member{p.first, compile(p.second, at+"/"+p.first), false});
+		} else if (!strcmp(k, "additionalProperties")) {
+			additional=v;
+		} else if (!strcmp(k, "allOf")) {
+			for (auto b : schemaList(k, v)) code.push_back(Insn{ALL_OF, b, 0, 0, 0});
+		} else if (!strcmp(k, "anyOf") || !strcmp(k, "oneOf")) {
+			auto blocks=schemaList(k, v);
+			code.push_back(Insn{k[0]=='a' ? ANY_OF : ONE_OF, (uint32_t)blocks.size(), 0, 0, 0});
+			for (auto b : blocks) code.push_back(Insn{BRANCH, b, 0, 0, 0});
+		} else if (!strcmp(k, "not")) {
+			code.push_back(Insn{NOT, compile(v, at), 0, 0, 0});
+		} else if (!annotation(k)) {
+			throw std::runtime_error("Invalid schema at "+at+": unsupported keyword "+k);
+		}
+	}
+	if (additional || required || !declared.empty()) {
+		// properties, required and additionalProperties become one pass over the members of
+		// the instance, looking each up in the sorted member table
+		std::sort(declared.begin(), declared.end(), [](const Member& x, const Member& y) {return strcmp(x.name, y.name)<0;});
+		uint32_t requiredCount=0;
+		if (required) for (auto r : JsonArrayElements(required)) {
+			const char* name=json_string_value(r);
+			auto m=std::lower_bound(declared.begin(), declared.end(), name, byName);
+			if (m==declared.end() || strcmp(m->name, name)) m=declared.insert(m, Member{name, NONE, false});
+			requiredCount+=!m->required;
+			m->required=true;
+		}
+		uint32_t block=additional ? compile(additional, where+"/additionalProperties") : NONE;
+		code.push_back(Insn{OBJECT, (uint32_t)members.size(), (uint32_t)declared.size(), block, 0, requiredCount});
+		members.insert(members.end(), declared.begin(), declared.end());
+	}
+	code.push_back(Insn{END, 0, 0, 0, 0});
+	uint32_t start=program.size();
+	program.insert(program.end(), code.begin(), code.end());
+	return start;
+}
+
+// short cut for the common leaf schema that only checks the type of a value
+inline bool Schema::typeOnly(uint32_t block, const json_t* v) const {
+	return program[block].op==TYPE && program[block+1].op==END && (typeMask(v) & program[block].a);
+}
+
+bool Schema::run(uint32_t pc, const json_t* v, Context* ctx) const {
+	bool ok=true;
+	for (;;++pc) {
+		const Insn& in=program[pc];
+		switch (in.op) {
+			case END:
+				return ok;
+			case FAIL:
+				ok=false;
+				if (!ctx->fail([&]() {return std::string("no value is allowed here");})) return false;
+				break;
+			case TYPE:
+				if (!(typeMask(v) & in.a)) {
+					ctx->fail([&]() {
+						std::string expected;
+						for (uint32_t i=0;i<7;++i) {
+							if (!(in.a & (1u<<i)) || (i==6 && (in.a & T_NUMBER))) continue;
+							expected+=expected.empty() ? "" : " or ";
+							expected+=TYPE_NAMES[i];
+						}
+						return "expected "+expected+", got "+typeName(v);
+					});
+					// the remaining keywords would only pile up noise about the same value
+					return false;
+				}
+				break;
+			case MINIMUM:
+			case MAXIMUM:
+				if (json_is_number(v)) {
+					double d=number(v);
+					bool bad=in.op==MINIMUM ? (in.a ? d<=in.d : d<in.d) : (in.a ? d>=in.d : d>in.d);
+					if (json_is_integer(v) && in.d==std::floor(in.d) && std::fabs(in.d)<9e15) {
+						long long x=json_integer_value(v), lim=(long long)in.d;
+						bad=in.op==MINIMUM ? (in.a ? x<=lim : x<lim) : (in.a ? x>=lim : x>lim);
+					}
+					if (bad) {
+						ok=false;
+						if (!ctx->fail([&]() {
+							return brief(v)+" is "+(in.op==MINIMUM ? "less than " : "greater than ")+(in.a ? "or equal to " : "")+format(in.d);
+						})) return false;
+					}
+				}
+				break;
+			case MULTIPLE_OF:
+				if (json_is_number(v)) {
+					bool bad;
+					if (json_is_integer(v) && in.d==std::floor(in.d) && in.d<9e15) bad=json_integer_value(v)%(long long)in.d!=0;
+					else {
+						double q=number(v)/in.d;
+						bad=!std::isfinite(q) || std::fabs(q-std::round(q))>1e-9*std::max(1.0, std::fabs(q));
+					}
+					if (bad) {
+						ok=false;
+						if (!ctx->fail([&]() {return brief(v)+" is not a multiple of "+format(in.d);})) return false;
+					}
+				}
+				break;
+			case MIN_LENGTH:
+			case MAX_LENGTH:
+				if (json_is_string(v)) {
+					size_t n=utf8Length(json_string_value(v), json_string_length(v));
+					if (in.op==MIN_LENGTH ? n<in.a : n>in.a) {
+						ok=false;
+						if (!ctx->fail([&]() {
+							return "string of length "+std::to_string(n)+" is "+(in.op==MIN_LENGTH ? "shorter than " : "longer than ")+std::to_string(in.a);
+						})) return false;
+					}
+				}
+				break;
+			case PATTERN:
+				if (json_is_string(v)) {
+					const char* s=json_string_value(v);
+					if (!std::regex_search(s, s+json_string_length(v), *patterns[in.a])) {
+						ok=false;
+						if (!ctx->fail([&]() {return brief(v)+" does not match the pattern";})) return false;
+					}
+				}
+				break;
+			case MIN_ITEMS:
+			case MAX_ITEMS:
+			case MIN_PROPERTIES:
+			case MAX_PROPERTIES: {
+				bool items=in.op==MIN_ITEMS || in.op==MAX_ITEMS;
+				if (items ? json_is_array(v) : json_is_object(v)) {
+					size_t n=items ? json_array_size(v) : json_object_size(v);
+					if ((in.op==MIN_ITEMS || in.op==MIN_PROPERTIES) ? n<in.a : n>in.a) {
+						ok=false;
+						if (!ctx->fail([&]() {
+							return std::string(items ? "array" : "object")+" has "+std::to_string(n)+(items ? " items" : " properties")
+									+", "+((in.op==MIN_ITEMS || in.op==MIN_PROPERTIES) ? "at least " : "at most ")+std::to_string(in.a)+" allowed";
+						})) return false;
+					}
+				}
+				break;
+			}
+			case UNIQUE_ITEMS:
+				if (json_is_array(v)) {
+					size_t n=json_array_size(v);
+					for (size_t i=1;i<n;++i) {
+						for (size_t j=0;j<i;++j) {
+							if (!json_equal(json_array_get(v, i), json_array_get(v, j))) continue;
+							ok=false;
+							if (!ctx->fail([&]() {return "items "+std::to_string(j)+" and "+std::to_string(i)+" are equal";})) return false;
+							i=n;
+							break;
+						}
+					}
+				}
+				break;
+			case ITEMS:
+				if (json_is_array(v)) {
+					for (size_t i=0;i<json_array_size(v);++i) {
+						if (typeOnly(in.a, json_array_get(v, i))) continue;
+						ctx->push(nullptr, i);
+						bool r=run(in.a, json_array_get(v, i), ctx);
+						ctx->pop();
+						if (!r) {
+							ok=false;
+							if (!ctx->errors || ctx->errors->size()>=ctx->maxErrors) return false;
+						}
+					}
+				}
+				break;
+			case OBJECT:
+				if (json_is_object(v)) {
+					auto first=members.begin()+in.a, last=first+in.b;
+					uint32_t present=0;
+					for (auto kv : JsonKeyValuePairs(v)) {
+						auto m=std::lower_bound(first, last, kv.first, byName);
+						uint32_t block=in.c;
+						if (m!=last && !strcmp(m->name, kv.first)) {
+							present+=m->required;
+							// a name only listed in required is still checked as an additional property
+							if (m->block!=NONE) block=m->block;
+						}
+						if (block==in.c && block!=NONE && program[block].op==FAIL) {
+							ok=false;
+							if (!ctx->fail([&]() {return std::string("property ")+kv.first+" is not allowed";})) return false;
+							continue;
+						}
+						if (block==NONE || typeOnly(block, kv.second)) continue;
+						ctx->push(kv.first, 0);
+						bool r=run(block, kv.second, ctx);
+						ctx->pop();
+						if (!r) {
+							ok=false;
+							if (!ctx->errors || ctx->errors->size()>=ctx->maxErrors) return false;
+						}
+					}
+					if (present<in.n) {
+						ok=false;
+						for (auto m=first;m!=last;++m) {
+							if (!m->required || json_object_get(v, m->name)) continue;
+							if (!ctx->fail([&]() {return std::string("missing required property ")+m->name;})) return false;
+						}
+					}
+				}
+				break;
+			case ENUM:
+			case CONST: {
+				bool found=false;
+				for (uint32_t i=0;i<(in.op==ENUM ? in.b : 1) && !found;++i) found=json_equal((json_t*)v, (json_t*)values[in.a+i]);
+				if (!found) {
+					ok=false;
+					if (!ctx->fail([&]() {return brief(v)+(in.op==ENUM ? " is not one of the allowed values" : " is not the expected constant");})) return false;
+				}
+				break;
+			}
+			case ALL_OF:
+				if (!run(in.a, v, ctx)) {
+					ok=false;
+					if (!ctx->errors || ctx->errors->size()>=ctx->maxErrors) return false;
+				}
+				break;
+			case ANY_OF:
+			case ONE_OF: {
+				// alternatives are tried silently, their own errors would only confuse
+				Context quiet;
+				quiet.errors=nullptr;
+				quiet.depth=0;
+				uint32_t matched=0;
+				for (uint32_t i=1;i<=in.a;++i) {
+					if (run(program[pc+i].a, v, &quiet)) ++matched;
+					if (in.op==ANY_OF ? matched>0 : matched>1) break;
+				}
+				if (in.op==ANY_OF ? matched==0 : matched!=1) {
+					ok=false;
+					if (!ctx->fail([&]() {
+						if (in.op==ANY_OF) return std::string("value matches none of the anyOf schemas");
+						return std::string(matched ? "value matches more than one oneOf schema" : "value matches none of the oneOf schemas");
+					})) return false;
+				}
+				pc+=in.a;
+				break;
+			}
+			case NOT: {
+				Context quiet;
+				quiet.errors=nullptr;
+				quiet.depth=0;
+				if (run(in.a, v, &quiet)) {
+					ok=false;
+					if (!ctx->fail([&]() {return std::string("value matches a schema it must not match");})) return false;
+				}
+				break;
+			}
+		}
+	}
+}
+
+bool Schema::validate(const json_t* doc) const {
+	if (!doc) return false;
+	Context ctx;
+	ctx.errors=nullptr;
+	ctx.maxErrors=0;
+	ctx.depth=0;
+	return run(root, doc, &ctx);
+}
+
+bool Schema::validate(const json_t* doc, std::vector<Error>& errors, size_t maxErrors) const {
+	errors.clear();
+	if (!doc) {
+		errors.push_back(Error{"", "no document"});
+		return false;
+	}
+	Context ctx;
+	ctx.errors=&errors;
+	ctx.maxErrors=std::max<size_t>(maxErrors, 1);
+	ctx.depth=0;
+	return run(root, doc, &ctx);
+}
+
+void Schema::check(const json_t* doc, size_t maxErrors) const {
+	std::vector<Error> errors;
+	if (validate(doc, errors, maxErrors+1)) return;
+	std::string msg="Invalid document: ";
+	for (size_t i=0;i<errors.size() && i<maxErrors;++i) {
+		if (i) msg+="; ";
+		msg+=(errors[i].path.empty() ? "(root)" : errors[i].path)+": "+errors[i].message;
+	}
+	if (errors.size()>maxErrors) msg+="; ...";
+	throw std::runtime_error(msg);
+}
+
+}
@@ -0,0 +1,85 @@
+#ifndef SRC_JSONSCHEMA_H_
+#define SRC_JSONSCHEMA_H_
+
+#include <cstdint>
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+#include <jsonutils.h>
+
+/*
+ * JSON Schema validation, compiled.
+ *
+ *   static const json::Schema orderSchema(json::parse(utils::slurpTextFile("order.schema.json")));
+ *   orderSchema.check(doc);           // throws: "Invalid document: /items/3/qty: 0 is less than 1; ..."
+ *   if (!orderSchema.validate(doc)) ...
+ *
+ * A schema is compiled once into a flat instruction program; validation walks the
+ * document and the program together and allocates nothing unless it has an error to
+ * report (pattern checks run std::regex, which may). Error reports are bounded: at most
+ * maxErrors entries, each a JSON Pointer to the offending value and a short message that
+ * never embeds more than a few dozen characters of the document.
+ *
+ * Supported, from draft 2020-12: boolean schemas, type, enum, const, minimum, maximum,
+ * exclusiveMinimum, exclusiveMaximum, multipleOf, minLength, maxLength, pattern, items,
+ * minItems, maxItems, uniqueItems, required, properties, additionalProperties,
+ * minProperties, maxProperties, allOf, anyOf, oneOf, not. Annotations ($schema, $id,
+ * title, description, default, examples, ...) are ignored; any other keyword, $ref
+ * included, is rejected at compile time rather than silently skipped.
+ */
+
+namespace json {
+
+class Schema {
+public:
+	struct Error {
+		std::string path;
+		std::string message;
+	};
+	struct Insn {
+		uint8_t op;
+		uint32_t a, b, c;
+		double d;
+		uint32_t n;
+	};
+	struct Member {
+		const char* name;
+		uint32_t block;
+		bool required;
+	};
+private:
+	jsonptr source;
+	std::vector<Insn> program;
+	std::vector<Member> members;
+	std::vector<const json_t*> values;
+	std::vector<std::unique_ptr<std::regex>> patterns;
+	uint32_t root;
+	struct Context;
+
+	uint32_t compile(const json_t* s, const std::string& where);
+	bool typeOnly(uint32_t block, const json_t* v) const;
+	bool run(uint32_t pc, const json_t* v, Context* ctx) const;
+public:
+	explicit Schema(const jsonptr& schema);
+	explicit Schema(const std::string& schemaText) : Schema(parse(schemaText)) {}
+	Schema(const Schema&) = delete;
+	Schema& operator=(const Schema&) = delete;
+
+	bool validate(const json_t* doc) const;
+	inline bool validate(const jsonptr& doc) const {return validate(doc.get());}
+	// collects up to maxErrors errors, returns true if there were none
+	bool validate(const json_t* doc, std::vector<Error>& errors, size_t maxErrors=10) const;
+	inline bool validate(const jsonptr& doc, std::vector<Error>& errors, size_t maxErrors=10) const {
+		return validate(doc.get(), errors, maxErrors);
+	}
+	// throws std::runtime_error listing up to maxErrors errors
+	void check(const json_t* doc, size_t maxErrors=5) const;
+	inline void check(const jsonptr& doc, size_t maxErrors=5) const {check(doc.get(), maxErrors);}
+
+	inline size_t programSize() const {return program.size();}
+};
+
+}
+
+#endif /* SRC_JSONSCHEMA_H_ */
@@ -0,0 +1,359 @@
+#include <jsonsnapshot.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <utils.h>
+
+namespace json {
+
+using namespace snapshot;
+
+namespace {
+
+const char MAGIC[8]={'C','U','J','S','N','A','P','1'};
+const uint32_t VERSION=1;
+const uint32_t ORDER_MARK=0x01020304;
+
+[[noreturn]] void corrupt(const std::string& what) {
+	throw std::runtime_error("Corrupt json snapshot: "+what);
+}
+
+inline int compareKey(const char* a, size_t alen, const char* b, size_t blen) {
+	int c=memcmp(a, b, std::min(alen, blen));
+	if (c) return c;
+	return alen<blen ? -1 : (alen>blen ? 1 : 0);
+}
+
+class Compiler {
+	std::string& out;
+	size_t start;
+	std::unordered_map<std::string_view, uint32_t> keyIds;
+	std::vector<std::string_view> keys;
+	std::unordered_map<std::string_view, uint64_t> strings;
+
+	size_t alloc(size_t size, size_t align) {
+		size_t pos=out.size()-start;
+		size_t pad=(align-pos%align)%align;
+		out.append(pad+size, '\0');
+		return pos+pad;
+	}
+	uint64_t putString(const char* s, size_t len) {
+		std::string_view v(s, len);
+		auto it=strings.find(v);
+		if (it!=strings.end()) return it->second;
+		size_t off=alloc(len+1, 1);
+		memcpy(&out[start+off], s, len);
+		strings.emplace(v, off);
+		return off;
+	}
+	void collectKeys(const json_t* j) {
+		if (json_is_object(j)) {
+			for (auto p : getJsonKeyValuePairs(j)) {
+				keyIds.emplace(std::string_view(p.first), 0);
+				collectKeys(p.second);
+			}
+		} else if (json_is_array(j)) {
+			for (auto e : getJsonArrayElements(j)) collectKeys(e);
+		}
+	}
+	static uint32_t count(size_t n) {
+		if (n>=UINT32_MAX) throw std::runtime_error("Json value is too large for a snapshot: "+std::to_string(n));
+		return (uint32_t)n;
+	}
+	Slot value(const json_t* j) {
+		Slot s;
+		memset(&s, 0, sizeof(s));
+		if (!j) {
+			s.type=JSON_NULL;
+			return s;
+		}
+		s.type=json_typeof(j);
+		switch (json_typeof(j)) {
+			case JSON_OBJECT: {
+				std::vector<std::pair<uint32_t, const json_t*>> entries;
+				entries.reserve(json_object_size(j));
+				for (auto p : getJsonKeyValuePairs(j)) entries.emplace_back(keyIds[std::string_view(p.first)], p.second);
+				std::sort(entries.begin(), entries.end(), [](const std::pair<uint32_t, const json_t*>& a, const std::pair<uint32_t, const json_t*>& b) {
+					return a.first<b.first;
+				});
+				s.count=count(entries.size());
+				size_t area=alloc(entries.size()*sizeof(Entry), 8);
+				s.value=area;
+				for (size_t i=0;i<entries.size();++i) {
+					Entry e;
+					memset(&e, 0, sizeof(e));
+					e.key=entries[i].first;
+					e.value=value(entries[i].second);
+					memcpy(&out[start+area+i*sizeof(Entry)], &e, sizeof(e));
+				}
+				break;
+			}
+			case JSON_ARRAY: {
+				size_t n=json_array_size(j);
+				s.count=count(n);
+				size_t area=alloc(n*sizeof(Slot), 8);
+				s.value=area;
+				for (size_t i=0;i<n;++i) {
+					Slot e=value(json_array_get(j, i));
+					memcpy(&out[start+area+i*sizeof(Slot)], &e, sizeof(e));
+				}
+				break;
+			}
+			case JSON_STRING:
+				s.count=count(json_string_length(j));
+				s.value=putString(json_string_value(j), json_string_length(j));
+				break;
+			case JSON_INTEGER:
+				s.value=(uint64_t)json_integer_value(j);
+				break;
+			case JSON_REAL: {
+				double d=json_real_value(j);
+				memcpy(&s.value, &d, sizeof(d));
+				break;
+			}
+			default:
+				break;
+		}
+		return s;
+	}
+public:
+	Compiler(std::string& o) : out(o), start(o.size()) {}
+	void compile(const json_t* j) {
+		alloc(sizeof(Header), 8);
+		collectKeys(j);
+		keys.reserve(keyIds.size());
+		for (auto& k : keyIds) keys.push_back(k.first);
+		std::sort(keys.begin(), keys.end());
+		std::vector<KeyRef> refs(keys.size());
+		for (size_t i=0;i<keys.size();++i) {
+			keyIds[keys[i]]=(uint32_t)i;
+			memset(&refs[i], 0, sizeof(KeyRef));
+			refs[i].offset=putString(keys[i].data(), keys[i].size());
+			refs[i].length=count(keys[i].size());
+		}
+		size_t table=alloc(refs.size()*sizeof(KeyRef), 8);
+		if (!refs.empty()) memcpy(&out[start+table], refs.data(), refs.size()*sizeof(KeyRef));
+		Header h;
+		memset(&h, 0, sizeof(h));
+		h.root=value(j);
+		alloc(0, 8);
+		memcpy(h.magic, MAGIC, sizeof(MAGIC));
+		h.version=VERSION;
+		h.byteOrder=ORDER_MARK;
+		h.size=out.size()-start;
+		h.keyCount=keys.size();
+		h.keyTable=table;
+		memcpy(&out[start], &h, sizeof(h));
+	}
+};
+
+}
+
+void compileSnapshot(const json_t* j, std::string& out) {
+	Compiler(out).compile(j);
+}
+
+void writeSnapshot(const json_t* j, const std::string& fileName) {
+	std::string out;
+	compileSnapshot(j, out);
+	utils::dumpToFileAtomic(fileName, out);
+}
+
+Snapshot::Snapshot(const std::string& fileName) : base(nullptr), len(0), mapping(nullptr), header(nullptr) {
+	utils::FD fd(::open(fileName.c_str(), O_RDONLY | O_CLOEXEC));
+	if (!fd) utils::errno_exception("Failed to open: "+fileName);
+	struct stat st;
+	if (::fstat(fd, &st)!=0) utils::errno_exception("Failed to stat: "+fileName);
+	if ((size_t)st.st_size<sizeof(Header)) throw std::runtime_error("Not a json snapshot: "+fileName);
+	void* m=::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (m==MAP_FAILED) utils::errno_exception("Failed to map: "+fileName);
+	mapping=m;
+	try {
+		open((const char*)m, st.st_size);
+	} catch (...) {
+		::munmap(mapping, st.st_size);
+		throw;
+	}
+}
+
+Snapshot::Snapshot(const void* p, size_t l) : base(nullptr), len(0), mapping(nullptr), header(nullptr) {
+	open((const char*)p, l);
+}
+
+Snapshot::~Snapshot() {
+	if (mapping) ::munmap(mapping, len);
+}
+
+void Snapshot::open(const char* p, size_t l) {
+	base=p;
+	len=l;
+	if (len<sizeof(Header) || ((uintptr_t)p & 7)) corrupt("truncated or misaligned header");
+	header=(const Header*)p;
+	if (memcmp(header->magic, MAGIC, sizeof(MAGIC))!=0) corrupt("bad magic");
+	if (header->version!=VERSION) corrupt("unsupported version "+std::to_string(header->version));
+	if (header->byteOrder!=ORDER_MARK) corrupt("written with a different byte order");
+	if (header->size!=len) corrupt("size "+std::to_string(len)+" does not match the header size "+std::to_string(header->size));
+	at(header->keyTable, 0, 8);
+	// divided rather than multiplied, so a hostile count cannot wrap the product
+	if (header->keyCount>(len-header->keyTable)/sizeof(KeyRef)) corrupt("key count "+std::to_string(header->keyCount)+" is out of bounds");
+}
+
+const char* Snapshot::at(uint64_t offset, uint64_t size, uint64_t align) const {
+	if (offset>len || size>len-offset) corrupt("range "+std::to_string(offset)+"+"+std::to_string(size)+" is out of bounds");
+	if (offset%align) corrupt("offset "+std::to_string(offset)+" is misaligned");
+	return base+offset;
+}
+
+const KeyRef& Snapshot::keyRef(uint32_t id) const {
+	if (id>=header->keyCount) corrupt("key id "+std::to_string(id)+" is out of range");
+	return ((const KeyRef*)(base+header->keyTable))[id];
+}
+
+const char* Snapshot::key(uint32_t id) const {
+	const KeyRef& r=keyRef(id);
+	const char* s=at(r.offset, (uint64_t)r.length+1);
+	if (s[r.length]) corrupt("key is not terminated");
+	return s;
+}
+
+uint32_t Snapshot::keyId(const char* k, size_t klen) const {
+	const KeyRef* table=(const KeyRef*)(base+header->keyTable);
+	size_t lo=0, hi=header->keyCount;
+	while (lo<hi) {
+		size_t mid=(lo+hi)/2;
+		int c=compareKey(at(table[mid].offset, table[mid].length), table[mid].length, k, klen);
+		if (c==0) return (uint32_t)mid;
+		if (c<0) lo=mid+1;
+		else hi=mid;
+	}
+	return SnapshotNode::npos;
+}
+
+SnapshotNode Snapshot::root() const {
+	return SnapshotNode(this, &header->root);
+}
+
+size_t SnapshotNode::size() const {
+	return (isArray() || isObject()) ? slot->count : 0;
+}
+
+SnapshotNode SnapshotNode::at(size_t i) const {
+	if (!isArray() || i>=slot->count) return SnapshotNode();
+	const Slot* elements=(const Slot*)snap->at(slot->value, (uint64_t)slot->count*sizeof(Slot), 8);
+	return SnapshotNode(snap, elements+i);
+}
+
+SnapshotNode SnapshotNode::find(const char* key, size_t len) const {
+	if (!isObject()) return SnapshotNode();
+	const Entry* entries=(const Entry*)snap->at(slot->value, (uint64_t)slot->count*sizeof(Entry), 8);
+	size_t lo=0, hi=slot->count;
+	while (lo<hi) {
+		size_t mid=(lo+hi)/2;
+		const KeyRef& r=snap->keyRef(entries[mid].key);
+		int c=compareKey(snap->at(r.offset, r.length), r.length, key, len);
+		if (c==0) return SnapshotNode(snap, &entries[mid].value);
+		if (c<0) lo=mid+1;
+		else hi=mid;
+	}
+	return SnapshotNode();
+}
+
+SnapshotNode SnapshotNode::find(uint32_t keyId) const {
+	if (!isObject() || keyId==npos) return SnapshotNode();
+	const Entry* entries=(const Entry*)snap->at(slot->value, (uint64_t)slot->count*sizeof(Entry), 8);
+	size_t lo=0, hi=slot->count;
+	while (lo<hi) {
+		size_t mid=(lo+hi)/2;
+		uint32_t k=entries[mid].key;
+		if (k==keyId) return SnapshotNode(snap, &entries[mid].value);
+		if (k<keyId) lo=mid+1;
+		else hi=mid;
+	}
+	return SnapshotNode();
+}
+
+const char* SnapshotNode::string() const {
+	if (!isString()) return nullptr;
+	const char* s=snap->at(slot->value, (uint64_t)slot->count+1);
+	if (s[slot->count]) corrupt("string is not terminated");
+	return s;
+}
+
+size_t SnapshotNode::stringLength() const {
+	return isString() ? slot->count : 0;
+}
+
+double SnapshotNode::real() const {
+	if (!isReal()) return 0;
+	double d;
+	memcpy(&d, &slot->value, sizeof(d));
+	return d;
+}
+
+namespace {
+// offsets come from the file, so a corrupt one can nest values without end or point back
+// at a parent; nesting is capped like the parser's, and a tree cannot have more nodes
+// than the file has slots, which also stops shared subtrees from multiplying
+struct Builder {
+	uint64_t budget;
+	int depth=0;
+	explicit Builder(size_t len) : budget(len/sizeof(Slot)+1) {}
+	json_t* build(const SnapshotNode& n) {
+		if (budget--==0) corrupt("more values than the snapshot can hold");
+		switch (n.type()) {
+			case JSON_OBJECT: {
+				if (++depth>JSON_PARSER_MAX_DEPTH) corrupt("maximum nesting depth exceeded");
+				// owned until complete, so a corrupt member does not leak what was built
+				jsonptr o=own(json_object());
+				for (auto p : n.pairs()) json_object_set_new_nocheck(o.get(), p.first, build(p.second));
+				--depth;
+				return json_incref(o.get());
+			}
+			case JSON_ARRAY: {
+				if (++depth>JSON_PARSER_MAX_DEPTH) corrupt("maximum nesting depth exceeded");
+				jsonptr a=own(json_array());
+				for (auto e : n.elements()) json_array_append_new(a.get(), build(e));
+				--depth;
+				return json_incref(a.get());
+			}
+			case JSON_STRING: return json_stringn_nocheck(n.string(), n.stringLength());
+			case JSON_INTEGER: return json_integer(n.integer());
+			case JSON_REAL: return json_real(n.real());
+			case JSON_TRUE: return json_true();
+			case JSON_FALSE: return json_false();
+			case JSON_NULL: return json_null();
+			default: corrupt("unknown value type "+std::to_string(n.type()));
+		}
+	}
+};
+}
+
+jsonptr SnapshotNode::materialize() const {
+	if (!slot) return jsonptr();
+	return own(Builder(snap->size()).build(*this));
+}
+
+SnapshotArrayIterator SnapshotArrayElements::begin() const {
+	if (!n.isArray()) return SnapshotArrayIterator(nullptr, nullptr);
+	return SnapshotArrayIterator(n.snap, (const Slot*)n.snap->at(n.slot->value, (uint64_t)n.slot->count*sizeof(Slot), 8));
+}
+SnapshotArrayIterator SnapshotArrayElements::end() const {
+	if (!n.isArray()) return SnapshotArrayIterator(nullptr, nullptr);
+	return SnapshotArrayIterator(n.snap, (const Slot*)n.snap->at(n.slot->value, (uint64_t)n.slot->count*sizeof(Slot), 8)+n.slot->count);
+}
+
+SnapshotKeyValueIterator SnapshotKeyValuePairs::begin() const {
+	if (!n.isObject()) return SnapshotKeyValueIterator(nullptr, nullptr);
+	return SnapshotKeyValueIterator(n.snap, (const Entry*)n.snap->at(n.slot->value, (uint64_t)n.slot->count*sizeof(Entry), 8));
+}
+SnapshotKeyValueIterator SnapshotKeyValuePairs::end() const {
+	if (!n.isObject()) return SnapshotKeyValueIterator(nullptr, nullptr);
+	return SnapshotKeyValueIterator(n.snap, (const Entry*)n.snap->at(n.slot->value, (uint64_t)n.slot->count*sizeof(Entry), 8)+n.slot->count);
+}
+
+}
@@ -0,0 +1,248 @@
+#ifndef SRC_JSONSNAPSHOT_H_
+#define SRC_JSONSNAPSHOT_H_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <jsonutils.h>
+
+/*
+ * Read-only, memory-mappable json snapshots.
+ *
+ * compileSnapshot() lays a json tree out as a flat file: fixed size slots with scalars
+ * stored inline, arrays as slot vectors, objects as entry vectors sorted by key, and one
+ * sorted, deduplicated key table. Strings are NUL terminated so they can be handed out
+ * as const char* straight from the mapping.
+ *
+ *   json::writeSnapshot(tree, "/var/lib/app/reference.snap");
+ *   json::Snapshot snap("/var/lib/app/reference.snap");   // mmap, no parsing
+ *   const char* city=json::getString(snap.root(), "address", "city");
+ *
+ * Opening a snapshot only validates the header; offsets are bounds checked as nodes are
+ * visited, and a corrupt file throws std::runtime_error rather than reading out of the
+ * mapping. Snapshots use the native byte order and are rejected on a mismatch. Processes
+ * mapping the same file share its page cache pages.
+ */
+
+namespace json {
+
+void compileSnapshot(const json_t* j, std::string& out);
+inline void compileSnapshot(const jsonptr& j, std::string& out) {compileSnapshot(j.get(), out);}
+// writes to a temporary file next to fileName and renames it over, so readers that still
+// map the previous version are unaffected
+void writeSnapshot(const json_t* j, const std::string& fileName);
+inline void writeSnapshot(const jsonptr& j, const std::string& fileName) {writeSnapshot(j.get(), fileName);}
+
+namespace snapshot {
+struct Slot {
+	uint8_t type;
+	uint8_t reserved[3];
+	uint32_t count;
+	uint64_t value;
+};
+struct Entry {
+	uint32_t key;
+	uint32_t reserved;
+	Slot value;
+};
+struct KeyRef {
+	uint64_t offset;
+	uint32_t length;
+	uint32_t reserved;
+};
+struct Header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint64_t size;
+	uint64_t keyCount;
+	uint64_t keyTable;
+	Slot root;
+	uint64_t reserved;
+};
+}
+
+class Snapshot;
+class SnapshotArrayElements;
+class SnapshotKeyValuePairs;
+
+class SnapshotNode {
+	const Snapshot* snap;
+	const snapshot::Slot* slot;
+	friend class SnapshotArrayIterator;
+	friend class SnapshotArrayElements;
+	friend class SnapshotKeyValueIterator;
+	friend class SnapshotKeyValuePairs;
+	inline uint8_t kind() const {return slot ? slot->type : (uint8_t)JSON_NULL;}
+public:
+	static const uint32_t npos=UINT32_MAX;
+	inline SnapshotNode() : snap(nullptr), slot(nullptr) {}
+	inline SnapshotNode(const Snapshot* s, const snapshot::Slot* sl) : snap(s), slot(sl) {}
+	inline explicit operator bool() const {return slot!=nullptr;}
+
+	inline json_type type() const {return (json_type)kind();}
+	inline bool isObject() const {return slot && slot->type==JSON_OBJECT;}
+	inline bool isArray() const {return slot && slot->type==JSON_ARRAY;}
+	inline bool isString() const {return slot && slot->type==JSON_STRING;}
+	inline bool isInteger() const {return slot && slot->type==JSON_INTEGER;}
+	inline bool isReal() const {return slot && slot->type==JSON_REAL;}
+	inline bool isNumber() const {return isInteger() || isReal();}
+	inline bool isBool() const {return slot && (slot->type==JSON_TRUE || slot->type==JSON_FALSE);}
+	inline bool isNull() const {return slot && slot->type==JSON_NULL;}
+
+	size_t size() const;
+	SnapshotNode at(size_t i) const;
+	SnapshotNode find(const char* key, size_t len) const;
+	inline SnapshotNode find(const char* key) const {return find(key, strlen(key));}
+	inline SnapshotNode find(const std::string& key) const {return find(key.data(), key.size());}
+	// lookup by a key id resolved once with Snapshot::keyId
+	SnapshotNode find(uint32_t keyId) const;
+
+	const char* string() const;
+	size_t stringLength() const;
+	inline long long integer() const {return isInteger() ? (long long)slot->value : 0;}
+	double real() const;
+	inline double number() const {return isInteger() ? (double)integer() : real();}
+	inline bool boolean() const {return slot && slot->type==JSON_TRUE;}
+
+	jsonptr materialize() const;
+
+	SnapshotArrayElements elements() const;
+	SnapshotKeyValuePairs pairs() const;
+};
+
+class Snapshot {
+	const char* base;
+	size_t len;
+	void* mapping;
+	const snapshot::Header* header;
+	void open(const char* p, size_t l);
+	friend class SnapshotNode;
+	friend class SnapshotArrayElements;
+	friend class SnapshotKeyValueIterator;
+	friend class SnapshotKeyValuePairs;
+	const char* at(uint64_t offset, uint64_t size, uint64_t align=1) const;
+	const snapshot::KeyRef& keyRef(uint32_t id) const;
+public:
+	explicit Snapshot(const std::string& fileName);
+	// a snapshot over memory owned by the caller
+	Snapshot(const void* p, size_t len);
+	Snapshot(const Snapshot&) = delete;
+	Snapshot(Snapshot&&) = delete;
+	Snapshot& operator=(const Snapshot&) = delete;
+	Snapshot& operator=(Snapshot&&) = delete;
+	~Snapshot();
+
+	SnapshotNode root() const;
+	inline size_t size() const {return len;}
+	inline size_t keyCount() const {return header->keyCount;}
+	// id of key in the snapshot key table, SnapshotNode::npos if no object uses it
+	uint32_t keyId(const char* key, size_t len) const;
+	inline uint32_t keyId(const char* key) const {return keyId(key, strlen(key));}
+	const char* key(uint32_t id) const;
+};
+
+class SnapshotArrayIterator {
+	SnapshotNode n;
+public:
+	explicit SnapshotArrayIterator(const Snapshot* s, const snapshot::Slot* p) : n(s, p) {}
+	inline bool operator ==(const SnapshotArrayIterator& rhs) const {return n.slot==rhs.n.slot;}
+	inline bool operator !=(const SnapshotArrayIterator& rhs) const {return n.slot!=rhs.n.slot;}
+	inline SnapshotNode operator *() const {return n;}
+	inline void operator++() {++n.slot;}
+};
+class SnapshotArrayElements {
+	SnapshotNode n;
+public:
+	explicit SnapshotArrayElements(const SnapshotNode& p) : n(p) {}
+	SnapshotArrayIterator begin() const;
+	SnapshotArrayIterator end() const;
+};
+
+class SnapshotKeyValueIterator {
+	const Snapshot* snap;
+	const snapshot::Entry* e;
+public:
+	explicit SnapshotKeyValueIterator(const Snapshot* s, const snapshot::Entry* p) : snap(s), e(p) {}
+	inline bool operator !=(const SnapshotKeyValueIterator& rhs) const {return e!=rhs.e;}
+	inline std::pair<const char*, SnapshotNode> operator *() const {return std::make_pair(snap->key(e->key), SnapshotNode(snap, &e->value));}
+	inline void operator++() {++e;}
+};
+class SnapshotKeyValuePairs {
+	SnapshotNode n;
+public:
+	explicit SnapshotKeyValuePairs(const SnapshotNode& p) : n(p) {}
+	SnapshotKeyValueIterator begin() const;
+	SnapshotKeyValueIterator end() const;
+};
+
+inline SnapshotArrayElements SnapshotNode::elements() const {return SnapshotArrayElements(*this);}
+inline SnapshotKeyValuePairs SnapshotNode::pairs() const {return SnapshotKeyValuePairs(*this);}
+
+inline SnapshotNode getChild(const SnapshotNode& n) {return n;}
+template<typename...REST> SnapshotNode getChild(const SnapshotNode& n, const char* first, REST... rest) {
+	return getChild(n.find(first), rest...);
+}
+template<typename...REST> bool hasChild(const SnapshotNode& n, REST... rest) {
+	return (bool)getChild(n, rest...);
+}
+template<typename...REST> jsonptr getChildPtr(const SnapshotNode& n, REST... rest) {
+	auto v=getChild(n, rest...);
+	return v ? v.materialize() : jsonptr();
+}
+
+template<typename...REST> const char* getString(const SnapshotNode& n, REST... rest) {
+	return getChild(n, rest...).string();
+}
+template<typename...REST> const char* getString(const char* fallback, const SnapshotNode& n, REST... rest) {
+	auto ret=getChild(n, rest...).string();
+	return ret ? ret : fallback;
+}
+template<typename...REST> bool hasString(const SnapshotNode& n, REST... rest) {
+	return getChild(n, rest...).isString();
+}
+
+template<typename...REST> long long getLong(const SnapshotNode& n, REST... rest) {
+	return getChild(n, rest...).integer();
+}
+template<typename...REST> long long getLong(long long fallback, const SnapshotNode& n, REST... rest) {
+	auto v=getChild(n, rest...);
+	return v.isInteger() ? v.integer() : fallback;
+}
+template<typename...REST> bool hasLong(const SnapshotNode& n, REST... rest) {
+	return getChild(n, rest...).isInteger();
+}
+
+template<typename...REST> bool getBool(const SnapshotNode& n, REST... rest) {
+	return getChild(n, rest...).boolean();
+}
+template<typename...REST> bool getBool(bool fallback, const SnapshotNode& n, REST... rest) {
+	auto v=getChild(n, rest...);
+	return v.isBool() ? v.boolean() : fallback;
+}
+template<typename...REST> bool hasBool(const SnapshotNode& n, REST... rest) {
+	return getChild(n, rest...).isBool();
+}
+
+template<typename...REST> double getNumber(const SnapshotNode& n, REST... rest) {
+	return getChild(n, rest...).number();
+}
+template<typename...REST> double getNumber(double fallback, const SnapshotNode& n, REST... rest) {
+	auto v=getChild(n, rest...);
+	return v.isNumber() ? v.number() : fallback;
+}
+template<typename...REST> bool hasNumber(const SnapshotNode& n, REST... rest) {
+	return getChild(n, rest...).isNumber();
+}
+
+template<typename...REST> SnapshotArrayElements getJsonArrayElements(const SnapshotNode& n, REST... rest) {
+	return getChild(n, rest...).elements();
+}
+template<typename...REST> SnapshotKeyValuePairs getJsonKeyValuePairs(const SnapshotNode& n, REST... rest) {
+	return getChild(n, rest...).pairs();
+}
+
+}
+
+#endif /* SRC_JSONSNAPSHOT_H_ */
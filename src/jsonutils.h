@@ -1,10 +1,13 @@
 #ifndef SRC_JSONUTILS_H_
 #define SRC_JSONUTILS_H_
 
+#include <cstddef>
+#include <iterator>
 #include <memory>
 #include <ostream>
 #include <string>
 #include <stdexcept>
+#include <vector>
 #include <jansson.h>
 
 
@@ -316,6 +319,28 @@ template<typename...REST> JsonKeyValuePairs getJsonKeyValuePairs(const json_t* p
 	return getJsonKeyValuePairs(json_object_get(p,first), rest...);
 }
 
+// The members of an object copied into a vector up front, for random access and for
+// splitting across threads. Keys and values are borrowed: the object must outlive the
+// snapshot and stay unmodified while it is in use.
+class JsonKeyValueSnapshot {
+	std::vector<std::pair<const char*, json_t*>> members;
+public:
+	typedef std::vector<std::pair<const char*, json_t*>>::const_iterator iterator;
+	explicit JsonKeyValueSnapshot(const json_t* p) {
+		members.reserve(json_object_size(p));
+		for (auto kv : JsonKeyValuePairs(p)) members.push_back(kv);
+	}
+	explicit JsonKeyValueSnapshot(const jsonptr& p) : JsonKeyValueSnapshot(p.get()) {}
+	inline iterator begin() const {return members.begin();}
+	inline iterator end() const {return members.end();}
+	inline size_t size() const {return members.size();}
+	inline const std::pair<const char*, json_t*>& operator [](size_t i) const {return members[i];}
+};
+inline JsonKeyValueSnapshot getJsonKeyValueSnapshot(const json_t* p) {return JsonKeyValueSnapshot(p);}
+template<typename...REST> JsonKeyValueSnapshot getJsonKeyValueSnapshot(const json_t* p,const char* first, REST... rest) {
+	return getJsonKeyValueSnapshot(json_object_get(p,first), rest...);
+}
+
 class JsonKeyIterator {
 	const json_t* obj;
 	void* ptr;
@@ -344,27 +369,51 @@ template<typename...REST> JsonKeys getJsonKeys(const jsonptr& p, REST... rest) {
 	return getJsonKeys(p.get(), rest...);
 }
 
+// random access, so it works with <algorithm> and can be split into chunks
 class JsonArrayIterator {
 	const json_t* array;
 	size_t pos;
 public:
+	typedef std::random_access_iterator_tag iterator_category;
+	typedef json_t* value_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef json_t* const* pointer;
+	typedef json_t* reference;
+
+	JsonArrayIterator() : array(nullptr),pos(0) {}
 	explicit JsonArrayIterator(const json_t* p) : array(p),pos(0) {}
 	explicit JsonArrayIterator(const json_t* p,size_t s) : array(p),pos(s) {}
 	inline bool operator ==(JsonArrayIterator rhs) const {return pos==rhs.pos && array==rhs.array;}
 	inline bool operator !=(JsonArrayIterator rhs) const {return ! (rhs== *this);}
+	inline bool operator <(JsonArrayIterator rhs) const {return pos<rhs.pos;}
+	inline bool operator >(JsonArrayIterator rhs) const {return pos>rhs.pos;}
+	inline bool operator <=(JsonArrayIterator rhs) const {return pos<=rhs.pos;}
+	inline bool operator >=(JsonArrayIterator rhs) const {return pos>=rhs.pos;}
 	inline json_t* operator *() const {return json_array_get(array, pos);}
-	inline void operator++() {pos++;}
-	inline void operator--() {pos--;}
-	inline operator bool() const {return pos>=0 && pos<json_array_size(array);}
+	inline json_t* operator [](difference_type d) const {return json_array_get(array, pos+d);}
+	inline JsonArrayIterator& operator++() {pos++; return *this;}
+	inline JsonArrayIterator& operator--() {pos--; return *this;}
+	inline JsonArrayIterator operator++(int) {auto r=*this; pos++; return r;}
+	inline JsonArrayIterator operator--(int) {auto r=*this; pos--; return r;}
+	inline JsonArrayIterator& operator+=(difference_type d) {pos+=d; return *this;}
+	inline JsonArrayIterator& operator-=(difference_type d) {pos-=d; return *this;}
+	inline JsonArrayIterator operator+(difference_type d) const {return JsonArrayIterator(array, pos+d);}
+	inline JsonArrayIterator operator-(difference_type d) const {return JsonArrayIterator(array, pos-d);}
+	inline difference_type operator-(JsonArrayIterator rhs) const {return (difference_type)pos-(difference_type)rhs.pos;}
+	inline size_t index() const {return pos;}
+	inline explicit operator bool() const {return pos<json_array_size(array);}
 };
+inline JsonArrayIterator operator+(JsonArrayIterator::difference_type d, JsonArrayIterator it) {return it+d;}
 
 class JsonArrayElements {
 	const json_t* array;
-	size_t size;
+	size_t n;
 public:
-	explicit JsonArrayElements(const json_t* p) : array(p),size(json_array_size(p)) {}
+	explicit JsonArrayElements(const json_t* p) : array(p),n(json_array_size(p)) {}
 	inline JsonArrayIterator begin() const {return JsonArrayIterator(array);}
-	inline JsonArrayIterator end() const {return JsonArrayIterator(array,size);}
+	inline JsonArrayIterator end() const {return JsonArrayIterator(array,n);}
+	inline size_t size() const {return n;}
+	inline json_t* operator [](size_t i) const {return json_array_get(array, i);}
 };
 
 inline JsonArrayElements getJsonArrayElements(const json_t* p) {return JsonArrayElements(p);}
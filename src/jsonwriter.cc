@@ -0,0 +1,113 @@
+#include <jsonwriter.h>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+
+namespace json {
+
+namespace {
+struct EscapeTable {
+	bool escape[256];
+	EscapeTable() {
+		for (int i=0;i<256;++i) escape[i]= i<0x20 || i=='"' || i=='\\';
+	}
+};
+const EscapeTable escapeTable;
+}
+
+void Writer::string(const char* s, size_t len) {
+	static const char* hex="0123456789abcdef";
+	out.reserve(out.size()+len+2);
+	out+='"';
+	const unsigned char* p=(const unsigned char*)s;
+	const unsigned char* end=p+len;
+	const unsigned char* run=p;
+	for (;p<end;++p) {
+		unsigned char c=*p;
+		if (!escapeTable.escape[c]) continue;
+		out.append((const char*)run, p-run);
+		run=p+1;
+		switch (c) {
+			case '"': out.append("\\\"",2); break;
+			case '\\': out.append("\\\\",2); break;
+			case '\b': out.append("\\b",2); break;
+			case '\f': out.append("\\f",2); break;
+			case '\n': out.append("\\n",2); break;
+			case '\r': out.append("\\r",2); break;
+			case '\t': out.append("\\t",2); break;
+			default: {
+				char u[6]={'\\','u','0','0',hex[c>>4],hex[c&0xf]};
+				out.append(u,sizeof(u));
+			}
+		}
+	}
+	out.append((const char*)run, end-run);
+	out+='"';
+}
+
+void Writer::integer(long long v) {
+	char buf[24];
+	auto r=std::to_chars(buf, buf+sizeof(buf), v);
+	out.append(buf, r.ptr-buf);
+}
+
+void Writer::unsignedInteger(unsigned long long v) {
+	char buf[24];
+	auto r=std::to_chars(buf, buf+sizeof(buf), v);
+	out.append(buf, r.ptr-buf);
+}
+
+void Writer::real(double v) {
+	if (!std::isfinite(v)) throw std::runtime_error("Can't write non finite real "+std::to_string(v)+" as json");
+	char buf[32];
+	auto r=std::to_chars(buf, buf+sizeof(buf), v);
+	size_t len=r.ptr-buf;
+	out.append(buf, len);
+	// keep reals distinguishable from integers, the way json_dumps does
+	for (size_t i=0;i<len;++i) {
+		char c=buf[i];
+		if (c=='.' || c=='e' || c=='E') return;
+	}
+	out.append(".0",2);
+}
+
+void Writer::value(const json_t* j) {
+	if (!j) {
+		null();
+		return;
+	}
+	switch (json_typeof(j)) {
+		case JSON_OBJECT: {
+			beginObject();
+			bool first=true;
+			for (auto p : getJsonKeyValuePairs(j)) {
+				key(first, p.first, strlen(p.first));
+				value(p.second);
+				first=false;
+			}
+			endObject();
+			break;
+		}
+		case JSON_ARRAY: {
+			beginArray();
+			bool first=true;
+			for (auto e : getJsonArrayElements(j)) {
+				element(first);
+				value(e);
+				first=false;
+			}
+			endArray();
+			break;
+		}
+		case JSON_STRING: string(json_string_value(j), json_string_length(j)); break;
+		case JSON_INTEGER: integer(json_integer_value(j)); break;
+		case JSON_REAL: real(json_real_value(j)); break;
+		case JSON_TRUE: boolean(true); break;
+		case JSON_FALSE: boolean(false); break;
+		case JSON_NULL: null(); break;
+		default:
+			throw std::runtime_error("Unknown json element type: "+std::to_string(j->type));
+	}
+}
+
+}
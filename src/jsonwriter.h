@@ -0,0 +1,262 @@
+#ifndef SRC_JSONWRITER_H_
+#define SRC_JSONWRITER_H_
+
+#include <array>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <jsonutils.h>
+
+/*
+ * Direct serialization of C++ values to JSON text, without building a json_t tree.
+ *
+ * Structs are described once with JSON_BINDING at global scope:
+ *
+ *   struct Item {std::string name; long long id; std::optional<std::string> note;};
+ *   JSON_BINDING(Item, JSON_FIELD(Item, name), JSON_FIELD(Item, id), json::field("x-note", &Item::note))
+ *
+ *   std::string buf;
+ *   json::write(item, buf);        // appends compact json to buf
+ *   json::write(item, buf, true);  // appends the same layout as json::pretty
+ *
+ * Field names are escaped and quoted at compile time. Empty optionals are omitted
+ * from objects and written as null elsewhere. Other types can be supported by
+ * specializing json::ValueWriter<T>.
+ */
+
+namespace json {
+
+template<size_t N> struct FieldName {
+	char data[6*N+2] {};
+	size_t len=0;
+	constexpr FieldName(const char (&s)[N]) {
+		const char* hex="0123456789abcdef";
+		data[len++]='"';
+		for (size_t i=0;i+1<N && s[i];++i) {
+			unsigned char c=s[i];
+			if (c=='"' || c=='\\') {
+				data[len++]='\\';
+				data[len++]=c;
+			} else if (c<0x20) {
+				data[len++]='\\';
+				data[len++]='u';
+				data[len++]='0';
+				data[len++]='0';
+				data[len++]=hex[c>>4];
+				data[len++]=hex[c&0xf];
+			} else {
+				data[len++]=c;
+			}
+		}
+		data[len++]='"';
+	}
+	inline std::string_view view() const {return std::string_view(data,len);}
+};
+
+template<typename T, typename M, size_t N> struct Field {
+	FieldName<N> name;
+	M T::* member;
+};
+template<typename T, typename M, size_t N> constexpr Field<T,M,N> field(const char (&name)[N], M T::* member) {
+	return Field<T,M,N>{FieldName<N>(name), member};
+}
+
+template<typename T> struct Binding {
+	static constexpr bool bound=false;
+};
+
+#define JSON_FIELD(TYPE, MEMBER) json::field(#MEMBER, &TYPE::MEMBER)
+#define JSON_BINDING(TYPE, ...) \
+	template<> struct json::Binding<TYPE> { \
+		static constexpr bool bound=true; \
+		static constexpr auto fields=std::make_tuple(__VA_ARGS__); \
+	};
+
+class Writer {
+	std::string& out;
+	bool pretty;
+	int depth;
+	void indent() {out.append(depth, '\t');}
+public:
+	explicit Writer(std::string& o, bool p=false) : out(o), pretty(p), depth(0) {}
+	inline std::string& buffer() {return out;}
+	inline bool isPretty() const {return pretty;}
+
+	inline void raw(std::string_view s) {out.append(s.data(), s.size());}
+	void string(const char* s, size_t len);
+	inline void string(std::string_view s) {string(s.data(), s.size());}
+	void integer(long long v);
+	void unsignedInteger(unsigned long long v);
+	void real(double v);
+	inline void boolean(bool v) {raw(v ? std::string_view("true",4) : std::string_view("false",5));}
+	inline void null() {raw(std::string_view("null",4));}
+	void value(const json_t* j);
+
+	inline void beginObject() {out+='{'; ++depth;}
+	inline void beginArray() {out+='['; ++depth;}
+	inline void endObject() {close('}');}
+	inline void endArray() {close(']');}
+	// separator and indentation before an element; first is true for the first element
+	inline void element(bool first) {
+		if (!first) out+=',';
+		if (pretty) {
+			out+='\n';
+			indent();
+		}
+	}
+	// an already quoted and escaped key, followed by the key/value separator
+	inline void key(bool first, std::string_view quoted) {
+		element(first);
+		raw(quoted);
+		if (pretty) raw(std::string_view(" : ",3));
+		else out+=':';
+	}
+	inline void key(bool first, const char* k, size_t len) {
+		element(first);
+		string(k,len);
+		if (pretty) raw(std::string_view(" : ",3));
+		else out+=':';
+	}
+private:
+	inline void close(char c) {
+		--depth;
+		if (pretty) {
+			out+='\n';
+			indent();
+		}
+		out+=c;
+	}
+};
+
+template<typename T, typename=void> struct ValueWriter;
+
+template<typename T> inline void writeValue(Writer& w, const T& v) {
+	ValueWriter<T>::write(w, v);
+}
+
+template<> struct ValueWriter<bool> {
+	static void write(Writer& w, bool v) {w.boolean(v);}
+};
+template<typename T> struct ValueWriter<T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type> {
+	static void write(Writer& w, T v) {w.integer(v);}
+};
+template<typename T> struct ValueWriter<T, typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value && !std::is_same<T,bool>::value>::type> {
+	static void write(Writer& w, T v) {w.unsignedInteger(v);}
+};
+template<typename T> struct ValueWriter<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+	static void write(Writer& w, T v) {w.real(v);}
+};
+template<> struct ValueWriter<std::string> {
+	static void write(Writer& w, const std::string& v) {w.string(v.data(), v.size());}
+};
+template<> struct ValueWriter<std::string_view> {
+	static void write(Writer& w, std::string_view v) {w.string(v.data(), v.size());}
+};
+template<> struct ValueWriter<const char*> {
+	static void write(Writer& w, const char* v) {
+		if (v) w.string(v, strlen(v));
+		else w.null();
+	}
+};
+template<size_t N> struct ValueWriter<char[N]> {
+	static void write(Writer& w, const char (&v)[N]) {w.string(v, strnlen(v,N));}
+};
+template<> struct ValueWriter<std::nullptr_t> {
+	static void write(Writer& w, std::nullptr_t) {w.null();}
+};
+template<> struct ValueWriter<jsonptr> {
+	static void write(Writer& w, const jsonptr& v) {w.value(v.get());}
+};
+template<> struct ValueWriter<json_t*> {
+	static void write(Writer& w, const json_t* v) {w.value(v);}
+};
+
+template<typename T> struct ValueWriter<std::optional<T>> {
+	static void write(Writer& w, const std::optional<T>& v) {
+		if (v) writeValue(w, *v);
+		else w.null();
+	}
+};
+
+template<typename C> struct SequenceWriter {
+	static void write(Writer& w, const C& c) {
+		w.beginArray();
+		bool first=true;
+		for (const auto& e : c) {
+			w.element(first);
+			writeValue(w, e);
+			first=false;
+		}
+		w.endArray();
+	}
+};
+template<typename T, typename A> struct ValueWriter<std::vector<T,A>> : SequenceWriter<std::vector<T,A>> {};
+template<typename T, typename A> struct ValueWriter<std::list<T,A>> : SequenceWriter<std::list<T,A>> {};
+template<typename T, typename A> struct ValueWriter<std::deque<T,A>> : SequenceWriter<std::deque<T,A>> {};
+template<typename T, size_t N> struct ValueWriter<std::array<T,N>> : SequenceWriter<std::array<T,N>> {};
+
+template<typename C> struct MapWriter {
+	static void write(Writer& w, const C& c) {
+		w.beginObject();
+		bool first=true;
+		for (const auto& e : c) {
+			std::string_view k(e.first);
+			w.key(first, k.data(), k.size());
+			writeValue(w, e.second);
+			first=false;
+		}
+		w.endObject();
+	}
+};
+template<typename K, typename T, typename L, typename A> struct ValueWriter<std::map<K,T,L,A>> : MapWriter<std::map<K,T,L,A>> {};
+template<typename K, typename T, typename H, typename E, typename A> struct ValueWriter<std::unordered_map<K,T,H,E,A>> : MapWriter<std::unordered_map<K,T,H,E,A>> {};
+
+template<typename M> struct FieldWriter {
+	template<typename T, size_t N> static bool write(Writer& w, bool first, const T& obj, const Field<T,M,N>& f) {
+		w.key(first, f.name.view());
+		writeValue(w, obj.*f.member);
+		return false;
+	}
+};
+template<typename M> struct FieldWriter<std::optional<M>> {
+	template<typename T, size_t N> static bool write(Writer& w, bool first, const T& obj, const Field<T,std::optional<M>,N>& f) {
+		const std::optional<M>& v=obj.*f.member;
+		if (!v) return first;
+		w.key(first, f.name.view());
+		writeValue(w, *v);
+		return false;
+	}
+};
+
+template<typename T> struct ValueWriter<T, typename std::enable_if<Binding<T>::bound>::type> {
+	static void write(Writer& w, const T& obj) {
+		w.beginObject();
+		bool first=true;
+		std::apply([&](const auto&... f) {
+			((first=FieldWriter<typename std::remove_cv<typename std::remove_reference<decltype(obj.*f.member)>::type>::type>::write(w, first, obj, f)), ...);
+		}, Binding<T>::fields);
+		w.endObject();
+	}
+};
+
+template<typename T> inline void write(const T& v, std::string& out, bool pretty=false) {
+	Writer w(out, pretty);
+	writeValue(w, v);
+}
+template<typename T> inline std::string write(const T& v, bool pretty=false) {
+	std::string out;
+	write(v, out, pretty);
+	return out;
+}
+
+}
+
+#endif /* SRC_JSONWRITER_H_ */
@@ -0,0 +1,231 @@
+#include <linereader.h>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace utils {
+
+namespace {
+
+#ifdef __SSE2__
+inline uint64_t newlines(const char* p) {
+	const __m128i nl=_mm_set1_epi8('\n');
+	uint64_t m=0;
+	for (int k=0;k<4;++k) {
+		__m128i v=_mm_loadu_si128((const __m128i*)(p+16*k));
+		m|=(uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl))<<(16*k);
+	}
+	return m;
+}
+#else
+inline uint64_t newlines(const char* p) {
+	uint64_t m=0;
+	for (int k=0;k<64;++k) m|=(uint64_t)(p[k]=='\n')<<k;
+	return m;
+}
+#endif
+
+inline uint64_t newlines(const char* p, size_t n) {
+	uint64_t m=0;
+	for (size_t k=0;k<n;++k) m|=(uint64_t)(p[k]=='\n')<<k;
+	return m;
+}
+
+}
+
+LineReader::LineReader(const std::string& fileName) : LineReader(fileName, Options()) {}
+
+LineReader::LineReader(FD&& f) : LineReader(std::move(f), Options()) {}
+
+LineReader::LineReader(const std::string& fileName, const Options& o) : name(fileName) {
+	fd=::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+	if (!fd) errno_exception("Failed to open "+fileName);
+	open(o);
+}
+
+LineReader::LineReader(FD&& f, const Options& o) : name("fd "+std::to_string(f.fd)), fd(std::move(f)) {
+	open(o);
+}
+
+LineReader::LineReader(Source s) : LineReader(std::move(s), Options()) {}
+
+LineReader::LineReader(Source s, const Options& o) : name("source"), source(std::move(s)) {
+	options=o;
+	if (options.bufferBytes<4096) options.bufferBytes=4096;
+	for (auto& b : buffers) b.mem.reset(new char[2*options.bufferBytes]);
+}
+
+LineReader::LineReader(std::string_view text) {
+	cur=scan=text.data();
+	end=cur+text.size();
+	last=true;
+}
+
+LineReader::~LineReader() {
+	if (reader.joinable()) {
+		{
+			std::lock_guard<std::mutex> g(lock);
+			stopping=true;
+		}
+		changed.notify_all();
+		reader.join();
+	}
+	if (mapping) ::munmap(mapping, mappedBytes);
+}
+
+void LineReader::open(const Options& o) {
+	options=o;
+	if (options.bufferBytes<4096) options.bufferBytes=4096;
+	struct stat st;
+	if (::fstat(fd, &st)) errno_exception("Failed to stat "+name);
+	regular=S_ISREG(st.st_mode);
+	if (regular) ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	if (options.map && regular && st.st_size>0) {
+		void* m=::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (m!=MAP_FAILED) {
+			::madvise(m, st.st_size, MADV_SEQUENTIAL);
+			mapping=m;
+			mappedBytes=st.st_size;
+			cur=scan=(const char*)m;
+			end=cur+mappedBytes;
+			last=true;
+			return;
+		}
+		// too large for the address space: read it instead
+	}
+	// each buffer has room in front of its data for the unfinished line of the other
+	for (auto& b : buffers) b.mem.reset(new char[2*options.bufferBytes]);
+}
+
+void LineReader::fill(Buffer& b) {
+	char* p=b.mem.get()+options.bufferBytes;
+	b.len=0;
+	b.eof=false;
+	while (b.len<options.bufferBytes) {
+		ssize_t r=source ? source(p+b.len, options.bufferBytes-b.len) : ::read(fd, p+b.len, options.bufferBytes-b.len);
+		if (r<0) {
+			if (errno==EINTR) continue;
+			errno_exception("Failed to read "+name);
+		}
+		if (!r) {
+			b.eof=true;
+			break;
+		}
+		b.len+=r;
+		// a pipe hands out what it has; no need to wait for a full buffer
+		if (!regular) break;
+	}
+}
+
+void LineReader::readAhead() {
+	for (int k=1;;k^=1) {
+		Buffer& b=buffers[k];
+		{
+			std::unique_lock<std::mutex> g(lock);
+			changed.wait(g, [&]() {return !b.full || stopping;});
+			if (stopping) return;
+		}
+		try {
+			fill(b);
+		} catch (...) {
+			std::lock_guard<std::mutex> g(lock);
+			error=std::current_exception();
+			changed.notify_all();
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> g(lock);
+			b.full=true;
+		}
+		changed.notify_all();
+		if (b.eof) return;
+	}
+}
+
+bool LineReader::refill() {
+	if (last) return false;
+	int n=current<0 ? 0 : current^1;
+	Buffer& b=buffers[n];
+	if (reader.joinable()) {
+		std::unique_lock<std::mutex> g(lock);
+		changed.wait(g, [&]() {return b.full || error;});
+		if (!b.full) std::rethrow_exception(error);
+	} else {
+		fill(b);
+		b.full=true;
+		if (current<0 && regular && !b.eof) reader=std::thread([this]() {readAhead();});
+	}
+	size_t tail=end-cur;
+	if (spilling || tail>options.bufferBytes) {
+		longLine.append(cur, tail);
+		spilling=true;
+		tail=0;
+	}
+	char* data=b.mem.get()+options.bufferBytes;
+	if (tail) memmove(data-tail, cur, tail);
+	if (current>=0) {
+		std::lock_guard<std::mutex> g(lock);
+		buffers[current].full=false;
+	}
+	if (reader.joinable()) changed.notify_all();
+	current=n;
+	cur=data-tail;
+	scan=data;
+	end=data+b.len;
+	bits=0;
+	last=b.eof;
+	return true;
+}
+
+bool LineReader::next(std::string_view& line) {
+	if (!spilling && !longLine.empty()) longLine.clear();
+	for (;;) {
+		if (bits) {
+			const char* nl=block+__builtin_ctzll(bits);
+			bits&=bits-1;
+			if (spilling) {
+				longLine.append(cur, nl-cur);
+				spilling=false;
+				line=longLine;
+			} else {
+				line=std::string_view(cur, nl-cur);
+			}
+			cur=nl+1;
+			if (!line.empty() && line.back()=='\r') line.remove_suffix(1);
+			++lines;
+			return true;
+		}
+		if (scan<end) {
+			block=scan;
+			if (end-scan>=64) {
+				bits=newlines(scan);
+				scan+=64;
+			} else {
+				bits=newlines(scan, end-scan);
+				scan=end;
+			}
+			continue;
+		}
+		if (!refill()) break;
+	}
+	// the last line has no newline
+	if (spilling) {
+		longLine.append(cur, end-cur);
+		spilling=false;
+		line=longLine;
+	} else if (cur<end) {
+		line=std::string_view(cur, end-cur);
+	} else {
+		return false;
+	}
+	cur=end;
+	if (!line.empty() && line.back()=='\r') line.remove_suffix(1);
+	++lines;
+	return true;
+}
+
+}
@@ -0,0 +1,123 @@
+#ifndef SRC_LINEREADER_H_
+#define SRC_LINEREADER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <utils.h>
+
+/*
+ * Streaming line reader for large text files.
+ *
+ *   utils::LineReader in("/var/log/big.tsv");
+ *   std::vector<std::string_view> fields;
+ *   for (std::string_view line;in.next(line);) {
+ *       utils::splitFields(line, '\t', fields);
+ *       ...
+ *   }
+ *
+ * Lines come without their "\n" or "\r\n" as views into the reader's buffer, valid until
+ * the next call; nothing is allocated per line. Newlines are found 64 bytes at a time
+ * (SSE2 compares folded into a bit mask), so short lines cost a few instructions each.
+ *
+ * A regular file is read in bufferBytes chunks by a background thread into the second of
+ * two buffers while the caller works through the first, with the kernel told to read ahead
+ * sequentially. Pipes and sockets are read in the calling thread. With map=true the file
+ * is mapped instead and lines point into the mapping for the reader's lifetime; a reader
+ * over a string_view works the same way on memory the caller owns. Lines longer than a
+ * buffer are assembled in a separate string. A Source, such as a DecompressReader, is
+ * pulled from in the calling thread like a pipe.
+ */
+
+namespace utils {
+
+class LineReader {
+public:
+	struct Options {
+		size_t bufferBytes=4<<20;		// each of the two buffers
+		bool map=false;
+	};
+	// fills up to size bytes of buffer, returns how many, 0 at the end
+	typedef std::function<size_t(char* buffer, size_t size)> Source;
+private:
+	struct Buffer {
+		std::unique_ptr<char[]> mem;
+		size_t len=0;
+		bool eof=false;
+		bool full=false;
+	};
+	Options options;
+	std::string name;
+	FD fd;
+	Source source;
+	void* mapping=nullptr;
+	size_t mappedBytes=0;
+	// the unread part of the current buffer, and how far newlines have been looked for
+	const char* cur=nullptr;
+	const char* end=nullptr;
+	const char* scan=nullptr;
+	const char* block=nullptr;
+	uint64_t bits=0;
+	uint64_t lines=0;
+	bool last=false;
+	std::string longLine;
+	bool spilling=false;
+
+	Buffer buffers[2];
+	int current=-1;
+	bool regular=false;
+	std::thread reader;
+	std::mutex lock;
+	std::condition_variable changed;
+	bool stopping=false;
+	std::exception_ptr error;
+
+	void open(const Options& o);
+	void fill(Buffer& b);
+	void readAhead();
+	bool refill();
+public:
+	explicit LineReader(const std::string& fileName);
+	LineReader(const std::string& fileName, const Options& options);
+	// reads from fd, which the reader then owns
+	explicit LineReader(FD&& fd);
+	LineReader(FD&& fd, const Options& options);
+	explicit LineReader(Source source);
+	LineReader(Source source, const Options& options);
+	explicit LineReader(std::string_view text);
+	LineReader(const LineReader&) = delete;
+	LineReader& operator=(const LineReader&) = delete;
+	~LineReader();
+
+	// the next line, false at the end of the input
+	bool next(std::string_view& line);
+	// 1-based number of the line last returned
+	inline uint64_t lineNumber() const {return lines;}
+};
+
+// splits line at every delimiter into views of line; an empty line gives one empty field
+inline size_t splitFields(std::string_view line, char delimiter, std::vector<std::string_view>& fields) {
+	fields.clear();
+	const char* p=line.data();
+	const char* e=p+line.size();
+	for (;;) {
+		const char* d=p<e ? (const char*)memchr(p, delimiter, e-p) : nullptr;
+		if (!d) break;
+		fields.emplace_back(p, d-p);
+		p=d+1;
+	}
+	fields.emplace_back(p, e-p);
+	return fields.size();
+}
+
+}
+
+#endif /* SRC_LINEREADER_H_ */
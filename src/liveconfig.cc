@@ -0,0 +1,188 @@
+#include <liveconfig.h>
+#include <stdexcept>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+namespace json {
+
+namespace {
+
+// Epoch domain shared by all LiveConfig instances. A thread claims one slot on its first
+// Guard and gives it back when it exits; epoch 0 marks a slot with no active guard.
+struct alignas(64) Slot {
+	std::atomic<uint64_t> epoch{0};
+	std::atomic<bool> owned{false};
+	unsigned depth=0;
+};
+
+const size_t SLOTS=1024;
+Slot slots[SLOTS];
+std::atomic<size_t> slotsUsed{0};
+std::atomic<uint64_t> globalEpoch{1};
+
+struct ThreadSlot {
+	Slot* s=nullptr;
+	inline Slot* get() {
+		if (s) return s;
+		for (size_t i=0;i<SLOTS;++i) {
+			bool expected=false;
+			if (!slots[i].owned.load(std::memory_order_relaxed) && slots[i].owned.compare_exchange_strong(expected, true)) {
+				size_t used=slotsUsed.load();
+				while (used<i+1 && !slotsUsed.compare_exchange_weak(used, i+1));
+				return s=&slots[i];
+			}
+		}
+		throw std::runtime_error("LiveConfig: more than "+std::to_string(SLOTS)+" threads hold guards");
+	}
+	~ThreadSlot() {
+		if (!s) return;
+		s->depth=0;
+		s->epoch.store(0);
+		s->owned.store(false, std::memory_order_release);
+	}
+};
+thread_local ThreadSlot threadSlot;
+
+// oldest epoch a live guard may have observed, UINT64_MAX if there are no guards
+uint64_t oldestEpoch() {
+	uint64_t oldest=UINT64_MAX;
+	size_t used=slotsUsed.load();
+	for (size_t i=0;i<used;++i) {
+		uint64_t e=slots[i].epoch.load();
+		if (e && e<oldest) oldest=e;
+	}
+	return oldest;
+}
+
+}
+
+LiveConfig::Guard::Guard(const LiveConfig& c) : cfg(c) {
+	Slot* s=threadSlot.get();
+	if (s->depth++==0) s->epoch.store(globalEpoch.load());
+	j=cfg.current.load();
+}
+
+LiveConfig::Guard::~Guard() {
+	Slot* s=threadSlot.s;
+	if (--s->depth==0) s->epoch.store(0, std::memory_order_release);
+}
+
+LiveConfig::LiveConfig(const std::string& f, Validator v)
+		: fileName(f), validator(std::move(v)), current(nullptr), reloads(0), failures(0), lastReloadUs(0), maxReloadUs(0) {
+	std::string dir, base;
+	utils::splitDirBasename(fileName, dir, base);
+	// watch before the first load, so that a change in between is not lost
+	notify=inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+	if (!notify) utils::errno_exception("inotify_init1 failed for "+fileName);
+	if (inotify_add_watch(notify, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO)<0) utils::errno_exception("Failed to watch "+dir);
+	wakeup=eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (!wakeup) utils::errno_exception("eventfd failed");
+	auto start=utils::clock();
+	publish(load());
+	lastReloadUs=maxReloadUs=utils::microseconds(start);
+	watcher=std::thread(&LiveConfig::watch, this);
+}
+
+LiveConfig::~LiveConfig() {
+	uint64_t one=1;
+	if (::write(wakeup, &one, sizeof(one))<0) {}
+	if (watcher.joinable()) watcher.join();
+	for (auto& r : retired) json_decref(r.j);
+	json_decref(current.load());
+}
+
+json_t* LiveConfig::load() {
+	auto j=parse(utils::slurpTextFile(fileName));
+	if (validator) validator(j.get());
+	return json_incref(j.get());
+}
+
+void LiveConfig::publish(json_t* j) {
+	json_t* old=current.exchange(j);
+	uint64_t epoch=globalEpoch.fetch_add(1)+1;
+	reloads.fetch_add(1, std::memory_order_release);
+	if (old) retired.push_back(Retired{epoch, old});
+	reclaim();
+}
+
+// a version retired at epoch E is unreachable once every active guard entered at E or later
+void LiveConfig::reclaim() {
+	if (retired.empty()) return;
+	uint64_t oldest=oldestEpoch();
+	size_t kept=0;
+	for (auto& r : retired) {
+		if (r.epoch<=oldest) json_decref(r.j);
+		else retired[kept++]=r;
+	}
+	retired.resize(kept);
+}
+
+bool LiveConfig::reload() {
+	std::lock_guard<std::mutex> g(lock);
+	auto start=utils::clock();
+	json_t* j;
+	try {
+		j=load();
+	} catch (const std::exception& e) {
+		error=e.what();
+		failures.fetch_add(1);
+		return false;
+	}
+	publish(j);
+	uint64_t us=utils::microseconds(start);
+	lastReloadUs.store(us);
+	if (us>maxReloadUs.load()) maxReloadUs.store(us);
+	return true;
+}
+
+jsonptr LiveConfig::get() const {
+	Guard g(*this);
+	return attach((json_t*)g.get());
+}
+
+LiveConfig::Stats LiveConfig::stats() const {
+	return Stats{reloads.load(), failures.load(), lastReloadUs.load(), maxReloadUs.load()};
+}
+
+std::string LiveConfig::lastError() {
+	std::lock_guard<std::mutex> g(lock);
+	return error;
+}
+
+void LiveConfig::watch() {
+	std::string dir, base;
+	utils::splitDirBasename(fileName, dir, base);
+	alignas(struct inotify_event) char buf[4096];
+	struct pollfd fds[2]={{notify, POLLIN, 0}, {wakeup, POLLIN, 0}};
+	for (;;) {
+		bool pending;
+		{
+			std::lock_guard<std::mutex> g(lock);
+			reclaim();
+			pending=!retired.empty();
+		}
+		// while old versions wait for guards to drain, poll for them every 10ms
+		int r=poll(fds, 2, pending ? 10 : -1);
+		if (r<0) {
+			if (errno==EINTR) continue;
+			return;
+		}
+		if (fds[1].revents) return;
+		if (!fds[0].revents) continue;
+		bool changed=false;
+		for (;;) {
+			ssize_t len=::read(notify, buf, sizeof(buf));
+			if (len<=0) break;
+			for (char* p=buf;p<buf+len;) {
+				auto ev=(struct inotify_event*)p;
+				if ((ev->mask & IN_Q_OVERFLOW) || (ev->len && base==ev->name)) changed=true;
+				p+=sizeof(struct inotify_event)+ev->len;
+			}
+		}
+		if (changed) reload();
+	}
+}
+
+}
@@ -0,0 +1,94 @@
+#ifndef SRC_LIVECONFIG_H_
+#define SRC_LIVECONFIG_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <jsonutils.h>
+#include <utils.h>
+
+/*
+ * A json config file that reloads itself when it changes on disk.
+ *
+ *   json::LiveConfig cfg("/etc/app/app.json", [](const json_t* j) {
+ *       if (!json::hasString(j, "db", "host")) throw std::runtime_error("db.host is required");
+ *   });
+ *   ...
+ *   json::LiveConfig::Guard g(cfg);
+ *   const char* host=json::getString(g.get(), "db", "host");
+ *
+ * A background thread watches the directory with inotify, so both in-place writes and
+ * rename-over saves are picked up. Each new version is parsed and validated off the read
+ * path and published with a pointer swap; a file that fails to parse or validate is
+ * counted and logged in lastError(), and the previous version stays current.
+ *
+ * Readers pin the current version with a Guard: entering and leaving one stores to a
+ * cache-line-private per-thread slot, with no lock and no refcount traffic. Old versions
+ * are released once every guard that could see them is gone (epoch based reclamation),
+ * so a Guard should be short lived. Use get() for a refcounted copy to keep around.
+ */
+
+namespace json {
+
+class LiveConfig {
+public:
+	typedef std::function<void(const json_t*)> Validator;
+	class Guard {
+		const LiveConfig& cfg;
+		const json_t* j;
+	public:
+		explicit Guard(const LiveConfig& c);
+		Guard(const Guard&) = delete;
+		Guard& operator=(const Guard&) = delete;
+		~Guard();
+		inline const json_t* get() const {return j;}
+		inline operator const json_t*() const {return j;}
+	};
+	struct Stats {
+		uint64_t reloads;
+		uint64_t failures;
+		uint64_t lastReloadMicroseconds;
+		uint64_t maxReloadMicroseconds;
+	};
+private:
+	struct Retired {
+		uint64_t epoch;
+		json_t* j;
+	};
+	std::string fileName;
+	Validator validator;
+	std::atomic<json_t*> current;
+	std::atomic<uint64_t> reloads, failures, lastReloadUs, maxReloadUs;
+	std::mutex lock;
+	std::string error;
+	std::vector<Retired> retired;
+	utils::FD notify, wakeup;
+	std::thread watcher;
+
+	json_t* load();
+	void publish(json_t* j);
+	void reclaim();
+	void watch();
+public:
+	explicit LiveConfig(const std::string& fileName, Validator validator=Validator());
+	LiveConfig(const LiveConfig&) = delete;
+	LiveConfig& operator=(const LiveConfig&) = delete;
+	~LiveConfig();
+
+	// a refcounted reference to the current version
+	jsonptr get() const;
+	// reparse now; false if the file did not parse or validate
+	bool reload();
+
+	inline uint64_t version() const {return reloads.load(std::memory_order_acquire);}
+	Stats stats() const;
+	std::string lastError();
+};
+
+}
+
+#endif /* SRC_LIVECONFIG_H_ */
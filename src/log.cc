@@ -0,0 +1,437 @@
+#include <log.h>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+namespace utils {
+
+namespace {
+
+std::atomic<uint64_t> logIds{0};
+
+// rings a thread logs to; marked closed when the thread exits so the writer can let go of them
+struct ThreadRings {
+	std::vector<std::shared_ptr<Log::Ring>> rings;
+	~ThreadRings() {
+		for (auto& r : rings) r->closed.store(true, std::memory_order_release);
+	}
+};
+thread_local ThreadRings threadRings;
+
+uint64_t realtimeNs() {
+	timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+}
+
+const char* levelNames[]={"DEBUG", "INFO ", "WARN ", "ERROR"};
+const char* jsonLevelNames[]={"debug", "info", "warn", "error"};
+
+void escape(std::string& out, std::string_view s) {
+	for (char c : s) {
+		switch (c) {
+			case '"': out+="\\\""; break;
+			case '\\': out+="\\\\"; break;
+			case '\n': out+="\\n"; break;
+			case '\r': out+="\\r"; break;
+			case '\t': out+="\\t"; break;
+			default:
+				if ((unsigned char)c<0x20) {
+					char u[8];
+					snprintf(u, sizeof(u), "\\u%04x", c);
+					out+=u;
+				} else {
+					out+=c;
+				}
+		}
+	}
+}
+
+struct Arg {
+	uint8_t type;
+	union {
+		int64_t i;
+		uint64_t u;
+		double d;
+		bool b;
+	};
+	std::string_view s;
+};
+
+const char* decode(const char* p, Arg& a) {
+	a.type=*p++;
+	switch (a.type) {
+		case Log::ARG_BOOL:
+			a.b=*p;
+			return p+1;
+		case Log::ARG_STRING: {
+			uint32_t n;
+			memcpy(&n, p, 4);
+			a.s=std::string_view(p+4, n);
+			return p+4+n;
+		}
+		default:
+			memcpy(&a.u, p, 8);
+			return p+8;
+	}
+}
+
+void appendValue(std::string& out, const Arg& a, bool json) {
+	char buf[32];
+	switch (a.type) {
+		case Log::ARG_INT: out+=std::to_string(a.i); return;
+		case Log::ARG_UINT: out+=std::to_string(a.u); return;
+		case Log::ARG_BOOL: out+=a.b ? "true" : "false"; return;
+		case Log::ARG_DOUBLE:
+			if (json && !std::isfinite(a.d)) {
+				out+=std::isnan(a.d) ? "\"nan\"" : a.d>0 ? "\"inf\"" : "\"-inf\"";
+				return;
+			}
+			snprintf(buf, sizeof(buf), "%.17g", a.d);
+			out+=buf;
+			return;
+		case Log::ARG_POINTER:
+			snprintf(buf, sizeof(buf), json ? "\"0x%llx\"" : "0x%llx", (unsigned long long)a.u);
+			out+=buf;
+			return;
+		case Log::ARG_STRING:
+			if (!json) {
+				out+=a.s;
+				return;
+			}
+			out+='"';
+			escape(out, a.s);
+			out+='"';
+			return;
+	}
+}
+
+}
+
+LogFormat::LogFormat(const char* format) {
+	Piece current;
+	for (const char* p=format;*p;++p) {
+		if ((p[0]=='{' && p[1]=='{') || (p[0]=='}' && p[1]=='}')) {
+			current.text+=*p++;
+			continue;
+		}
+		if (*p!='{') {
+			current.text+=*p;
+			continue;
+		}
+		const char* close=strchr(p, '}');
+		if (!close) throw std::runtime_error("Invalid log format, unclosed placeholder: "+std::string(format));
+		current.name.assign(p+1, close);
+		if (current.name.empty()) current.name="arg"+std::to_string(pieces.size());
+		pieces.push_back(std::move(current));
+		current=Piece();
+		p=close;
+	}
+	pieces.push_back(std::move(current));
+}
+
+Log::Ring::Ring(size_t c, uint64_t l, int t) : buf(new char[c]), capacity(c), log(l), tid(t) {
+	// fault the pages in now rather than on the logging path
+	memset(buf.get(), 0, c);
+}
+
+Log::Log(const Options& o) : options(o), id(++logIds), currentLevel((int)o.level) {
+	size_t capacity=4096;
+	while (capacity<options.ringBytes) capacity<<=1;
+	options.ringBytes=capacity;
+	maxRecord=capacity/4;
+	options.maxStringBytes=std::min(options.maxStringBytes, maxRecord/2);
+	open();
+	calibrate();
+	writer=std::thread([this]() {run();});
+}
+
+Log::~Log() {
+	{
+		std::lock_guard<std::mutex> g(lock);
+		stopping=true;
+	}
+	wake.notify_one();
+	writer.join();
+}
+
+Log::Ring* Log::attach() {
+	auto& mine=threadRings.rings;
+	for (auto& r : mine) {
+		if (r->log==id) {
+			cache={id, r.get()};
+			return r.get();
+		}
+	}
+	// a ring nobody else references belongs to a Log that is gone
+	mine.erase(std::remove_if(mine.begin(), mine.end(), [](const std::shared_ptr<Ring>& r) {return r.use_count()==1;}), mine.end());
+	auto r=std::make_shared<Ring>(options.ringBytes, id, (int)syscall(SYS_gettid));
+	{
+		std::lock_guard<std::mutex> g(lock);
+		rings.push_back(r);
+	}
+	mine.push_back(r);
+	cache={id, r.get()};
+	return r.get();
+}
+
+void Log::waitForSpace(Ring* r) {
+	uint32_t w=r->drained.fetch_or(1, std::memory_order_seq_cst) | 1;
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	// the writer made room since reserve() looked
+	if (r->tail.load(std::memory_order_relaxed)!=r->cachedTail) return;
+	{
+		// counts as a flush request so the writer drains now, not after flushMicroseconds
+		std::lock_guard<std::mutex> g(lock);
+		++flushRequests;
+	}
+	wake.notify_one();
+	futexWait(r->drained, w);
+}
+
+void Log::flush() {
+	std::unique_lock<std::mutex> g(lock);
+	uint64_t request=++flushRequests;
+	wake.notify_one();
+	flushed.wait(g, [&]() {return flushesDone>=request;});
+}
+
+Log::Stats Log::stats() const {
+	return Stats{records.load(), droppedTotal.load(), bytes.load(), rotations.load(), writeErrors.load()};
+}
+
+void Log::run() {
+	std::vector<std::shared_ptr<Ring>> active;
+	std::vector<std::string> batches;
+	uint64_t lastCalibration=realtimeNs();
+	for (;;) {
+		uint64_t requests;
+		bool stop;
+		{
+			std::unique_lock<std::mutex> g(lock);
+			wake.wait_for(g, std::chrono::microseconds(options.flushMicroseconds), [&]() {return stopping || flushRequests>flushesDone;});
+			// rings of exited threads go once they are empty
+			rings.erase(std::remove_if(rings.begin(), rings.end(), [](const std::shared_ptr<Ring>& r) {
+				return r->closed.load(std::memory_order_acquire) && r->tail.load()==r->head.load(std::memory_order_acquire);
+			}), rings.end());
+			active=rings;
+			requests=flushRequests;
+			stop=stopping;
+		}
+		if (realtimeNs()-lastCalibration>=1000000000) {
+			calibrate();
+			lastCalibration=realtimeNs();
+		}
+		batches.resize(active.size());
+		for (size_t i=0;i<active.size();++i) {
+			auto& r=*active[i];
+			batches[i].clear();
+			uint64_t count=0;
+			drain(r, batches[i], count);
+			records+=count;
+			uint64_t dropped=r.dropped.load(std::memory_order_relaxed);
+			uint64_t seen=r.reportedDropped;
+			if (dropped>seen) {
+				droppedTotal+=dropped-seen;
+				r.reportedDropped=dropped;
+				static const LogFormat droppedFormat("{dropped} records dropped by thread {thread}, its log ring is full");
+				uint64_t n=dropped-seen;
+				char args[2*9];
+				putScalar(args, ARG_UINT, n);
+				putScalar(args+9, ARG_INT, (int64_t)r.tid);
+				Header h{0, (uint8_t)LogLevel::WARN, 2, 0, ticks(), &droppedFormat};
+				format(h, args, r.tid, batches[i]);
+			}
+		}
+		write(batches);
+		{
+			std::lock_guard<std::mutex> g(lock);
+			flushesDone=requests;
+		}
+		flushed.notify_all();
+		if (stop) return;
+	}
+}
+
+void Log::drain(Ring& r, std::string& out, uint64_t& count) {
+	uint64_t tail=r.tail.load(std::memory_order_relaxed);
+	uint64_t head=r.head.load(std::memory_order_acquire);
+	if (tail==head) return;
+	while (tail<head) {
+		const char* p=r.buf.get()+(tail & (r.capacity-1));
+		uint32_t word[2];
+		memcpy(word, p, sizeof(word));
+		if (word[1]!=PADDING) {
+			Header h;
+			memcpy(&h, p, sizeof(h));
+			format(h, p+sizeof(Header), r.tid, out);
+			++count;
+		}
+		tail+=word[0];
+		r.tail.store(tail, std::memory_order_release);
+	}
+	// only a producer that announced itself in waitForSpace costs a system call
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	uint32_t w=r.drained.load(std::memory_order_relaxed);
+	if ((w & 1) && r.drained.compare_exchange_strong(w, (w+2) & ~1u, std::memory_order_seq_cst)) futexWake(r.drained, INT_MAX);
+}
+
+void Log::format(const Header& h, const char* args, int tid, std::string& out) {
+	uint64_t ns=anchorNs+(int64_t)((double)(int64_t)(h.time-anchorTicks)*nsPerTick);
+	time_t second=ns/1000000000;
+	if (second!=cachedSecond) {
+		struct tm tm;
+		gmtime_r(&second, &tm);
+		strftime(secondText, sizeof(secondText), "%Y-%m-%dT%H:%M:%S", &tm);
+		cachedSecond=second;
+	}
+	char stamp[48];
+	snprintf(stamp, sizeof(stamp), "%s.%06uZ", secondText, (unsigned)(ns%1000000000/1000));
+
+	Arg decoded[256];
+	const char* p=args;
+	for (unsigned i=0;i<h.args;++i) p=decode(p, decoded[i]);
+	auto& pieces=h.format->parts();
+	size_t placeholders=pieces.size()-1;
+	unsigned level=std::min<unsigned>(h.level, 3);
+	if (options.json) {
+		out+="{\"ts\":\"";
+		out+=stamp;
+		out+="\",\"level\":\"";
+		out+=jsonLevelNames[level];
+		out+="\",\"tid\":";
+		out+=std::to_string(tid);
+		out+=",\"msg\":\"";
+	} else {
+		out+=stamp;
+		out+=' ';
+		out+=levelNames[level];
+		out+=" [";
+		out+=std::to_string(tid);
+		out+="] ";
+	}
+	size_t mark=out.size();
+	std::string message;
+	std::string& m=options.json ? message : out;
+	for (size_t i=0;i<pieces.size();++i) {
+		m+=pieces[i].text;
+		if (i<placeholders && i<h.args) appendValue(m, decoded[i], false);
+	}
+	for (size_t i=placeholders;i<h.args;++i) {
+		m+=' ';
+		appendValue(m, decoded[i], false);
+	}
+	if (!options.json) {
+		// keep one record on one line
+		std::replace(out.begin()+mark, out.end(), '\n', ' ');
+		out+='\n';
+		return;
+	}
+	escape(out, message);
+	out+='"';
+	for (size_t i=0;i<h.args;++i) {
+		out+=",\"";
+		if (i<placeholders) escape(out, pieces[i].name);
+		else out+="arg"+std::to_string(i);
+		out+="\":";
+		appendValue(out, decoded[i], true);
+	}
+	out+="}\n";
+}
+
+void Log::write(std::vector<std::string>& batches) {
+	std::vector<iovec> iov;
+	size_t total=0;
+	for (auto& b : batches) {
+		if (b.empty()) continue;
+		iov.push_back(iovec{(void*)b.data(), b.size()});
+		total+=b.size();
+	}
+	if (!total) return;
+	size_t first=0;
+	while (first<iov.size()) {
+		auto w=::writev((int)fd, iov.data()+first, (int)std::min<size_t>(iov.size()-first, IOV_MAX));
+		if (w<0) {
+			if (errno==EINTR) continue;
+			++writeErrors;
+			break;
+		}
+		bytes+=w;
+		fileBytes+=w;
+		for (size_t left=w;left>0 && first<iov.size();) {
+			if (left>=iov[first].iov_len) {
+				left-=iov[first].iov_len;
+				++first;
+			} else {
+				iov[first].iov_base=(char*)iov[first].iov_base+left;
+				iov[first].iov_len-=left;
+				left=0;
+			}
+		}
+	}
+	if ((options.maxFileBytes && fileBytes>=options.maxFileBytes) ||
+			(options.maxFileSeconds && realtimeNs()/1000000000-fileOpened>=options.maxFileSeconds)) {
+		try {
+			rotate();
+		} catch (const std::exception&) {
+			++writeErrors;
+		}
+	}
+}
+
+void Log::open() {
+	if (options.fileName.empty()) {
+		fd=::dup(2);
+		if (!fd) errno_exception("Failed to duplicate stderr for the log");
+		fileBytes=0;
+	} else {
+		fd=::open(options.fileName.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if (!fd) errno_exception("Failed to open log file "+options.fileName);
+		struct stat st;
+		fileBytes=fstat(fd, &st) ? 0 : st.st_size;
+	}
+	fileOpened=realtimeNs()/1000000000;
+}
+
+void Log::rotate() {
+	if (options.fileName.empty()) return;
+	const std::string& name=options.fileName;
+	if (options.keepFiles) {
+		for (unsigned i=options.keepFiles-1;i>0;--i) {
+			::rename((name+"."+std::to_string(i)).c_str(), (name+"."+std::to_string(i+1)).c_str());
+		}
+		if (::rename(name.c_str(), (name+".1").c_str())) errno_exception("Failed to rotate log file "+name);
+	} else {
+		::unlink(name.c_str());
+	}
+	open();
+	++rotations;
+}
+
+// maps ticks() to wall clock nanoseconds: the rate is measured between the previous
+// anchor and now, about a second apart, and the first one over a short busy wait
+void Log::calibrate() {
+#if defined(__x86_64__) || defined(__i386__)
+	uint64_t t=ticks(), n=realtimeNs();
+	if (!anchorTicks) {
+		uint64_t t0=t, n0=n;
+		do {
+			t=ticks();
+			n=realtimeNs();
+		} while (n-n0<2000000);
+		nsPerTick=(double)(n-n0)/(double)(t-t0);
+	} else if (t>anchorTicks) {
+		nsPerTick=(double)(n-anchorNs)/(double)(t-anchorTicks);
+	}
+	anchorTicks=t;
+	anchorNs=n;
+#endif
+}
+
+}
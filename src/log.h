@@ -0,0 +1,267 @@
+#ifndef SRC_LOG_H_
+#define SRC_LOG_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <time.h>
+#include <utils.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Asynchronous logger.
+ *
+ *   utils::Log log({"/var/log/app/app.log"});
+ *   static const utils::LogFormat served("served {path} to {user} in {us} us");
+ *   log.info(served, path, user, elapsedUs);
+ *
+ * The calling thread only copies a binary record (raw timestamp counter, level, format,
+ * arguments) into its own ring buffer: no lock, no system call and no allocation after
+ * the thread's first record. A background thread drains the rings every flushMicroseconds,
+ * formats the records and writes them with writev, rotating the file by size and age.
+ * With json=true each record is a compact JSON line carrying the named placeholders as
+ * fields: {"ts":"...","level":"info","tid":12,"msg":"served /a to ann in 35 us","path":"/a",...}
+ *
+ * Arguments may be integers, floating point, bool, strings (copied, and cut at
+ * maxStringBytes) and pointers. When a thread's ring is full its record is dropped and
+ * counted (Overflow::DROP, reported in the log by the writer) or the thread parks on a
+ * futex in its ring until the writer has drained it (Overflow::BLOCK). Records of one thread keep their order; records of
+ * different threads are written in order of their rings being drained, not of time.
+ */
+
+namespace utils {
+
+enum class LogLevel : uint8_t {DEBUG, INFO, WARN, ERROR};
+
+// A format string with {} or {name} placeholders, parsed once; must outlive the Log.
+class LogFormat {
+public:
+	struct Piece {
+		std::string text;
+		std::string name;
+	};
+private:
+	std::vector<Piece> pieces;
+public:
+	explicit LogFormat(const char* format);
+	LogFormat(const LogFormat&) = delete;
+	LogFormat& operator=(const LogFormat&) = delete;
+	// text before each placeholder and its name; the last piece has no placeholder
+	inline const std::vector<Piece>& parts() const {return pieces;}
+};
+
+class Log {
+public:
+	enum class Overflow {DROP, BLOCK};
+	struct Options {
+		std::string fileName;			// empty for stderr
+		size_t maxFileBytes=64<<20;		// rotate when exceeded, 0 for never
+		uint64_t maxFileSeconds=0;		// rotate when older, 0 for never
+		unsigned keepFiles=5;			// fileName.1 .. fileName.keepFiles
+		size_t ringBytes=256<<10;		// per thread, rounded up to a power of 2
+		size_t maxStringBytes=1024;
+		LogLevel level=LogLevel::INFO;
+		bool json=false;
+		Overflow overflow=Overflow::DROP;
+		uint32_t flushMicroseconds=1000;
+	};
+	struct Stats {
+		uint64_t records;
+		uint64_t dropped;
+		uint64_t bytes;
+		uint64_t rotations;
+		uint64_t writeErrors;
+	};
+
+	struct Header {
+		uint32_t size;		// including the header and padding to 8 bytes
+		uint8_t level;
+		uint8_t args;
+		uint16_t reserved;
+		uint64_t time;
+		const LogFormat* format;
+	};
+	// the second word of a header that only pads out the end of the ring
+	static const uint32_t PADDING=0xffffffff;
+	enum ArgType : uint8_t {ARG_INT, ARG_UINT, ARG_DOUBLE, ARG_BOOL, ARG_STRING, ARG_POINTER};
+
+	struct alignas(64) Ring {
+		alignas(64) std::atomic<uint64_t> head{0};
+		uint64_t cachedTail=0;
+		std::atomic<uint64_t> dropped{0};
+		alignas(64) std::atomic<uint64_t> tail{0};
+		// eventcount the writer bumps after draining; bit 0 says a blocked producer may be parked
+		std::atomic<uint32_t> drained{0};
+		alignas(64) std::unique_ptr<char[]> buf;
+		size_t capacity;
+		uint64_t log;
+		int tid;
+		std::atomic<bool> closed{false};
+		uint64_t reportedDropped=0;
+		Ring(size_t capacity, uint64_t log, int tid);
+	};
+	struct ThreadCache {
+		uint64_t log;
+		Ring* ring;
+	};
+private:
+	static inline thread_local ThreadCache cache{0, nullptr};
+
+	Options options;
+	uint64_t id;
+	size_t maxRecord;
+	std::atomic<int> currentLevel;
+	std::mutex lock;
+	std::condition_variable wake, flushed;
+	std::vector<std::shared_ptr<Ring>> rings;
+	bool stopping=false;
+	uint64_t flushRequests=0, flushesDone=0;
+	std::atomic<uint64_t> records{0}, droppedTotal{0}, bytes{0}, rotations{0}, writeErrors{0};
+	FD fd;
+	uint64_t fileBytes=0, fileOpened=0;
+	double nsPerTick=1;
+	uint64_t anchorTicks=0, anchorNs=0;
+	time_t cachedSecond=-1;
+	char secondText[32];
+	std::thread writer;
+
+	Ring* attach();
+	void waitForSpace(Ring* r);
+	void run();
+	void drain(Ring& r, std::string& out, uint64_t& count);
+	void format(const Header& h, const char* args, int tid, std::string& out);
+	void write(std::vector<std::string>& batches);
+	void open();
+	void rotate();
+	void calibrate();
+
+	static inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		return (uint64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+#endif
+	}
+
+	inline Ring* ring() {
+		if (cache.log==id) return cache.ring;
+		return attach();
+	}
+
+	template<typename T> static inline std::string_view view(const T& v) {
+		if constexpr (std::is_pointer<T>::value) {
+			if (!v) return "(null)";
+		}
+		return std::string_view(v);
+	}
+	template<typename T> inline size_t argSize(const T& v) const {
+		if constexpr (std::is_same<T, bool>::value) {
+			return 2;
+		} else if constexpr (std::is_convertible<const T&, std::string_view>::value) {
+			return 1+4+std::min(view(v).size(), options.maxStringBytes);
+		} else {
+			static_assert(std::is_arithmetic<T>::value || std::is_pointer<T>::value || std::is_enum<T>::value, "unsupported log argument type");
+			return 1+8;
+		}
+	}
+	template<typename T> static inline char* putScalar(char* p, ArgType t, T v) {
+		*p++=t;
+		memcpy(p, &v, 8);
+		return p+8;
+	}
+	template<typename T> inline char* put(char* p, const T& v) const {
+		if constexpr (std::is_same<T, bool>::value) {
+			p[0]=ARG_BOOL;
+			p[1]=v;
+			return p+2;
+		} else if constexpr (std::is_convertible<const T&, std::string_view>::value) {
+			std::string_view s=view(v);
+			uint32_t n=(uint32_t)std::min(s.size(), options.maxStringBytes);
+			*p++=ARG_STRING;
+			memcpy(p, &n, 4);
+			memcpy(p+4, s.data(), n);
+			return p+4+n;
+		} else if constexpr (std::is_pointer<T>::value) {
+			return putScalar(p, ARG_POINTER, (uint64_t)(uintptr_t)v);
+		} else if constexpr (std::is_floating_point<T>::value) {
+			return putScalar(p, ARG_DOUBLE, (double)v);
+		} else if constexpr (std::is_enum<T>::value || std::is_signed<T>::value) {
+			return putScalar(p, ARG_INT, (int64_t)v);
+		} else {
+			return putScalar(p, ARG_UINT, (uint64_t)v);
+		}
+	}
+	inline char* putAll(char* p) const {return p;}
+	template<typename T, typename...REST> inline char* putAll(char* p, const T& v, const REST&... rest) const {
+		return putAll(put(p, v), rest...);
+	}
+
+	// reserves a contiguous record of size bytes, padding out the end of the ring if needed
+	inline char* reserve(Ring* r, size_t size) {
+		uint64_t head=r->head.load(std::memory_order_relaxed);
+		size_t offset=head & (r->capacity-1);
+		size_t pad=offset+size>r->capacity ? r->capacity-offset : 0;
+		if (head+pad+size-r->cachedTail>r->capacity) {
+			r->cachedTail=r->tail.load(std::memory_order_acquire);
+			if (head+pad+size-r->cachedTail>r->capacity) return nullptr;
+		}
+		if (pad) {
+			uint32_t marker[2]={(uint32_t)pad, PADDING};
+			memcpy(r->buf.get()+offset, marker, sizeof(marker));
+			r->head.store(head+pad, std::memory_order_release);
+			offset=0;
+		}
+		return r->buf.get()+offset;
+	}
+public:
+	explicit Log(const Options& options);
+	Log(const Log&) = delete;
+	Log& operator=(const Log&) = delete;
+	~Log();
+
+	inline bool enabled(LogLevel level) const {return (int)level>=currentLevel.load(std::memory_order_relaxed);}
+	inline void setLevel(LogLevel level) {currentLevel.store((int)level, std::memory_order_relaxed);}
+
+	template<typename...ARGS> void log(LogLevel level, const LogFormat& f, const ARGS&... args) {
+		if (!enabled(level)) return;
+		uint64_t now=ticks();
+		size_t size=(sizeof(Header)+(argSize(args)+...+0)+7) & ~size_t(7);
+		Ring* r=ring();
+		char* p;
+		while (size>maxRecord || !(p=reserve(r, size))) {
+			if (options.overflow==Overflow::DROP || size>maxRecord) {
+				r->dropped.store(r->dropped.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+				return;
+			}
+			waitForSpace(r);
+		}
+		Header h{(uint32_t)size, (uint8_t)level, (uint8_t)sizeof...(args), 0, now, &f};
+		memcpy(p, &h, sizeof(h));
+		putAll(p+sizeof(Header), args...);
+		r->head.store(r->head.load(std::memory_order_relaxed)+size, std::memory_order_release);
+	}
+	template<typename...ARGS> inline void debug(const LogFormat& f, const ARGS&... args) {log(LogLevel::DEBUG, f, args...);}
+	template<typename...ARGS> inline void info(const LogFormat& f, const ARGS&... args) {log(LogLevel::INFO, f, args...);}
+	template<typename...ARGS> inline void warn(const LogFormat& f, const ARGS&... args) {log(LogLevel::WARN, f, args...);}
+	template<typename...ARGS> inline void error(const LogFormat& f, const ARGS&... args) {log(LogLevel::ERROR, f, args...);}
+
+	// returns once everything logged before the call has been written
+	void flush();
+	Stats stats() const;
+};
+
+}
+
+#endif /* SRC_LOG_H_ */
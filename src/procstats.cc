@@ -0,0 +1,383 @@
+#include <procstats.h>
+#include <reactor.h>
+#include <jsonutils.h>
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+
+namespace utils {
+
+namespace {
+
+inline uint64_t number(const char*& p) {
+	while (*p==' ' || *p=='\t') ++p;
+	uint64_t v=0;
+	while (*p>='0' && *p<='9') v=v*10+(*p++-'0');
+	return v;
+}
+
+struct Dirent64 {
+	ino64_t d_ino;
+	off64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+// calls f with the name of every entry of the directory fd, from its start
+template<typename F> void listDirectory(int fd, char* buffer, size_t size, F f) {
+	if (::lseek(fd, 0, SEEK_SET)<0) errno_exception("Failed to rewind directory");
+	for (;;) {
+		long n=::syscall(SYS_getdents64, fd, buffer, size);
+		if (n<0) errno_exception("getdents64 failed");
+		if (!n) return;
+		for (long off=0;off<n;) {
+			auto d=(const Dirent64*)(buffer+off);
+			if (strcmp(d->d_name, ".") && strcmp(d->d_name, "..")) f(d->d_name);
+			off+=d->d_reclen;
+		}
+	}
+}
+
+bool validName(const std::string& name) {
+	if (name.empty() || (name[0]>='0' && name[0]<='9')) return false;
+	for (char c : name) {
+		if (!isalnum((unsigned char)c) && c!='_' && c!=':') return false;
+	}
+	return true;
+}
+
+}
+
+ProcStats::ProcStats(pid_t pid) : self(!pid || pid==::getpid()) {
+	std::string base=pid ? "/proc/"+std::to_string(pid) : "/proc/self";
+	auto open=[&](FD& fd, const char* name, bool required) {
+		fd=::open((base+"/"+name).c_str(), O_RDONLY | O_CLOEXEC | (strcmp(name, "fd") ? 0 : O_DIRECTORY));
+		if (!fd && required) errno_exception("Failed to open "+base+"/"+name);
+	};
+	open(stat, "stat", true);
+	open(statm, "statm", true);
+	open(status, "status", true);
+	open(io, "io", false);
+	open(fdDir, "fd", false);
+	ticksPerSecond=sysconf(_SC_CLK_TCK);
+	pageSize=sysconf(_SC_PAGESIZE);
+	buffer[0]='\n';
+
+	// starttime counts ticks from boot
+	std::string s=slurpTextFile("/proc/stat");
+	size_t at=s.find("\nbtime ");
+	if (at!=std::string::npos && read(stat)) {
+		const char* b=s.c_str()+at+7;
+		uint64_t boot=number(b);
+		const char* p=strrchr(buffer+1, ')');
+		if (p) {
+			p+=2;
+			for (int k=3;k<22;++k) {
+				while (*p && *p!=' ') ++p;
+				while (*p==' ') ++p;
+			}
+			startTimeSeconds=boot+number(p)/ticksPerSecond;
+		}
+	}
+}
+
+size_t ProcStats::read(int fd) {
+	size_t len=0;
+	for (;;) {
+		ssize_t r=::pread(fd, buffer+1+len, BUFFER-len, len);
+		if (r<0) {
+			if (errno==EINTR) continue;
+			errno_exception("Failed to read process statistics");
+		}
+		if (!r || (len+=r)==BUFFER) break;
+	}
+	buffer[1+len]=0;
+	return len;
+}
+
+uint64_t ProcStats::field(const char* name) const {
+	const char* p=strstr(buffer, name);
+	if (!p) return 0;
+	p+=strlen(name);
+	return number(p);
+}
+
+size_t ProcStats::countFds() {
+	size_t n=0;
+	listDirectory(fdDir, buffer, BUFFER, [&](const char*) {++n;});
+	// not counting the directory itself
+	return self && n ? n-1 : n;
+}
+
+void ProcStats::sample(ProcSample& s) {
+	s.timeMicroseconds=currentTimeMicroseconds();
+	s.startTimeSeconds=startTimeSeconds;
+	if (read(stat)) {
+		// the name may hold anything, fields start after its last ')'
+		const char* p=strrchr(buffer+1, ')');
+		uint64_t f[25]={0};
+		if (p) {
+			p+=2;
+			// skip the state
+			while (*p && *p!=' ') ++p;
+			for (int k=4;k<25 && *p;++k) {
+				if (*p==' ') ++p;
+				if (*p=='-') ++p;
+				f[k]=number(p);
+				while (*p && *p!=' ') ++p;
+			}
+		}
+		s.minorFaults=f[10];
+		s.majorFaults=f[12];
+		s.userMicroseconds=f[14]*1000000/ticksPerSecond;
+		s.systemMicroseconds=f[15]*1000000/ticksPerSecond;
+		s.threads=f[20];
+	}
+	if (read(statm)) {
+		const char* p=buffer+1;
+		s.virtualBytes=number(p)*pageSize;
+		s.residentBytes=number(p)*pageSize;
+		s.sharedBytes=number(p)*pageSize;
+	}
+	if (read(status)) {
+		s.voluntarySwitches=field("\nvoluntary_ctxt_switches:");
+		s.involuntarySwitches=field("\nnonvoluntary_ctxt_switches:");
+		s.peakResidentBytes=field("\nVmHWM:")*1024;
+	}
+	if (io && read(io)) {
+		s.readChars=field("\nrchar:");
+		s.writeChars=field("\nwchar:");
+		s.readBytes=field("\nread_bytes:");
+		s.writeBytes=field("\nwrite_bytes:");
+	}
+	if (fdDir) s.fds=countFds();
+	rlimit rl;
+	s.maxFds=::getrlimit(RLIMIT_NOFILE, &rl) ? 0 : rl.rlim_cur;
+}
+
+std::vector<std::pair<int, std::string>> ProcStats::descriptors() {
+	std::vector<std::pair<int, std::string>> v;
+	if (!fdDir) return v;
+	std::vector<std::string> names;
+	listDirectory(fdDir, buffer, BUFFER, [&](const char* name) {names.push_back(name);});
+	for (auto& name : names) {
+		int fd=atoi(name.c_str());
+		if (self && fd==fdDir.fd) continue;
+		char target[PATH_MAX];
+		ssize_t n=::readlinkat(fdDir, name.c_str(), target, sizeof(target));
+		v.emplace_back(fd, n<0 ? std::string("?") : std::string(target, n));
+	}
+	std::sort(v.begin(), v.end());
+	return v;
+}
+
+MetricsExporter::MetricsExporter(const Options& o) : options(o) {
+	stats.sample(last);
+	if (options.socketPath.empty()) return;
+	reactor.reset(new Reactor());
+	listen();
+	reactor->every(options.sampleMicroseconds, [this]() {
+		ProcSample s;
+		stats.sample(s);
+		std::lock_guard<std::mutex> g(lock);
+		last=s;
+	});
+	server=std::thread([this]() {reactor->run();});
+}
+
+MetricsExporter::~MetricsExporter() {
+	if (server.joinable()) {
+		reactor->stop();
+		server.join();
+	}
+	if (!options.socketPath.empty() && options.socketPath[0]!='@') ::unlink(options.socketPath.c_str());
+}
+
+void MetricsExporter::listen() {
+	sockaddr_un a;
+	memset(&a, 0, sizeof(a));
+	a.sun_family=AF_UNIX;
+	if (options.socketPath.size()>=sizeof(a.sun_path)) throw std::runtime_error("Socket path too long: "+options.socketPath);
+	memcpy(a.sun_path, options.socketPath.data(), options.socketPath.size());
+	socklen_t len=offsetof(sockaddr_un, sun_path)+options.socketPath.size();
+	if (a.sun_path[0]=='@') {
+		a.sun_path[0]=0;
+	} else {
+		// left over by a process that did not get to clean up
+		::unlink(options.socketPath.c_str());
+		++len;
+	}
+	listener=::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (!listener) errno_exception("Failed to create metrics socket");
+	if (::bind(listener, (sockaddr*)&a, len)) errno_exception("Failed to bind metrics socket "+options.socketPath);
+	if (::listen(listener, 64)) errno_exception("Failed to listen on "+options.socketPath);
+	reactor->add(listener, Reactor::READ, [this](uint32_t) {accept();});
+}
+
+void MetricsExporter::accept() {
+	for (;;) {
+		int fd=::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd<0) {
+			if (errno==EINTR || errno==ECONNABORTED) continue;
+			// EAGAIN, or out of descriptors: the next connection tries again
+			return;
+		}
+		struct Connection {
+			FD fd;
+			std::string in;
+			std::string out;
+			size_t sent=0;
+			Reactor::TimerId timeout=0;
+		};
+		auto c=std::make_shared<Connection>();
+		c->fd=fd;
+		auto close=[this, c]() {
+			reactor->cancel(c->timeout);
+			reactor->remove(c->fd);
+			c->fd=-1;
+		};
+		c->timeout=reactor->after(5000000, close);
+		reactor->add(fd, Reactor::READ | Reactor::WRITE, [this, c, close](uint32_t events) {
+			if (c->out.empty()) {
+				char b[1024];
+				ssize_t n;
+				while ((n=::read(c->fd, b, sizeof(b)))>0 && c->in.size()<8192) c->in.append(b, n);
+				size_t eol=c->in.find('\n');
+				if (eol==std::string::npos && n!=0) {
+					if (n<0 && errno!=EAGAIN && errno!=EINTR) close();
+					return;
+				}
+				std::string line=c->in.substr(0, eol);
+				if (!line.empty() && line.back()=='\r') line.pop_back();
+				bool http=line.compare(0, 4, "GET ")==0;
+				bool asJson=line=="json";
+				if (http) {
+					std::string path=line.substr(4, line.find(' ', 4)-4);
+					asJson=path.size()>=5 && path.compare(path.size()-5, 5, ".json")==0;
+					// the rest of the request does not matter, but wait for it to be sent
+					if (c->in.find("\r\n\r\n")==std::string::npos && c->in.find("\n\n")==std::string::npos && n!=0) return;
+				}
+				std::string body=asJson ? json() : prometheus();
+				if (http) {
+					c->out="HTTP/1.0 200 OK\r\nContent-Type: "+std::string(asJson ? "application/json" : "text/plain; version=0.0.4")+
+							"\r\nContent-Length: "+std::to_string(body.size())+"\r\nConnection: close\r\n\r\n";
+				}
+				c->out+=body;
+			}
+			while (c->sent<c->out.size()) {
+				ssize_t n=::send(c->fd, c->out.data()+c->sent, c->out.size()-c->sent, MSG_NOSIGNAL);
+				if (n<0) {
+					if (errno==EINTR) continue;
+					if (errno!=EAGAIN) close();
+					return;
+				}
+				c->sent+=n;
+			}
+			close();
+		});
+	}
+}
+
+Counter& MetricsExporter::counter(const std::string& name, const std::string& help) {
+	if (!validName(name)) throw std::runtime_error("Invalid metric name: "+name);
+	std::lock_guard<std::mutex> g(lock);
+	for (auto& c : counters) if (c.name==name) return c.metric;
+	for (auto& c : gauges) if (c.name==name) throw std::runtime_error("Metric "+name+" is a gauge");
+	counters.emplace_back(name, help);
+	return counters.back().metric;
+}
+
+Gauge& MetricsExporter::gauge(const std::string& name, const std::string& help) {
+	if (!validName(name)) throw std::runtime_error("Invalid metric name: "+name);
+	std::lock_guard<std::mutex> g(lock);
+	for (auto& c : gauges) if (c.name==name) return c.metric;
+	for (auto& c : counters) if (c.name==name) throw std::runtime_error("Metric "+name+" is a counter");
+	gauges.emplace_back(name, help);
+	return gauges.back().metric;
+}
+
+ProcSample MetricsExporter::sample() {
+	std::lock_guard<std::mutex> g(lock);
+	if (!server.joinable()) stats.sample(last);
+	return last;
+}
+
+namespace {
+
+struct Row {
+	const char* name;
+	const char* type;
+	const char* help;
+	double value;
+};
+
+std::vector<Row> rows(const ProcSample& s) {
+	return {
+		{"cpu_seconds_total", "counter", "User and system CPU time", (s.userMicroseconds+s.systemMicroseconds)/1e6},
+		{"cpu_user_seconds_total", "counter", "User CPU time", s.userMicroseconds/1e6},
+		{"cpu_system_seconds_total", "counter", "System CPU time", s.systemMicroseconds/1e6},
+		{"start_time_seconds", "gauge", "Start time since the epoch", (double)s.startTimeSeconds},
+		{"virtual_memory_bytes", "gauge", "Virtual memory size", (double)s.virtualBytes},
+		{"resident_memory_bytes", "gauge", "Resident memory size", (double)s.residentBytes},
+		{"resident_memory_max_bytes", "gauge", "Peak resident memory size", (double)s.peakResidentBytes},
+		{"shared_memory_bytes", "gauge", "Resident memory backed by files", (double)s.sharedBytes},
+		{"minor_page_faults_total", "counter", "Page faults served without I/O", (double)s.minorFaults},
+		{"major_page_faults_total", "counter", "Page faults that needed I/O", (double)s.majorFaults},
+		{"voluntary_context_switches_total", "counter", "Context switches while waiting", (double)s.voluntarySwitches},
+		{"involuntary_context_switches_total", "counter", "Context switches by preemption", (double)s.involuntarySwitches},
+		{"threads", "gauge", "Threads", (double)s.threads},
+		{"read_bytes_total", "counter", "Bytes read from storage", (double)s.readBytes},
+		{"write_bytes_total", "counter", "Bytes written to storage", (double)s.writeBytes},
+		{"read_chars_total", "counter", "Bytes passed to read calls", (double)s.readChars},
+		{"write_chars_total", "counter", "Bytes passed to write calls", (double)s.writeChars},
+		{"open_fds", "gauge", "Open file descriptors", (double)s.fds},
+		{"max_fds", "gauge", "Limit of open file descriptors", (double)s.maxFds},
+	};
+}
+
+void number(std::string& out, double v) {
+	char b[32];
+	snprintf(b, sizeof(b), "%.17g", v);
+	out+=b;
+}
+
+}
+
+std::string MetricsExporter::prometheus() {
+	ProcSample s=sample();
+	std::string out;
+	auto emit=[&](const std::string& name, const std::string& type, const std::string& help, double v) {
+		out+="# HELP "+name+" "+help+"\n# TYPE "+name+" "+type+"\n"+name+" ";
+		number(out, v);
+		out+="\n";
+	};
+	for (auto& r : rows(s)) emit(options.prefix+r.name, r.type, r.help, r.value);
+	std::lock_guard<std::mutex> g(lock);
+	for (auto& c : counters) emit(c.name, "counter", c.help, (double)c.metric.get());
+	for (auto& c : gauges) emit(c.name, "gauge", c.help, (double)c.metric.get());
+	return out;
+}
+
+std::string MetricsExporter::json() {
+	ProcSample s=sample();
+	auto j=::json::own(json_object());
+	for (auto& r : rows(s)) {
+		json_t* v=r.value==(double)(int64_t)r.value ? json_integer((int64_t)r.value) : json_real(r.value);
+		json_object_set_new(j.get(), (options.prefix+r.name).c_str(), v);
+	}
+	json_object_set_new(j.get(), "time_microseconds", json_integer(s.timeMicroseconds));
+	std::lock_guard<std::mutex> g(lock);
+	for (auto& c : counters) json_object_set_new(j.get(), c.name.c_str(), json_integer(c.metric.get()));
+	for (auto& c : gauges) json_object_set_new(j.get(), c.name.c_str(), json_integer(c.metric.get()));
+	return ::json::to_string(j);
+}
+
+}
@@ -0,0 +1,162 @@
+#ifndef SRC_PROCSTATS_H_
+#define SRC_PROCSTATS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+#include <utils.h>
+
+/*
+ * Process resource sampling and a metrics endpoint.
+ *
+ *   utils::ProcStats stats;
+ *   utils::ProcSample s;
+ *   stats.sample(s);                      // CPU, memory, faults, switches, I/O, fds
+ *
+ *   utils::MetricsExporter::Options o;
+ *   o.socketPath="/run/myservice/metrics.sock";
+ *   utils::MetricsExporter exporter(o);
+ *   auto& requests=exporter.counter("requests_total", "Requests served");
+ *   requests.add();
+ *
+ *   curl --unix-socket /run/myservice/metrics.sock http://localhost/metrics
+ *   echo json | nc -U /run/myservice/metrics.sock
+ *
+ * ProcStats opens /proc/<pid>/stat, statm, status, io and fd once and reads them again
+ * with pread into its own buffer for every sample; open descriptors are counted with
+ * getdents64 on the kept directory. A sample makes no allocation and takes a few
+ * microseconds. Without task I/O accounting the I/O fields stay 0.
+ *
+ * The exporter samples every sampleMicroseconds on a thread of its own running a
+ * Reactor, which also serves the socket: a connection sends one line, "json" for JSON
+ * and anything else for Prometheus text, or an HTTP GET, where a path ending in .json
+ * asks for JSON; the reply follows and the connection is closed. A socketPath starting
+ * with '@' is in the abstract namespace. Counters and gauges are atomics, cheap to update
+ * from any thread; references to them stay valid for the exporter's lifetime.
+ */
+
+namespace utils {
+
+struct ProcSample {
+	uint64_t timeMicroseconds=0;
+	uint64_t startTimeSeconds=0;
+	uint64_t userMicroseconds=0;
+	uint64_t systemMicroseconds=0;
+	uint64_t minorFaults=0;
+	uint64_t majorFaults=0;
+	uint64_t voluntarySwitches=0;
+	uint64_t involuntarySwitches=0;
+	uint64_t virtualBytes=0;
+	uint64_t residentBytes=0;
+	uint64_t peakResidentBytes=0;
+	uint64_t sharedBytes=0;
+	uint64_t threads=0;
+	// storage I/O, and all bytes through read and write calls
+	uint64_t readBytes=0;
+	uint64_t writeBytes=0;
+	uint64_t readChars=0;
+	uint64_t writeChars=0;
+	uint64_t fds=0;
+	uint64_t maxFds=0;
+};
+
+class ProcStats {
+	static const size_t BUFFER=8192;
+	FD stat;
+	FD statm;
+	FD status;
+	FD io;
+	FD fdDir;
+	// fdDir is one of the descriptors it lists only when sampling this process
+	bool self;
+	long ticksPerSecond;
+	long pageSize;
+	uint64_t startTimeSeconds=0;
+	// one byte before the text, always '\n', so every field starts after a newline
+	char buffer[BUFFER+2];
+
+	size_t read(int fd);
+	uint64_t field(const char* name) const;
+	size_t countFds();
+public:
+	// pid 0 is this process
+	explicit ProcStats(pid_t pid=0);
+	ProcStats(const ProcStats&) = delete;
+	ProcStats& operator=(const ProcStats&) = delete;
+
+	void sample(ProcSample& s);
+	// open descriptors and what they point to, for tracking down leaks
+	std::vector<std::pair<int, std::string>> descriptors();
+};
+
+class Counter {
+	std::atomic<uint64_t> value{0};
+public:
+	inline void add(uint64_t n=1) {value.fetch_add(n, std::memory_order_relaxed);}
+	inline uint64_t get() const {return value.load(std::memory_order_relaxed);}
+};
+
+class Gauge {
+	std::atomic<int64_t> value{0};
+public:
+	inline void set(int64_t v) {value.store(v, std::memory_order_relaxed);}
+	inline void add(int64_t n) {value.fetch_add(n, std::memory_order_relaxed);}
+	inline int64_t get() const {return value.load(std::memory_order_relaxed);}
+};
+
+class Reactor;
+
+class MetricsExporter {
+public:
+	struct Options {
+		// no socket when empty: prometheus() and json() still work
+		std::string socketPath;
+		uint64_t sampleMicroseconds=1000000;
+		// put before every process metric name
+		std::string prefix="process_";
+	};
+private:
+	template<typename T> struct Named {
+		std::string name;
+		std::string help;
+		T metric;
+		Named(const std::string& n, const std::string& h) : name(n), help(h) {}
+	};
+	Options options;
+	ProcStats stats;
+	std::mutex lock;
+	ProcSample last;
+	std::deque<Named<Counter>> counters;
+	std::deque<Named<Gauge>> gauges;
+
+	FD listener;
+	std::unique_ptr<Reactor> reactor;
+	std::thread server;
+
+	void listen();
+	void accept();
+public:
+	explicit MetricsExporter(const Options& options);
+	MetricsExporter(const MetricsExporter&) = delete;
+	MetricsExporter& operator=(const MetricsExporter&) = delete;
+	~MetricsExporter();
+
+	Counter& counter(const std::string& name, const std::string& help);
+	Gauge& gauge(const std::string& name, const std::string& help);
+
+	// the latest sample, taken now when nothing samples in the background
+	ProcSample sample();
+	std::string prometheus();
+	std::string json();
+};
+
+}
+
+#endif /* SRC_PROCSTATS_H_ */
@@ -0,0 +1,450 @@
+#include <profiler.h>
+#include <jsonutils.h>
+#include <utils.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include <cxxabi.h>
+#include <elf.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <link.h>
+#include <signal.h>
+#include <time.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+namespace utils {
+
+namespace {
+
+const int MAX_DEPTH=64;
+// the handler and the signal trampoline
+const int SKIP=2;
+// 16 bytes, what PR_GET_NAME fills
+const size_t NAME=16/sizeof(uintptr_t);
+
+// a sample is [depth, tid, name, pc...] with the leaf first, the thread's name taking
+// NAME words when threads are profiled and none otherwise; the buffer starts zeroed and
+// nothing has depth 0, so a reader stops at the first 0 or at the end
+struct State {
+	std::mutex lock;
+	bool running=false;
+	bool installed=false;
+	bool threads=false;
+	bool framePointers=false;
+	pid_t pid=0;
+	size_t nameWords=0;
+	timer_t timer;
+	uintptr_t* words=nullptr;
+	size_t capacity=0;
+	std::atomic<bool> enabled{false};
+	std::atomic<int> inHandler{0};
+	std::atomic<size_t> used{0};
+	std::atomic<uint64_t> samples{0};
+	std::atomic<uint64_t> dropped{0};
+};
+
+State state;
+
+uintptr_t contextPc(void* context) {
+	auto uc=(ucontext_t*)context;
+#if defined(__x86_64__)
+	return uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__i386__)
+	return uc->uc_mcontext.gregs[REG_EIP];
+#elif defined(__arm__)
+	return uc->uc_mcontext.arm_pc;
+#elif defined(__aarch64__)
+	return uc->uc_mcontext.pc;
+#else
+	(void)uc;
+	return 0;
+#endif
+}
+
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+const bool FRAME_POINTERS=true;
+#else
+// 32 bit ARM code has no one frame layout
+const bool FRAME_POINTERS=false;
+#endif
+
+uintptr_t contextFp(void* context) {
+	auto uc=(ucontext_t*)context;
+#if defined(__x86_64__)
+	return uc->uc_mcontext.gregs[REG_RBP];
+#elif defined(__i386__)
+	return uc->uc_mcontext.gregs[REG_EBP];
+#elif defined(__aarch64__)
+	return uc->uc_mcontext.regs[29];
+#else
+	(void)uc;
+	return 0;
+#endif
+}
+
+// follows the chain of saved frame pointers, each frame starting with the caller's frame
+// pointer and the return address; process_vm_readv fails on a bad pointer where a plain
+// read would fault, and a frame must lie above the one before, which ends any cycle
+int walkFrames(void* context, void** frames, int max) {
+	int n=0;
+	frames[n++]=(void*)contextPc(context);
+	uintptr_t fp=contextFp(context);
+	while (n<max && fp && !(fp%sizeof(uintptr_t))) {
+		uintptr_t frame[2];
+		iovec local={frame, sizeof(frame)}, remote={(void*)fp, sizeof(frame)};
+		if (::process_vm_readv(state.pid, &local, 1, &remote, 1, 0)!=(ssize_t)sizeof(frame) || !frame[1]) break;
+		frames[n++]=(void*)frame[1];
+		if (frame[0]<=fp) break;
+		fp=frame[0];
+	}
+	return n;
+}
+
+void onProf(int, siginfo_t*, void* context) {
+	int saved=errno;
+	state.inHandler.fetch_add(1);
+	if (state.enabled.load()) {
+		void* frames[MAX_DEPTH+SKIP];
+		int first=0, n;
+		if (state.framePointers) {
+			n=walkFrames(context, frames, MAX_DEPTH);
+		} else {
+			n=::backtrace(frames, MAX_DEPTH+SKIP);
+			uintptr_t pc=contextPc(context);
+			// start at the interrupted instruction; when unwinding could not get through the
+			// signal frame keep that instruction alone
+			while (first<n && (uintptr_t)frames[first]!=pc) ++first;
+			if (first==n) {
+				first=std::max(n-1, 0);
+				frames[first]=(void*)pc;
+				n=first+1;
+			}
+		}
+		size_t depth=std::min(n-first, MAX_DEPTH);
+		size_t size=2+state.nameWords+depth;
+		size_t at=state.used.fetch_add(size, std::memory_order_relaxed);
+		if (at+size>state.capacity) {
+			state.dropped.fetch_add(1, std::memory_order_relaxed);
+		} else {
+			uintptr_t* w=state.words+at;
+			w[1]=::syscall(SYS_gettid);
+			// the name now, the thread may be gone by the time the profile is read
+			if (state.nameWords) ::prctl(PR_GET_NAME, (unsigned long)(w+2), 0, 0, 0);
+			w+=state.nameWords;
+			for (size_t i=0;i<depth;++i) w[2+i]=(uintptr_t)frames[first+i];
+			w-=state.nameWords;
+			w[0]=depth;
+			state.samples.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+	state.inHandler.fetch_sub(1);
+	errno=saved;
+}
+
+std::string hex(uintptr_t v) {
+	char b[24];
+	snprintf(b, sizeof(b), "0x%llx", (unsigned long long)v);
+	return b;
+}
+
+std::string demangle(const char* name) {
+	int status=-1;
+	char* d=abi::__cxa_demangle(name, nullptr, nullptr, &status);
+	if (!d) return name;
+	std::string s=d;
+	::free(d);
+	return s;
+}
+
+class Symbolizer {
+	struct Symbol {
+		uintptr_t address;
+		uintptr_t size;
+		std::string name;
+		bool operator<(const Symbol& o) const {return address<o.address;}
+	};
+	struct Module {
+		std::string path;
+		std::string name;
+		uintptr_t bias;
+		uintptr_t low;
+		uintptr_t high;
+		bool loaded=false;
+		std::vector<Symbol> symbols;
+	};
+	std::vector<Module> modules;
+	std::unordered_map<uintptr_t, std::string> cache;
+
+	static int collect(dl_phdr_info* info, size_t, void* data) {
+		Module m;
+		m.path=info->dlpi_name ? info->dlpi_name : "";
+		if (m.path.empty()) m.path="/proc/self/exe";
+		m.bias=info->dlpi_addr;
+		m.low=UINTPTR_MAX;
+		m.high=0;
+		for (int i=0;i<info->dlpi_phnum;++i) {
+			const ElfW(Phdr)& p=info->dlpi_phdr[i];
+			if (p.p_type!=PT_LOAD) continue;
+			m.low=std::min<uintptr_t>(m.low, m.bias+p.p_vaddr);
+			m.high=std::max<uintptr_t>(m.high, m.bias+p.p_vaddr+p.p_memsz);
+		}
+		if (m.low<m.high) ((std::vector<Module>*)data)->push_back(std::move(m));
+		return 0;
+	}
+
+	// function symbols from .symtab, or from .dynsym when the file is stripped
+	static void load(Module& m) {
+		m.loaded=true;
+		std::string file=m.path;
+		if (file=="/proc/self/exe") {
+			char b[4096];
+			ssize_t n=::readlink(file.c_str(), b, sizeof(b));
+			if (n>0) file.assign(b, n);
+		}
+		m.name=file.substr(file.rfind('/')+1);
+		FD fd(::open(m.path.c_str(), O_RDONLY | O_CLOEXEC));
+		struct stat st;
+		if (!fd || ::fstat(fd, &st) || (size_t)st.st_size<sizeof(ElfW(Ehdr))) return;
+		size_t size=st.st_size;
+		void* map=::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map==MAP_FAILED) return;
+		const char* base=(const char*)map;
+		auto eh=(const ElfW(Ehdr)*)base;
+		if (!memcmp(eh->e_ident, ELFMAG, SELFMAG) && eh->e_ident[EI_CLASS]==(sizeof(void*)==8 ? ELFCLASS64 : ELFCLASS32) &&
+				eh->e_shentsize==sizeof(ElfW(Shdr)) && eh->e_shoff && eh->e_shoff+eh->e_shnum*sizeof(ElfW(Shdr))<=size) {
+			auto sh=(const ElfW(Shdr)*)(base+eh->e_shoff);
+			const ElfW(Shdr)* table=nullptr;
+			for (int i=0;i<eh->e_shnum;++i) {
+				if (sh[i].sh_type==SHT_SYMTAB) table=&sh[i];
+				else if (sh[i].sh_type==SHT_DYNSYM && !table) table=&sh[i];
+			}
+			if (table && table->sh_link<eh->e_shnum && table->sh_offset+table->sh_size<=size) {
+				const ElfW(Shdr)& strings=sh[table->sh_link];
+				if (strings.sh_offset+strings.sh_size<=size) {
+					auto syms=(const ElfW(Sym)*)(base+table->sh_offset);
+					size_t count=table->sh_size/sizeof(ElfW(Sym));
+					for (size_t i=0;i<count;++i) {
+						const ElfW(Sym)& s=syms[i];
+						int type=s.st_info & 0xf;
+						if ((type!=STT_FUNC && type!=STT_GNU_IFUNC) || s.st_shndx==SHN_UNDEF || !s.st_value) continue;
+						if (s.st_name>=strings.sh_size) continue;
+						const char* name=base+strings.sh_offset+s.st_name;
+						m.symbols.push_back(Symbol{m.bias+s.st_value, s.st_size,
+							std::string(name, strnlen(name, strings.sh_size-s.st_name))});
+					}
+				}
+			}
+		}
+		::munmap(map, size);
+		std::sort(m.symbols.begin(), m.symbols.end());
+	}
+
+	std::string lookup(uintptr_t address) {
+		for (Module& m : modules) {
+			if (address<m.low || address>=m.high) continue;
+			if (!m.loaded) load(m);
+			auto i=std::upper_bound(m.symbols.begin(), m.symbols.end(), Symbol{address, 0, std::string()});
+			if (i!=m.symbols.begin()) {
+				--i;
+				// a symbol without a size covers everything up to the next one
+				if (!i->size || address<i->address+i->size) return demangle(i->name.c_str());
+			}
+			return m.name+"+"+hex(address-m.bias);
+		}
+		return hex(address);
+	}
+public:
+	Symbolizer() {
+		::dl_iterate_phdr(&Symbolizer::collect, &modules);
+	}
+
+	const std::string& name(uintptr_t address) {
+		auto i=cache.find(address);
+		if (i!=cache.end()) return i->second;
+		std::string s=lookup(address);
+		for (char& c : s) {
+			if (c==';' || c=='\n') c=':';
+		}
+		return cache.emplace(address, std::move(s)).first->second;
+	}
+};
+
+// distinct stacks of the last run, root first, with their counts
+std::map<std::vector<std::string>, uint64_t> stacks() {
+	std::lock_guard<std::mutex> l(state.lock);
+	if (state.running) throw std::runtime_error("Profiler is running, stop it before reading the profile");
+	// keyed by the thread and its name when those count, then the frames
+	std::map<std::vector<uintptr_t>, uint64_t> raw;
+	size_t end=std::min(state.used.load(), state.capacity);
+	size_t skip=state.threads ? 1 : 2+state.nameWords;
+	std::vector<uintptr_t> key;
+	for (size_t at=0;at<end && state.words[at];) {
+		size_t size=2+state.nameWords+state.words[at];
+		key.assign(state.words+at+skip, state.words+at+size);
+		++raw[key];
+		at+=size;
+	}
+	Symbolizer symbols;
+	std::map<std::vector<std::string>, uint64_t> out;
+	std::vector<std::string> frames;
+	for (auto& r : raw) {
+		frames.clear();
+		size_t first=0;
+		if (state.threads) {
+			char name[NAME*sizeof(uintptr_t)+1];
+			memcpy(name, &r.first[1], NAME*sizeof(uintptr_t));
+			name[sizeof(name)-1]=0;
+			std::string thread=std::string(name)+" "+std::to_string(r.first[0]);
+			for (char& c : thread) {
+				if (c==';') c=':';
+			}
+			frames.push_back(thread);
+			first=1+NAME;
+		}
+		// return addresses point past the call: look up the call itself
+		for (size_t i=r.first.size();i-->first;) frames.push_back(symbols.name(i==first ? r.first[i] : r.first[i]-1));
+		out[frames]+=r.second;
+	}
+	return out;
+}
+
+}
+
+void Profiler::start(unsigned hz) {
+	Options o;
+	o.hz=hz;
+	start(o);
+}
+
+void Profiler::start(const Options& options) {
+	if (!options.hz || options.hz>100000) throw std::runtime_error("Profiler rate must be between 1 and 100000 Hz");
+	std::lock_guard<std::mutex> l(state.lock);
+	if (state.running) throw std::runtime_error("Profiler is already running");
+	if (options.framePointers && !FRAME_POINTERS) throw std::runtime_error("Frame pointer unwinding is not supported on this architecture");
+	// backtrace loads the unwinder on its first call, which must not happen in the handler
+	void* warm[4];
+	::backtrace(warm, 4);
+
+	size_t capacity=std::max<size_t>(options.bufferBytes/sizeof(uintptr_t), MAX_DEPTH+2+NAME);
+	// untouched pages of a large calloc are not committed
+	uintptr_t* words=(uintptr_t*)::calloc(capacity, sizeof(uintptr_t));
+	if (!words) throw std::runtime_error("Failed to allocate the profiler buffer");
+	::free(state.words);
+	state.words=words;
+	state.capacity=capacity;
+	state.threads=options.threads;
+	state.framePointers=options.framePointers;
+	state.pid=::getpid();
+	state.nameWords=options.threads ? NAME : 0;
+	state.used=0;
+	state.samples=0;
+	state.dropped=0;
+
+	if (!state.installed) {
+		// stays installed: a SIGPROF still pending after stop() must not kill the process
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_sigaction=&onProf;
+		sa.sa_flags=SA_SIGINFO | SA_RESTART;
+		sigemptyset(&sa.sa_mask);
+		if (::sigaction(SIGPROF, &sa, nullptr)) errno_exception("Failed to install the SIGPROF handler");
+		state.installed=true;
+	}
+	sigevent sev;
+	memset(&sev, 0, sizeof(sev));
+	sev.sigev_notify=SIGEV_SIGNAL;
+	sev.sigev_signo=SIGPROF;
+	if (::timer_create(CLOCK_PROCESS_CPUTIME_ID, &sev, &state.timer)) errno_exception("Failed to create the profiler timer");
+	state.enabled=true;
+	itimerspec its;
+	uint64_t period=1000000000ULL/options.hz;
+	its.it_interval.tv_sec=period/1000000000;
+	its.it_interval.tv_nsec=period%1000000000;
+	its.it_value=its.it_interval;
+	if (::timer_settime(state.timer, 0, &its, nullptr)) {
+		state.enabled=false;
+		::timer_delete(state.timer);
+		errno_exception("Failed to start the profiler timer");
+	}
+	state.running=true;
+}
+
+void Profiler::stop() {
+	std::lock_guard<std::mutex> l(state.lock);
+	if (!state.running) return;
+	::timer_delete(state.timer);
+	state.enabled=false;
+	// a handler that saw enabled set is still writing
+	while (state.inHandler.load()) sched_yield();
+	state.running=false;
+}
+
+bool Profiler::running() {
+	std::lock_guard<std::mutex> l(state.lock);
+	return state.running;
+}
+
+Profiler::Stats Profiler::stats() {
+	return Stats{state.samples.load(), state.dropped.load()};
+}
+
+std::string Profiler::folded() {
+	std::string out;
+	for (auto& s : stacks()) {
+		for (size_t i=0;i<s.first.size();++i) {
+			if (i) out+=';';
+			out+=s.first[i];
+		}
+		out+=' ';
+		out+=std::to_string(s.second);
+		out+='\n';
+	}
+	return out;
+}
+
+std::string Profiler::json() {
+	struct Node {
+		uint64_t value=0;
+		std::map<std::string, size_t> children;
+	};
+	std::vector<Node> nodes(1);
+	for (auto& s : stacks()) {
+		size_t at=0;
+		nodes[at].value+=s.second;
+		for (auto& f : s.first) {
+			auto c=nodes[at].children.find(f);
+			if (c==nodes[at].children.end()) {
+				c=nodes[at].children.emplace(f, nodes.size()).first;
+				nodes.emplace_back();
+			}
+			at=c->second;
+			nodes[at].value+=s.second;
+		}
+	}
+	std::function<json_t*(const std::string&, size_t)> build=[&](const std::string& name, size_t at) {
+		json_t* j=json_object();
+		json_object_set_new(j, "name", json_string(name.c_str()));
+		json_object_set_new(j, "value", json_integer(nodes[at].value));
+		json_t* children=json_array();
+		for (auto& c : nodes[at].children) json_array_append_new(children, build(c.first, c.second));
+		json_object_set_new(j, "children", children);
+		return j;
+	};
+	return ::json::to_string(::json::own(build("all", 0)));
+}
+
+}
@@ -0,0 +1,74 @@
+#ifndef SRC_PROFILER_H_
+#define SRC_PROFILER_H_
+
+#include <cstdint>
+#include <string>
+
+/*
+ * Sampling CPU profiler.
+ *
+ *   utils::Profiler::start(100);
+ *   ...
+ *   utils::Profiler::stop();
+ *   utils::dumpToFile("cpu.folded", utils::Profiler::folded());     // flamegraph.pl cpu.folded
+ *   utils::dumpToFile("cpu.json", utils::Profiler::json());         // d3-flame-graph
+ *
+ * A POSIX timer on the process CPU clock sends SIGPROF hz times per second of CPU used,
+ * to whichever thread is running; the kernel checks CPU timers at its tick, so rates
+ * above CONFIG_HZ, often 250, sample at the tick. The handler takes the stack and appends
+ * the raw return addresses to a buffer allocated by start(), claiming room with one atomic
+ * add; when the buffer is full samples are counted as dropped.
+ *
+ * By default the stack comes from backtrace(), which reads the unwind tables and so works
+ * for optimized code, but is not async-signal-safe: start() calls it once so libgcc is not
+ * loaded in the handler, yet a sample landing in the unwinder while an exception is being
+ * thrown re-enters it, and unwinding takes the loader's lock, so dlopen or dlclose while
+ * profiling may deadlock. Options::framePointers instead follows the frame pointer chain,
+ * reading every frame with process_vm_readv so a bad pointer ends the walk instead of
+ * faulting; that is async-signal-safe, but a function built without frame pointers
+ * (-fno-omit-frame-pointer) hides its caller. 32 bit ARM only has backtrace().
+ *
+ * Nothing is resolved while sampling: folded() and json() aggregate identical stacks
+ * and look addresses up in the symbol tables of the loaded files, so static functions of
+ * an executable without -rdynamic are named too; addresses without a symbol show as
+ * file+0xoffset.
+ *
+ * A profile stays available after stop() until the next start(). Threads that must not
+ * be interrupted can block SIGPROF. System calls interrupted by the signal are restarted
+ * where the kernel allows; those that never are (epoll_wait, nanosleep, ...) may return
+ * EINTR as with any signal.
+ */
+
+namespace utils {
+
+class Profiler {
+public:
+	struct Options {
+		unsigned hz=100;
+		size_t bufferBytes=16<<20;
+		// puts the thread's name and id at the root of each stack
+		bool threads=false;
+		// walks frame pointers instead of calling backtrace(); see above
+		bool framePointers=false;
+	};
+	struct Stats {
+		uint64_t samples;
+		uint64_t dropped;
+	};
+
+	static void start(unsigned hz=100);
+	static void start(const Options& options);
+	static void stop();
+	static bool running();
+	static Stats stats();
+
+	// one line per distinct stack, root first, frames separated by ';', then the count;
+	// only between stop() and the next start()
+	static std::string folded();
+	// {"name": "all", "value": n, "children": [...]}
+	static std::string json();
+};
+
+}
+
+#endif /* SRC_PROFILER_H_ */
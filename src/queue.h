@@ -0,0 +1,332 @@
+#ifndef SRC_QUEUE_H_
+#define SRC_QUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <utils.h>
+
+/*
+ * Bounded lock-free ring queues.
+ *
+ *   utils::SpscQueue<utils::FD> q(1024);			// one producer, one consumer
+ *   utils::MpmcQueue<json::jsonptr> m(4096);		// any number of each
+ *   if (!m.try_push(std::move(j))) ...			// full: j is left untouched
+ *   utils::BlockingQueue<utils::MpmcQueue<Job>> jobs(4096);
+ *   jobs.push(std::move(job));						// waits while full
+ *   while (jobs.pop(job)) ...						// false once closed and drained
+ *
+ * The capacity is rounded up to a power of two. Producer and consumer positions live on
+ * separate cache lines. SpscQueue is wait-free: each side keeps a cached copy of the
+ * other's position and reads the shared one only when the cache says full or empty.
+ * MpmcQueue is Vyukov's bounded queue: every cell carries a sequence number telling
+ * whose turn it is, so producers and consumers contend only on one CAS of their own
+ * position. Payloads may be move-only; a failed try_push does not move from its argument.
+ *
+ * push_batch/pop_batch move up to n elements and return how many they moved, claiming
+ * the whole run with one position update.
+ *
+ * BlockingQueue spins briefly, then parks on a futex. A waiter first marks the futex word;
+ * the next push (or pop, for waiting producers) clears the mark and wakes all waiters with
+ * one system call, and later ones see no mark and skip it. A batch signals once.
+ */
+
+namespace utils {
+
+namespace detail {
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+inline size_t queueCapacity(size_t capacity, size_t least) {
+	if (capacity>(SIZE_MAX>>2)) throw std::runtime_error("Queue capacity too large");
+	size_t c=least;
+	while (c<capacity) c<<=1;
+	return c;
+}
+
+}
+
+template<typename T> class SpscQueue {
+	struct Slot {
+		alignas(T) unsigned char data[sizeof(T)];
+		inline T* get() {return std::launder(reinterpret_cast<T*>(data));}
+	};
+	alignas(64) std::atomic<size_t> head{0};
+	size_t cachedTail=0;
+	alignas(64) std::atomic<size_t> tail{0};
+	size_t cachedHead=0;
+	alignas(64) size_t mask;
+	std::unique_ptr<Slot[]> slots;
+
+	inline size_t room(size_t h, size_t want) {
+		if (h-cachedTail+want>mask+1) cachedTail=tail.load(std::memory_order_acquire);
+		return mask+1-(h-cachedTail);
+	}
+	inline size_t available(size_t t, size_t want) {
+		if (cachedHead-t<want) cachedHead=head.load(std::memory_order_acquire);
+		return cachedHead-t;
+	}
+public:
+	typedef T value_type;
+
+	explicit SpscQueue(size_t capacity) : mask(detail::queueCapacity(capacity, 1)-1), slots(new Slot[mask+1]) {}
+	SpscQueue(const SpscQueue&) = delete;
+	SpscQueue& operator=(const SpscQueue&) = delete;
+	~SpscQueue() {
+		for (size_t t=tail.load(), h=head.load();t!=h;++t) slots[t & mask].get()->~T();
+	}
+
+	inline size_t capacity() const {return mask+1;}
+	// exact only when neither side is running
+	inline size_t size() const {
+		size_t t=tail.load(std::memory_order_acquire);
+		return head.load(std::memory_order_acquire)-t;
+	}
+	inline bool empty() const {return !size();}
+
+	// producer side
+	template<typename...A> bool try_emplace(A&&... args) {
+		size_t h=head.load(std::memory_order_relaxed);
+		if (!room(h, 1)) return false;
+		new (slots[h & mask].data) T(std::forward<A>(args)...);
+		head.store(h+1, std::memory_order_release);
+		return true;
+	}
+	inline bool try_push(T&& v) {return try_emplace(std::move(v));}
+	inline bool try_push(const T& v) {return try_emplace(v);}
+	template<typename IT> size_t push_batch(IT first, size_t n) {
+		size_t h=head.load(std::memory_order_relaxed);
+		n=std::min(n, room(h, n));
+		for (size_t i=0;i<n;++i, ++first) new (slots[(h+i) & mask].data) T(std::move(*first));
+		if (n) head.store(h+n, std::memory_order_release);
+		return n;
+	}
+
+	// consumer side
+	bool try_pop(T& out) {
+		size_t t=tail.load(std::memory_order_relaxed);
+		if (!available(t, 1)) return false;
+		T* p=slots[t & mask].get();
+		out=std::move(*p);
+		p->~T();
+		tail.store(t+1, std::memory_order_release);
+		return true;
+	}
+	template<typename OUT> size_t pop_batch(OUT out, size_t max) {
+		size_t t=tail.load(std::memory_order_relaxed);
+		size_t n=std::min(max, available(t, max));
+		for (size_t i=0;i<n;++i, ++out) {
+			T* p=slots[(t+i) & mask].get();
+			*out=std::move(*p);
+			p->~T();
+		}
+		if (n) tail.store(t+n, std::memory_order_release);
+		return n;
+	}
+};
+
+template<typename T> class MpmcQueue {
+	struct Cell {
+		std::atomic<size_t> sequence;
+		alignas(T) unsigned char data[sizeof(T)];
+		inline T* get() {return std::launder(reinterpret_cast<T*>(data));}
+	};
+	alignas(64) std::atomic<size_t> enqueuePos{0};
+	alignas(64) std::atomic<size_t> dequeuePos{0};
+	alignas(64) size_t mask;
+	std::unique_ptr<Cell[]> cells;
+
+	// claims up to n consecutive cells whose sequence is pos+i+ready; returns the count and the first position
+	inline size_t claim(std::atomic<size_t>& position, size_t ready, size_t n, size_t& pos) {
+		pos=position.load(std::memory_order_relaxed);
+		if (!n) return 0;
+		for (;;) {
+			size_t k=0;
+			intptr_t d=0;
+			while (k<n && !(d=(intptr_t)cells[(pos+k) & mask].sequence.load(std::memory_order_acquire)-(intptr_t)(pos+k+ready))) ++k;
+			if (k) {
+				if (position.compare_exchange_weak(pos, pos+k, std::memory_order_relaxed)) return k;
+			} else if (d<0) {
+				return 0;
+			} else {
+				// another thread took pos meanwhile
+				pos=position.load(std::memory_order_relaxed);
+			}
+		}
+	}
+public:
+	typedef T value_type;
+
+	explicit MpmcQueue(size_t capacity) : mask(detail::queueCapacity(capacity, 2)-1), cells(new Cell[mask+1]) {
+		for (size_t i=0;i<=mask;++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+	MpmcQueue(const MpmcQueue&) = delete;
+	MpmcQueue& operator=(const MpmcQueue&) = delete;
+	~MpmcQueue() {
+		for (size_t t=dequeuePos.load(), h=enqueuePos.load();t!=h;++t) cells[t & mask].get()->~T();
+	}
+
+	inline size_t capacity() const {return mask+1;}
+	// approximate while producers or consumers are running
+	inline size_t size() const {
+		size_t t=dequeuePos.load(std::memory_order_acquire);
+		size_t h=enqueuePos.load(std::memory_order_acquire);
+		return h>t ? h-t : 0;
+	}
+	inline bool empty() const {return !size();}
+
+	template<typename...A> bool try_emplace(A&&... args) {
+		size_t pos;
+		if (!claim(enqueuePos, 0, 1, pos)) return false;
+		Cell& c=cells[pos & mask];
+		new (c.data) T(std::forward<A>(args)...);
+		c.sequence.store(pos+1, std::memory_order_release);
+		return true;
+	}
+	inline bool try_push(T&& v) {return try_emplace(std::move(v));}
+	inline bool try_push(const T& v) {return try_emplace(v);}
+	template<typename IT> size_t push_batch(IT first, size_t n) {
+		size_t pos;
+		n=claim(enqueuePos, 0, n, pos);
+		for (size_t i=0;i<n;++i, ++first) {
+			Cell& c=cells[(pos+i) & mask];
+			new (c.data) T(std::move(*first));
+			c.sequence.store(pos+i+1, std::memory_order_release);
+		}
+		return n;
+	}
+
+	bool try_pop(T& out) {
+		size_t pos;
+		if (!claim(dequeuePos, 1, 1, pos)) return false;
+		Cell& c=cells[pos & mask];
+		out=std::move(*c.get());
+		c.get()->~T();
+		c.sequence.store(pos+mask+1, std::memory_order_release);
+		return true;
+	}
+	template<typename OUT> size_t pop_batch(OUT out, size_t max) {
+		size_t pos;
+		size_t n=claim(dequeuePos, 1, max, pos);
+		for (size_t i=0;i<n;++i, ++out) {
+			Cell& c=cells[(pos+i) & mask];
+			*out=std::move(*c.get());
+			c.get()->~T();
+			c.sequence.store(pos+i+mask+1, std::memory_order_release);
+		}
+		return n;
+	}
+};
+
+// Q is SpscQueue<T> or MpmcQueue<T>; with SpscQueue there must still be one producer and one consumer
+template<typename Q> class BlockingQueue {
+public:
+	typedef typename Q::value_type value_type;
+private:
+	static const int SPINS=64;
+	Q q;
+	// eventcounts: bit 0 says someone may be parked, the rest counts wakeups
+	alignas(64) std::atomic<uint32_t> notEmpty{0};
+	alignas(64) std::atomic<uint32_t> notFull{0};
+	alignas(64) std::atomic<bool> closed{false};
+
+	static inline void signal(std::atomic<uint32_t>& word) {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		uint32_t w=word.load(std::memory_order_relaxed);
+		// only the first signal after someone announced itself pays for the system call
+		if ((w & 1) && word.compare_exchange_strong(w, (w+2) & ~1u, std::memory_order_seq_cst)) futexWake(word, INT_MAX);
+	}
+	// retries op, spinning and then parking on word, until it succeeds or the queue is closed;
+	// pushes (!drainClosed) look at closed before every try, so none lands after close()
+	template<typename OP> bool await(OP op, std::atomic<uint32_t>& word, bool drainClosed) {
+		for (int i=0;i<SPINS;++i) {
+			if (!drainClosed && closed.load(std::memory_order_acquire)) return false;
+			if (op()) return true;
+			if (closed.load(std::memory_order_relaxed)) break;
+			detail::cpuRelax();
+		}
+		for (;;) {
+			uint32_t w=word.fetch_or(1, std::memory_order_seq_cst) | 1;
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (!drainClosed && closed.load(std::memory_order_seq_cst)) return false;
+			if (op()) return true;
+			if (closed.load(std::memory_order_seq_cst)) return drainClosed && op();
+			futexWait(word, w);
+		}
+	}
+public:
+	explicit BlockingQueue(size_t capacity) : q(capacity) {}
+
+	inline size_t capacity() const {return q.capacity();}
+	inline size_t size() const {return q.size();}
+	inline bool isClosed() const {return closed.load(std::memory_order_acquire);}
+
+	// waits while full; false, leaving v untouched, if the queue is or gets closed
+	bool push(value_type&& v) {
+		if (closed.load(std::memory_order_acquire)) return false;
+		if (!await([&]() {return q.try_push(std::move(v));}, notFull, false)) return false;
+		signal(notEmpty);
+		return true;
+	}
+	bool try_push(value_type&& v) {
+		if (closed.load(std::memory_order_acquire) || !q.try_push(std::move(v))) return false;
+		signal(notEmpty);
+		return true;
+	}
+	// waits for an element; false once the queue is closed and empty
+	bool pop(value_type& out) {
+		if (!await([&]() {return q.try_pop(out);}, notEmpty, true)) return false;
+		signal(notFull);
+		return true;
+	}
+	bool try_pop(value_type& out) {
+		if (!q.try_pop(out)) return false;
+		signal(notFull);
+		return true;
+	}
+
+	// pushes all n, waiting for room as needed; returns how many were pushed (fewer only if closed)
+	template<typename IT> size_t push_batch(IT first, size_t n) {
+		size_t done=0;
+		while (done<n && !closed.load(std::memory_order_acquire)) {
+			size_t k=0;
+			if (!await([&]() {return (k=q.push_batch(first, n-done))>0;}, notFull, false)) break;
+			std::advance(first, k);
+			done+=k;
+			signal(notEmpty);
+		}
+		return done;
+	}
+	// waits for at least one element, then takes up to max; 0 once closed and empty
+	template<typename OUT> size_t pop_batch(OUT out, size_t max) {
+		size_t k=0;
+		if (!max || !await([&]() {return (k=q.pop_batch(out, max))>0;}, notEmpty, true)) return 0;
+		signal(notFull);
+		return k;
+	}
+
+	// wakes everyone; pushes fail from now on, pops drain what is left
+	void close() {
+		closed.store(true, std::memory_order_seq_cst);
+		notEmpty.fetch_add(2, std::memory_order_seq_cst);
+		futexWake(notEmpty, INT_MAX);
+		notFull.fetch_add(2, std::memory_order_seq_cst);
+		futexWake(notFull, INT_MAX);
+	}
+};
+
+}
+
+#endif /* SRC_QUEUE_H_ */
@@ -0,0 +1,325 @@
+#include <reactor.h>
+#include <stdexcept>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+
+namespace utils {
+
+void TimerWheel::place(Id id, uint64_t expires) {
+	uint64_t delta=expires>current ? expires-current : 0;
+	int level=0;
+	while (level+1<LEVELS && delta>=(uint64_t(1)<<(BITS*(level+1)))) ++level;
+	// past the top level: wait in the slot that comes around last
+	uint64_t at=delta>=(uint64_t(1)<<(BITS*LEVELS)) ? current : expires;
+	slots[level][(at>>(BITS*level)) & (SLOTS-1)].push_back(id);
+}
+
+void TimerWheel::cascade(int level) {
+	uint64_t index=(current>>(BITS*level)) & (SLOTS-1);
+	if (level+1<LEVELS && !index) cascade(level+1);
+	std::vector<Id> ids;
+	ids.swap(slots[level][index]);
+	for (Id id : ids) {
+		if (Timer* t=find(id)) place(id, t->expires);
+	}
+}
+
+TimerWheel::Id TimerWheel::add(uint64_t tick, std::function<void()> f, uint64_t period) {
+	if (tick<=current) tick=current+1;
+	uint32_t index;
+	if (unused.empty()) {
+		index=pool.size();
+		pool.emplace_back();
+	} else {
+		index=unused.back();
+		unused.pop_back();
+	}
+	Timer& t=pool[index];
+	t.expires=tick;
+	t.period=period;
+	t.f=std::move(f);
+	t.live=true;
+	++live;
+	Id id=(uint64_t)++t.generation<<32 | index;
+	place(id, tick);
+	return id;
+}
+
+void TimerWheel::release(Id id) {
+	Timer& t=pool[(uint32_t)id];
+	t.live=false;
+	t.f=nullptr;
+	unused.push_back((uint32_t)id);
+	--live;
+}
+
+bool TimerWheel::cancel(Id id) {
+	if (!find(id)) return false;
+	release(id);
+	return true;
+}
+
+uint64_t TimerWheel::nextTick() const {
+	if (!live) return UINT64_MAX;
+	uint64_t best=UINT64_MAX;
+	for (int level=0;level<LEVELS;++level) {
+		uint64_t base=current>>(BITS*level);
+		// the slot at base itself was emptied when the level got there
+		for (uint64_t j=1;j<=SLOTS;++j) {
+			if (!slots[level][(base+j) & (SLOTS-1)].empty()) {
+				best=std::min(best, (base+j)<<(BITS*level));
+				break;
+			}
+		}
+	}
+	return best;
+}
+
+void TimerWheel::advance(uint64_t tick) {
+	while (current<tick) {
+		// nothing happens before next, not even a cascade
+		uint64_t next=nextTick();
+		if (next>tick) {
+			current=tick;
+			break;
+		}
+		if (next>current+1) current=next-1;
+		++current;
+		if (!(current & (SLOTS-1))) cascade(1);
+		std::vector<Id> due;
+		due.swap(slots[0][current & (SLOTS-1)]);
+		for (size_t k=0;k<due.size();++k) {
+			Timer* t=find(due[k]);
+			if (!t) continue;
+			if (t->expires>current) {
+				place(due[k], t->expires);
+				continue;
+			}
+			try {
+				// f may add timers, which can move pool
+				if (t->period) {
+					t->expires=std::max(t->expires+t->period, current+1);
+					place(due[k], t->expires);
+					auto f=t->f;
+					f();
+				} else {
+					auto f=std::move(t->f);
+					release(due[k]);
+					f();
+				}
+			} catch (...) {
+				for (++k;k<due.size();++k) slots[0][current & (SLOTS-1)].push_back(due[k]);
+				throw;
+			}
+		}
+	}
+}
+
+Reactor::Reactor() : start(std::chrono::steady_clock::now()) {
+	epoll=::epoll_create1(EPOLL_CLOEXEC);
+	if (!epoll) errno_exception("epoll_create1 failed");
+	wake=::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (!wake) errno_exception("eventfd failed");
+	timer=::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (!timer) errno_exception("timerfd_create failed");
+	sigemptyset(&signalMask);
+	pthread_sigmask(SIG_SETMASK, nullptr, &savedMask);
+	watch(wake, EPOLLIN, [this](uint32_t) {
+		uint64_t v;
+		while (::read(wake, &v, sizeof(v))>0);
+		runPosted();
+	});
+	watch(timer, EPOLLIN, [this](uint32_t) {
+		uint64_t v;
+		while (::read(timer, &v, sizeof(v))>0);
+		armed=UINT64_MAX;
+		runTimers();
+	});
+}
+
+Reactor::~Reactor() {
+	if (signals) pthread_sigmask(SIG_SETMASK, &savedMask, nullptr);
+}
+
+void Reactor::watch(int fd, uint32_t events, std::function<void(uint32_t)> h) {
+	if (fd<0) throw std::runtime_error("Invalid descriptor "+std::to_string(fd));
+	if ((size_t)fd>=watches.size()) watches.resize(std::max<size_t>(fd+1, watches.size()*2));
+	Watch& w=watches[fd];
+	if (w.handler) throw std::runtime_error("Descriptor "+std::to_string(fd)+" is already watched");
+	++w.generation;
+	epoll_event e{};
+	e.events=events;
+	e.data.u64=(uint64_t)w.generation<<32 | (uint32_t)fd;
+	if (::epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &e)) errno_exception("Failed to watch descriptor "+std::to_string(fd));
+	w.handler=std::make_shared<IoHandler>(std::move(h));
+}
+
+void Reactor::add(int fd, uint32_t events, IoHandler handler) {
+	watch(fd, events | EPOLLET, std::move(handler));
+	watches[fd].user=true;
+	++watched;
+}
+
+void Reactor::modify(int fd, uint32_t events) {
+	if (fd<0 || (size_t)fd>=watches.size() || !watches[fd].handler) throw std::runtime_error("Descriptor "+std::to_string(fd)+" is not watched");
+	epoll_event e{};
+	e.events=events | EPOLLET;
+	e.data.u64=(uint64_t)watches[fd].generation<<32 | (uint32_t)fd;
+	if (::epoll_ctl(epoll, EPOLL_CTL_MOD, fd, &e)) errno_exception("Failed to modify descriptor "+std::to_string(fd));
+}
+
+void Reactor::remove(int fd) {
+	if (fd<0 || (size_t)fd>=watches.size() || !watches[fd].handler) return;
+	::epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+	Watch& w=watches[fd];
+	// events already fetched for fd are dropped
+	++w.generation;
+	w.handler.reset();
+	if (w.user) --watched;
+	w.user=false;
+}
+
+uint64_t Reactor::ticks() const {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-start).count();
+}
+
+void Reactor::runTimers() {
+	wheel.advance(ticks());
+	uint64_t next=wheel.nextTick();
+	if (next==armed) return;
+	armed=next;
+	itimerspec its{};
+	if (next!=UINT64_MAX) {
+		auto at=std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count()+(int64_t)next*1000000;
+		its.it_value.tv_sec=at/1000000000;
+		its.it_value.tv_nsec=at%1000000000;
+	}
+	if (::timerfd_settime(timer, TFD_TIMER_ABSTIME, &its, nullptr)) errno_exception("timerfd_settime failed");
+}
+
+Reactor::TimerId Reactor::after(uint64_t microseconds, std::function<void()> f) {
+	// an empty wheel just moves to now, so the new timer is placed from there
+	if (!wheel.size()) wheel.advance(ticks());
+	// ticks() rounds down, one more tick keeps the deadline from coming early
+	TimerId id=wheel.add(ticks()+1+(microseconds+999)/1000, std::move(f));
+	runTimers();
+	return id;
+}
+
+Reactor::TimerId Reactor::every(uint64_t microseconds, std::function<void()> f) {
+	if (!wheel.size()) wheel.advance(ticks());
+	uint64_t period=std::max<uint64_t>(1, (microseconds+999)/1000);
+	TimerId id=wheel.add(ticks()+1+period, std::move(f), period);
+	runTimers();
+	return id;
+}
+
+bool Reactor::cancel(TimerId id) {
+	return wheel.cancel(id);
+}
+
+void Reactor::onSignal(int signo, std::function<void(const signalfd_siginfo&)> f) {
+	sigset_t one;
+	sigemptyset(&one);
+	sigaddset(&one, signo);
+	if (pthread_sigmask(SIG_BLOCK, &one, nullptr)) throw std::runtime_error("Failed to block signal "+std::to_string(signo));
+	sigaddset(&signalMask, signo);
+	int fd=::signalfd(signals ? signals.fd : -1, &signalMask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd<0) errno_exception("signalfd failed");
+	signalHandlers[signo]=std::move(f);
+	if (!signals) {
+		signals=fd;
+		watch(signals, EPOLLIN, [this](uint32_t) {readSignals();});
+	}
+}
+
+void Reactor::readSignals() {
+	signalfd_siginfo si;
+	while (::read(signals, &si, sizeof(si))==sizeof(si)) {
+		auto it=signalHandlers.find(si.ssi_signo);
+		if (it==signalHandlers.end()) continue;
+		auto f=it->second;
+		f(si);
+	}
+}
+
+void Reactor::onExit(pid_t pid, std::function<void(int status)> f) {
+	if (children.count(pid)) throw std::runtime_error("Process "+std::to_string(pid)+" is already watched");
+	int fd=(int)::syscall(SYS_pidfd_open, pid, 0);
+	Child& c=children[pid];
+	c.f=std::move(f);
+	if (fd>=0) {
+		c.pidfd=fd;
+		watch(fd, EPOLLIN, [this, pid](uint32_t) {reap(pid);});
+		return;
+	}
+	// no pidfd, whatever the reason: poll, the child must be reaped either way
+	c.poll=every(10000, [this, pid]() {reap(pid);});
+	reap(pid);
+}
+
+void Reactor::reap(pid_t pid) {
+	int status=0;
+	pid_t r;
+	while ((r=::waitpid(pid, &status, WNOHANG))<0 && errno==EINTR);
+	if (!r) return;
+	auto it=children.find(pid);
+	if (it==children.end()) return;
+	auto f=std::move(it->second.f);
+	if (it->second.pidfd) remove(it->second.pidfd);
+	else cancel(it->second.poll);
+	children.erase(it);
+	// reaped by someone else, the status is lost
+	f(r==pid ? status : -1);
+}
+
+void Reactor::post(std::function<void()> f) {
+	{
+		std::lock_guard<std::mutex> g(postLock);
+		posted.push_back(std::move(f));
+	}
+	uint64_t one=1;
+	if (::write(wake.fd, &one, sizeof(one))<0 && errno!=EAGAIN) errno_exception("Failed to wake reactor");
+}
+
+void Reactor::runPosted() {
+	std::vector<std::function<void()>> fs;
+	{
+		std::lock_guard<std::mutex> g(postLock);
+		fs.swap(posted);
+	}
+	for (auto& f : fs) f();
+}
+
+void Reactor::stop() {
+	stopping.store(true);
+	uint64_t one=1;
+	if (::write(wake.fd, &one, sizeof(one))<0 && errno!=EAGAIN) errno_exception("Failed to wake reactor");
+}
+
+void Reactor::run() {
+	while (!stopping.exchange(false)) runOnce();
+}
+
+size_t Reactor::runOnce(long timeoutMicroseconds) {
+	epoll_event events[256];
+	int n=::epoll_wait(epoll, events, 256, timeoutMicroseconds<0 ? -1 : (int)((timeoutMicroseconds+999)/1000));
+	if (n<0) {
+		if (errno==EINTR) return 0;
+		errno_exception("epoll_wait failed");
+	}
+	// every event of the batch is handled even after stop(): an edge is not reported twice
+	for (int i=0;i<n;++i) {
+		uint32_t fd=(uint32_t)events[i].data.u64;
+		uint32_t generation=events[i].data.u64>>32;
+		if (fd>=watches.size() || watches[fd].generation!=generation || !watches[fd].handler) continue;
+		auto h=watches[fd].handler;
+		(*h)(events[i].events);
+	}
+	return n;
+}
+
+}
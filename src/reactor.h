@@ -0,0 +1,175 @@
+#ifndef SRC_REACTOR_H_
+#define SRC_REACTOR_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <utils.h>
+
+/*
+ * Event loop over epoll, with timers, signals, child exits and cross-thread calls.
+ *
+ *   utils::Reactor r;
+ *   r.add(sock, utils::Reactor::READ, [&](uint32_t events) {
+ *       while ((n=::read(sock, buf, sizeof(buf)))>0) ...;       // drain until EAGAIN
+ *   });
+ *   auto t=r.after(5000000, [&]() {r.stop();});
+ *   r.onExit(pid, [&](int status) {...});
+ *   r.onSignal(SIGTERM, [&](const signalfd_siginfo&) {r.stop();});
+ *   r.run();
+ *
+ * Descriptors are watched edge-triggered: a handler is told once that its descriptor
+ * became ready and must read or write until EAGAIN, so descriptors should be
+ * non-blocking. Handlers live in a vector indexed by descriptor, so dispatch costs the
+ * same with ten or ten thousand of them. remove() may be called from any handler, for
+ * any descriptor, and the descriptor must be removed before it is closed.
+ *
+ * Timers have millisecond ticks on a TimerWheel, so adding and cancelling one is
+ * O(1); a timerfd is armed for the next tick that has work. Signals given to onSignal
+ * are blocked in the calling thread and read from a signalfd; they should be blocked in
+ * every other thread too, for instance by calling onSignal before starting them. onExit
+ * watches a child through a pidfd and reaps it; where there is none (kernels before 5.3,
+ * seccomp filters) it polls waitpid every 10ms, as SIGCHLD may go to any other thread.
+ *
+ * Everything runs on the thread calling run(); only post() and stop() may be called
+ * from other threads, and they wake the loop through an eventfd.
+ */
+
+namespace utils {
+
+// hierarchical timing wheel: 4 levels of 64 slots over integer ticks, beyond 64^4 ticks
+// timers wait in the top level and are placed again when it comes around
+class TimerWheel {
+public:
+	typedef uint64_t Id;
+private:
+	static const int LEVELS=4;
+	static const int BITS=6;
+	static const uint64_t SLOTS=1<<BITS;
+	struct Timer {
+		uint64_t expires=0;
+		uint64_t period=0;
+		std::function<void()> f;
+		uint32_t generation=0;
+		bool live=false;
+	};
+	uint64_t current;
+	// an id is the timer's index in pool and, above it, the generation of that entry
+	std::vector<Timer> pool;
+	std::vector<uint32_t> unused;
+	size_t live=0;
+	// cancelled timers stay listed in their slot until it comes around
+	std::vector<Id> slots[LEVELS][SLOTS];
+
+	inline Timer* find(Id id) {
+		uint32_t index=(uint32_t)id;
+		if (index>=pool.size()) return nullptr;
+		Timer& t=pool[index];
+		return t.live && t.generation==(uint32_t)(id>>32) ? &t : nullptr;
+	}
+	void release(Id id);
+	void place(Id id, uint64_t expires);
+	void cascade(int level);
+public:
+	explicit TimerWheel(uint64_t now=0) : current(now) {}
+
+	// f runs once advance() reaches tick, then every period ticks unless period is 0
+	Id add(uint64_t tick, std::function<void()> f, uint64_t period=0);
+	bool cancel(Id id);
+	// runs, in order of ticks, everything due up to and including tick
+	void advance(uint64_t tick);
+	// the first tick advance() may have work at, UINT64_MAX when empty
+	uint64_t nextTick() const;
+
+	inline uint64_t now() const {return current;}
+	inline size_t size() const {return live;}
+};
+
+class Reactor {
+public:
+	static const uint32_t READ=EPOLLIN | EPOLLRDHUP;
+	static const uint32_t WRITE=EPOLLOUT;
+	// called with the ready events, EPOLLHUP and EPOLLERR included
+	typedef std::function<void(uint32_t events)> IoHandler;
+	typedef TimerWheel::Id TimerId;
+private:
+	struct Watch {
+		uint32_t generation=0;
+		std::shared_ptr<IoHandler> handler;
+		bool user=false;
+	};
+	FD epoll;
+	FD wake;
+	FD timer;
+	FD signals;
+	std::vector<Watch> watches;
+	size_t watched=0;
+
+	std::chrono::steady_clock::time_point start;
+	TimerWheel wheel;
+	uint64_t armed=UINT64_MAX;
+
+	sigset_t signalMask;
+	sigset_t savedMask;
+	std::map<int, std::function<void(const signalfd_siginfo&)>> signalHandlers;
+
+	struct Child {
+		FD pidfd;
+		// polls waitpid where there is no pidfd
+		TimerId poll=0;
+		std::function<void(int status)> f;
+	};
+	std::map<pid_t, Child> children;
+
+	std::mutex postLock;
+	std::vector<std::function<void()>> posted;
+	std::atomic<bool> stopping{false};
+
+	void watch(int fd, uint32_t events, std::function<void(uint32_t)> h);
+	uint64_t ticks() const;
+	void runTimers();
+	void readSignals();
+	void reap(pid_t pid);
+	void runPosted();
+public:
+	Reactor();
+	Reactor(const Reactor&) = delete;
+	Reactor& operator=(const Reactor&) = delete;
+	// restores the signal mask of the calling thread
+	~Reactor();
+
+	void add(int fd, uint32_t events, IoHandler handler);
+	void modify(int fd, uint32_t events);
+	void remove(int fd);
+	inline size_t size() const {return watched;}
+
+	TimerId after(uint64_t microseconds, std::function<void()> f);
+	TimerId every(uint64_t microseconds, std::function<void()> f);
+	bool cancel(TimerId id);
+
+	void onSignal(int signo, std::function<void(const signalfd_siginfo&)> f);
+	// f gets the wait status once pid, a child of this process, has exited and been reaped
+	void onExit(pid_t pid, std::function<void(int status)> f);
+
+	// runs f on the loop's thread; thread safe
+	void post(std::function<void()> f);
+	// makes run() return once the current handler is done; thread safe
+	void stop();
+
+	void run();
+	// waits up to timeoutMicroseconds (forever if negative) and handles what is ready;
+	// returns the number of events
+	size_t runOnce(long timeoutMicroseconds=-1);
+};
+
+}
+
+#endif /* SRC_REACTOR_H_ */
@@ -0,0 +1,352 @@
+#include <shmring.h>
+#include <jsonbinary.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+namespace utils {
+
+namespace {
+
+const uint32_t MAGIC=0x474e4952;
+const uint32_t VERSION=1;
+// the ring starts one page after the header
+const size_t DATA=4096;
+const uint32_t PAD=UINT32_MAX;
+const uint32_t WRITTEN=1;
+const uint32_t CONSUMED=2;
+const int SPINS=64;
+
+// the record's position in its 30 top bits, so a stale word from an earlier lap never
+// matches; positions repeat only after 16 GB and the capacity stays far below
+inline uint32_t state(uint64_t pos, uint32_t status) {
+	return (uint32_t)((pos>>4)<<2) | status;
+}
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+// eventcounts as in BlockingQueue: bit 0 says someone may be parked, in any process
+void signal(std::atomic<uint32_t>& word) {
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	uint32_t w=word.load(std::memory_order_relaxed);
+	if ((w & 1) && word.compare_exchange_strong(w, (w+2) & ~1u, std::memory_order_seq_cst)) futexWake(word, INT_MAX, true);
+}
+
+template<typename OP> bool await(OP op, std::atomic<uint32_t>& word, const std::atomic<uint32_t>& closed, bool drainClosed, long timeoutMicroseconds) {
+	for (int i=0;i<SPINS;++i) {
+		if (op()) return true;
+		if (closed.load(std::memory_order_relaxed)) break;
+		cpuRelax();
+	}
+	auto start=clock();
+	for (;;) {
+		uint32_t w=word.fetch_or(1, std::memory_order_seq_cst) | 1;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (op()) return true;
+		if (closed.load(std::memory_order_seq_cst)) return drainClosed && op();
+		long left=-1;
+		if (timeoutMicroseconds>=0) {
+			left=timeoutMicroseconds-(long)microseconds(start);
+			if (left<=0) return false;
+		}
+		futexWait(word, w, left, true);
+	}
+}
+
+}
+
+struct ShmRing::Header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t capacity;
+	// claimed by producers
+	alignas(64) std::atomic<uint64_t> tail;
+	// the next record for consumers
+	alignas(64) std::atomic<uint64_t> next;
+	// everything before is released and free
+	alignas(64) std::atomic<uint64_t> head;
+	alignas(64) std::atomic<uint32_t> notEmpty;
+	alignas(64) std::atomic<uint32_t> notFull;
+	alignas(64) std::atomic<uint32_t> closed;
+};
+
+// every record starts at a multiple of 16 and the message follows the header
+struct ShmRing::Record {
+	std::atomic<uint32_t> state;
+	uint32_t kind;
+	uint64_t length;
+};
+
+static_assert(sizeof(std::atomic<uint64_t>)==8 && std::atomic<uint64_t>::is_always_lock_free, "shared memory needs lock-free 64 bit atomics");
+
+namespace {
+
+const uint64_t RECORD=16;
+
+inline uint64_t recordBytes(uint64_t length) {
+	return (RECORD+length+15) & ~uint64_t(15);
+}
+
+}
+
+ShmRing::ShmRing(size_t capacity) {
+	static_assert(sizeof(Record)==RECORD && sizeof(Header)<=DATA, "ring layout");
+	if (capacity>(size_t(1)<<32)) throw std::runtime_error("Shared ring capacity too large: "+std::to_string(capacity));
+	uint64_t c=4096;
+	while (c<capacity) c<<=1;
+	memfd=::memfd_create("cpputils-shmring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (!memfd) errno_exception("Failed to create a memfd for a shared ring");
+	if (::ftruncate(memfd, DATA+c)) errno_exception("Failed to size the shared ring");
+	// the size is fixed for good: no peer can shrink it under another's mapping
+	if (::fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)) errno_exception("Failed to seal the shared ring");
+	map();
+	header->capacity=c;
+	header->version=VERSION;
+	header->magic=MAGIC;
+	mask=c-1;
+}
+
+ShmRing::ShmRing(FD&& fd) : memfd(std::move(fd)) {
+	int seals=::fcntl(memfd, F_GET_SEALS);
+	if (seals<0) errno_exception("Not a memfd");
+	if (!(seals & F_SEAL_SHRINK)) throw std::runtime_error("The shared ring's memfd is not sealed against shrinking");
+	map();
+	uint64_t c=header->capacity;
+	if (header->magic!=MAGIC || header->version!=VERSION || c<4096 || (c & (c-1)) || DATA+c!=mappedBytes) {
+		::munmap(header, mappedBytes);
+		throw std::runtime_error("The memfd does not hold a shared ring");
+	}
+	mask=c-1;
+}
+
+ShmRing::~ShmRing() {
+	if (header) ::munmap(header, mappedBytes);
+}
+
+void ShmRing::map() {
+	struct stat st;
+	if (::fstat(memfd, &st)) errno_exception("Failed to stat the shared ring");
+	if ((size_t)st.st_size<DATA+4096) throw std::runtime_error("The memfd is too small for a shared ring");
+	void* m=::mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+	if (m==MAP_FAILED) errno_exception("Failed to map the shared ring");
+	header=(Header*)m;
+	ring=(char*)m+DATA;
+	mappedBytes=st.st_size;
+}
+
+size_t ShmRing::maxMessage() const {
+	return capacity()/2-RECORD;
+}
+
+bool ShmRing::claim(uint64_t size, uint64_t& pos) {
+	uint64_t t=header->tail.load(std::memory_order_relaxed);
+	uint64_t pad;
+	for (;;) {
+		// a message never wraps: the rest of the ring becomes padding
+		uint64_t offset=t & mask;
+		pad=offset+size>capacity() ? capacity()-offset : 0;
+		// added rather than subtracted: head read after a stale t can be past it
+		if (t+pad+size>header->head.load(std::memory_order_acquire)+capacity()) return false;
+		if (header->tail.compare_exchange_weak(t, t+pad+size, std::memory_order_acq_rel, std::memory_order_relaxed)) break;
+	}
+	if (pad) {
+		Record* r=(Record*)(ring+(t & mask));
+		r->kind=PAD;
+		r->length=pad-RECORD;
+		r->state.store(state(t, WRITTEN), std::memory_order_release);
+	}
+	pos=t+pad;
+	return true;
+}
+
+void ShmRing::commit(uint64_t pos) {
+	((Record*)(ring+(pos & mask)))->state.store(state(pos, WRITTEN), std::memory_order_seq_cst);
+	signal(header->notEmpty);
+}
+
+void ShmRing::release(uint64_t pos) {
+	// all seq_cst: a releaser that marks its record and then reads an old head must be
+	// seen by the one moving the head onto that record, or neither moves it past
+	((Record*)(ring+(pos & mask)))->state.store(state(pos, CONSUMED), std::memory_order_seq_cst);
+	bool freed=false;
+	for (;;) {
+		uint64_t h=header->head.load(std::memory_order_seq_cst);
+		Record* r=(Record*)(ring+(h & mask));
+		uint32_t expected=state(h, CONSUMED);
+		// whoever clears the record at the head moves the head past it, in order
+		if (!r->state.compare_exchange_strong(expected, 0, std::memory_order_seq_cst, std::memory_order_seq_cst)) break;
+		// tryPop checked the length, but a peer can write it again; never past the ring's end
+		uint64_t room=capacity()-(h & mask);
+		uint64_t size=std::min(recordBytes(std::min<uint64_t>(r->length, room)), room);
+		// clear every place a later record may start, so old bytes never read as written
+		for (uint64_t o=16;o<size;o+=16) memset((char*)r+o, 0, sizeof(uint32_t));
+		header->head.store(h+size, std::memory_order_seq_cst);
+		freed=true;
+	}
+	if (freed) signal(header->notFull);
+}
+
+bool ShmRing::tryPush(const void* p, size_t len, uint32_t kind) {
+	if (len>maxMessage()) throw std::runtime_error("Message of "+std::to_string(len)+" bytes is larger than the shared ring's limit of "+std::to_string(maxMessage()));
+	if (kind==PAD) throw std::runtime_error("Message kind "+std::to_string(kind)+" is reserved");
+	if (header->closed.load(std::memory_order_acquire)) return false;
+	uint64_t pos;
+	if (!claim(recordBytes(len), pos)) return false;
+	Record* r=(Record*)(ring+(pos & mask));
+	r->kind=kind;
+	r->length=len;
+	memcpy((char*)r+RECORD, p, len);
+	commit(pos);
+	return true;
+}
+
+bool ShmRing::push(const void* p, size_t len, uint32_t kind, long timeoutMicroseconds) {
+	if (header->closed.load(std::memory_order_acquire)) return false;
+	return await([&]() {return tryPush(p, len, kind);}, header->notFull, header->closed, false, timeoutMicroseconds);
+}
+
+bool ShmRing::tryPop(Message& m) {
+	m.release();
+	uint64_t n=header->next.load(std::memory_order_acquire);
+	for (;;) {
+		Record* r=(Record*)(ring+(n & mask));
+		if (r->state.load(std::memory_order_acquire)!=state(n, WRITTEN)) return false;
+		// read before claiming: if another consumer got here first the CAS fails anyway
+		uint64_t length=r->length;
+		uint32_t kind=r->kind;
+		// a record must end inside the ring, and padding exactly at its end
+		uint64_t room=capacity()-(n & mask);
+		if (kind==PAD ? length!=room-RECORD : length>maxMessage() || recordBytes(length)>room) {
+			// from a stale n this may be the middle of a newer record; only the front is checked
+			uint64_t now=header->next.load(std::memory_order_acquire);
+			if (now!=n) {
+				n=now;
+				continue;
+			}
+			throw std::runtime_error("Corrupt record of "+std::to_string(length)+" bytes at "+std::to_string(n)+" in the shared ring");
+		}
+		if (!header->next.compare_exchange_weak(n, n+recordBytes(length), std::memory_order_acq_rel, std::memory_order_acquire)) continue;
+		if (kind==PAD) {
+			release(n);
+			n+=recordBytes(length);
+			continue;
+		}
+		m.ring=this;
+		m.pos=n;
+		m.p=(const char*)r+RECORD;
+		m.n=length;
+		m.k=kind;
+		return true;
+	}
+}
+
+bool ShmRing::pop(Message& m, long timeoutMicroseconds) {
+	return await([&]() {return tryPop(m);}, header->notEmpty, header->closed, true, timeoutMicroseconds);
+}
+
+bool ShmRing::pushJson(const json_t* j, bool cbor, long timeoutMicroseconds) {
+	if (cbor) return push(json::toCbor(j), JSON_CBOR, timeoutMicroseconds);
+	return push(json::to_string(j), JSON_TEXT, timeoutMicroseconds);
+}
+
+json::jsonptr ShmRing::popJson(long timeoutMicroseconds) {
+	Message m;
+	if (!pop(m, timeoutMicroseconds)) return json::jsonptr();
+	if (m.kind()==JSON_TEXT) return json::parse(m.data(), m.size());
+	if (m.kind()==JSON_CBOR) return json::fromCbor(m.data(), m.size());
+	throw std::runtime_error("Message of kind "+std::to_string(m.kind())+" is not JSON");
+}
+
+void ShmRing::close() {
+	header->closed.store(1, std::memory_order_seq_cst);
+	header->notEmpty.fetch_add(2, std::memory_order_seq_cst);
+	futexWake(header->notEmpty, INT_MAX, true);
+	header->notFull.fetch_add(2, std::memory_order_seq_cst);
+	futexWake(header->notFull, INT_MAX, true);
+}
+
+bool ShmRing::isClosed() const {
+	return header->closed.load(std::memory_order_acquire);
+}
+
+ShmRing::Message::Message(Message&& o) noexcept : ring(o.ring), pos(o.pos), p(o.p), n(o.n), k(o.k) {
+	o.ring=nullptr;
+}
+
+ShmRing::Message& ShmRing::Message::operator=(Message&& o) noexcept {
+	if (this!=&o) {
+		release();
+		ring=o.ring;
+		pos=o.pos;
+		p=o.p;
+		n=o.n;
+		k=o.k;
+		o.ring=nullptr;
+	}
+	return *this;
+}
+
+void ShmRing::Message::release() {
+	if (!ring) return;
+	ring->release(pos);
+	ring=nullptr;
+	p=nullptr;
+	n=0;
+}
+
+void sendFd(int socket, int fd) {
+	char byte=0;
+	iovec iov{&byte, 1};
+	alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+	memset(control, 0, sizeof(control));
+	msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov=&iov;
+	msg.msg_iovlen=1;
+	msg.msg_control=control;
+	msg.msg_controllen=sizeof(control);
+	cmsghdr* c=CMSG_FIRSTHDR(&msg);
+	c->cmsg_level=SOL_SOCKET;
+	c->cmsg_type=SCM_RIGHTS;
+	c->cmsg_len=CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(c), &fd, sizeof(int));
+	while (::sendmsg(socket, &msg, MSG_NOSIGNAL)<0) {
+		if (errno!=EINTR) errno_exception("Failed to send a descriptor");
+	}
+}
+
+FD receiveFd(int socket) {
+	char byte;
+	iovec iov{&byte, 1};
+	alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+	msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov=&iov;
+	msg.msg_iovlen=1;
+	msg.msg_control=control;
+	msg.msg_controllen=sizeof(control);
+	ssize_t n;
+	while ((n=::recvmsg(socket, &msg, MSG_CMSG_CLOEXEC))<0) {
+		if (errno!=EINTR) errno_exception("Failed to receive a descriptor");
+	}
+	if (!n) throw std::runtime_error("Connection closed before a descriptor arrived");
+	for (cmsghdr* c=CMSG_FIRSTHDR(&msg);c;c=CMSG_NXTHDR(&msg, c)) {
+		if (c->cmsg_level==SOL_SOCKET && c->cmsg_type==SCM_RIGHTS && c->cmsg_len==CMSG_LEN(sizeof(int))) {
+			int fd;
+			memcpy(&fd, CMSG_DATA(c), sizeof(int));
+			return FD(fd);
+		}
+	}
+	throw std::runtime_error("No descriptor in the message received");
+}
+
+}
@@ -0,0 +1,133 @@
+#ifndef SRC_SHMRING_H_
+#define SRC_SHMRING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <jsonutils.h>
+#include <utils.h>
+
+/*
+ * Variable-length messages between processes through a ring in shared memory.
+ *
+ *   utils::ShmRing ring(16<<20);                      // a new sealed memfd
+ *   utils::sendFd(socket, ring.fd());                 // or inherit it through fork/spawn
+ *
+ *   utils::ShmRing peer(utils::receiveFd(socket));    // in the other process
+ *   peer.pushJson(j.get());
+ *
+ *   utils::ShmRing::Message m;
+ *   while (ring.pop(m)) {
+ *       auto j=json::parse(m.data(), m.size());       // parsed in place, no copy out
+ *       ...
+ *   }                                                 // the next pop, or ~Message, frees it
+ *
+ * The ring lives in a memfd sealed against shrinking and growing, so a peer cannot make
+ * the mapping fault. Any number of processes and threads may push and pop (MPMC; the
+ * usual shapes are MPSC and SPMC). A producer claims room with one CAS on the tail, copies
+ * its message in and marks the record written; records that would wrap are preceded by
+ * padding, so every message is contiguous and messages are limited to half the capacity.
+ * A consumer claims the next written record with one CAS and gets a view of it in place;
+ * the room is given back when the view is released, in ring order, so a view kept for
+ * long holds producers back once the ring comes around. Waiting spins briefly, then parks
+ * on a process-shared futex in the ring, announced so that only the first push or pop after
+ * someone parked makes a system call.
+ *
+ * A process that dies between claiming and finishing a push leaves a record that is never
+ * written, and consumers wait at it; close() or the timeouts are the way out. For the same
+ * reason pops after close() stop at the first record that is not written yet: close() only
+ * once every producer has returned from its push, or a message still being copied in is
+ * lost. The kind of a message is a number for the application; pushJson uses JSON_TEXT and
+ * JSON_CBOR.
+ */
+
+namespace utils {
+
+class ShmRing {
+	struct Header;
+	struct Record;
+	FD memfd;
+	Header* header=nullptr;
+	char* ring=nullptr;
+	size_t mappedBytes=0;
+	uint64_t mask=0;
+
+	void map();
+	bool claim(uint64_t size, uint64_t& pos);
+	void commit(uint64_t pos);
+	void release(uint64_t pos);
+public:
+	static const uint32_t BYTES=0;
+	static const uint32_t JSON_TEXT=1;
+	static const uint32_t JSON_CBOR=2;
+
+	// a popped message, valid until it is released, moved from or destroyed
+	class Message {
+		friend class ShmRing;
+		ShmRing* ring=nullptr;
+		uint64_t pos=0;
+		const char* p=nullptr;
+		size_t n=0;
+		uint32_t k=0;
+	public:
+		Message() {}
+		Message(const Message&) = delete;
+		Message& operator=(const Message&) = delete;
+		Message(Message&& o) noexcept;
+		Message& operator=(Message&& o) noexcept;
+		~Message() {release();}
+
+		inline const char* data() const {return p;}
+		inline size_t size() const {return n;}
+		inline uint32_t kind() const {return k;}
+		inline std::string_view view() const {return std::string_view(p, n);}
+		inline explicit operator bool() const {return ring!=nullptr;}
+		void release();
+	};
+
+	// a ring of capacity bytes, rounded up to a power of 2, in a new memfd
+	explicit ShmRing(size_t capacity);
+	// maps the ring in fd, received from or inherited from the process that made it
+	explicit ShmRing(FD&& fd);
+	ShmRing(const ShmRing&) = delete;
+	ShmRing& operator=(const ShmRing&) = delete;
+	~ShmRing();
+
+	// close-on-exec: clear FD_CLOEXEC or dup2 it for a child that should inherit it
+	inline int fd() const {return memfd.fd;}
+	inline size_t capacity() const {return mask+1;}
+	size_t maxMessage() const;
+
+	// false when there is no room, or the ring is closed
+	bool tryPush(const void* p, size_t len, uint32_t kind=BYTES);
+	inline bool tryPush(std::string_view s, uint32_t kind=BYTES) {return tryPush(s.data(), s.size(), kind);}
+	// waits for room at most timeoutMicroseconds unless negative; false on timeout or when closed
+	bool push(const void* p, size_t len, uint32_t kind=BYTES, long timeoutMicroseconds=-1);
+	inline bool push(std::string_view s, uint32_t kind=BYTES, long timeoutMicroseconds=-1) {
+		return push(s.data(), s.size(), kind, timeoutMicroseconds);
+	}
+	// releases what m held, then takes the next message; false when there is none
+	bool tryPop(Message& m);
+	// waits at most timeoutMicroseconds unless negative; false on timeout, or once closed and drained
+	bool pop(Message& m, long timeoutMicroseconds=-1);
+
+	// compact JSON text, or CBOR with cbor set
+	bool pushJson(const json_t* j, bool cbor=false, long timeoutMicroseconds=-1);
+	// parses the next JSON_TEXT or JSON_CBOR message in place; null on timeout or when closed and drained
+	json::jsonptr popJson(long timeoutMicroseconds=-1);
+
+	// wakes everyone in every process; pushes fail from now on, pops drain what was written
+	// and not what is still being pushed, so producers must be done first
+	void close();
+	bool isClosed() const;
+};
+
+// passes a descriptor over a Unix socket (SCM_RIGHTS)
+void sendFd(int socket, int fd);
+FD receiveFd(int socket);
+
+}
+
+#endif /* SRC_SHMRING_H_ */
@@ -11,17 +11,20 @@
 #include <libgen.h>
 #include <spawn.h>
 #include <stdlib.h>
-#include <sys/select.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include "utils.h"
+#include "reactor.h"
 #include <locale.h>
 #include <alloca.h>
 #include <string.h>
 #include <sys/types.h>
 #include <dirent.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 #include <chrono>
 #include <thread>
 
@@ -99,73 +102,63 @@ int sh(const char* cmd, std::string *out, std::string* err) {
 	}
 	::close(cout_pipe[1]); // cout_pipe[0] is the read end of the parent
 	::close(cerr_pipe[1]);
-	int flags1=::fcntl(cout_pipe[0],F_GETFL, 0);
-	int flags2=::fcntl(cerr_pipe[0],F_GETFL, 0);
-	::fcntl(cout_pipe[0],F_SETFL, flags1 | O_NONBLOCK);
-	::fcntl(cerr_pipe[0],F_SETFL, flags2 | O_NONBLOCK);
-
-	std::map<int,std::string*> m= { {cout_pipe[0],out}, {cerr_pipe[0],err} };
-
-	for (;;) {
-		if (m.size()==0) break;
-		int fdmax=-1;
-		fd_set read_fds;
-		FD_ZERO(&read_fds);
-		for (auto it=m.begin(), end=m.end(); it!=end;++it) {
-			int fd=it->first;
-			if (fd > fdmax) fdmax=fd;
-			FD_SET(fd,&read_fds);
-		}
-		if (select(fdmax+1,&read_fds,NULL,NULL,NULL)==-1) {
-			if (errno==EINTR) continue;
-			errno_exception("select failed");
-		}
-		for (auto it=m.begin(); it!=m.end();) {
-			bool close=false;
-			int fd=it->first;
-			std::string* log=it->second;
-			if (FD_ISSET(fd,&read_fds)) {
-				char buffer[BUF_SIZE];
-				int length=sizeof(buffer);
-				int nb=::read(fd, buffer, length);
-				if (log && nb > 0) log->append(buffer,buffer+nb);
-				if (nb <= 0 ) {
-					FD_CLR(fd, &read_fds);
-					::close(fd);
-					close=true;
+	FD outFd(cout_pipe[0]), errFd(cerr_pipe[0]);
+	::fcntl(outFd, F_SETFL, ::fcntl(outFd, F_GETFL, 0) | O_NONBLOCK);
+	::fcntl(errFd, F_SETFL, ::fcntl(errFd, F_GETFL, 0) | O_NONBLOCK);
+
+	int open=2;
+	auto drain=[&](Reactor& r, FD& fd, std::string* log) {
+		return [&, log](uint32_t) {
+			char buffer[BUF_SIZE*64];
+			for (;;) {
+				ssize_t nb=::read(fd, buffer, sizeof(buffer));
+				if (nb>0) {
+					if (log) log->append(buffer, nb);
+					continue;
 				}
+				if (nb<0 && errno==EINTR) continue;
+				if (nb<0 && errno==EAGAIN) return;
+				r.remove(fd);
+				fd=-1;
+				--open;
+				return;
 			}
-			if (close)
-				m.erase(it++);
-			else
-				++it;
-
-
-		}
+		};
+	};
+	std::exception_ptr error;
+	try {
+		Reactor r;
+		r.add(outFd, Reactor::READ, drain(r, outFd, out));
+		r.add(errFd, Reactor::READ, drain(r, errFd, err));
+		while (open) r.runOnce();
+	} catch (...) {
+		// the child is reaped whatever happened to the pipes
+		error=std::current_exception();
+		outFd=-1;
+		errFd=-1;
 	}
 	for (;;) {
 		int status;
 		pid_t reported_pid=::waitpid(pid, &status, 0);
 		if (reported_pid==-1) {
 			if (errno==EINTR) continue;
+			if (error) std::rethrow_exception(error);
 			errno_exception("waitpid failed for "+std::string(cmd));
 		}
+		if (error) std::rethrow_exception(error);
 		if (reported_pid==pid)
 			return status;
-
 	}
 }
 
 
 
 
-void dumpToFile(const std::string& fileName, const void* buf, size_t len) {
-	FD fd(::creat(fileName.c_str(), S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH));
-	if (!fd) errno_exception("Failed to open "+fileName);
+static void writeAll(int fd, const void* buf, size_t len, const std::string& fileName) {
 	size_t left=len;
 	char* ptr=(char*)(buf);
 	while (left>0) {
-		auto w=::write((int)fd,ptr,left);
+		auto w=::write(fd,ptr,left);
 		if (w<0) {
 			if (errno==EINTR) continue;
 			errno_exception("failed on writing to "+fileName);
@@ -176,6 +169,58 @@ void dumpToFile(const std::string& fileName, const void* buf, size_t len) {
 	}
 }
 
+void dumpToFile(const std::string& fileName, const void* buf, size_t len) {
+	FD fd(::creat(fileName.c_str(), S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH));
+	if (!fd) errno_exception("Failed to open "+fileName);
+	writeAll(fd, buf, len, fileName);
+}
+
+void dumpToFileAtomic(const std::string& fileName, const void* buf, size_t len, bool sync) {
+	static std::atomic<uint32_t> serial{0};
+	std::string tmp=fileName+".tmp."+std::to_string(getpid())+"."+std::to_string(serial++);
+	FD fd(::open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH));
+	if (!fd) errno_exception("Failed to create "+tmp);
+	try {
+		// a replaced file keeps its permissions
+		struct stat st;
+		if (!::stat(fileName.c_str(), &st) && ::fchmod(fd, st.st_mode & 07777)) errno_exception("Failed to chmod "+tmp);
+		writeAll(fd, buf, len, tmp);
+		if (sync && ::fdatasync(fd)) errno_exception("Failed to sync "+tmp);
+		int raw=fd.fd;
+		fd.fd=-1;
+		if (::close(raw)) errno_exception("Failed to close "+tmp);
+		if (::rename(tmp.c_str(), fileName.c_str())) errno_exception("Failed to rename "+tmp+" to "+fileName);
+	} catch (...) {
+		::unlink(tmp.c_str());
+		throw;
+	}
+	if (sync) {
+		std::string dir, base;
+		splitDirBasename(fileName, dir, base);
+		FD d(::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+		if (!d || ::fsync(d)) errno_exception("Failed to sync directory of "+fileName);
+	}
+}
+
+static bool sameContent(const std::string& fileName, const void* buf, size_t len) {
+	FD fd(::open(fileName.c_str(), O_RDONLY | O_CLOEXEC));
+	struct stat st;
+	if (!fd || ::fstat(fd, &st) || !S_ISREG(st.st_mode) || (uint64_t)st.st_size!=len) return false;
+	if (!len) return true;
+	void* m=::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (m==MAP_FAILED) return false;
+	::madvise(m, len, MADV_SEQUENTIAL);
+	bool same=!memcmp(m, buf, len);
+	::munmap(m, len);
+	return same;
+}
+
+bool dumpToFileIfChanged(const std::string& fileName, const void* buf, size_t len, bool sync) {
+	if (sameContent(fileName, buf, len)) return false;
+	dumpToFileAtomic(fileName, buf, len, sync);
+	return true;
+}
+
 bool isFileSystemObject(const std::string& name) {
 	struct stat st;
 	return (0==::stat(name.c_str(), &st));
@@ -258,6 +303,15 @@ std::string slurpTextFile(const std::string& fileName) {
 	return std::move(v);
 }
 
+void futexWait(std::atomic<uint32_t>& word, uint32_t value, long timeoutMicroseconds, bool shared) {
+	timespec ts{timeoutMicroseconds/1000000, (timeoutMicroseconds%1000000)*1000};
+	syscall(SYS_futex, (uint32_t*)&word, shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, value, timeoutMicroseconds<0 ? nullptr : &ts, nullptr, 0);
+}
+
+void futexWake(std::atomic<uint32_t>& word, int count, bool shared) {
+	syscall(SYS_futex, (uint32_t*)&word, shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
 uint64_t currentTimeMilliseconds() {
 	std::chrono::time_point<std::chrono::system_clock> now = std::chrono::system_clock::now();
 	auto duration = now.time_since_epoch();
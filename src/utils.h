@@ -4,6 +4,8 @@
 
 
 
+#include <atomic>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <unistd.h>
@@ -28,6 +30,19 @@ namespace utils {
 	inline void dumpToFile(const std::string& fileName, const std::string& s) {
 		dumpToFile(fileName, s.data(), s.length());
 	}
+	// writes a temporary file next to fileName and renames it over fileName, so readers see
+	// the old content or the new, never a part; with sync the data and the rename are on disk
+	// when it returns
+	void dumpToFileAtomic(const std::string& fileName, const void* buffer, size_t len, bool sync=false);
+	inline void dumpToFileAtomic(const std::string& fileName, const std::string& s, bool sync=false) {
+		dumpToFileAtomic(fileName, s.data(), s.length(), sync);
+	}
+	// leaves fileName untouched, mtime included, when it already holds exactly these bytes
+	// and replaces it atomically otherwise; returns whether it wrote
+	bool dumpToFileIfChanged(const std::string& fileName, const void* buffer, size_t len, bool sync=false);
+	inline bool dumpToFileIfChanged(const std::string& fileName, const std::string& s, bool sync=false) {
+		return dumpToFileIfChanged(fileName, s.data(), s.length(), sync);
+	}
 	void splitDirBasename(const std::string& name, std::string& dir,std::string& base);
 	bool isFileSystemObject(const std::string& name);
 
@@ -43,9 +58,16 @@ namespace utils {
 		inline FD() : fd(-1) {}
 		inline FD(int _fd) : fd(_fd) {}
 		FD(const FD & ) = delete;
-		FD(FD && ) = delete;
+		inline FD(FD && o) : fd(o.fd) {o.fd=-1;}
 		FD& operator =(const FD & ) =delete;
-		FD& operator =(FD && ) =delete;
+		inline FD& operator =(FD && o) {
+			if (this!=&o) {
+				if (fd>=0) ::close(fd);
+				fd=o.fd;
+				o.fd=-1;
+			}
+			return *this;
+		}
 		inline operator bool() {return fd>=0;}
 		inline operator int() {return fd;}
 		inline FD& operator =(int v) {
@@ -56,6 +78,11 @@ namespace utils {
 		inline ~FD() {if (fd>=0) {::close(fd);fd=-1;}}
 	};
 
+	// blocks while word holds value, at most timeoutMicroseconds unless negative; may return spuriously;
+	// shared is for words in memory mapped by several processes
+	void futexWait(std::atomic<uint32_t>& word, uint32_t value, long timeoutMicroseconds=-1, bool shared=false);
+	void futexWake(std::atomic<uint32_t>& word, int count, bool shared=false);
+
 	uint64_t currentTimeMilliseconds();
 	uint64_t currentTimeMicroseconds();
 
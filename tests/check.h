@@ -0,0 +1,9 @@
+#ifndef TESTS_CHECK_H_
+#define TESTS_CHECK_H_
+
+#include <iostream>
+
+// fails the test, returning 1 from main, with the condition and where it is
+#define CHECK(c) if (!(c)) {std::cout<<"Check failed: "<<#c<<" "<<__FILE__<<":"<<__LINE__<<std::endl; return 1;}
+
+#endif /* TESTS_CHECK_H_ */
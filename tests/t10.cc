@@ -0,0 +1,102 @@
+#include <iostream>
+#include <random>
+#include <jsonpatch.h>
+#include "check.h"
+
+static bool roundTrip(const char* a, const char* b, size_t ops) {
+	auto ja=json::parse(a), jb=json::parse(b);
+	auto patch=json::diff(ja, jb);
+	auto doc=json::own(json_deep_copy(ja.get()));
+	json::applyPatch(doc, patch);
+	if (!json_equal(doc.get(), jb.get()) || json_array_size(patch.get())!=ops) {
+		std::cout<<"Bad patch "<<json::to_string(patch)<<" for "<<a<<" -> "<<b<<std::endl;
+		return false;
+	}
+	return true;
+}
+
+static json_t* randomTree(std::mt19937& r, int depth) {
+	int k=r()%(depth>3 ? 4 : 7);
+	if (k==0) return json_integer(r()%5);
+	if (k==1) return json_string(std::string(1, 'a'+r()%4).c_str());
+	if (k==2) return r()%2 ? json_true() : json_null();
+	if (k==3) return json_real((r()%3)*0.5);
+	if (k<6) {
+		json_t* a=json_array();
+		for (int i=r()%6;i>0;--i) json_array_append_new(a, randomTree(r, depth+1));
+		return a;
+	}
+	json_t* o=json_object();
+	for (int i=r()%5;i>0;--i) json_object_set_new(o, std::string(1, 'k'+r()%5).c_str(), randomTree(r, depth+1));
+	return o;
+}
+
+int main() {
+	CHECK(roundTrip("{\"a\" : 1, \"b\" : {\"c\" : [1, 2]}}", "{\"a\" : 1, \"b\" : {\"c\" : [1, 2]}}", 0));
+	CHECK(roundTrip("{\"a\" : 1, \"b\" : 2}", "{\"a\" : 1, \"c\" : 3}", 2));
+	CHECK(roundTrip("{\"db\" : {\"port\" : 5432, \"host\" : \"x\"}}", "{\"db\" : {\"port\" : 5433, \"host\" : \"x\"}}", 1));
+	CHECK(roundTrip("[1, 2, 3, 4, 5, 6]", "[1, 2, 3, 99, 4, 5, 6]", 1));
+	CHECK(roundTrip("[1, 2, 3, 4, 5, 6]", "[1, 2, 4, 5, 6]", 1));
+	CHECK(roundTrip("[{\"id\" : 1, \"v\" : 1}, {\"id\" : 2}, 3]", "[{\"id\" : 1, \"v\" : 2}, {\"id\" : 2}, 3]", 1));
+	CHECK(roundTrip("[1, 2, 3]", "[4, 5]", 3));
+	CHECK(roundTrip("[]", "[1, [2]]", 2));
+	CHECK(roundTrip("1", "1.0", 1));
+	CHECK(roundTrip("{\"a/b\" : 1, \"m~n\" : 2}", "{\"a/b\" : 2, \"m~n\" : 3}", 2));
+	CHECK(std::string(json::getString(json_array_get(json::diff(json::parse("{\"a/b\" : 1}"), json::parse("{\"a/b\" : 2}")).get(), 0), "path"))=="/a~1b");
+
+	// unchanged subtrees that are shared between versions are skipped without comparing
+	auto v1=json::parse("{\"big\" : [1, 2, 3], \"small\" : 1}");
+	auto v2=json::own(json_copy(v1.get()));
+	json_object_set_new(v2.get(), "small", json_integer(2));
+	CHECK(json_array_size(json::diff(v1, v2).get())==1);
+
+	// RFC 6902 appendix examples
+	auto doc=json::parse("{\"foo\" : [\"bar\", \"baz\"], \"qux\" : {\"baz\" : 1}}");
+	json::applyPatch(doc, json::parse("[{\"op\" : \"add\", \"path\" : \"/foo/1\", \"value\" : \"qux\"},"
+			" {\"op\" : \"add\", \"path\" : \"/foo/-\", \"value\" : \"end\"},"
+			" {\"op\" : \"move\", \"from\" : \"/qux/baz\", \"path\" : \"/qux/thud\"},"
+			" {\"op\" : \"copy\", \"from\" : \"/foo/0\", \"path\" : \"/copied\"},"
+			" {\"op\" : \"test\", \"path\" : \"/qux/thud\", \"value\" : 1},"
+			" {\"op\" : \"replace\", \"path\" : \"/foo/0\", \"value\" : \"first\"},"
+			" {\"op\" : \"remove\", \"path\" : \"/foo/2\"}]"));
+	CHECK(json_equal(doc.get(), json::parse("{\"foo\" : [\"first\", \"qux\", \"end\"], \"qux\" : {\"thud\" : 1}, \"copied\" : \"bar\"}").get()));
+	json::applyPatch(doc, json::parse("[{\"op\" : \"replace\", \"path\" : \"\", \"value\" : [1]}]"));
+	CHECK(json_equal(doc.get(), json::parse("[1]").get()));
+	CHECK(json::getPointer(json::parse("{\"a\" : [0, {\"b\" : 5}]}").get(), "/a/1/b"));
+	CHECK(!json::getPointer(json::parse("{\"a\" : [0]}").get(), "/a/01"));
+
+	// a failing operation rolls back the ones before it
+	auto before=json::parse("{\"a\" : [1, 2], \"b\" : {\"c\" : 1}}");
+	doc=json::own(json_deep_copy(before.get()));
+	const char* bad[]={
+		"[{\"op\" : \"remove\", \"path\" : \"/a/0\"}, {\"op\" : \"add\", \"path\" : \"/b/d\", \"value\" : 2},"
+				" {\"op\" : \"replace\", \"path\" : \"/b/c\", \"value\" : 3}, {\"op\" : \"test\", \"path\" : \"/a/0\", \"value\" : 1}]",
+		"[{\"op\" : \"add\", \"path\" : \"/a/-\", \"value\" : 3}, {\"op\" : \"remove\", \"path\" : \"/nope\"}]",
+		"[{\"op\" : \"move\", \"from\" : \"/b\", \"path\" : \"/b/x\"}]",
+		"[{\"op\" : \"add\", \"path\" : \"/a/5\", \"value\" : 3}]",
+		"[{\"op\" : \"jump\", \"path\" : \"/a\"}]",
+		"[{\"op\" : \"copy\", \"from\" : \"/a\", \"path\" : \"/z\"}, {\"op\" : \"replace\", \"path\" : \"\", \"value\" : 1}, {\"op\" : \"remove\", \"path\" : \"/x~2\"}]",
+	};
+	for (auto p : bad) {
+		bool exPassed=false;
+		try {
+			json::applyPatch(doc, json::parse(p));
+		} catch (const std::exception& e) {
+			exPassed=true;
+			std::cout<<"Correct ex: "<<e.what()<<std::endl;
+		}
+		CHECK(exPassed);
+		CHECK(json_equal(doc.get(), before.get()));
+	}
+
+	std::mt19937 r(7);
+	for (int i=0;i<2000;++i) {
+		auto a=json::own(randomTree(r, 0)), b=json::own(randomTree(r, 0));
+		auto patch=json::diff(a, b);
+		auto d=json::own(json_deep_copy(a.get()));
+		json::applyPatch(d, patch);
+		CHECK(json_equal(d.get(), b.get()));
+		CHECK(json::treeHash(a.get())!=json::treeHash(b.get()) || json_equal(a.get(), b.get()) || json_array_size(patch.get()));
+	}
+	return 0;
+}
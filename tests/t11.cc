@@ -0,0 +1,77 @@
+#include <iostream>
+#include <jsonmerge.h>
+#include "check.h"
+
+int main() {
+	// RFC 7386 appendix A
+	const char* cases[][3]={
+		{"{\"a\":\"b\"}", "{\"a\":\"c\"}", "{\"a\":\"c\"}"},
+		{"{\"a\":\"b\"}", "{\"b\":\"c\"}", "{\"a\":\"b\",\"b\":\"c\"}"},
+		{"{\"a\":\"b\"}", "{\"a\":null}", "{}"},
+		{"{\"a\":\"b\",\"b\":\"c\"}", "{\"a\":null}", "{\"b\":\"c\"}"},
+		{"{\"a\":[\"b\"]}", "{\"a\":\"c\"}", "{\"a\":\"c\"}"},
+		{"{\"a\":\"c\"}", "{\"a\":[\"b\"]}", "{\"a\":[\"b\"]}"},
+		{"{\"a\":{\"b\":\"c\"}}", "{\"a\":{\"b\":\"d\",\"c\":null}}", "{\"a\":{\"b\":\"d\"}}"},
+		{"{\"a\":[{\"b\":\"c\"}]}", "{\"a\":[1]}", "{\"a\":[1]}"},
+		{"[\"a\",\"b\"]", "[\"c\",\"d\"]", "[\"c\",\"d\"]"},
+		{"{\"a\":\"b\"}", "[\"c\"]", "[\"c\"]"},
+		{"{\"a\":\"foo\"}", "null", "null"},
+		{"{\"a\":\"foo\"}", "\"bar\"", "\"bar\""},
+		{"{\"e\":null}", "{\"a\":1}", "{\"e\":null,\"a\":1}"},
+		{"[1,2]", "{\"a\":\"b\",\"c\":null}", "{\"a\":\"b\"}"},
+		{"{}", "{\"a\":{\"bb\":{\"ccc\":null}}}", "{\"a\":{\"bb\":{}}}"},
+	};
+	for (auto& c : cases) {
+		auto target=json::parse(c[0]), patch=json::parse(c[1]);
+		auto before=json::own(json_deep_copy(target.get()));
+		auto r=json::merge(target, patch);
+		if (!json_equal(r.get(), json::parse(c[2]).get())) {
+			std::cout<<"Bad merge "<<c[0]<<" + "<<c[1]<<" = "<<json::to_string(r)<<std::endl;
+			return 1;
+		}
+		CHECK(json_equal(target.get(), before.get()));
+	}
+
+	auto base=json::parse("{\"db\" : {\"host\" : \"localhost\", \"port\" : 5432, \"pool\" : {\"min\" : 1, \"max\" : 10}},"
+			" \"log\" : {\"level\" : \"info\", \"sinks\" : [\"stderr\"]}, \"features\" : {\"x\" : true}}");
+	auto env=json::parse("{\"db\" : {\"host\" : \"db.prod\"}, \"features\" : null}");
+	auto host=json::parse("{\"db\" : {\"pool\" : {\"max\" : 50}}, \"extra\" : {\"id\" : 7}}");
+	auto r=json::merge(base, env, host);
+	CHECK(json_equal(r.get(), json::parse("{\"db\" : {\"host\" : \"db.prod\", \"port\" : 5432, \"pool\" : {\"min\" : 1, \"max\" : 50}},"
+			" \"log\" : {\"level\" : \"info\", \"sinks\" : [\"stderr\"]}, \"extra\" : {\"id\" : 7}}").get()));
+	// untouched subtrees are shared, not copied
+	CHECK(json::getChild(r, "log")==json::getChild(base, "log"));
+	CHECK(json::getChild(r, "db", "port")==json::getChild(base, "db", "port"));
+	CHECK(json::getChild(r, "extra")==json::getChild(host, "extra"));
+	CHECK(json::getChild(r, "db")!=json::getChild(base, "db"));
+	CHECK(json::getLong(base, "db", "pool", "max")==10);
+	CHECK(json_equal(json::merge(std::vector<json::jsonptr>{base, env, host}).get(), r.get()));
+
+	// a base layer keeps its nulls; a shared subtree still applies its own deletes
+	auto nulls=json::parse("{\"a\" : null, \"b\" : {\"x\" : 1, \"n\" : null}}");
+	CHECK(json_equal(json::merge(std::vector<json::jsonptr>{nulls}).get(), nulls.get()));
+	CHECK(json_equal(json::merge(std::vector<json::jsonptr>{nulls, json::parse("{\"c\" : 2}")}).get(),
+			json::parse("{\"a\" : null, \"b\" : {\"x\" : 1, \"n\" : null}, \"c\" : 2}").get()));
+	CHECK(json_equal(json::LayeredConfig({nulls}).result().get(), nulls.get()));
+	CHECK(json_equal(json::merge(nulls, nulls).get(), json::parse("{\"b\" : {\"x\" : 1}}").get()));
+
+	json::LayeredConfig cfg({base, env, host});
+	CHECK(json_equal(cfg.result().get(), r.get()));
+	auto envResult=cfg.result();
+	cfg.setLayer(2, json::parse("{\"log\" : {\"level\" : \"debug\"}}"));
+	CHECK(std::string(json::getString(cfg.result(), "log", "level"))=="debug");
+	CHECK(std::string(json::getString(cfg.result(), "db", "host"))=="db.prod");
+	CHECK(json::getLong(cfg.result(), "db", "pool", "max")==10);
+	CHECK(json::getLong(envResult, "db", "pool", "max")==50);
+	cfg.setLayer(1, json::parse("{}"));
+	CHECK(json::getBool(cfg.result().get(), "features", "x"));
+	bool exPassed=false;
+	try {
+		cfg.setLayer(3, base);
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+	return 0;
+}
@@ -0,0 +1,107 @@
+#include <iostream>
+#include <jsonschema.h>
+#include "check.h"
+
+int main() {
+	json::Schema order(std::string("{\"$schema\" : \"https://json-schema.org/draft/2020-12/schema\", \"title\" : \"order\","
+			" \"type\" : \"object\", \"required\" : [\"id\", \"items\"], \"additionalProperties\" : false,"
+			" \"properties\" : {"
+			"  \"id\" : {\"type\" : \"string\", \"pattern\" : \"^o-[0-9]+$\"},"
+			"  \"status\" : {\"enum\" : [\"new\", \"paid\", \"shipped\"]},"
+			"  \"note\" : {\"type\" : [\"string\", \"null\"], \"maxLength\" : 5},"
+			"  \"total\" : {\"type\" : \"number\", \"minimum\" : 0, \"exclusiveMaximum\" : 1000, \"multipleOf\" : 0.01},"
+			"  \"tags\" : {\"type\" : \"array\", \"items\" : {\"type\" : \"string\"}, \"uniqueItems\" : true, \"maxItems\" : 3},"
+			"  \"items\" : {\"type\" : \"array\", \"minItems\" : 1, \"items\" : {\"type\" : \"object\", \"required\" : [\"sku\", \"qty\"],"
+			"   \"properties\" : {\"sku\" : {\"type\" : \"string\", \"minLength\" : 2}, \"qty\" : {\"type\" : \"integer\", \"minimum\" : 1}},"
+			"   \"additionalProperties\" : {\"type\" : \"boolean\"}}},"
+			"  \"contact\" : {\"oneOf\" : [{\"required\" : [\"email\"]}, {\"required\" : [\"phone\"]}], \"minProperties\" : 1},"
+			"  \"coupon\" : {\"anyOf\" : [{\"type\" : \"integer\"}, {\"type\" : \"string\", \"const\" : \"FREE\"}]},"
+			"  \"ref\" : {\"not\" : {\"type\" : \"null\"}, \"allOf\" : [{\"type\" : \"integer\"}, {\"maximum\" : 10}]}"
+			" }}"));
+	CHECK(order.programSize()>20);
+	auto good=json::parse("{\"id\" : \"o-17\", \"status\" : \"paid\", \"note\" : \"héllo\", \"total\" : 12.5, \"tags\" : [\"a\", \"b\"],"
+			" \"items\" : [{\"sku\" : \"ab\", \"qty\" : 2, \"gift\" : true}, {\"sku\" : \"cd\", \"qty\" : 1.0}],"
+			" \"contact\" : {\"email\" : \"x@y\"}, \"coupon\" : \"FREE\", \"ref\" : 3}");
+	CHECK(order.validate(good));
+	std::vector<json::Schema::Error> errors;
+	CHECK(order.validate(good, errors) && errors.empty());
+	order.check(good);
+
+	auto bad=json::parse("{\"id\" : \"x-1\", \"status\" : \"lost\", \"note\" : \"too long\", \"total\" : 1000, \"tags\" : [\"a\", \"a\"],"
+			" \"items\" : [{\"sku\" : \"a\", \"qty\" : 0}, {\"qty\" : \"2\", \"gift\" : 1}, 7],"
+			" \"contact\" : {\"email\" : \"x@y\", \"phone\" : \"1\"}, \"coupon\" : \"CHEAP\", \"ref\" : null, \"extra~/\" : 1}");
+	CHECK(!order.validate(bad));
+	CHECK(!order.validate(bad, errors, 100));
+	std::string all;
+	for (auto& e : errors) all+=e.path+": "+e.message+"\n";
+	std::cout<<all;
+	const char* expected[]={
+		"/id: \"x-1\" does not match the pattern",
+		"/status: \"lost\" is not one of the allowed values",
+		"/note: string of length 8 is longer than 5",
+		"/total: 1000 is greater than or equal to 1000",
+		"/tags: items 0 and 1 are equal",
+		"/items/0/sku: string of length 1 is shorter than 2",
+		"/items/0/qty: 0 is less than 1",
+		"/items/1: missing required property sku",
+		"/items/1/qty: expected integer, got string",
+		"/items/1/gift: expected boolean, got integer",
+		"/items/2: expected object, got integer",
+		"/contact: value matches more than one oneOf schema",
+		"/coupon: value matches none of the anyOf schemas",
+		"/ref: value matches a schema it must not match",
+		": property extra~/ is not allowed",
+	};
+	for (auto e : expected) {
+		if (all.find(e)==std::string::npos) {
+			std::cout<<"Missing error: "<<e<<std::endl;
+			return 1;
+		}
+	}
+	CHECK(errors.size()==16);
+	CHECK(!order.validate(bad, errors, 3) && errors.size()==3);
+
+	bool exPassed=false;
+	try {
+		order.check(bad, 2);
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+		CHECK(std::string(e.what()).find("; ...")!=std::string::npos);
+	}
+	CHECK(exPassed);
+
+	// messages stay short however large the offending value is
+	json_t* huge=json_object();
+	json_object_set_new(huge, "id", json_string(std::string(100000, 'x').c_str()));
+	json_object_set_new(huge, "items", json_array());
+	CHECK(!order.validate(huge, errors));
+	for (auto& e : errors) CHECK(e.message.size()<100);
+	json_decref(huge);
+
+	CHECK(json::Schema(std::string("true")).validate(json::parse("[1]")));
+	CHECK(!json::Schema(std::string("false")).validate(json::parse("1")));
+	CHECK(json::Schema(std::string("{\"type\" : \"integer\"}")).validate(json::parse("2.0")));
+	CHECK(!json::Schema(std::string("{\"type\" : \"integer\"}")).validate(json::parse("2.5")));
+	// names listed only in required are not declared properties
+	json::Schema closed(std::string("{\"required\" : [\"x\"], \"additionalProperties\" : false}"));
+	CHECK(!closed.validate(json::parse("{\"x\" : 1}")));
+	json::Schema typed(std::string("{\"required\" : [\"x\"], \"properties\" : {\"y\" : {}}, \"additionalProperties\" : {\"type\" : \"string\"}}"));
+	CHECK(typed.validate(json::parse("{\"x\" : \"s\", \"y\" : 1}")));
+	CHECK(!typed.validate(json::parse("{\"x\" : 1, \"y\" : 1}")));
+	CHECK(!typed.validate(json::parse("{\"y\" : 1}")));
+	CHECK(json::Schema(std::string("{\"multipleOf\" : 0.1}")).validate(json::parse("0.3")));
+
+	const char* invalid[]={"{\"$ref\" : \"#/x\"}", "{\"type\" : \"float\"}", "{\"minLength\" : -1}", "{\"pattern\" : \"(\"}", "{\"anyOf\" : []}", "7"};
+	for (auto s : invalid) {
+		exPassed=false;
+		try {
+			json::Schema x{std::string(s)};
+		} catch (const std::exception& e) {
+			exPassed=true;
+			std::cout<<"Correct ex: "<<e.what()<<std::endl;
+		}
+		CHECK(exPassed);
+	}
+	return 0;
+}
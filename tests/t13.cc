@@ -0,0 +1,105 @@
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <jsonparallel.h>
+#include "check.h"
+
+int main() {
+	auto sorted=json::parse("[1, 3, 5, 7, 9, 11]");
+	auto elements=json::getJsonArrayElements(sorted);
+	CHECK(elements.size()==6 && json_integer_value(elements[2])==5);
+	CHECK(elements.end()-elements.begin()==6);
+	auto it=std::lower_bound(elements.begin(), elements.end(), 7, [](json_t* e, int v) {return json_integer_value(e)<v;});
+	CHECK(it.index()==3 && json_integer_value(*it)==7 && json_integer_value(it[-1])==5);
+	CHECK(json_integer_value(*(2+elements.begin()))==5 && (elements.end()-1).index()==5);
+	CHECK(std::accumulate(elements.begin(), elements.end(), 0LL, [](long long s, json_t* e) {return s+json_integer_value(e);})==36);
+	auto rit=std::find_if(std::make_reverse_iterator(elements.end()), std::make_reverse_iterator(elements.begin()),
+			[](json_t* e) {return json_integer_value(e)<6;});
+	CHECK(json_integer_value(*rit)==5);
+	size_t count=0;
+	for (auto e : json::getJsonArrayElements(sorted)) count+=json_is_integer(e);
+	CHECK(count==6);
+
+	auto obj=json::parse("{\"a\" : 1, \"b\" : 2, \"c\" : 3}");
+	auto members=json::getJsonKeyValueSnapshot(obj.get());
+	CHECK(members.size()==3);
+	long long sum=0;
+	std::string keys;
+	for (auto& kv : members) {
+		keys+=kv.first;
+		sum+=json_integer_value(kv.second);
+	}
+	CHECK(sum==6 && keys.size()==3);
+
+	const size_t n=100003;
+	json_t* a=json_array();
+	for (size_t i=0;i<n;++i) {
+		if (i%10==0) json_array_append_new(a, json_pack("{s:I, s:[i,i,i]}", "v", (json_int_t)i, "w", 1, 2, 3));
+		else json_array_append_new(a, json_integer(i));
+	}
+	auto big=json::own(a);
+	long long expected=(long long)n*(n-1)/2;
+	auto value=[](json_t* e) {return json_is_integer(e) ? json_integer_value(e) : json::getLong(e, "v");};
+	for (unsigned threads : {1u, 2u, 4u, 0u}) {
+		CHECK(json::transform_reduce(json::getJsonArrayElements(big), 0LL, std::plus<long long>(), value, threads)==expected);
+		std::atomic<long long> total(0);
+		std::atomic<size_t> visits(0);
+		json::parallel_for_each(json::getJsonArrayElements(big), [&](json_t* e) {
+			total+=value(e);
+			++visits;
+		}, threads);
+		CHECK(total==expected && visits==n);
+	}
+	CHECK(json::transform_reduce(json::getJsonArrayElements(json::parse("[]")), 5, std::plus<int>(), [](json_t*) {return 1;})==5);
+
+	json_t* o=json_object();
+	for (int i=0;i<10000;++i) json_object_set_new(o, ("k"+std::to_string(i)).c_str(), json_integer(i));
+	auto bigObj=json::own(o);
+	CHECK(json::transform_reduce(json::getJsonKeyValueSnapshot(o), 0LL, std::plus<long long>(),
+			[](const std::pair<const char*, json_t*>& kv) {return json_integer_value(kv.second);}, 4)==10000LL*9999/2);
+
+	bool exPassed=false;
+	try {
+		json::parallel_for_each(json::getJsonArrayElements(big), [](json_t* e) {
+			if (json_is_integer(e) && json_integer_value(e)==77777) throw std::runtime_error("element 77777");
+		}, 4);
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+
+	CHECK(json_array_size(json::parseArrayParallel(" [ ] ").get())==0);
+	auto small=json::parseArrayParallel("[1, \"a,]\\\"[\", {\"b\" : [2, 3]}, null]");
+	CHECK(json_equal(small.get(), json::parse("[1, \"a,]\\\"[\", {\"b\" : [2, 3]}, null]").get()));
+	std::string records="[\n";
+	for (int i=0;i<300000;++i) records+=std::string(i ? ",\n" : "")+"{\"id\" : "+std::to_string(i)+", \"name\" : \"r\\\"}"+std::to_string(i)+"\", \"tags\" : [\"x\", \"y,z\"]}";
+	records+="\n]\n";
+	auto parsed=json::parseArrayParallel(records, 4);
+	CHECK(json_array_size(parsed.get())==300000 && json_equal(parsed.get(), json::parse(records).get()));
+	std::atomic<long long> ids(0);
+	CHECK(json::parseArrayParallel(records, [&](size_t i, json::jsonptr r) {
+		if (json::getLong(r, "id")==(long long)i) ids+=i;
+	}, 4)==300000);
+	CHECK(ids==300000LL*299999/2);
+
+	auto errorPosition=[](const std::string& m) {return m.substr(m.rfind(": line : "));};
+	std::string broken=records;
+	broken.replace(broken.find("\"id\" : 123456,"), 14, "\"id\" : 12x456,");
+	std::string serialError, parallelError;
+	try {json::parse(broken);} catch (const std::exception& e) {serialError=e.what();}
+	try {json::parseArrayParallel(broken, 4);} catch (const std::exception& e) {parallelError=e.what();}
+	std::cout<<"Correct ex: "<<parallelError<<std::endl;
+	CHECK(!serialError.empty() && !parallelError.empty() && errorPosition(serialError)==errorPosition(parallelError));
+	for (const char* bad : {"{\"a\" : 1}", "[1, 2", "[1, 2] 3", "[1, [2, 3]]]", "[1, \"2]", "[1,,2]", "[1, 2,]", ""}) {
+		try {
+			json::parseArrayParallel(bad);
+			std::cout<<"Check failed: accepted "<<bad<<std::endl;
+			return 1;
+		} catch (const std::exception& e) {
+			std::cout<<"Correct ex: "<<e.what()<<std::endl;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,59 @@
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <jsonkeys.h>
+#include "check.h"
+
+int main() {
+	size_t before=json::internedKeys();
+	CHECK(!json::findKey("t14-never-interned").valid());
+	json::Key user=json::intern("user");
+	json::Key id=json::intern(std::string("id"));
+	CHECK(user.valid() && id.valid() && user!=id);
+	CHECK(json::intern("user")==user && json::intern("user").c_str()==user.c_str());
+	CHECK(json::findKey("user")==user && json::keyById(user.id())==user);
+	CHECK(user.size()==4 && !strcmp(user, "user"));
+	CHECK(json::internedKeys()==before+2);
+	std::string embedded("a\0b", 3);
+	json::Key e=json::intern(embedded);
+	CHECK(e.size()==3 && e!=json::intern("a"));
+
+	auto doc=json::parse("{\"user\" : {\"id\" : 42, \"name\" : \"ann\"}}");
+	CHECK(json::getLong(doc, user, id)==42);
+	CHECK(!strcmp(json::getString(doc, user, json::intern("name")), "ann"));
+	CHECK(json::hasLong(doc, json::keyById(user.id()), id) && !json::hasChild(doc, id));
+
+	bool exPassed=false;
+	try {
+		json::keyById(1u<<30);
+	} catch (const std::exception& ex) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<ex.what()<<std::endl;
+	}
+	CHECK(exPassed);
+
+	// overlapping names from several threads, enough to grow the table a few times
+	const int threads=4, names=5000;
+	std::vector<std::vector<json::Key>> seen(threads);
+	std::vector<std::thread> pool;
+	for (int t=0;t<threads;++t) pool.emplace_back([&, t]() {
+		for (int i=0;i<names;++i) {
+			int n=(i*7+t*1111)%names;
+			json::Key k=json::intern("t14-key-"+std::to_string(n));
+			if (!json::findKey("t14-key-"+std::to_string(n)).valid()) return;
+			seen[t].push_back(k);
+		}
+	});
+	for (auto& t : pool) t.join();
+	CHECK(json::internedKeys()==before+5+names);
+	for (int t=0;t<threads;++t) {
+		CHECK(seen[t].size()==(size_t)names);
+		for (int i=0;i<names;++i) {
+			int n=(i*7+t*1111)%names;
+			CHECK(seen[t][i]==json::findKey("t14-key-"+std::to_string(n)));
+			CHECK(json::keyById(seen[t][i].id())==seen[t][i]);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,125 @@
+#include <iostream>
+#include <sstream>
+#include <stdio.h>
+#include <log.h>
+#include <jsonutils.h>
+#include <utils.h>
+#include "check.h"
+
+static std::vector<std::string> lines(const std::string& file) {
+	std::vector<std::string> r;
+	std::istringstream in(utils::slurpTextFile(file));
+	for (std::string l;std::getline(in, l);) r.push_back(l);
+	return r;
+}
+
+int main() {
+	char dir[]="/tmp/cpputils_t15_XXXXXX";
+	CHECK(mkdtemp(dir));
+	std::string file=std::string(dir)+"/app.log";
+	static const utils::LogFormat served("served {path} to {user} in {us} us");
+	static const utils::LogFormat counter("thread {t} record {n}");
+
+	bool exPassed=false;
+	try {
+		utils::LogFormat bad("unclosed {placeholder");
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+
+	{
+		utils::Log::Options o;
+		o.fileName=file;
+		utils::Log log(o);
+		log.info(served, "/index.html", std::string("ann"), 35);
+		log.debug(served, "/hidden", "nobody", 0);
+		log.warn(served, std::string_view("/a\nb"), (const char*)nullptr, -1.5);
+		std::vector<std::thread> pool;
+		for (int t=0;t<3;++t) pool.emplace_back([&, t]() {
+			for (int n=0;n<1000;++n) log.info(counter, t, n);
+		});
+		for (auto& t : pool) t.join();
+		log.flush();
+		auto l=lines(file);
+		CHECK(l.size()==3002);
+		CHECK(l[0].size()>30 && l[0][4]=='-' && l[0][26]=='Z');
+		CHECK(l[0].find(" INFO  [")!=std::string::npos && l[0].substr(l[0].size()-34)=="served /index.html to ann in 35 us");
+		CHECK(l[1].find(" WARN  [")!=std::string::npos && l[1].find("served /a b to (null) in -1.5 us")!=std::string::npos);
+		int next[3]={0, 0, 0};
+		for (size_t i=2;i<l.size();++i) {
+			int t, n;
+			CHECK(sscanf(l[i].c_str()+l[i].find("] ")+2, "thread %d record %d", &t, &n)==2);
+			CHECK(t>=0 && t<3 && n==next[t]);
+			++next[t];
+		}
+		auto s=log.stats();
+		CHECK(s.records==3002 && s.dropped==0 && s.bytes==utils::slurpTextFile(file).size());
+	}
+	unlink(file.c_str());
+
+	{
+		utils::Log::Options o;
+		o.fileName=file;
+		o.json=true;
+		o.level=utils::LogLevel::DEBUG;
+		utils::Log log(o);
+		log.debug(served, "/q?\"x\"", "bob", 7u);
+		log.error(served, "/", "eve", true, 2.5, &o);
+	}
+	{
+		auto l=lines(file);
+		CHECK(l.size()==2);
+		auto first=json::parse(l[0]);
+		CHECK(!strcmp(json::getString(first, "level"), "debug") && !strcmp(json::getString(first, "path"), "/q?\"x\""));
+		CHECK(!strcmp(json::getString(first, "msg"), "served /q?\"x\" to bob in 7 us") && json::getLong(first, "us")==7);
+		CHECK(json::hasLong(first, "tid") && strlen(json::getString(first, "ts"))==27);
+		auto second=json::parse(l[1]);
+		CHECK(!strcmp(json::getString(second, "level"), "error") && json::getBool(second.get(), "us"));
+		CHECK(json::getNumber(second.get(), "arg3")==2.5 && json::hasString(second, "arg4"));
+	}
+	unlink(file.c_str());
+
+	for (auto overflow : {utils::Log::Overflow::DROP, utils::Log::Overflow::BLOCK}) {
+		utils::Log::Options o;
+		o.fileName=file;
+		o.ringBytes=4096;
+		o.flushMicroseconds=200000;
+		o.overflow=overflow;
+		utils::Log log(o);
+		auto start=utils::clock();
+		for (int n=0;n<10000;++n) log.info(counter, 0, n);
+		log.flush();
+		// a blocked producer wakes the writer instead of waiting out flushMicroseconds per refill
+		CHECK(utils::microseconds(start)<2000000);
+		auto s=log.stats();
+		auto l=lines(file);
+		if (overflow==utils::Log::Overflow::DROP) {
+			CHECK(s.dropped>0 && s.records+s.dropped==10000);
+			CHECK(l.size()==s.records+1 && l.back().find(" records dropped by thread ")!=std::string::npos);
+		} else {
+			CHECK(s.dropped==0 && s.records==10000 && l.size()==10000);
+		}
+		unlink(file.c_str());
+	}
+
+	{
+		utils::Log::Options o;
+		o.fileName=file;
+		o.maxFileBytes=4096;
+		o.keepFiles=2;
+		o.flushMicroseconds=100;
+		utils::Log log(o);
+		for (int n=0;n<2000;++n) {
+			log.info(counter, 0, n);
+			if (n%100==0) log.flush();
+		}
+		log.flush();
+		CHECK(log.stats().rotations>2);
+		CHECK(utils::isRegularFile(file+".1") && utils::isRegularFile(file+".2") && !utils::isFileSystemObject(file+".3"));
+	}
+	for (auto f : {file, file+".1", file+".2"}) unlink(f.c_str());
+	rmdir(dir);
+	return 0;
+}
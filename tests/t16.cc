@@ -0,0 +1,90 @@
+#include <iostream>
+#include <atomic>
+#include <numeric>
+#include <thread>
+#include <executor.h>
+#include "check.h"
+
+int main() {
+	utils::Executor ex(4);
+	CHECK(ex.size()==4 && ex.currentWorker()==-1);
+
+	auto answer=ex.submit([]() {return 6*7;});
+	CHECK(answer.get()==42);
+	// a thread waiting on a future may run the task itself, so wait without helping
+	std::atomic<int> worker(-2);
+	ex.post([&]() {worker=ex.currentWorker();});
+	while (worker==-2) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	CHECK(worker>=0 && worker<4);
+
+	auto chained=ex.submit([]() {return std::string("forty");})
+			.then([](std::string s) {return s+" two";})
+			.then([](std::string s) {return s.size();});
+	CHECK(chained.get()==9);
+	std::atomic<int> sideEffect(0);
+	auto done=ex.submit([&]() {sideEffect=1;}).then([&]() {return sideEffect.load()+1;});
+	CHECK(done.get()==2);
+
+	bool exPassed=false;
+	auto failing=ex.submit([]() -> int {throw std::runtime_error("task failed");}).then([](int v) {return v+1;});
+	try {
+		failing.get();
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+
+	std::vector<utils::Future<long long>> many;
+	for (long long i=0;i<10000;++i) many.push_back(ex.submit([i]() {return i*i;}));
+	long long squares=0;
+	for (auto& f : many) squares+=f.get();
+	CHECK(squares==9999LL*10000*19999/6);
+
+	const size_t n=1000000;
+	std::vector<int> v(n);
+	ex.parallel_for(0, n, [&](size_t b, size_t e) {
+		for (size_t i=b;i<e;++i) v[i]=(int)(i%1000);
+	});
+	CHECK(std::accumulate(v.begin(), v.end(), 0LL)==(long long)(n/1000)*999*1000/2);
+	std::atomic<size_t> covered(0);
+	ex.parallel_for(10, 20, [&](size_t b, size_t e) {covered+=e-b;}, 1);
+	CHECK(covered==10);
+
+	// nested: tasks that wait on parallel loops must not starve the pool
+	std::vector<utils::Future<long long>> nested;
+	for (int t=0;t<16;++t) nested.push_back(ex.submit([&ex]() {
+		std::atomic<long long> s(0);
+		ex.parallel_for(0, 100000, [&](size_t b, size_t e) {
+			long long local=0;
+			for (size_t i=b;i<e;++i) local+=i;
+			s+=local;
+		}, 1000);
+		return s.load();
+	}));
+	for (auto& f : nested) CHECK(f.get()==100000LL*99999/2);
+
+	exPassed=false;
+	try {
+		ex.parallel_for(0, 100000, [](size_t b, size_t e) {
+			if (b<=77777 && 77777<e) throw std::runtime_error("range containing 77777");
+		}, 100);
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+
+	auto st=ex.stats();
+	CHECK(st.submitted>=10000 && st.executed<=st.submitted && st.executed>=10000);
+	std::cout<<"submitted "<<st.submitted<<", executed "<<st.executed<<", stolen "<<st.stolen<<", parked "<<st.parked<<std::endl;
+
+	std::atomic<int> drained(0);
+	{
+		utils::Executor pinned(2, true);
+		for (int i=0;i<1000;++i) pinned.post([&]() {++drained;});
+	}
+	CHECK(drained==1000);
+	CHECK(utils::Executor::shared().size()>=1);
+	return 0;
+}
@@ -0,0 +1,185 @@
+#include <iostream>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <queue.h>
+#include <jsonutils.h>
+#include "check.h"
+
+// producers push (id<<32 | sequence); every consumer checks that each producer's values
+// arrive in order and the totals add up
+template<typename Q> bool exchange(Q& q, int producers, int consumers, uint64_t perProducer, bool batches) {
+	std::vector<std::thread> threads;
+	std::atomic<uint64_t> sum(0), count(0);
+	std::atomic<bool> ordered(true);
+	for (int p=0;p<producers;++p) threads.emplace_back([&, p]() {
+		uint64_t buf[16];
+		for (uint64_t i=0;i<perProducer;) {
+			if (batches) {
+				size_t n=std::min<uint64_t>(16, perProducer-i);
+				for (size_t k=0;k<n;++k) buf[k]=((uint64_t)p<<32)|(i+k);
+				size_t done=0;
+				while (done<n) done+=q.push_batch(buf+done, n-done);
+				i+=n;
+			} else {
+				uint64_t v=((uint64_t)p<<32)|i;
+				while (!q.try_push(std::move(v))) std::this_thread::yield();
+				++i;
+			}
+		}
+	});
+	for (int c=0;c<consumers;++c) threads.emplace_back([&]() {
+		std::vector<int64_t> last(producers, -1);
+		uint64_t buf[16];
+		while (count.load()<producers*perProducer) {
+			size_t n=batches ? q.pop_batch(buf, 16) : q.try_pop(buf[0]);
+			if (!n) {
+				std::this_thread::yield();
+				continue;
+			}
+			for (size_t k=0;k<n;++k) {
+				int p=buf[k]>>32;
+				int64_t i=buf[k] & 0xffffffff;
+				if (i<=last[p]) ordered=false;
+				last[p]=i;
+				sum+=i;
+			}
+			count+=n;
+		}
+	});
+	for (auto& t : threads) t.join();
+	return ordered && count==producers*perProducer && sum==producers*(perProducer*(perProducer-1)/2) && q.empty();
+}
+
+int main() {
+	utils::SpscQueue<int> small(5);
+	CHECK(small.capacity()==8 && small.empty());
+	for (int i=0;i<8;++i) CHECK(small.try_push(i));
+	CHECK(!small.try_push(8) && small.size()==8);
+	int v;
+	CHECK(small.try_pop(v) && v==0);
+	CHECK(small.try_push(8));
+	int out[16];
+	CHECK(small.pop_batch(out, 16)==8 && out[0]==1 && out[7]==8);
+	CHECK(!small.try_pop(v));
+	int in[]={1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+	CHECK(small.push_batch(in, 10)==8 && small.pop_batch(out, 3)==3 && out[2]==3 && small.push_batch(in+8, 2)==2);
+	CHECK(small.pop_batch(out, 16)==7 && out[4]==8 && out[6]==10);
+
+	utils::MpmcQueue<int> mp(1);
+	CHECK(mp.capacity()==2 && mp.try_push(1) && mp.try_push(2) && !mp.try_push(3));
+	CHECK(mp.pop_batch(out, 4)==2 && out[0]==1 && out[1]==2 && mp.pop_batch(out, 4)==0);
+
+	bool exPassed=false;
+	try {
+		utils::MpmcQueue<int> huge(SIZE_MAX);
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+
+	// move-only payloads: a failed push leaves the value with the caller
+	{
+		utils::SpscQueue<utils::FD> fds(2);
+		utils::FD a(open("/dev/null", O_RDONLY)), b(open("/dev/null", O_RDONLY)), c(open("/dev/null", O_RDONLY));
+		int fdA=a;
+		CHECK(fds.try_push(std::move(a)) && fds.try_push(std::move(b)) && !a && !b);
+		CHECK(!fds.try_push(std::move(c)) && c);
+		utils::FD got;
+		CHECK(fds.try_pop(got) && (int)got==fdA);
+		// the one left in the queue is closed by its destructor
+	}
+	{
+		utils::MpmcQueue<json::jsonptr> docs(4);
+		json::jsonptr d=json::parse(R"({"a":1})");
+		CHECK(docs.try_push(std::move(d)) && !d);
+		std::vector<json::jsonptr> got;
+		CHECK(docs.pop_batch(std::back_inserter(got), 4)==1 && json::getLong(got[0].get(), "a")==1);
+		utils::MpmcQueue<std::unique_ptr<std::string>> strings(4);
+		std::unique_ptr<std::string> s(new std::string("x"));
+		CHECK(strings.try_push(std::move(s)) && !s && strings.try_pop(s) && *s=="x");
+	}
+
+	{
+		utils::SpscQueue<uint64_t> q(64);
+		CHECK(exchange(q, 1, 1, 20000, false));
+		CHECK(exchange(q, 1, 1, 20000, true));
+	}
+	{
+		utils::MpmcQueue<uint64_t> q(64);
+		CHECK(exchange(q, 4, 4, 5000, false));
+		CHECK(exchange(q, 3, 2, 5000, true));
+	}
+
+	{
+		utils::BlockingQueue<utils::MpmcQueue<uint64_t>> q(16);
+		const uint64_t n=100000;
+		std::atomic<uint64_t> sum(0), count(0);
+		std::vector<std::thread> threads;
+		for (int c=0;c<3;++c) threads.emplace_back([&]() {
+			uint64_t x, buf[8];
+			for (bool batch=false;;batch=!batch) {
+				size_t k=batch ? q.pop_batch(buf, 8) : q.pop(x);
+				if (!k) break;
+				if (!batch) buf[0]=x;
+				for (size_t i=0;i<k;++i) sum+=buf[i];
+				count+=k;
+			}
+		});
+		std::atomic<bool> pushed(true);
+		std::vector<std::thread> producers;
+		for (int p=0;p<2;++p) producers.emplace_back([&, p]() {
+			uint64_t buf[10];
+			for (uint64_t i=p;i<n;i+=20) {
+				for (uint64_t k=0;k<10;++k) buf[k]=i+2*k;
+				if (p) {
+					if (q.push_batch(buf, 10)!=10) pushed=false;
+				} else {
+					for (uint64_t k=0;k<10;++k) if (!q.push(std::move(buf[k]))) pushed=false;
+				}
+			}
+		});
+		for (auto& t : producers) t.join();
+		q.close();
+		for (auto& t : threads) t.join();
+		CHECK(pushed && count==n && sum==n*(n-1)/2);
+		uint64_t x=1;
+		CHECK(!q.push(std::move(x)) && !q.pop(x) && q.isClosed());
+	}
+	{
+		// a consumer parked on an empty queue is woken by close
+		utils::BlockingQueue<utils::SpscQueue<utils::FD>> q(4);
+		std::atomic<int> result(-1);
+		std::thread t([&]() {
+			utils::FD fd;
+			result=q.pop(fd);
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		CHECK(result==-1);
+		q.close();
+		t.join();
+		CHECK(result==0);
+	}
+	{
+		// a producer parked on a full queue fails once closed, even if room appears after
+		utils::BlockingQueue<utils::SpscQueue<uint64_t>> q(2);
+		uint64_t x=1;
+		while (q.try_push(std::move(x))) x=1;
+		std::atomic<int> result(-1);
+		std::thread t([&]() {
+			uint64_t v=7;
+			result=q.push(std::move(v));
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		CHECK(result==-1);
+		size_t full=q.size();
+		q.close();
+		CHECK(q.pop(x));
+		t.join();
+		CHECK(result==0 && q.size()==full-1);
+	}
+	return 0;
+}
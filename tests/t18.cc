@@ -0,0 +1,141 @@
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <stdio.h>
+#include <appendlog.h>
+#include <hash.h>
+#include <jsonutils.h>
+#include <utils.h>
+#include "check.h"
+
+static std::vector<std::string> readAll(const utils::AppendLog& log, uint64_t from, std::vector<uint64_t>* sequences=nullptr) {
+	std::vector<std::string> r;
+	log.read(from, [&](const utils::AppendLog::Record& rec) {
+		r.emplace_back(rec.data);
+		if (sequences) sequences->push_back(rec.sequence);
+		return true;
+	});
+	return r;
+}
+
+int main() {
+	// the check value from RFC 3720 and a running crc over two pieces
+	CHECK(utils::crc32c("123456789", 9)==0xe3069283);
+	CHECK(utils::crc32c("56789", 5, utils::crc32c("1234", 4))==0xe3069283);
+	std::string zeros(100, 0);
+	CHECK(utils::crc32c(zeros.data()+3, 77)==utils::crc32c(std::string(77, 0)));
+
+	char dir[]="/tmp/cpputils_t18_XXXXXX";
+	CHECK(mkdtemp(dir));
+	std::string path=std::string(dir)+"/events";
+	utils::AppendLog::Options o;
+	o.directory=path;
+	o.segmentBytes=4096;
+	{
+		utils::AppendLog log(o);
+		CHECK(log.end()==0 && readAll(log, 0).empty());
+		CHECK(log.append("first")==0);
+		CHECK(log.append(std::string(""))==1);
+		CHECK(log.append(json::parse(R"({"a":[1,2]})"))==2);
+		CHECK(log.append(json::parse(R"({"b":"c"})"), utils::AppendLog::CBOR)==3);
+		std::vector<json::jsonptr> docs;
+		log.read(2, [&](const utils::AppendLog::Record& r) {
+			docs.push_back(r.json());
+			return true;
+		});
+		CHECK(docs.size()==2 && json::to_string(docs[0])==R"({"a":[1,2]})" && json::to_string(docs[1])==R"({"b":"c"})");
+
+		bool exPassed=false;
+		try {
+			log.read(0, [](const utils::AppendLog::Record& r) {r.json();return true;});
+		} catch (const std::exception& e) {
+			exPassed=true;
+			std::cout<<"Correct ex: "<<e.what()<<std::endl;
+		}
+		CHECK(exPassed);
+		exPassed=false;
+		try {
+			utils::AppendLog again(o);
+		} catch (const std::exception& e) {
+			exPassed=true;
+			std::cout<<"Correct ex: "<<e.what()<<std::endl;
+		}
+		CHECK(exPassed);
+
+		// concurrent writers share commits; records roll over into several segments
+		std::vector<std::thread> threads;
+		for (int t=0;t<4;++t) threads.emplace_back([&, t]() {
+			for (int i=0;i<200;++i) log.append("thread "+std::to_string(t)+" record "+std::to_string(i));
+		});
+		for (auto& t : threads) t.join();
+		auto st=log.stats();
+		CHECK(st.records==804 && st.commits<=st.records && st.syncs==st.commits && st.segments>5);
+		std::vector<uint64_t> sequences;
+		auto all=readAll(log, 0, &sequences);
+		CHECK(all.size()==804 && all[0]=="first" && sequences.back()==803);
+		for (size_t i=0;i<sequences.size();++i) CHECK(sequences[i]==i);
+		int last[4]={-1, -1, -1, -1};
+		for (size_t i=4;i<all.size();++i) {
+			int t, n;
+			CHECK(sscanf(all[i].c_str(), "thread %d record %d", &t, &n)==2 && n==last[t]+1);
+			last[t]=n;
+		}
+		CHECK(readAll(log, 800).size()==4 && readAll(log, 804).empty());
+	}
+	{
+		// reopening scans the last segment and carries on numbering
+		utils::AppendLog log(o);
+		CHECK(log.end()==804 && log.append("after reopen")==804);
+		CHECK(readAll(log, 804).size()==1);
+		size_t before=log.stats().segments;
+		log.dropBefore(500);
+		CHECK(log.stats().segments<before);
+		std::vector<uint64_t> sequences;
+		auto rest=readAll(log, 0, &sequences);
+		CHECK(sequences.front()<=500 && sequences.back()==804 && rest.back()=="after reopen");
+	}
+
+	// a torn last record is cut off on open, and so is anything after it
+	std::string lastSegment;
+	{
+		utils::AppendLog log(o);
+		uint64_t seq=log.append("to be damaged");
+		log.append("follows the damage");
+		char name[32];
+		for (uint64_t s=seq;;--s) {
+			snprintf(name, sizeof(name), "/%020llu.log", (unsigned long long)s);
+			if (utils::isRegularFile(path+name)) break;
+		}
+		lastSegment=path+name;
+	}
+	{
+		std::string bytes=utils::slurpTextFile(lastSegment);
+		size_t at=bytes.find("to be damaged");
+		CHECK(at!=std::string::npos);
+		bytes[at+3]^=1;
+		utils::dumpToFile(lastSegment, bytes);
+	}
+	{
+		utils::AppendLog log(o);
+		CHECK(log.end()==805);
+		CHECK(log.append("replacement")==805);
+		auto tail=readAll(log, 804);
+		CHECK(tail.size()==2 && tail[0]=="after reopen" && tail[1]=="replacement");
+	}
+	{
+		// unsynced mode writes without flushing until sync()
+		utils::AppendLog::Options u=o;
+		u.sync=false;
+		u.preallocate=false;
+		utils::AppendLog log(u);
+		for (int i=0;i<10;++i) log.append("unsynced");
+		CHECK(log.stats().syncs==0);
+		log.sync();
+		CHECK(log.stats().syncs==1 && readAll(log, 806).size()==10);
+	}
+	std::string err;
+	utils::sh(("rm -rf "+std::string(dir)).c_str(), nullptr, &err);
+	return 0;
+}
@@ -0,0 +1,112 @@
+#include <iostream>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <filecopy.h>
+#include <utils.h>
+#include "check.h"
+
+static std::string content(size_t n) {
+	std::string s(n, 0);
+	uint64_t x=88172645463325252ULL;
+	for (auto& c : s) {
+		x^=x<<13;
+		x^=x>>7;
+		x^=x<<17;
+		c=(char)x;
+	}
+	return s;
+}
+
+int main() {
+	char dir[]="/tmp/cpputils_t19_XXXXXX";
+	CHECK(mkdtemp(dir));
+	std::string d=dir;
+	std::string data=content(3<<20 | 123);
+	utils::dumpToFile(d+"/src.bin", data);
+	CHECK(!chmod((d+"/src.bin").c_str(), 0640));
+	timespec old[2]={{1000000000, 5}, {1200000000, 700}};
+	CHECK(!utimensat(AT_FDCWD, (d+"/src.bin").c_str(), old, 0));
+
+	auto m=utils::copyFile(d+"/src.bin", d+"/auto.bin");
+	std::cout<<"copied with "<<utils::copyMethodName(m)<<std::endl;
+	CHECK(utils::slurpTextFile(d+"/auto.bin")==data);
+	struct stat st;
+	CHECK(!stat((d+"/auto.bin").c_str(), &st) && (st.st_mode & 0777)==0640 && st.st_mtim.tv_sec==1200000000 && st.st_mtim.tv_nsec==700);
+
+	for (auto method : {utils::CopyMethod::COPY_FILE_RANGE, utils::CopyMethod::SENDFILE, utils::CopyMethod::READ_WRITE}) {
+		utils::CopyOptions o;
+		o.method=method;
+		CHECK(utils::copyFile(d+"/src.bin", d+"/forced.bin", o)==method);
+		CHECK(utils::slurpTextFile(d+"/forced.bin")==data);
+		// a size of 0 keeps the forced method: an empty file copies, /proc copies or throws
+		utils::dumpToFile(d+"/empty.bin", std::string());
+		CHECK(utils::copyFile(d+"/empty.bin", d+"/forced.bin", o)==method && utils::slurpTextFile(d+"/forced.bin").empty());
+		try {
+			CHECK(utils::copyFile("/proc/self/status", d+"/forced.bin", o)==method && !utils::slurpTextFile(d+"/forced.bin").empty());
+		} catch (const std::exception& e) {
+			CHECK(method!=utils::CopyMethod::READ_WRITE);
+			std::cout<<"Correct ex: "<<e.what()<<std::endl;
+		}
+	}
+	utils::CopyOptions clone;
+	clone.method=utils::CopyMethod::CLONE;
+	try {
+		utils::copyFile(d+"/src.bin", d+"/clone.bin", clone);
+		CHECK(utils::slurpTextFile(d+"/clone.bin")==data);
+	} catch (const std::exception& e) {
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+
+	bool exPassed=false;
+	try {
+		utils::copyFile(d+"/src.bin", d+"/../"+d.substr(5)+"/src.bin");
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed && utils::slurpTextFile(d+"/src.bin")==data);
+
+	// holes stay holes, also when copied the slow way
+	{
+		utils::FD fd(open((d+"/sparse.bin").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+		CHECK(fd && !ftruncate(fd, 64<<20));
+		CHECK(pwrite(fd, "head", 4, 0)==4 && pwrite(fd, "middle", 6, 32<<20)==6 && pwrite(fd, "tail", 4, (64<<20)-4)==4);
+	}
+	utils::CopyOptions slow;
+	slow.method=utils::CopyMethod::READ_WRITE;
+	utils::copyFile(d+"/sparse.bin", d+"/sparse.copy", slow);
+	std::string sparse=utils::slurpTextFile(d+"/sparse.copy");
+	CHECK(sparse.size()==64<<20 && sparse.compare(0, 4, "head")==0 && sparse.compare(32<<20, 6, "middle")==0 && sparse.compare((64<<20)-4, 4, "tail")==0);
+	CHECK(!stat((d+"/sparse.copy").c_str(), &st) && st.st_blocks*512<(1<<20));
+
+	// trees: directories, files and links, also into a directory of the tree itself
+	utils::mkdir_p(d+"/tree/a/b");
+	utils::dumpToFile(d+"/tree/top.txt", std::string("top"));
+	utils::dumpToFile(d+"/tree/a/b/deep.txt", std::string("deep"));
+	CHECK(!symlink("a/b/deep.txt", (d+"/tree/link").c_str()));
+	CHECK(utils::copyTree(d+"/tree", d+"/copy")==3);
+	CHECK(utils::slurpTextFile(d+"/copy/a/b/deep.txt")=="deep" && utils::slurpTextFile(d+"/copy/link")=="deep");
+	char target[64]={0};
+	CHECK(readlink((d+"/copy/link").c_str(), target, sizeof(target))>0 && std::string(target)=="a/b/deep.txt");
+	CHECK(utils::copyTree(d+"/tree", d+"/tree/a/self")==3 && !utils::isFileSystemObject(d+"/tree/a/self/a/self"));
+
+	utils::moveFile(d+"/copy", d+"/moved");
+	CHECK(!utils::isFileSystemObject(d+"/copy") && utils::slurpTextFile(d+"/moved/top.txt")=="top");
+	// across file systems the tree is copied, then deleted
+	struct stat shm, tmp;
+	if (!stat("/dev/shm", &shm) && !stat(dir, &tmp) && shm.st_dev!=tmp.st_dev) {
+		std::string away=std::string("/dev/shm/")+(dir+5);
+		utils::moveFile(d+"/moved", away);
+		CHECK(!utils::isFileSystemObject(d+"/moved") && utils::slurpTextFile(away+"/a/b/deep.txt")=="deep");
+		utils::moveFile(away+"/top.txt", d+"/top.txt");
+		CHECK(utils::slurpTextFile(d+"/top.txt")=="top" && !utils::isFileSystemObject(away+"/top.txt"));
+		utils::removeTree(away);
+		CHECK(!utils::isFileSystemObject(away));
+	}
+
+	utils::removeTree(d);
+	CHECK(!utils::isFileSystemObject(d));
+	utils::removeTree(d);
+	return 0;
+}
@@ -2,6 +2,7 @@
 #include <string>
 
 #include <jsonutils.h>
+#include <procstats.h>
 #include <utils.h>
 #include <libgen.h>
 #include <math.h>
@@ -10,9 +11,9 @@
 
 
 int main() {
-	std::string log;
-	utils::sh("lsof -b -n -P -p $PPID", &log, nullptr);
-	std::cout<<"lsof:\n"<<log<<std::endl;
+	utils::ProcStats stats;
+	std::cout<<"open descriptors:"<<std::endl;
+	for (auto& d : stats.descriptors()) std::cout<<d.first<<"\t"<<d.second<<std::endl;
 
 
 	std::string name="aaa/", dir, base;
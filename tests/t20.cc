@@ -0,0 +1,97 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+#include <linereader.h>
+#include <utils.h>
+#include "check.h"
+
+static std::vector<std::string> all(utils::LineReader& r) {
+	std::vector<std::string> v;
+	for (std::string_view l;r.next(l);) v.emplace_back(l);
+	return v;
+}
+
+int main() {
+	{
+		utils::LineReader r(std::string_view("a\nb\r\n\nlast"));
+		auto v=all(r);
+		CHECK(v.size()==4 && v[0]=="a" && v[1]=="b" && v[2]=="" && v[3]=="last" && r.lineNumber()==4);
+		std::string_view l;
+		CHECK(!r.next(l));
+		utils::LineReader one(std::string_view("x\n"));
+		CHECK(all(one).size()==1);
+		utils::LineReader none(std::string_view(""));
+		CHECK(all(none).empty());
+	}
+
+	// lines of every length around the block and buffer sizes, some far longer than a buffer
+	std::vector<std::string> expected;
+	std::string text;
+	uint64_t x=12345;
+	for (int i=0;i<3000;++i) {
+		x^=x<<13;
+		x^=x>>7;
+		x^=x<<17;
+		size_t len=i%97==0 ? 4096*3+x%5000 : x%150;
+		std::string line(len, 0);
+		for (size_t k=0;k<len;++k) line[k]='a'+(k+i)%26;
+		expected.push_back(line);
+		text+=line;
+		text+=i%5==0 ? "\r\n" : "\n";
+	}
+	text+="no newline at the end";
+	expected.push_back("no newline at the end");
+
+	char dir[]="/tmp/cpputils_t20_XXXXXX";
+	CHECK(mkdtemp(dir));
+	std::string file=std::string(dir)+"/lines.txt";
+	utils::dumpToFile(file, text);
+	for (bool map : {false, true}) {
+		utils::LineReader::Options o;
+		o.bufferBytes=4096;
+		o.map=map;
+		utils::LineReader r(file, o);
+		CHECK(all(r)==expected && r.lineNumber()==expected.size());
+	}
+	{
+		utils::LineReader big(file);
+		CHECK(all(big)==expected);
+		utils::LineReader memory{std::string_view(text)};
+		CHECK(all(memory)==expected);
+	}
+	{
+		// a pipe delivers in small pieces
+		int p[2];
+		CHECK(!pipe(p));
+		std::thread writer([&]() {
+			utils::FD w(p[1]);
+			for (size_t off=0;off<text.size();off+=777) {
+				if (::write(w, text.data()+off, std::min<size_t>(777, text.size()-off))<0) return;
+			}
+		});
+		utils::LineReader::Options o;
+		o.bufferBytes=4096;
+		utils::LineReader r(utils::FD(p[0]), o);
+		auto v=all(r);
+		writer.join();
+		CHECK(v==expected);
+	}
+
+	std::vector<std::string_view> fields;
+	CHECK(utils::splitFields("a\tb\t\tc", '\t', fields)==4 && fields[0]=="a" && fields[2]=="" && fields[3]=="c");
+	CHECK(utils::splitFields("", '\t', fields)==1 && fields[0].empty());
+	CHECK(utils::splitFields("x\t", '\t', fields)==2 && fields[0]=="x" && fields[1]=="");
+
+	bool exPassed=false;
+	try {
+		utils::LineReader r(std::string(dir)+"/missing.txt");
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+	unlink(file.c_str());
+	rmdir(dir);
+	return 0;
+}
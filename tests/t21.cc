@@ -0,0 +1,130 @@
+#include <iostream>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <compress.h>
+#include <filecopy.h>
+#include <utils.h>
+#include "check.h"
+
+static std::string ndjson(int n) {
+	std::string s;
+	for (int i=0;i<n;++i) {
+		s+="{\"id\":"+std::to_string(i)+",\"name\":\"user"+std::to_string(i%977)+"\",\"tags\":[\"a\",\"b\"]}\n";
+		if (i%1000==0) s+="\n";
+	}
+	return s;
+}
+
+static bool throws(const std::function<void()>& f) {
+	try {
+		f();
+	} catch (const std::exception& e) {
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+		return true;
+	}
+	return false;
+}
+
+int main() {
+	char dir[]="/tmp/cpputils_t21_XXXXXX";
+	CHECK(mkdtemp(dir));
+	std::string d=dir;
+	std::string text=ndjson(30000);
+
+	for (auto c : {utils::Compression::NONE, utils::Compression::GZIP, utils::Compression::ZLIB, utils::Compression::ZSTD}) {
+		std::string file=d+"/data."+utils::compressionName(c);
+		utils::CompressWriter::Options o;
+		o.compression=c;
+		o.level=c==utils::Compression::GZIP ? 1 : -1;
+		if (!utils::compressionSupported(c)) {
+			CHECK(throws([&]() {utils::dumpToCompressedFile(file, text, o);}));
+			continue;
+		}
+		{
+			utils::CompressWriter out(file, o);
+			// in uneven pieces, one larger than the writer's buffer
+			size_t off=0;
+			for (size_t k=1;off<text.size();k=k*3+1) {
+				size_t n=std::min(k, text.size()-off);
+				out.write(text.data()+off, n);
+				off+=n;
+			}
+			out.close();
+			CHECK(out.uncompressedBytes()==text.size());
+			CHECK(c==utils::Compression::NONE ? out.compressedBytes()==text.size() : out.compressedBytes()<text.size()/4);
+		}
+		CHECK(utils::slurpCompressedFile(file)==text);
+		for (bool readAhead : {false, true}) {
+			utils::DecompressReader::Options ro;
+			ro.chunkBytes=4096;
+			ro.readAhead=readAhead;
+			utils::DecompressReader in(file, ro);
+			CHECK(in.compression()==c);
+			size_t n=0;
+			long long sum=0;
+			CHECK(json::forEachLine(in, [&](const json::jsonptr& j) {sum+=json::getLong(j.get(), "id");++n;})==30000);
+			CHECK(n==30000 && sum==30000LL*29999/2);
+		}
+	}
+
+	utils::dumpToFile(d+"/empty", std::string());
+	CHECK(utils::slurpCompressedFile(d+"/empty").empty());
+	utils::dumpToFile(d+"/short", std::string("x"));
+	CHECK(utils::slurpCompressedFile(d+"/short")=="x");
+	// a reader dropped early while its read-ahead waits on a pipe that stays open
+	{
+		int p[2];
+		CHECK(!pipe2(p, O_CLOEXEC));
+		utils::FD w(p[1]);
+		CHECK(::write(w, "plain text", 10)==10);
+		utils::DecompressReader::Options ro;
+		ro.readAhead=true;
+		utils::DecompressReader in(utils::FD(p[0]), ro);
+		CHECK(in.compression()==utils::Compression::NONE);
+		// the read-ahead fills its first chunk and is left waiting for more
+		::usleep(20000);
+	}
+	if (!utils::compressionSupported(utils::Compression::GZIP)) {
+		utils::removeTree(d);
+		return 0;
+	}
+
+	// text that happens to start with a valid zlib header is passed through
+	std::string caret="x^2 + y^2 = r^2\n";
+	CHECK(utils::detectCompression(caret.data(), caret.size())==utils::Compression::ZLIB);
+	utils::dumpToFile(d+"/caret.txt", caret);
+	CHECK(utils::slurpCompressedFile(d+"/caret.txt")==caret);
+
+	// gzip's own output, several members in a row, and ours read back by gzip
+	std::string out, err;
+	std::string plain=d+"/data.none", gz=d+"/data.gzip";
+	CHECK(!utils::sh(("gzip -c "+plain+" >"+d+"/two.gz && gzip -c "+plain+" >>"+d+"/two.gz").c_str(), &out, &err));
+	CHECK(utils::slurpCompressedFile(d+"/two.gz")==text+text);
+	CHECK(!utils::sh(("gzip -dc "+gz+" >"+d+"/back.txt").c_str(), &out, &err));
+	CHECK(utils::slurpTextFile(d+"/back.txt")==text);
+
+	// one document parsed as it streams
+	std::string doc="{\"items\":[";
+	for (int i=0;i<20000;++i) doc+=(i ? ",":"")+std::to_string(i);
+	doc+="]}";
+	utils::CompressWriter::Options zo;
+	utils::dumpToCompressedFile(d+"/doc.json.gz", doc, zo);
+	auto j=json::parseFile(d+"/doc.json.gz");
+	CHECK(json_array_size(json::getChild(j, "items"))==20000);
+
+	// broken input
+	std::string packed=utils::slurpTextFile(gz);
+	utils::dumpToFile(d+"/cut.gz", packed.substr(0, packed.size()/2));
+	CHECK(throws([&]() {utils::slurpCompressedFile(d+"/cut.gz");}));
+	std::string bad=packed;
+	for (size_t k=100;k<200;++k) bad[k]^=0x5a;
+	utils::dumpToFile(d+"/bad.gz", bad);
+	CHECK(throws([&]() {json::forEachLine(d+"/bad.gz", [](const json::jsonptr&) {});}));
+	utils::dumpToCompressedFile(d+"/doc.bad.gz", std::string("{\"a\":1}\n{\"b\":\n"), zo);
+	CHECK(throws([&]() {json::forEachLine(d+"/doc.bad.gz", [](const json::jsonptr&) {});}));
+	CHECK(throws([&]() {json::parseFile(d+"/missing.gz");}));
+
+	utils::removeTree(d);
+	return 0;
+}
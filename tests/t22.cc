@@ -0,0 +1,143 @@
+#include <iostream>
+#include <thread>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <reactor.h>
+#include <utils.h>
+#include "check.h"
+
+int main() {
+	{
+		// timers at every scale fire at their tick, in order, also when added while running
+		utils::TimerWheel w(5);
+		std::vector<std::pair<uint64_t, uint64_t>> fired;
+		std::vector<utils::TimerWheel::Id> ids;
+		uint64_t x=777;
+		for (int i=0;i<5000;++i) {
+			x^=x<<13;
+			x^=x>>7;
+			x^=x<<17;
+			uint64_t t=6+(i%4==3 ? x%40000000 : x%(64<<(x%19)));
+			ids.push_back(w.add(t, [&, t]() {fired.emplace_back(t, w.now());}));
+		}
+		size_t cancelled=0;
+		for (size_t i=0;i<ids.size();i+=3) cancelled+=w.cancel(ids[i]);
+		CHECK(!w.cancel(ids[0]) && w.size()==5000-cancelled);
+		int ticks=0;
+		auto every=w.add(100, [&]() {
+			if (++ticks==5) w.add(w.now()+64, [&]() {fired.emplace_back(w.now(), w.now());});
+		}, 1000);
+		w.advance(50000000);
+		CHECK(fired.size()==5000-cancelled+1);
+		for (size_t i=0;i<fired.size();++i) {
+			CHECK(fired[i].first==fired[i].second);
+			CHECK(!i || fired[i-1].second<=fired[i].second);
+		}
+		CHECK(w.cancel(every) && w.size()==0 && w.nextTick()==UINT64_MAX && ticks==50000);
+		w.add(1, []() {});
+		CHECK(w.nextTick()==50000001);
+	}
+
+	utils::Reactor r;
+	{
+		// many pipes, some removed from within another's handler
+		const int N=2000;
+		std::vector<utils::FD> readers(N), writers(N);
+		std::vector<int> got(N, 0);
+		for (int i=0;i<N;++i) {
+			int p[2];
+			CHECK(!pipe2(p, O_NONBLOCK | O_CLOEXEC));
+			readers[i]=p[0];
+			writers[i]=p[1];
+		}
+		for (int i=0;i<N;++i) {
+			r.add(readers[i], utils::Reactor::READ, [&, i](uint32_t) {
+				char b[64];
+				while (::read(readers[i], b, sizeof(b))>0) ++got[i];
+				if (i%2==0 && i+1<N) r.remove(readers[i+1]);
+			});
+		}
+		CHECK(r.size()==N);
+		for (int i=0;i<N;++i) CHECK(::write(writers[i], "x", 1)==1);
+		while (r.size()>N/2) {
+			size_t before=r.size();
+			r.runOnce(0);
+			if (r.size()==before) break;
+		}
+		for (int round=0;round<3;++round) r.runOnce(0);
+		int seen=0;
+		for (int i=0;i<N;++i) seen+=got[i];
+		CHECK(seen>=N/2 && seen<N);
+		for (int i=0;i<N;i+=2) CHECK(got[i]==1);
+		for (int i=0;i<N;++i) r.remove(readers[i]);
+		CHECK(r.size()==0);
+	}
+	{
+		// timers and signals
+		auto start=utils::clock();
+		int n=0;
+		bool late=false, signalled=false;
+		utils::Reactor::TimerId t=r.every(5000, [&]() {++n;});
+		auto never=r.after(1000000, [&]() {late=true;});
+		r.after(30000, [&]() {
+			r.cancel(t);
+			r.cancel(never);
+			raise(SIGUSR1);
+		});
+		r.onSignal(SIGUSR1, [&](const signalfd_siginfo& si) {
+			signalled=si.ssi_signo==SIGUSR1;
+			r.stop();
+		});
+		r.run();
+		uint64_t us=utils::microseconds(start);
+		std::cout<<"ticks: "<<n<<" in "<<us<<" us"<<std::endl;
+		// only lower bounds: a loaded machine runs the loop late, never early
+		CHECK(signalled && !late && n>=2 && us>=30000);
+	}
+	{
+		// children
+		pid_t pid;
+		const char* argv[]={"sh", "-c", "sleep 0.05; exit 3", NULL};
+		CHECK(!posix_spawn(&pid, "/bin/sh", NULL, NULL, (char**)argv, environ));
+		int status=-1;
+		r.onExit(pid, [&](int s) {
+			status=s;
+			r.stop();
+		});
+		r.run();
+		CHECK(WIFEXITED(status) && WEXITSTATUS(status)==3);
+		CHECK(::waitpid(pid, &status, WNOHANG)<0);
+	}
+	{
+		// calls from other threads
+		int sum=0;
+		std::thread t([&]() {
+			for (int i=1;i<=100;++i) r.post([&, i]() {sum+=i;});
+			r.post([&]() {r.stop();});
+		});
+		r.run();
+		t.join();
+		CHECK(sum==5050);
+		std::thread s([&]() {r.stop();});
+		s.join();
+		r.run();
+	}
+	{
+		// sh on the reactor: both streams larger than a pipe's buffer
+		std::string out, err;
+		int status=utils::sh("head -c 300000 /dev/zero; head -c 200000 /dev/zero >&2; exit 7", &out, &err);
+		CHECK(out.size()==300000 && err.size()==200000 && WEXITSTATUS(status)==7);
+		CHECK(utils::sh("echo hi", &out, nullptr)==0);
+	}
+
+	bool exPassed=false;
+	try {
+		r.add(-1, utils::Reactor::READ, [](uint32_t) {});
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+	return 0;
+}
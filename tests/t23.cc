@@ -0,0 +1,156 @@
+#include <iostream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <jsonutils.h>
+#include <procstats.h>
+#include <utils.h>
+#include "check.h"
+
+// sends request to the socket at path and returns everything until the server closes
+static std::string ask(const std::string& path, const std::string& request) {
+	utils::FD fd(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+	sockaddr_un a;
+	memset(&a, 0, sizeof(a));
+	a.sun_family=AF_UNIX;
+	memcpy(a.sun_path, path.data(), path.size());
+	socklen_t len=offsetof(sockaddr_un, sun_path)+path.size();
+	if (path[0]=='@') a.sun_path[0]=0;
+	else ++len;
+	if (::connect(fd, (sockaddr*)&a, len)) utils::errno_exception("connect "+path);
+	if (::write(fd, request.data(), request.size())<0) utils::errno_exception("write");
+	::shutdown(fd, SHUT_WR);
+	std::string out;
+	char b[4096];
+	for (ssize_t n;(n=::read(fd, b, sizeof(b)))>0;) out.append(b, n);
+	return out;
+}
+
+int main() {
+	char dir[]="/tmp/cpputils_t23_XXXXXX";
+	CHECK(mkdtemp(dir));
+	std::string d=dir;
+
+	utils::ProcStats stats;
+	utils::ProcSample a, b;
+	stats.sample(a);
+	CHECK(a.residentBytes>0 && a.virtualBytes>=a.residentBytes && a.threads>=1 && a.fds>=3 && a.maxFds>=a.fds);
+	CHECK(a.startTimeSeconds>1000000000 && a.startTimeSeconds<=a.timeMicroseconds/1000000+1);
+
+	std::vector<utils::FD> extra;
+	for (int i=0;i<10;++i) extra.emplace_back(::open("/dev/null", O_RDONLY | O_CLOEXEC));
+	// touch fresh memory, burn some CPU, write a file
+	size_t size=32<<20;
+	char* m=(char*)malloc(size);
+	for (size_t i=0;i<size;i+=4096) m[i]=(char)i;
+	volatile uint64_t x=1;
+	auto start=utils::clock();
+	while (utils::microseconds(start)<30000) x=x*31+1;
+	utils::dumpToFile(d+"/out.bin", m, 1<<20);
+	stats.sample(b);
+	std::cout<<"rss "<<a.residentBytes<<" -> "<<b.residentBytes<<", minor faults "<<a.minorFaults<<" -> "<<b.minorFaults
+			<<", cpu us "<<a.userMicroseconds+a.systemMicroseconds<<" -> "<<b.userMicroseconds+b.systemMicroseconds
+			<<", switches "<<b.voluntarySwitches<<"/"<<b.involuntarySwitches<<", fds "<<a.fds<<" -> "<<b.fds<<std::endl;
+	CHECK(b.fds==a.fds+10);
+	CHECK(b.minorFaults>=a.minorFaults+size/4096/2 && b.residentBytes>a.residentBytes+size/2 && b.peakResidentBytes>=b.residentBytes);
+	CHECK(b.userMicroseconds+b.systemMicroseconds>a.userMicroseconds+a.systemMicroseconds);
+	CHECK(b.writeChars>=a.writeChars+(1<<20) || !utils::isFileSystemObject("/proc/self/io"));
+	free(m);
+	bool listed=false;
+	for (auto& e : stats.descriptors()) listed|=e.first==extra[3].fd && e.second=="/dev/null";
+	CHECK(listed);
+	extra.clear();
+
+	{
+		// another process: our descriptor numbers are its own there, none is skipped
+		int p[2];
+		CHECK(!pipe2(p, O_CLOEXEC));
+		std::vector<utils::FD> nulls;
+		for (int i=0;i<8;++i) nulls.emplace_back(::open("/dev/null", O_RDONLY | O_CLOEXEC));
+		pid_t child=fork();
+		if (!child) {
+			::close(p[1]);
+			char c;
+			while (::read(p[0], &c, 1)<0 && errno==EINTR);
+			_exit(0);
+		}
+		CHECK(child>0);
+		// freed here, so the ProcStats descriptors reuse numbers the child still has open
+		nulls.clear();
+		utils::ProcStats other(child);
+		auto list=other.descriptors();
+		utils::ProcSample s;
+		other.sample(s);
+		size_t seen=0, direct=0;
+		for (auto& e : list) seen+=e.second=="/dev/null";
+		DIR* d=opendir(("/proc/"+std::to_string(child)+"/fd").c_str());
+		while (dirent* e=d ? readdir(d) : nullptr) direct+=e->d_name[0]!='.';
+		if (d) closedir(d);
+		::close(p[0]);
+		::close(p[1]);
+		waitpid(child, nullptr, 0);
+		CHECK(seen>=8 && s.fds==direct && list.size()==direct);
+	}
+
+	{
+		utils::MetricsExporter::Options o;
+		o.socketPath=d+"/metrics.sock";
+		o.sampleMicroseconds=10000;
+		utils::MetricsExporter exporter(o);
+		auto& requests=exporter.counter("requests_total", "Requests served");
+		auto& queue=exporter.gauge("queue_depth", "Items waiting");
+		CHECK(&exporter.counter("requests_total", "again")==&requests);
+		requests.add(3);
+		queue.set(-2);
+
+		auto j=json::parse(ask(o.socketPath, "json\n"));
+		CHECK(json::getLong(j.get(), "requests_total")==3 && json::getLong(j.get(), "queue_depth")==-2);
+		CHECK(json::getLong(j.get(), "process_open_fds")>=3 && json::getNumber(j.get(), "process_resident_memory_bytes")>0);
+
+		std::string text=ask(o.socketPath, "\n");
+		CHECK(text.find("# TYPE process_cpu_seconds_total counter\nprocess_cpu_seconds_total ")!=std::string::npos);
+		CHECK(text.find("\nrequests_total 3\n")!=std::string::npos && text.find("\nqueue_depth -2\n")!=std::string::npos);
+
+		requests.add();
+		std::string http=ask(o.socketPath, "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+		CHECK(http.compare(0, 17, "HTTP/1.0 200 OK\r\n")==0 && http.find("\nrequests_total 4\n")!=std::string::npos);
+		http=ask(o.socketPath, "GET /metrics.json HTTP/1.1\r\n\r\n");
+		CHECK(http.find("application/json")!=std::string::npos && http.find("\"requests_total\":4")!=std::string::npos);
+
+		bool exPassed=false;
+		try {
+			exporter.gauge("requests_total", "");
+		} catch (const std::exception& e) {
+			exPassed=true;
+			std::cout<<"Correct ex: "<<e.what()<<std::endl;
+		}
+		CHECK(exPassed);
+		exPassed=false;
+		try {
+			exporter.counter("bad-name", "");
+		} catch (const std::exception& e) {
+			exPassed=true;
+			std::cout<<"Correct ex: "<<e.what()<<std::endl;
+		}
+		CHECK(exPassed);
+	}
+	CHECK(!utils::isFileSystemObject(d+"/metrics.sock"));
+	{
+		utils::MetricsExporter::Options o;
+		o.socketPath="@cpputils_t23_"+std::to_string(getpid());
+		utils::MetricsExporter exporter(o);
+		CHECK(json::getLong(json::parse(ask(o.socketPath, "json")).get(), "process_threads")>=1);
+	}
+	{
+		utils::MetricsExporter::Options o;
+		utils::MetricsExporter quiet(o);
+		CHECK(quiet.prometheus().find("process_max_fds ")!=std::string::npos);
+	}
+	unlink((d+"/out.bin").c_str());
+	rmdir(dir);
+	return 0;
+}
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <time.h>
+#include <jsonutils.h>
+#include <profiler.h>
+#include <utils.h>
+#include "check.h"
+
+static volatile uint64_t sink;
+
+static uint64_t cpuMicroseconds() {
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+
+// static and not inlined, so only the executable's own symbol table names them; spins
+// for CPU time, so a loaded machine still gets samples of them. They keep frame pointers
+// for the profiler's frame pointer walk
+#define SPIN __attribute__((noinline, optimize("no-omit-frame-pointer")))
+
+static SPIN void spinInner(uint64_t us) {
+	uint64_t start=cpuMicroseconds();
+	uint64_t x=1;
+	while (cpuMicroseconds()-start<us) {
+		for (int i=0;i<1000;++i) x=x*6364136223846793005ULL+1;
+	}
+	sink=x;
+}
+
+static SPIN void spinOuter(uint64_t us) {
+	spinInner(us);
+	sink=sink+1;
+}
+
+static SPIN void spinOther(uint64_t us) {
+	spinInner(us);
+	sink=sink+2;
+}
+
+static uint64_t processCpuMicroseconds() {
+	timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+
+// spins in 10ms steps until the profiler has taken n samples, dropped ones included; at
+// a rate of 100 Hz or more that takes well under limitUs of process CPU, so hitting the
+// limit means samples went missing
+static void spinUntil(void (*spin)(uint64_t), uint64_t n, uint64_t limitUs) {
+	uint64_t start=processCpuMicroseconds();
+	for (;;) {
+		auto s=utils::Profiler::stats();
+		if (s.samples+s.dropped>=n || processCpuMicroseconds()-start>=limitUs) return;
+		spin(10000);
+	}
+}
+
+int main() {
+	utils::Profiler::Options o;
+	o.hz=1000;
+	o.threads=true;
+	utils::Profiler::start(o);
+	CHECK(utils::Profiler::running());
+	bool exPassed=false;
+	try {
+		utils::Profiler::folded();
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+	exPassed=false;
+	try {
+		utils::Profiler::start(100);
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+
+	std::thread background([]() {
+		pthread_setname_np(pthread_self(), "t24-other");
+		spinUntil(spinOther, 100, 4000000);
+	});
+	spinUntil(spinOuter, 100, 4000000);
+	background.join();
+	utils::Profiler::stop();
+	CHECK(!utils::Profiler::running());
+
+	auto stats=utils::Profiler::stats();
+	std::string folded=utils::Profiler::folded();
+	std::cout<<"samples "<<stats.samples<<", dropped "<<stats.dropped<<std::endl;
+	std::cout<<folded.substr(0, 600)<<std::endl;
+	CHECK(stats.samples>=100 && stats.dropped==0);
+	uint64_t total=0, outer=0, other=0;
+	for (size_t at=0;at<folded.size();) {
+		size_t nl=folded.find('\n', at);
+		CHECK(nl!=std::string::npos);
+		std::string line=folded.substr(at, nl-at);
+		size_t space=line.rfind(' ');
+		CHECK(space!=std::string::npos && space>0);
+		uint64_t n=std::stoull(line.substr(space+1));
+		total+=n;
+		if (line.find(";spinOuter(unsigned long);spinInner(unsigned long)")!=std::string::npos) outer+=n;
+		if (line.compare(0, 10, "t24-other ")==0 && line.find(";spinOther(unsigned long)")!=std::string::npos && line.find(";spinInner(unsigned long)")!=std::string::npos) other+=n;
+		CHECK(line.compare(0, 4, "t24 ")==0 || line.compare(0, 10, "t24-other ")==0);
+		at=nl+1;
+	}
+	std::cout<<"outer "<<outer<<", other "<<other<<" of "<<total<<std::endl;
+	CHECK(total==stats.samples);
+	// both threads spin until the total is reached, and the CPU is shared between them
+	CHECK(outer>=10 && other>=10);
+
+	auto j=json::parse(utils::Profiler::json());
+	CHECK(std::string(json::getString(j.get(), "name"))=="all" && (uint64_t)json::getLong(j.get(), "value")==total);
+	CHECK(json_array_size(json_object_get(j.get(), "children"))>=1);
+
+	// a buffer with room for a few stacks
+	o.hz=1000;
+	o.threads=false;
+	o.bufferBytes=1;
+	utils::Profiler::start(o);
+	spinUntil(spinOuter, 50, 4000000);
+	utils::Profiler::stop();
+	stats=utils::Profiler::stats();
+	CHECK(stats.samples>=1 && stats.samples<=10 && stats.dropped>=1 && stats.samples+stats.dropped>=50);
+	folded=utils::Profiler::folded();
+	CHECK(std::count(folded.begin(), folded.end(), '\n')<=(long)stats.samples);
+	CHECK(folded.find(";spinOuter(unsigned long)")!=std::string::npos);
+
+	// the frame pointer walk gets the callers of functions that keep frame pointers
+	o.bufferBytes=16<<20;
+	o.framePointers=true;
+	utils::Profiler::start(o);
+	spinUntil(spinOuter, 50, 4000000);
+	utils::Profiler::stop();
+	stats=utils::Profiler::stats();
+	CHECK(stats.samples>=50 && stats.dropped==0);
+	folded=utils::Profiler::folded();
+	outer=0;
+	for (size_t at=0;at<folded.size();) {
+		size_t nl=folded.find('\n', at);
+		std::string line=folded.substr(at, nl-at);
+		if (line.find(";spinOuter(unsigned long);spinInner(unsigned long)")!=std::string::npos) outer+=std::stoull(line.substr(line.rfind(' ')+1));
+		at=nl+1;
+	}
+	std::cout<<"frame pointers: outer "<<outer<<" of "<<stats.samples<<std::endl;
+	CHECK(outer>=stats.samples/2);
+
+	// the lowest rate has a period of a whole second
+	utils::Profiler::start(1);
+	CHECK(utils::Profiler::running());
+	utils::Profiler::stop();
+
+	// idle: no CPU, no samples, and sleeping is not disturbed
+	utils::Profiler::start(1000);
+	auto start=utils::clock();
+	::usleep(50000);
+	CHECK(utils::microseconds(start)>=50000);
+	utils::Profiler::stop();
+	CHECK(utils::Profiler::stats().samples<=5);
+	return 0;
+}
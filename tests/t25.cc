@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <filecopy.h>
+#include <hash.h>
+#include <utils.h>
+#include "check.h"
+
+// one bit at a time, the definition
+static uint32_t crcReference(const uint8_t* p, size_t len, uint32_t crc=0) {
+	crc=~crc;
+	while (len--) {
+		crc^=*p++;
+		for (int k=0;k<8;++k) crc=(crc>>1)^(0x82f63b78 & (0-(crc & 1)));
+	}
+	return ~crc;
+}
+
+static size_t entries(const std::string& dir) {
+	size_t n=0;
+	DIR* d=opendir(dir.c_str());
+	while (dirent* e=readdir(d)) n+=e->d_name[0]!='.';
+	closedir(d);
+	return n;
+}
+
+int main() {
+	std::cout<<"crc32c in hardware: "<<utils::crc32cHardware()<<std::endl;
+	std::string data(40000, 0);
+	uint64_t x=88172645463325252ULL;
+	for (char& c : data) {
+		x^=x<<13;
+		x^=x>>7;
+		x^=x<<17;
+		c=(char)x;
+	}
+	const uint8_t* bytes=(const uint8_t*)data.data();
+	// every alignment, lengths around the three-stream blocks, and running pieces
+	for (size_t offset=0;offset<9;++offset) {
+		for (size_t len : {0, 1, 7, 8, 15, 100, 3071, 3072, 3073, 6144, 9000, 39000}) {
+			CHECK(utils::crc32c(bytes+offset, len)==crcReference(bytes+offset, len));
+		}
+	}
+	for (size_t cut : {1, 1000, 3072, 20001}) {
+		CHECK(utils::crc32c(bytes+cut, data.size()-cut, utils::crc32c(bytes, cut))==crcReference(bytes, data.size()));
+	}
+	CHECK(utils::crc32c("123456789", 9, 0xffffffff)==crcReference((const uint8_t*)"123456789", 9, 0xffffffff));
+
+	char dir[]="/tmp/cpputils_t25_XXXXXX";
+	CHECK(mkdtemp(dir));
+	std::string d=dir, f=d+"/out.bin";
+	utils::dumpToFile(f, data);
+	CHECK(utils::hashFile(f)==utils::hash64(data) && utils::hashFile(f, 5)==utils::hash64(data, 5));
+	CHECK(utils::crc32cFile(f)==utils::crc32c(data));
+	utils::dumpToFile(d+"/empty", "", 0);
+	CHECK(utils::hashFile(d+"/empty")==utils::hash64("", 0) && utils::crc32cFile(d+"/empty")==0);
+	{
+		// a pipe is read to its end
+		int p[2];
+		CHECK(!pipe(p));
+		utils::FD r(p[0]);
+		{
+			utils::FD w(p[1]);
+			CHECK(::write(w, data.data(), 30000)==30000);
+		}
+		CHECK(utils::crc32cFile(r)==utils::crc32c(data.data(), 30000));
+	}
+	// a stream is hashed piece by piece as it arrives, to the same result
+	std::string big=data;
+	while (big.size()<(3<<20)) big+=big;
+	for (size_t len : {0, 1, 16, 17, 48, 49, 50, 96, 97, 1000, 40000, 3<<20}) {
+		int p[2];
+		CHECK(!pipe(p));
+		utils::FD r(p[0]);
+		std::thread writer([&, len]() {
+			utils::FD w(p[1]);
+			static const size_t pieces[]={1, 7, 48, 49, 13, 200, 65536, 3};
+			for (size_t at=0, k=0;at<len;++k) {
+				size_t n=std::min(pieces[k%8], len-at);
+				if (::write(w, big.data()+at, n)!=(ssize_t)n) break;
+				at+=n;
+			}
+		});
+		uint64_t h=utils::hashFile(r, 9);
+		writer.join();
+		CHECK(h==utils::hash64(big.data(), len, 9));
+	}
+
+	// unchanged content leaves the file alone
+	CHECK(::chmod(f.c_str(), 0640)==0);
+	struct stat before, after;
+	CHECK(!::stat(f.c_str(), &before));
+	CHECK(!utils::dumpToFileIfChanged(f, data));
+	CHECK(!::stat(f.c_str(), &after));
+	CHECK(after.st_ino==before.st_ino && after.st_mtim.tv_nsec==before.st_mtim.tv_nsec && after.st_mtim.tv_sec==before.st_mtim.tv_sec);
+
+	// a changed byte or size replaces it with a new file, keeping the permissions
+	std::string changed=data;
+	changed[23456]^=1;
+	CHECK(utils::dumpToFileIfChanged(f, changed, true));
+	CHECK(!::stat(f.c_str(), &after));
+	CHECK(after.st_ino!=before.st_ino && (after.st_mode & 07777)==0640);
+	CHECK(utils::slurpTextFile(f)==changed);
+	CHECK(utils::dumpToFileIfChanged(f, changed.substr(1)));
+	CHECK(utils::hashFile(f)==utils::hash64(changed.substr(1)));
+	CHECK(utils::dumpToFileIfChanged(d+"/new", "x", 1) && !utils::dumpToFileIfChanged(d+"/new", "x", 1));
+	utils::dumpToFileAtomic(d+"/new", std::string("yz"));
+	CHECK(utils::slurpTextFile(d+"/new")=="yz");
+	CHECK(entries(d)==3);
+
+	bool exPassed=false;
+	try {
+		utils::dumpToFileAtomic(d+"/missing/dir/file", data);
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+	exPassed=false;
+	try {
+		utils::hashFile(d+"/missing");
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+	utils::removeTree(d);
+	return 0;
+}
@@ -0,0 +1,177 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <jsonutils.h>
+#include <shmring.h>
+#include <utils.h>
+#include "check.h"
+
+int main() {
+	{
+		utils::ShmRing ring(5000);
+		CHECK(ring.capacity()==8192 && ring.maxMessage()==4096-16);
+		// sizes that make records wrap, so padding gets used, checked in order
+		uint64_t x=1;
+		std::vector<std::string> sent;
+		size_t next=0;
+		utils::ShmRing::Message m;
+		for (int i=0;i<3000;++i) {
+			x=x*6364136223846793005ULL+1442695040888963407ULL;
+			std::string s((x>>33)%(i%10==0 ? 4000 : 300), 0);
+			for (size_t k=0;k<s.size();++k) s[k]=(char)(x>>(k%56));
+			while (!ring.tryPush(s.data(), s.size(), i%7)) {
+				CHECK(ring.tryPop(m) && m.view()==sent[next] && m.kind()==next%7);
+				m.release();
+				++next;
+			}
+			sent.push_back(s);
+		}
+		while (ring.tryPop(m)) {
+			CHECK(m.view()==sent[next] && m.kind()==next%7);
+			++next;
+		}
+		CHECK(next==sent.size() && !m);
+
+		// a view held back keeps its room until it is released
+		std::string big(3000, 'b');
+		CHECK(ring.tryPush(big) && ring.tryPush(big));
+		utils::ShmRing::Message first, second;
+		CHECK(ring.tryPop(first) && ring.tryPop(second));
+		second.release();
+		CHECK(!ring.tryPush(big));
+		first.release();
+		CHECK(ring.tryPush(big));
+		CHECK(ring.tryPop(first) && first.size()==3000);
+		first.release();
+		while (ring.tryPop(first)) {}
+
+		auto start=utils::clock();
+		CHECK(!ring.pop(m, 20000));
+		CHECK(utils::microseconds(start)>=20000);
+
+		bool exPassed=false;
+		try {
+			ring.tryPush(std::string(5000, 'x'));
+		} catch (const std::exception& e) {
+			exPassed=true;
+			std::cout<<"Correct ex: "<<e.what()<<std::endl;
+		}
+		CHECK(exPassed);
+	}
+
+	{
+		// another process gets the ring over a socket and sends JSON, text and CBOR
+		int sv[2];
+		CHECK(!socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv));
+		utils::FD mine(sv[0]), theirs(sv[1]);
+		const int N=20000;
+		pid_t pid=fork();
+		CHECK(pid>=0);
+		if (!pid) {
+			try {
+				utils::ShmRing peer(utils::receiveFd(theirs));
+				for (int i=0;i<N;++i) {
+					auto j=json::parse("{\"i\": 0, \"name\": \"message\", \"list\": [1, 2, 3]}");
+					json_object_set_new(j.get(), "i", json_integer(i));
+					if (!peer.pushJson(j.get(), i%2)) _exit(2);
+				}
+				peer.close();
+			} catch (const std::exception& e) {
+				std::cout<<"child: "<<e.what()<<std::endl;
+				_exit(1);
+			}
+			_exit(0);
+		}
+		utils::ShmRing ring(1<<16);
+		utils::sendFd(mine, ring.fd());
+		int got=0;
+		while (auto j=ring.popJson()) {
+			CHECK(json::getLong(j.get(), "i")==got && json_array_size(json_object_get(j.get(), "list"))==3);
+			++got;
+		}
+		int status;
+		CHECK(::waitpid(pid, &status, 0)==pid && WIFEXITED(status) && WEXITSTATUS(status)==0);
+		CHECK(got==N && ring.isClosed() && !ring.push("late"));
+	}
+
+	{
+		// threads on both sides
+		utils::ShmRing ring(1<<14);
+		const int PRODUCERS=3, CONSUMERS=2, N=30000;
+		std::vector<std::thread> threads;
+		std::vector<uint64_t> sums(CONSUMERS, 0), counts(CONSUMERS, 0);
+		for (int c=0;c<CONSUMERS;++c) {
+			threads.emplace_back([&, c]() {
+				utils::ShmRing::Message m;
+				std::vector<int64_t> last(PRODUCERS, -1);
+				while (ring.pop(m)) {
+					uint64_t v;
+					memcpy(&v, m.data(), 8);
+					// each consumer sees every producer's messages in the order they were pushed
+					if ((int64_t)(v>>8)<=last[v & 0xff]) return;
+					last[v & 0xff]=v>>8;
+					sums[c]+=v>>8;
+					++counts[c];
+				}
+			});
+		}
+		std::vector<std::thread> producers;
+		for (int p=0;p<PRODUCERS;++p) {
+			producers.emplace_back([&, p]() {
+				for (uint64_t i=0;i<N;++i) {
+					uint64_t v=(i<<8) | p;
+					std::string s((const char*)&v, 8);
+					s.append(i%50, 'p');
+					ring.push(s);
+				}
+			});
+		}
+		for (auto& t : producers) t.join();
+		ring.close();
+		for (auto& t : threads) t.join();
+		uint64_t sum=0, count=0;
+		for (int c=0;c<CONSUMERS;++c) {
+			sum+=sums[c];
+			count+=counts[c];
+		}
+		CHECK(count==(uint64_t)PRODUCERS*N && sum==(uint64_t)PRODUCERS*N*(N-1)/2);
+	}
+
+	{
+		// a peer that writes a bad length gets an exception, not a write outside the ring
+		utils::ShmRing ring(4096);
+		CHECK(ring.tryPush(std::string("hello")));
+		char* m=(char*)mmap(nullptr, 4096+ring.capacity(), PROT_READ | PROT_WRITE, MAP_SHARED, ring.fd(), 0);
+		CHECK(m!=MAP_FAILED);
+		uint64_t length=uint64_t(1)<<40;
+		// the first record, after the one page header: state, kind, then the length
+		memcpy(m+4096+8, &length, sizeof(length));
+		utils::ShmRing::Message msg;
+		bool thrown=false;
+		try {
+			ring.tryPop(msg);
+		} catch (const std::exception& e) {
+			thrown=true;
+			std::cout<<"Correct ex: "<<e.what()<<std::endl;
+		}
+		CHECK(thrown && !msg);
+		munmap(m, 4096+ring.capacity());
+	}
+
+	bool exPassed=false;
+	try {
+		utils::FD fd(::memfd_create("unsealed", MFD_CLOEXEC));
+		CHECK(!ftruncate(fd, 1<<16));
+		utils::ShmRing ring(std::move(fd));
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+	return 0;
+}
@@ -0,0 +1,73 @@
+#include <iostream>
+#include <jsonwriter.h>
+#include "check.h"
+
+struct Item {
+	std::string name;
+	long long id;
+	double weight;
+	std::optional<std::string> note;
+};
+JSON_BINDING(Item, JSON_FIELD(Item, name), JSON_FIELD(Item, id), JSON_FIELD(Item, weight), json::field("x-\"note\"", &Item::note))
+
+struct Response {
+	bool ok;
+	unsigned status;
+	std::vector<Item> items;
+	std::map<std::string, long long> counters;
+	std::optional<int> missing;
+	std::vector<std::optional<int>> holes;
+	json::jsonptr extra;
+};
+JSON_BINDING(Response, JSON_FIELD(Response, ok), JSON_FIELD(Response, status), JSON_FIELD(Response, items),
+		JSON_FIELD(Response, counters), JSON_FIELD(Response, missing), JSON_FIELD(Response, holes), JSON_FIELD(Response, extra))
+
+int main() {
+	Response r;
+	r.ok=true;
+	r.status=200;
+	r.items.push_back(Item{"plain", 1, 1.0, std::nullopt});
+	r.items.push_back(Item{"esc \"q\" \\ \n\t\x01 \xd0\xbf", -2, 0.1, std::string("n")});
+	r.counters["a"]=1;
+	r.counters["b\""]=2;
+	r.holes={1, std::nullopt, 3};
+	r.extra=json::parse("{\"z\" : [1.5,2,\"s\"], \"e\" : {}}");
+
+	std::string buf;
+	json::write(r, buf);
+	std::cout<<"Compact: "<<buf<<std::endl;
+	auto parsed=json::parse(buf);
+
+	auto expected=json::parse("{\"ok\":true,\"status\":200,\"items\":["
+			"{\"name\":\"plain\",\"id\":1,\"weight\":1.0},"
+			"{\"name\":\"esc \\\"q\\\" \\\\ \\n\\t\\u0001 \xd0\xbf\",\"id\":-2,\"weight\":0.1,\"x-\\\"note\\\"\":\"n\"}],"
+			"\"counters\":{\"a\":1,\"b\\\"\":2},\"holes\":[1,null,3],\"extra\":{\"z\":[1.5,2,\"s\"],\"e\":{}}}");
+	CHECK(json_equal(parsed.get(), expected.get()));
+	CHECK(!json::hasChild(parsed, "missing"));
+	CHECK(json_is_real(json::getChild(json_array_get(json::getChild(parsed, "items"),0), "weight")));
+
+	std::string pbuf;
+	json::write(r, pbuf, true);
+	std::cout<<"Pretty: "<<pbuf<<std::endl;
+	CHECK(json_equal(json::parse(pbuf).get(), expected.get()));
+	std::string fromTree;
+	json::write(parsed, fromTree, true);
+	CHECK(fromTree==json::pretty(parsed));
+
+	buf.clear();
+	json::write(std::vector<int>{}, buf);
+	CHECK(buf=="[]");
+	buf.clear();
+	json::write(std::map<std::string,int>{}, buf, true);
+	CHECK(buf==json::pretty(json::parse("{}")));
+
+	bool exPassed=false;
+	try {
+		json::write(std::vector<double>{1.0/0.0});
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+	return 0;
+}
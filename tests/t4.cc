@@ -0,0 +1,76 @@
+#include <functional>
+#include <iostream>
+#include <jsoncursor.h>
+#include "check.h"
+
+static bool throws(const char* text) {
+	try {
+		json::Document doc(text, strlen(text));
+		std::function<void(const json::Cursor&)> walk=[&](const json::Cursor& c) {
+			c.type();
+			if (c.isString()) c.string();
+			for (auto e : c.elements()) walk(e);
+			for (auto kv : c.pairs()) walk(kv.second);
+		};
+		walk(doc.root());
+	} catch (const std::exception& e) {
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+		return true;
+	}
+	return false;
+}
+
+int main() {
+	std::string text="{\"user\" : {\"name\" : \"J\\u00e9r\\u00f4me \\\"\\\\\\\" \", \"id\" : 42, \"score\" : -1.5e2,"
+			" \"tags\" : [\"a\", \"b\\\\\", {\"deep\" : [[], {}]}], \"ok\" : true, \"none\" : null},"
+			" \"esc\\\"key\" : 7, \"list\" : [1, 2, 3, 4, 5]}";
+	// pad the document across several 64 byte blocks, including long runs of backslashes
+	text.insert(1, "\"pad\" : \"" + std::string(70, 'x') + "\\\\\\\\\\\\\\\\" + std::string(60, 'y') + "\\\"\", ");
+
+	json::Document doc(text);
+	auto root=doc.root();
+	auto tree=json::parse(text);
+
+	CHECK(json::getString(root, "user", "name")==json::getString(tree, "user", "name"));
+	CHECK(json::getString(root, "pad")==json::getString(tree, "pad"));
+	CHECK(json::getLong(root, "user", "id")==42);
+	CHECK(json::hasLong(root, "user", "id"));
+	CHECK(!json::hasLong(root, "user", "score"));
+	CHECK(json::getNumber(root, "user", "score")==-150.0);
+	CHECK(json::getBool(root, "user", "ok"));
+	CHECK(json::getChild(root, "user", "none").isNull());
+	CHECK(json::getLong(root, "esc\"key")==7);
+	CHECK(!json::hasChild(root, "user", "missing"));
+	CHECK(json::getLong(-1, root, "user", "missing")==-1);
+	CHECK(json::getString("fb", root, "user", "id")=="fb");
+	CHECK(json::getChild(root, "list").size()==5);
+	CHECK(json::getChild(root, "list").at(3).integer()==4);
+	CHECK(!json::getChild(root, "list").at(5));
+	CHECK(json::getChild(root, "user").size()==6);
+
+	long long sum=0;
+	for (auto e : json::getJsonArrayElements(root, "list")) sum+=e.integer();
+	CHECK(sum==15);
+
+	std::string keys;
+	for (auto kv : json::getJsonKeyValuePairs(root)) keys+=std::string(kv.first)+",";
+	CHECK(keys=="pad,user,esc\"key,list,");
+
+	auto tags=json::getChildPtr(root, "user", "tags");
+	CHECK(json_equal(tags.get(), json::getChild(tree, "user", "tags")));
+	CHECK(json_equal(root.materialize().get(), tree.get()));
+	CHECK(json::getChild(root, "user", "tags").at(2).find("deep").type()==JSON_ARRAY);
+
+	json::Document scalar(std::string(" \"just a string\" "));
+	CHECK(scalar.root().string()=="just a string");
+
+	CHECK(throws("{\"a\" : [1,2}"));
+	CHECK(throws("{\"a\" : \"unterminated}"));
+	CHECK(throws("[1,,2]"));
+	CHECK(throws("{\"a\" : }"));
+	CHECK(throws("[1] 2"));
+	CHECK(throws("[01]"));
+	CHECK(throws("[\"bad \\q escape\"]"));
+	CHECK(throws("   "));
+	return 0;
+}
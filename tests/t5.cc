@@ -0,0 +1,77 @@
+#include <iostream>
+#include <climits>
+#include <jsonbinary.h>
+#include "check.h"
+
+static std::string hex(const std::string& s) {
+	static const char* h="0123456789abcdef";
+	std::string r;
+	for (unsigned char c : s) {
+		r+=h[c>>4];
+		r+=h[c&0xf];
+	}
+	return r;
+}
+
+static bool throws(json::jsonptr (*decode)(const char*, size_t), const std::string& data) {
+	try {
+		decode(data.data(), data.size());
+	} catch (const std::exception& e) {
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+		return true;
+	}
+	return false;
+}
+
+int main() {
+	CHECK(hex(json::toCbor(json::parse("1")))=="01");
+	CHECK(hex(json::toCbor(json::parse("[1,-1,24,-500]")))=="84012018183901f3");
+	CHECK(hex(json::toCbor(json::parse("{\"a\" : true}")))=="a16161f5");
+	CHECK(hex(json::toCbor(json::parse("1.5")))=="fa3fc00000");
+	CHECK(hex(json::toCbor(json::parse("0.1")))=="fb3fb999999999999a");
+	CHECK(hex(json::toMsgPack(json::parse("{\"a\" : 1}")))=="81a16101");
+	CHECK(hex(json::toMsgPack(json::parse("[-1,-33,200,null,false]")))=="95ffd0dfccc8c0c2");
+
+	auto doc=json::own(json_pack("{s:[I,I,I,I,I,I,I,I,I,I,I], s:[f,f,f,f,f], s:s#, s:s, s:{}, s:[], s:{s:[{s:n}]}, s:b}",
+			"ints", (json_int_t)0, (json_int_t)23, (json_int_t)24, (json_int_t)255, (json_int_t)256, (json_int_t)65536,
+			(json_int_t)4294967296LL, (json_int_t)-1, (json_int_t)-4294967297LL, (json_int_t)LLONG_MAX, (json_int_t)LLONG_MIN,
+			"reals", 1.0, 0.1, -1e300, 3.4028234663852886e38, 1e-310,
+			"nul", "a\0b", (int)3,
+			"utf", "\xd0\xbf\xe2\x82\xac\xf0\x9f\x98\x80",
+			"empty", "none", "nested", "x", "y", "t", 1));
+	CHECK(doc);
+	std::string longString(70000, 'z');
+	json_object_set_new(doc.get(), "long", json_string(longString.c_str()));
+	json_t* big=json_array();
+	for (int i=0;i<70000;++i) json_array_append_new(big, json_integer(i));
+	json_object_set_new(doc.get(), "big", big);
+
+	std::string buf;
+	json::toCbor(doc, buf);
+	auto c=json::fromCbor(buf);
+	CHECK(json_equal(c.get(), doc.get()));
+	CHECK(json_is_real(json_array_get(json::getChild(c, "reals"), 0)));
+	CHECK(json_string_length(json::getChild(c, "nul"))==3);
+	buf.clear();
+	json::toMsgPack(doc, buf);
+	auto m=json::fromMsgPack(buf);
+	CHECK(json_equal(m.get(), doc.get()));
+	CHECK(json::to_string(m)==json::to_string(doc));
+
+	// indefinite length array, map and text string, and a tagged value
+	CHECK(json_equal(json::fromCbor(std::string("\x9f\x01\xbf\x61\x6b\x7f\x61\x61\x61\x62\xff\xff\xc1\x02\xff", 15)).get(),
+			json::parse("[1, {\"k\" : \"ab\"}, 2]").get()));
+	CHECK(json_real_value(json::fromCbor(std::string("\xf9\x3c\x00", 3)).get())==1.0);
+
+	CHECK(throws(json::fromCbor, std::string("\x82\x01", 2)));
+	CHECK(throws(json::fromCbor, std::string("\x01\x01", 2)));
+	CHECK(throws(json::fromCbor, std::string("\x41\x00", 2)));
+	CHECK(throws(json::fromCbor, std::string("\x1b\xff\xff\xff\xff\xff\xff\xff\xff", 9)));
+	CHECK(throws(json::fromCbor, std::string("\xa1\x01\x01", 3)));
+	CHECK(throws(json::fromCbor, std::string("\x62\xc3\x28", 3)));
+	CHECK(throws(json::fromCbor, std::string(5000, '\x81')));
+	CHECK(throws(json::fromMsgPack, std::string("\xc4\x01\x00", 3)));
+	CHECK(throws(json::fromMsgPack, std::string("\x92\x01", 2)));
+	CHECK(throws(json::fromMsgPack, std::string("\x81\x01\x01", 3)));
+	return 0;
+}
@@ -0,0 +1,116 @@
+#include <iostream>
+#include <jsonsnapshot.h>
+#include <utils.h>
+#include "check.h"
+
+int main() {
+	auto tree=json::parse("{\"name\" : \"reference\", \"version\" : 7, \"ratio\" : 0.25, \"on\" : true, \"off\" : false, \"none\" : null,"
+			" \"items\" : [{\"id\" : 1, \"name\" : \"one\"}, {\"id\" : 2, \"name\" : \"two\", \"extra\" : [1, 2.5, \"x\"]}, {}],"
+			" \"nested\" : {\"b\" : {\"c\" : \"deep\"}, \"a\" : []}, \"\" : \"empty key\"}");
+	json_object_set_new(tree.get(), "nul", json_stringn("a\0b", 3));
+
+	std::string buf;
+	json::compileSnapshot(tree, buf);
+	json::Snapshot mem(buf.data(), buf.size());
+	auto root=mem.root();
+	CHECK(root.isObject());
+	CHECK(std::string(json::getString(root, "name"))=="reference");
+	CHECK(json::getLong(root, "version")==7);
+	CHECK(json::getNumber(root, "ratio")==0.25);
+	CHECK(json::getBool(root, "on") && json::hasBool(root, "off") && !json::getBool(root, "off"));
+	CHECK(json::getChild(root, "none").isNull());
+	CHECK(std::string(json::getString(root, "nested", "b", "c"))=="deep");
+	CHECK(!json::hasChild(root, "nested", "missing"));
+	CHECK(json::getString(root, "version")==nullptr);
+	CHECK(std::string(json::getString("fb", root, "nope"))=="fb");
+	CHECK(json::getLong(-1, root, "nope")==-1);
+	CHECK(std::string(json::getString(root, ""))=="empty key");
+	CHECK(json::getChild(root, "nul").stringLength()==3);
+	CHECK(json::getChild(root, "items").size()==3);
+	CHECK(json::getLong(json::getChild(root, "items").at(1), "id")==2);
+	CHECK(!json::getChild(root, "items").at(3));
+
+	uint32_t nameId=mem.keyId("name");
+	CHECK(nameId!=json::SnapshotNode::npos);
+	CHECK(mem.keyId("not a key")==json::SnapshotNode::npos);
+	std::string names;
+	for (auto e : json::getJsonArrayElements(root, "items")) {
+		auto n=e.find(nameId);
+		if (n) names+=n.string();
+	}
+	CHECK(names=="onetwo");
+
+	std::string keys;
+	for (auto kv : json::getJsonKeyValuePairs(root, "nested")) keys+=kv.first;
+	CHECK(keys=="ab");
+	CHECK(json_equal(root.materialize().get(), tree.get()));
+	CHECK(json_equal(json::getChildPtr(root, "items").get(), json::getChild(tree, "items")));
+
+	char dir[]="/tmp/cpputils_t6_XXXXXX";
+	CHECK(mkdtemp(dir));
+	std::string file=std::string(dir)+"/ref.snap";
+	json::writeSnapshot(tree, file);
+	{
+		json::Snapshot snap(file);
+		CHECK(snap.size()==buf.size());
+		CHECK(json_equal(snap.root().materialize().get(), tree.get()));
+		// replacing the file does not disturb an existing mapping
+		json::writeSnapshot(json::parse("[1]"), file);
+		CHECK(std::string(json::getString(snap.root(), "name"))=="reference");
+		json::Snapshot snap2(file);
+		CHECK(snap2.root().at(0).integer()==1);
+	}
+
+	bool exPassed=false;
+	try {
+		std::string bad=buf;
+		bad[0]='X';
+		json::Snapshot s(bad.data(), bad.size());
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+	exPassed=false;
+	try {
+		std::string bad=buf;
+		json::snapshot::Header* h=(json::snapshot::Header*)&bad[0];
+		h->root.value=bad.size()+64;
+		json::Snapshot s(bad.data(), bad.size());
+		json::getString(s.root(), "name");
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+	exPassed=false;
+	try {
+		std::string bad=buf;
+		json::snapshot::Header* h=(json::snapshot::Header*)&bad[0];
+		// times the entry size this wraps around to 16 bytes
+		h->keyCount=(uint64_t(1)<<60)+1;
+		json::Snapshot s(bad.data(), bad.size());
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+	exPassed=false;
+	try {
+		std::string bad;
+		json::compileSnapshot(json::parse("[[0]]"), bad);
+		json::snapshot::Header* h=(json::snapshot::Header*)&bad[0];
+		// the inner array now points back at the outer one's elements
+		json::snapshot::Slot* inner=(json::snapshot::Slot*)&bad[h->root.value];
+		inner->value=h->root.value;
+		json::Snapshot s(bad.data(), bad.size());
+		s.root().materialize();
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+	unlink(file.c_str());
+	rmdir(dir);
+	return 0;
+}
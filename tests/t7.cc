@@ -0,0 +1,67 @@
+#include <iostream>
+#include <jsonindex.h>
+#include "check.h"
+
+static json::jsonptr users(size_t n) {
+	json_t* a=json_array();
+	for (size_t i=0;i<n;++i) {
+		json_array_append_new(a, json_pack("{s:s, s:I, s:{s:i}}", "id", ("u-"+std::to_string(i)).c_str(),
+				"n", (json_int_t)i, "address", "zip", (int)(i%100)));
+	}
+	return json::own(a);
+}
+
+int main() {
+	auto small=json::parse("[{\"id\" : \"a\", \"v\" : 1}, {\"id\" : \"b\", \"v\" : 1.0}, {\"v\" : null}, {\"id\" : \"a\", \"v\" : true},"
+			" {\"id\" : 5, \"v\" : \"x\"}, 7, {\"id\" : {}, \"v\" : -0.0}, {\"v\" : 0.0}]");
+	json::ArrayIndex idx(small, {{"id"}, {"v"}}, true);
+	CHECK(idx.valid() && idx.size()==8);
+	CHECK(idx.find(0, "a")==json_array_get(small.get(), 0));
+	CHECK(idx.findAll(0, "a").size()==2 && idx.findAll(0, "a")[1]==json_array_get(small.get(), 3));
+	CHECK(idx.find(0, 5)==json_array_get(small.get(), 4));
+	CHECK(!idx.find(0, "c") && !idx.find(0, 6));
+	CHECK(idx.find(1, 1)==json_array_get(small.get(), 0));
+	CHECK(idx.find(1, json::own(json_real(1)).get())==json_array_get(small.get(), 1));
+	CHECK(idx.find(1, json::own(json_null()).get())==json_array_get(small.get(), 2));
+	CHECK(idx.findAll(1, json::own(json_real(0)).get()).size()==2);
+	CHECK(!idx.find(1, json::own(json_object()).get()));
+	auto numbers=idx.range(1, json::own(json_real(-1)), json::own(json_integer(1)));
+	CHECK(numbers.size()==4);
+	CHECK(numbers[0]==json_array_get(small.get(), 6) && numbers[1]==json_array_get(small.get(), 7));
+	CHECK(idx.range(1, json::jsonptr(), json::own(json_true())).size()==2);
+	CHECK(idx.range(1, json::own(json_string("")), json::jsonptr()).size()==1);
+	try {
+		idx.find(2, "a");
+		return 1;
+	} catch (const std::runtime_error& e) {
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+
+	json_array_append_new(small.get(), json_pack("{s:s}", "id", "c"));
+	idx.invalidate();
+	try {
+		idx.find(0, "c");
+		return 1;
+	} catch (const std::runtime_error& e) {
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	idx.rebuild();
+	CHECK(idx.find(0, "c")==json_array_get(small.get(), 8));
+
+	size_t n=json::ArrayIndex::parallelThreshold*2+3;
+	auto big=users(n);
+	json::ArrayIndex serial(big, {{"id"}, {"address", "zip"}}, true, 1);
+	json::ArrayIndex parallel(big, {{"id"}, {"address", "zip"}}, true, 4);
+	for (size_t i=0;i<n;i+=997) {
+		std::string id="u-"+std::to_string(i);
+		CHECK(serial.find(0, id)==json_array_get(big.get(), i));
+		CHECK(parallel.find(0, id)==json_array_get(big.get(), i));
+	}
+	CHECK(parallel.find(1, 42)==json_array_get(big.get(), 42));
+	CHECK(parallel.findAll(1, 42).size()==serial.findAll(1, 42).size());
+	auto r=parallel.range(1, json::own(json_integer(10)), json::own(json_integer(11)));
+	CHECK(r==serial.range(1, json::own(json_integer(10)), json::own(json_integer(11))));
+	CHECK(r.size()==parallel.findAll(1, 10).size()+parallel.findAll(1, 11).size());
+	CHECK(r[0]==json_array_get(big.get(), 10));
+	return 0;
+}
@@ -0,0 +1,82 @@
+#include <iostream>
+#include <atomic>
+#include <stdio.h>
+#include <liveconfig.h>
+#include <utils.h>
+#include "check.h"
+
+static bool waitVersion(const json::LiveConfig& cfg, uint64_t version) {
+	for (int i=0;i<500 && cfg.version()<version;++i) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	return cfg.version()>=version;
+}
+
+int main() {
+	char dir[]="/tmp/cpputils_t8_XXXXXX";
+	CHECK(mkdtemp(dir));
+	std::string file=std::string(dir)+"/app.json", tmp=std::string(dir)+"/app.json.tmp";
+	utils::dumpToFile(file, "{\"generation\" : 1, \"port\" : 8080}");
+
+	bool exPassed=false;
+	try {
+		json::LiveConfig bad(std::string(dir)+"/missing.json");
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+
+	json::LiveConfig cfg(file, [](const json_t* j) {
+		if (!json::hasLong(j, "port")) throw std::runtime_error("port is required");
+	});
+	CHECK(cfg.version()==1);
+	{
+		json::LiveConfig::Guard g(cfg);
+		CHECK(json::getLong(g, "generation")==1);
+	}
+	auto pinned=cfg.get();
+
+	std::atomic<bool> stop(false);
+	std::atomic<long long> seen(0);
+	std::vector<std::thread> readers;
+	for (int t=0;t<3;++t) readers.emplace_back([&]() {
+		while (!stop.load()) {
+			json::LiveConfig::Guard g(cfg);
+			json::LiveConfig::Guard nested(cfg);
+			long long gen=json::getLong(g, "generation");
+			if (gen<1 || json::getLong(nested, "port")!=8080) seen=-1;
+			else if (seen>=0) seen=gen;
+		}
+	});
+
+	// in place writes and rename-over saves are both picked up
+	utils::dumpToFile(file, "{\"generation\" : 2, \"port\" : 8080}");
+	CHECK(waitVersion(cfg, 2));
+	for (int gen=3;gen<=20;++gen) {
+		utils::dumpToFile(tmp, "{\"generation\" : "+std::to_string(gen)+", \"port\" : 8080}");
+		CHECK(rename(tmp.c_str(), file.c_str())==0);
+		CHECK(waitVersion(cfg, gen));
+	}
+	stop=true;
+	for (auto& t : readers) t.join();
+	CHECK(seen>0);
+	CHECK(json::getLong(cfg.get(), "generation")==20);
+	CHECK(json::getLong(pinned, "generation")==1);
+
+	// a broken or rejected file leaves the current version in place
+	utils::dumpToFile(file, "{\"generation\" : 21");
+	CHECK(!cfg.reload());
+	std::cout<<"Correct error: "<<cfg.lastError()<<std::endl;
+	utils::dumpToFile(file, "{\"generation\" : 22}");
+	CHECK(!cfg.reload());
+	CHECK(cfg.lastError()=="port is required");
+	CHECK(json::getLong(cfg.get(), "generation")==20);
+	auto stats=cfg.stats();
+	CHECK(stats.failures>=2 && stats.reloads==20 && stats.maxReloadMicroseconds>=stats.lastReloadMicroseconds);
+
+	utils::dumpToFile(file, "{\"generation\" : 23, \"port\" : 8080}");
+	CHECK(waitVersion(cfg, 21));
+	CHECK(json::getLong(cfg.get(), "generation")==23);
+	unlink(file.c_str());
+	rmdir(dir);
+	return 0;
+}
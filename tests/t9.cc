@@ -0,0 +1,80 @@
+#include <iostream>
+#include <atomic>
+#include <set>
+#include <thread>
+#include <hash.h>
+#include <jsoncache.h>
+#include "check.h"
+
+int main() {
+	std::string bytes;
+	for (int i=0;i<300;++i) bytes+=(char)(i*31+7);
+	std::set<uint64_t> seen;
+	std::set<std::pair<uint64_t, uint64_t>> seen128;
+	for (size_t len=0;len<=bytes.size();++len) {
+		seen.insert(utils::hash64(bytes.data(), len));
+		auto h=utils::hash128(bytes.data(), len);
+		seen128.insert(std::make_pair(h.lo, h.hi));
+		CHECK(h.lo!=h.hi);
+	}
+	CHECK(seen.size()==bytes.size()+1 && seen128.size()==bytes.size()+1);
+	CHECK(utils::hash64(bytes)==utils::hash64(std::string(bytes)));
+	CHECK(utils::hash64(bytes, 1)!=utils::hash64(bytes, 2));
+	std::string flipped=bytes;
+	flipped[150]^=1;
+	CHECK(utils::hash64(bytes)!=utils::hash64(flipped));
+	CHECK(utils::hash128(bytes)!=utils::hash128(flipped));
+
+	json::ParseCache cache(1<<20, 4);
+	std::string doc="{\"a\" : [1, 2, 3], \"b\" : \"text\"}";
+	auto first=cache.parse(doc);
+	auto second=cache.parse(std::string(doc));
+	CHECK(first.get()==second.get());
+	CHECK(json_equal(first.get(), json::parse(doc).get()));
+	CHECK(cache.parse("{\"a\" : [1, 2, 3], \"b\" : \"text\"} ").get()!=first.get());
+	auto st=cache.stats();
+	CHECK(st.hits==1 && st.misses==2 && st.entries==2 && st.bytes>0);
+	CHECK(st.hitRate()>0.3 && st.hitRate()<0.4);
+
+	bool exPassed=false;
+	try {
+		cache.parse("{bad");
+	} catch (const std::exception& e) {
+		exPassed=true;
+		std::cout<<"Correct ex: "<<e.what()<<std::endl;
+	}
+	CHECK(exPassed);
+	// null input behaves as it does with json::parse
+	CHECK(!cache.parse((const char*)nullptr));
+	CHECK(!cache.parse(nullptr, 0));
+	CHECK(!cache.parse(std::string()));
+	CHECK(cache.stats().entries==2);
+
+	// a small budget keeps only the most recently used entries
+	json::ParseCache small(4096, 1);
+	for (int i=0;i<100;++i) small.parse("{\"n\" : "+std::to_string(i)+"}");
+	st=small.stats();
+	CHECK(st.evictions>0 && st.entries+st.evictions==100 && st.bytes<=4096);
+	auto hot=small.parse("{\"n\" : 99}");
+	CHECK(small.stats().hits==1);
+	std::string huge="[";
+	for (int i=0;i<1000;++i) huge+=std::to_string(i)+",";
+	huge+="0]";
+	CHECK(json_array_size(small.parse(huge).get())==1001);
+	CHECK(small.stats().entries==st.entries);
+	small.clear();
+	CHECK(small.stats().entries==0 && small.stats().bytes==0);
+
+	std::vector<std::thread> threads;
+	std::atomic<int> bad(0);
+	for (int t=0;t<4;++t) threads.emplace_back([&]() {
+		for (int i=0;i<2000;++i) {
+			auto j=cache.parse("{\"k\" : "+std::to_string(i%50)+"}");
+			if (json::getLong(j, "k")!=i%50) ++bad;
+		}
+	});
+	for (auto& t : threads) t.join();
+	CHECK(bad==0);
+	CHECK(cache.stats().hits>=7800);
+	return 0;
+}